@@ -8,6 +8,7 @@
 #include "base/strings/utf_string_conversions.h"
 #include "content/public/browser/browser_thread.h"
 #include "xwalk/jsapi/dialog.h"
+#include "xwalk/jsapi/dialog_function_ids.h"
 
 using content::BrowserThread;
 
@@ -24,6 +25,7 @@ DialogExtension::DialogExtension(RuntimeRegistry* runtime_registry)
     runtime_registry_(runtime_registry),
     owning_window_(NULL) {
   set_name("xwalk.experimental.dialog");
+  SetJavaScriptAPI(kFunctionIdsJavaScript, kSource_dialog_api);
   runtime_registry_->AddObserver(this);
 }
 
@@ -31,10 +33,6 @@ DialogExtension::~DialogExtension() {
   runtime_registry_->RemoveObserver(this);
 }
 
-const char* DialogExtension::GetJavaScriptAPI() {
-  return kSource_dialog_api;
-}
-
 XWalkExtensionInstance* DialogExtension::CreateInstance() {
   return new DialogInstance(this);
 }
@@ -50,27 +48,27 @@ void DialogExtension::OnRuntimeAdded(Runtime* runtime) {
 DialogInstance::DialogInstance(DialogExtension* extension)
   : extension_(extension),
     dialog_(NULL) {
-  RegisterFunction("showOpenDialog", &DialogInstance::OnShowOpenDialog);
-  RegisterFunction("showSaveDialog", &DialogInstance::OnShowSaveDialog);
+  RegisterFunction(kShowOpenDialog, &DialogInstance::OnShowOpenDialog);
+  RegisterFunction(kShowSaveDialog, &DialogInstance::OnShowSaveDialog);
 }
 
 DialogInstance::~DialogInstance() {
 }
 
-void DialogInstance::HandleMessage(scoped_ptr<base::Value> msg) {
+void DialogInstance::HandleSerializedMessage(const std::string& data) {
   if (!BrowserThread::CurrentlyOn(BrowserThread::UI)) {
     BrowserThread::PostTask(
       BrowserThread::UI, FROM_HERE,
-      base::Bind(&XWalkInternalExtensionInstance::HandleMessage,
-          base::Unretained(this), base::Passed(&msg)));
+      base::Bind(&XWalkInternalExtensionInstance::HandleSerializedMessage,
+          base::Unretained(this), data));
     return;
   }
 
-  XWalkInternalExtensionInstance::HandleMessage(msg.Pass());
+  XWalkInternalExtensionInstance::HandleSerializedMessage(data);
 }
 
-void DialogInstance::OnShowOpenDialog(const std::string& function_name,
-                                     const std::string& callback_id,
+void DialogInstance::OnShowOpenDialog(int function_id,
+                                     int callback_id,
                                      base::ListValue* args) {
   CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
 
@@ -78,7 +76,8 @@ void DialogInstance::OnShowOpenDialog(const std::string& function_name,
       params(ShowOpenDialog::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -94,8 +93,7 @@ void DialogInstance::OnShowOpenDialog(const std::string& function_name,
   // FIXME(jeez): implement file_type and file_extension support.
   base::FilePath::StringType file_extension;
 
-  std::pair<std::string, std::string>* data =
-      new std::pair<std::string, std::string>(function_name, callback_id);
+  std::pair<int, int>* data = new std::pair<int, int>(function_id, callback_id);
 
   if (!dialog_)
     dialog_ = ui::SelectFileDialog::Create(this, 0 /* policy */);
@@ -106,8 +104,8 @@ void DialogInstance::OnShowOpenDialog(const std::string& function_name,
                       extension_->owning_window_, data);
 }
 
-void DialogInstance::OnShowSaveDialog(const std::string& function_name,
-                                     const std::string& callback_id,
+void DialogInstance::OnShowSaveDialog(int function_id,
+                                     int callback_id,
                                      base::ListValue* args) {
   CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
 
@@ -115,7 +113,8 @@ void DialogInstance::OnShowSaveDialog(const std::string& function_name,
       params(ShowSaveDialog::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -128,8 +127,7 @@ void DialogInstance::OnShowSaveDialog(const std::string& function_name,
   if (!dialog_)
     dialog_ = ui::SelectFileDialog::Create(this, 0 /* policy */);
 
-  std::pair<std::string, std::string>* data =
-      new std::pair<std::string, std::string>(function_name, callback_id);
+  std::pair<int, int>* data = new std::pair<int, int>(function_id, callback_id);
 
   base::FilePath filePath =
       base::FilePath::FromUTF8Unsafe(params->initial_path);
@@ -143,11 +141,11 @@ void DialogInstance::OnShowSaveDialog(const std::string& function_name,
 
 void DialogInstance::FileSelected(const base::FilePath& path, int,
                                  void* params) {
-  scoped_ptr<std::pair<std::string, std::string> >
-      data(static_cast<std::pair<std::string, std::string>*>(params));
+  scoped_ptr<std::pair<int, int> >
+      data(static_cast<std::pair<int, int>*>(params));
 
   std::string strPath = path.AsUTF8Unsafe();
-  if (data->first == "showOpenDialog") {
+  if (data->first == kShowOpenDialog) {
     std::vector<std::string> filesList;
     filesList.push_back(strPath);
     PostResult(data->second,
@@ -160,8 +158,8 @@ void DialogInstance::FileSelected(const base::FilePath& path, int,
 
 void DialogInstance::MultiFilesSelected(
     const std::vector<base::FilePath>& files, void* params) {
-  scoped_ptr<std::pair<std::string, std::string> >
-      data(static_cast<std::pair<std::string, std::string>*>(params));
+  scoped_ptr<std::pair<int, int> >
+      data(static_cast<std::pair<int, int>*>(params));
 
   std::vector<std::string> filesList;
   std::vector<base::FilePath>::const_iterator it;
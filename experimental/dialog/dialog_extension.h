@@ -31,7 +31,6 @@ class DialogExtension : public XWalkInternalExtension,
   virtual ~DialogExtension();
 
   // XWalkExtension implementation.
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
   virtual XWalkExtensionInstance* CreateInstance() OVERRIDE;
 
   // RuntimeRegistryObserver implementation.
@@ -53,7 +52,7 @@ class DialogInstance : public XWalkInternalExtensionInstance,
   explicit DialogInstance(DialogExtension* extension);
   virtual ~DialogInstance();
 
-  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleSerializedMessage(const std::string& data) OVERRIDE;
 
   // ui::SelectFileDialog::Listener implementation.
   virtual void FileSelected(const base::FilePath& path,
@@ -62,10 +61,10 @@ class DialogInstance : public XWalkInternalExtensionInstance,
     const std::vector<base::FilePath>& files, void* params) OVERRIDE;
 
  private:
-  void OnShowOpenDialog(const std::string& function_name,
-                        const std::string& callback_id, base::ListValue* args);
-  void OnShowSaveDialog(const std::string& function_name,
-                        const std::string& callback_id, base::ListValue* args);
+  void OnShowOpenDialog(int function_id,
+                        int callback_id, base::ListValue* args);
+  void OnShowSaveDialog(int function_id,
+                        int callback_id, base::ListValue* args);
 
   DialogExtension* extension_;
   scoped_refptr<SelectFileDialog> dialog_;
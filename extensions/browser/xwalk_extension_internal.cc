@@ -5,86 +5,112 @@
 #include "xwalk/extensions/browser/xwalk_extension_internal.h"
 
 #include "base/logging.h"
-#include "base/strings/string_number_conversions.h"
-#include "base/strings/string_split.h"
+#include "base/values.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
 
 namespace xwalk {
 namespace extensions {
 
+const char* XWalkInternalExtension::GetJavaScriptAPI() {
+  return javascript_api_.c_str();
+}
+
 XWalkExtensionInstance* XWalkInternalExtension::CreateInstance() {
   return new XWalkInternalExtensionInstance();
 }
 
+void XWalkInternalExtension::SetJavaScriptAPI(const char* function_ids,
+                                              const char* api) {
+  javascript_api_ = std::string(function_ids) + api;
+}
+
+const int XWalkInternalExtensionInstance::kNoCallback;
+
 XWalkInternalExtensionInstance::XWalkInternalExtensionInstance() {
 }
 
 XWalkInternalExtensionInstance::~XWalkInternalExtensionInstance() {
 }
 
-XWalkInternalExtensionInstance::FunctionHandler*
-    XWalkInternalExtensionInstance::GetHandlerForFunction(
-    const std::string& function) {
-  FunctionHandlerMap::iterator iter = handlers_.find(function);
-  if (iter == handlers_.end())
-    return NULL;
+void XWalkInternalExtensionInstance::HandleSerializedMessage(
+    const std::string& data) {
+  XWalkExtensionWireReader reader(data);
 
-  return &iter->second;
-}
-
-void XWalkInternalExtensionInstance::HandleMessage(
-    scoped_ptr<base::Value> msg) {
-  base::ListValue* args;
-  if (!msg->GetAsList(&args) || args->GetSize() < 2) {
+  // The message is a tuple of the function ID, the callback id and the list
+  // of function arguments.
+  int32_t function_id;
+  int32_t callback_id;
+  if (!reader.EnterArray() || !reader.ReadInteger(&function_id) ||
+      !reader.ReadInteger(&callback_id)) {
     // FIXME(tmpsantos): This warning could be better if the Context had a
     // pointer to the Extension. We could tell what extension sent the
     // invalid message.
-    LOG(WARNING) << "Invalid number of arguments.";
+    LOG(WARNING) << "Invalid function ID or callback id.";
     return;
   }
 
-  // The first parameter stands for the function signature.
-  std::string function_name;
-  if (!args->GetString(0, &function_name)) {
-    LOG(WARNING) << "The function name is not a string.";
+  if (function_id < 0 ||
+      static_cast<size_t>(function_id) >= handlers_.size() ||
+      handlers_[function_id].is_null()) {
+    DLOG(WARNING) << "Function not registered: " << function_id;
     return;
   }
 
-  // The second parameter stands for callback id, the remaining
-  // ones are the function arguments.
-  std::string callback_id;
-  if (!args->GetString(1, &callback_id)) {
-    LOG(WARNING) << "The callback id is not a string.";
+  scoped_ptr<base::Value> value(ReadWireFormatValue(&reader));
+  base::ListValue* args;
+  if (!value || !value->GetAsList(&args) || !reader.ReadEnd()) {
+    LOG(WARNING) << "Malformed arguments for function " << function_id;
     return;
   }
 
-  FunctionHandler* handler = GetHandlerForFunction(function_name);
-  if (!handler) {
-    DLOG(WARNING) << "Function not registered: " << function_name;
-    return;
-  }
+  handlers_[function_id].Run(function_id, callback_id, args);
+}
 
-  // We reuse args to pass the extra arguments to the handler, so remove
-  // function_name and callback_id from it.
-  args->Remove(0, NULL);
-  args->Remove(0, NULL);
-  handler->Run(function_name, callback_id, args);
+void XWalkInternalExtensionInstance::HandleMessage(
+    scoped_ptr<base::Value> msg) {
+  // Only reached if the message was already converted, serialize it back to
+  // share the dispatch code.
+  std::string data;
+  ValueToWireFormat(*msg, &data);
+  HandleSerializedMessage(data);
 }
 
 void XWalkInternalExtensionInstance::PostResult(
-    const std::string& callback_id, scoped_ptr<base::ListValue> result) {
+    int callback_id, scoped_ptr<base::ListValue> result) {
   DCHECK(result);
 
-  if (callback_id.empty()) {
-    DLOG(WARNING) << "Sending a reply with an empty callback id has no"
+  if (callback_id == kNoCallback) {
+    DLOG(WARNING) << "Sending a reply without a callback id has no"
         "practical effect. This code can be optimized by not creating "
         "and not posting the result.";
     return;
   }
 
-  // Prepend the callback id to the list, so the handlers
-  // on the JavaScript side know which callback should be evoked.
-  result->Insert(0, new base::StringValue(callback_id));
-  PostMessageToJS(scoped_ptr<base::Value>(result.release()));
+  // The reply is the tuple [callback_id, [results...]], so the handlers on
+  // the JavaScript side know which callback should be evoked.
+  std::string data;
+  XWalkExtensionWireWriter writer(&data);
+  writer.BeginArray();
+  writer.WriteInteger(callback_id);
+  ValueToWireFormat(*result, &data);
+  writer.EndContainer();
+  PostSerializedMessageToJS(&data);
+}
+
+void XWalkInternalExtensionInstance::PostError(int callback_id,
+                                               const std::string& message) {
+  if (callback_id == kNoCallback)
+    return;
+
+  // Failures are the tuple [callback_id, null, error_message].
+  std::string data;
+  XWalkExtensionWireWriter writer(&data);
+  writer.BeginArray();
+  writer.WriteInteger(callback_id);
+  writer.WriteNull();
+  writer.WriteString(message.data(), message.size());
+  writer.EndContainer();
+  PostSerializedMessageToJS(&data);
 }
 
 }  // namespace extensions
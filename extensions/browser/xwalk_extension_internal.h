@@ -5,9 +5,10 @@
 #ifndef XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_INTERNAL_H_
 #define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_INTERNAL_H_
 
-#include <map>
 #include <string>
+#include <vector>
 #include "base/bind.h"
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 
@@ -22,9 +23,24 @@ class XWalkInternalExtension : public XWalkExtension {
  public:
   XWalkInternalExtension() {}
 
+  virtual const char* GetJavaScriptAPI() OVERRIDE;
   virtual XWalkExtensionInstance* CreateInstance() OVERRIDE;
 
+ protected:
+  // Sets the JavaScript API to |api|, preceded by the |function_ids| generated
+  // from the IDL describing it, usually from the constructor:
+  //
+  //   SetJavaScriptAPI(jsapi::foo::kFunctionIdsJavaScript, kSource_foo_api);
+  //
+  // The API can then call the function handlers by their ID, see
+  // XWalkInternalExtensionInstance::RegisterFunction():
+  //
+  //   internal.postMessage(FunctionId.showBar, [arg1, arg2], callback);
+  void SetJavaScriptAPI(const char* function_ids, const char* api);
+
  private:
+  std::string javascript_api_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkInternalExtension);
 };
 
@@ -38,34 +54,45 @@ class XWalkInternalExtensionInstance : public XWalkExtensionInstance {
   XWalkInternalExtensionInstance();
   virtual ~XWalkInternalExtensionInstance();
 
+  // Used as |callback_id| when the JavaScript caller didn't pass a callback.
+  static const int kNoCallback = -1;
+
+  // Messages are the list [function_id, callback_id, [args...]]. They are
+  // dispatched straight from the wire format, only the arguments are
+  // converted to base::Value.
+  virtual void HandleSerializedMessage(const std::string& data) OVERRIDE;
   virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE;
 
  protected:
   // This method will register a function to handle a message tagged as
-  // |function_name|. When invoked, the handler will get as first parameter
-  // the |function_name| (which can be used in case a handler is in charge of
-  // more than one function). The |callback_id| is a unique identifier that
-  // should be returned on the PostResult() in case the function triggers a
-  // callback (empty string otherwise). Finally, |args| contains the list of
-  // parameters ready to be used as input for Params::Create() generated from
-  // the IDL description of the API.
+  // |function_id|, the ID generated for the function from the IDL description
+  // of the API (see xwalk_function_ids.gypi). When invoked, the handler will
+  // get as first parameter the |function_id| (which can be used in case a
+  // handler is in charge of more than one function, its name is in
+  // kFunctionNames). The |callback_id| is a small integer that should be
+  // returned on the PostResult() in case the function triggers a callback
+  // (kNoCallback otherwise). Finally, |args| contains the list of parameters
+  // ready to be used as input for Params::Create() generated from the IDL
+  // description of the API.
   //
   // The signature of a function handler shall like the following:
   //
-  //   void FooContext::OnShowBar(const std::string& function_name,
-  //                              const std::string& callback_id,
+  //   void FooContext::OnShowBar(int function_id, int callback_id,
   //                              base::ListValue* args)
   //
   // And register them like this, preferable at the FooContext constructor:
   //
-  //   RegisterFunction("showBar", &FooContext::OnShowBar);
-  //   RegisterFunction("getStuff", &FooContext::OnGetStuff);
+  //   RegisterFunction(jsapi::foo::kShowBar, &FooContext::OnShowBar);
+  //   RegisterFunction(jsapi::foo::kGetStuff, &FooContext::OnGetStuff);
   //   ...
   template <class T>
-  void RegisterFunction(const std::string& function_name,
-      void (T::*handler)(const std::string& function_name,
-      const std::string& callback_id, base::ListValue* args)) {
-    handlers_[function_name] = base::Bind(handler,
+  void RegisterFunction(int function_id,
+      void (T::*handler)(int function_id, int callback_id,
+      base::ListValue* args)) {
+    DCHECK_GE(function_id, 0);
+    if (static_cast<size_t>(function_id) >= handlers_.size())
+      handlers_.resize(function_id + 1);
+    handlers_[function_id] = base::Bind(handler,
         base::Unretained(static_cast<T*>(this)));
   }
 
@@ -73,22 +100,23 @@ class XWalkInternalExtensionInstance : public XWalkExtensionInstance {
   // |callback_id| must be the same as the one got on the function handler.
   // The |result| should be created using the output from Results::Create(),
   // function generated from the IDL describing the JavaScript API. It is a
-  // valid optimization not post a result in case the |callback_id| is an
-  // empty string, because it won't have any practical effect other than noise
+  // valid optimization not post a result in case the |callback_id| is
+  // kNoCallback, because it won't have any practical effect other than noise
   // at the IPC channel. This can be the case when the user of the JavaScript
   // API omits the callback. If the JavaScript function doesn't take a
   // callback at all, you won't need to call this method.
-  void PostResult(const std::string& callback_id,
-                  scoped_ptr<base::ListValue> result);
+  void PostResult(int callback_id, scoped_ptr<base::ListValue> result);
 
- private:
-  typedef base::Callback<void(const std::string&, const std::string&,
-                              base::ListValue*)> FunctionHandler;
-  typedef std::map<std::string, FunctionHandler> FunctionHandlerMap;
+  // Reports that the function failed instead of posting its result. The
+  // Promise returned by postMessageWithPromise() is rejected with an Error
+  // carrying |message|, a callback passed to postMessage() is not called.
+  void PostError(int callback_id, const std::string& message);
 
-  FunctionHandler* GetHandlerForFunction(const std::string& function);
+ private:
+  typedef base::Callback<void(int, int, base::ListValue*)> FunctionHandler;
 
-  FunctionHandlerMap handlers_;
+  // Indexed by function ID, IDs without a handler hold a null callback.
+  std::vector<FunctionHandler> handlers_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkInternalExtensionInstance);
 };
@@ -44,10 +44,26 @@ class ExtensionSandboxedProcessLauncherDelegate
 };
 #endif
 
+namespace {
+
+void SendChannelHandleToRenderProcess(int render_process_id,
+                                      const IPC::ChannelHandle& handle) {
+  CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
+  content::RenderProcessHost* host =
+      content::RenderProcessHost::FromID(render_process_id);
+  if (host)
+    host->Send(new XWalkViewMsg_ExtensionProcessChannelCreated(handle));
+}
+
+}  // namespace
+
 XWalkExtensionProcessHost::XWalkExtensionProcessHost()
-    : ep_rp_channel_handle_(""),
-      render_process_host_(0),
-      is_extension_process_channel_ready_(false) {
+    : warm_spare_(CommandLine::ForCurrentProcess()->HasSwitch(
+          switches::kXWalkExtensionProcessWarmSpare)),
+      extensions_registered_(false),
+      spare_channel_requested_(false),
+      spare_channel_requests_(0),
+      spare_channel_assignments_(0) {
   BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
       base::Bind(&XWalkExtensionProcessHost::StartProcess,
       base::Unretained(this)));
@@ -77,6 +93,12 @@ void XWalkExtensionProcessHost::StartProcess() {
   cmd_line->AppendSwitchASCII(switches::kProcessType,
                               switches::kXWalkExtensionProcess);
   cmd_line->AppendSwitchASCII(switches::kProcessChannelID, channel_id);
+
+  static const char* const kSwitchNames[] = {
+    switches::kXWalkExtensionSharedTransport,
+  };
+  cmd_line->CopySwitchesFrom(*CommandLine::ForCurrentProcess(), kSwitchNames,
+                             arraysize(kSwitchNames));
   process_->Launch(
 #if defined(OS_WIN)
       new ExtensionSandboxedProcessLauncherDelegate(),
@@ -94,16 +116,76 @@ void XWalkExtensionProcessHost::StopProcess() {
 }
 
 void XWalkExtensionProcessHost::RegisterExternalExtensions(
-    const base::FilePath& extension_path) {
-  Send(new XWalkExtensionProcessMsg_RegisterExtensions(extension_path));
+    const std::vector<base::FilePath>& libraries) {
+  if (!BrowserThread::CurrentlyOn(BrowserThread::IO)) {
+    BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+        base::Bind(&XWalkExtensionProcessHost::RegisterExternalExtensions,
+        base::Unretained(this), libraries));
+    return;
+  }
+
+  Send(new XWalkExtensionProcessMsg_RegisterExtensions(libraries));
+  // Channels get the extensions registered when they are created, so the
+  // spare must come after them.
+  extensions_registered_ = true;
+  RequestSpareChannel();
 }
 
 void XWalkExtensionProcessHost::OnRenderProcessHostCreated(
     content::RenderProcessHost* render_process_host) {
-  render_process_host_ = render_process_host;
-  CHECK(render_process_host_);
+  CHECK(render_process_host);
+  BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+      base::Bind(&XWalkExtensionProcessHost::CreateRenderProcessChannel,
+      base::Unretained(this), render_process_host->GetID()));
+}
+
+void XWalkExtensionProcessHost::OnRenderProcessHostClosed(
+    content::RenderProcessHost* render_process_host) {
+  CHECK(render_process_host);
+  BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+      base::Bind(&XWalkExtensionProcessHost::CloseRenderProcessChannel,
+      base::Unretained(this), render_process_host->GetID()));
+}
+
+void XWalkExtensionProcessHost::CreateRenderProcessChannel(
+    int render_process_id) {
+  CHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+  if (!render_process_ids_.insert(render_process_id).second)
+    return;
+
+  if (spare_channel_) {
+    Send(new XWalkExtensionProcessMsg_AssignSpareRenderProcessChannel(
+        render_process_id));
+    BrowserThread::PostTask(BrowserThread::UI, FROM_HERE,
+        base::Bind(&SendChannelHandleToRenderProcess, render_process_id,
+                   *spare_channel_));
+    spare_channel_.reset();
+    spare_channel_assignments_++;
+    RequestSpareChannel();
+    return;
+  }
+
+  Send(new XWalkExtensionProcessMsg_CreateRenderProcessChannel(
+      render_process_id));
+}
+
+void XWalkExtensionProcessHost::RequestSpareChannel() {
+  CHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+  if (!warm_spare_ || !extensions_registered_ || spare_channel_ ||
+      spare_channel_requested_)
+    return;
+  spare_channel_requested_ = true;
+  spare_channel_requests_++;
+  Send(new XWalkExtensionProcessMsg_CreateSpareRenderProcessChannel);
+}
 
-  SendChannelHandleToRenderProcess();
+void XWalkExtensionProcessHost::CloseRenderProcessChannel(
+    int render_process_id) {
+  CHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+  if (!render_process_ids_.erase(render_process_id))
+    return;
+  Send(new XWalkExtensionProcessMsg_CloseRenderProcessChannel(
+      render_process_id));
 }
 
 void XWalkExtensionProcessHost::Send(IPC::Message* msg) {
@@ -123,6 +205,9 @@ bool XWalkExtensionProcessHost::OnMessageReceived(const IPC::Message& message) {
     IPC_MESSAGE_HANDLER(
         XWalkExtensionProcessHostMsg_RenderProcessChannelCreated,
         OnRenderChannelCreated)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionProcessHostMsg_SpareRenderProcessChannelCreated,
+        OnSpareChannelCreated)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
   return handled;
@@ -137,26 +222,24 @@ void XWalkExtensionProcessHost::OnProcessLaunched() {
 }
 
 void XWalkExtensionProcessHost::OnRenderChannelCreated(
-    const IPC::ChannelHandle& handle) {
-  ep_rp_channel_handle_ = handle;
-  is_extension_process_channel_ready_ = true;
-
-  SendChannelHandleToRenderProcess();
-}
-
-void XWalkExtensionProcessHost::SendChannelHandleToRenderProcess() {
-  // It can be that the EP channel got created before the RenderProcessHost.
-  if (!render_process_host_)
+    int render_process_id, const IPC::ChannelHandle& handle) {
+  // The render process could be gone while the channel was being created, in
+  // that case the extension process was already asked to close it.
+  if (render_process_ids_.find(render_process_id) ==
+      render_process_ids_.end())
     return;
 
-  // It can be that the RenderProcessHost got created before the EP channel.
-  if (!is_extension_process_channel_ready_)
-    return;
-
-  render_process_host_->Send(new XWalkViewMsg_ExtensionProcessChannelCreated(
-      ep_rp_channel_handle_));
+  // RenderProcessHosts must be used in the UI thread.
+  BrowserThread::PostTask(BrowserThread::UI, FROM_HERE,
+      base::Bind(&SendChannelHandleToRenderProcess, render_process_id,
+                 handle));
 }
 
+void XWalkExtensionProcessHost::OnSpareChannelCreated(
+    const IPC::ChannelHandle& handle) {
+  spare_channel_requested_ = false;
+  spare_channel_.reset(new IPC::ChannelHandle(handle));
+}
 
 }  // namespace extensions
 }  // namespace xwalk
@@ -5,6 +5,9 @@
 #ifndef XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_PROCESS_HOST_H_
 #define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_PROCESS_HOST_H_
 
+#include <set>
+#include <vector>
+
 #include "base/memory/scoped_ptr.h"
 #include "content/public/browser/browser_child_process_host_delegate.h"
 #include "ipc/ipc_channel_handle.h"
@@ -27,16 +30,30 @@ namespace extensions {
 
 // This class represents the browser side of the browser <-> extension process
 // communication channel. It has to run some operations in IO thread for
-// creating the extra process.
+// creating the extra process. The extension process creates one channel for
+// each render process, which is passed by the browser to the renderer.
 class XWalkExtensionProcessHost
     : public content::BrowserChildProcessHostDelegate {
  public:
   XWalkExtensionProcessHost();
   virtual ~XWalkExtensionProcessHost();
 
-  void RegisterExternalExtensions(const base::FilePath& extension_path);
+  // Loads the external extensions found in |libraries| in this process.
+  void RegisterExternalExtensions(const std::vector<base::FilePath>& libraries);
 
   void OnRenderProcessHostCreated(content::RenderProcessHost* host);
+  void OnRenderProcessHostClosed(content::RenderProcessHost* host);
+
+  // Spare channel bookkeeping, only to be called in the IO thread.
+  bool HasSpareChannelForTesting() const {
+    return spare_channel_.get() != NULL;
+  }
+  int GetSpareChannelsRequestedForTesting() const {
+    return spare_channel_requests_;
+  }
+  int GetSpareChannelsAssignedForTesting() const {
+    return spare_channel_assignments_;
+  }
 
  private:
   void StartProcess();
@@ -50,16 +67,35 @@ class XWalkExtensionProcessHost
   virtual void OnProcessCrashed(int exit_code) OVERRIDE;
   virtual void OnProcessLaunched() OVERRIDE;
 
-  // Message Handlers.
-  void OnRenderChannelCreated(const IPC::ChannelHandle& channel_id);
+  void CreateRenderProcessChannel(int render_process_id);
+  void CloseRenderProcessChannel(int render_process_id);
 
-  void SendChannelHandleToRenderProcess();
+  // Asks for a spare channel if the warm spare mode is on and there is none.
+  void RequestSpareChannel();
+
+  // Message Handlers.
+  void OnRenderChannelCreated(int render_process_id,
+                              const IPC::ChannelHandle& channel_id);
+  void OnSpareChannelCreated(const IPC::ChannelHandle& channel_id);
 
   scoped_ptr<content::BrowserChildProcessHost> process_;
-  IPC::ChannelHandle ep_rp_channel_handle_;
-  content::RenderProcessHost* render_process_host_;
 
-  bool is_extension_process_channel_ready_;
+  // Render processes that asked for a channel and weren't closed yet, only
+  // accessed in the IO thread.
+  std::set<int> render_process_ids_;
+
+  // With --extension-process-warm-spare, the extension process keeps a
+  // channel ready for the next render process, so it gets the channel
+  // without a round trip to the extension process. A new spare is asked for
+  // each time one is used. Only accessed in the IO thread.
+  bool warm_spare_;
+  bool extensions_registered_;
+  bool spare_channel_requested_;
+  scoped_ptr<IPC::ChannelHandle> spare_channel_;
+  int spare_channel_requests_;
+  int spare_channel_assignments_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionProcessHost);
 };
 
 }  // namespace extensions
@@ -4,9 +4,14 @@
 
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 
+#include "base/bind.h"
 #include "base/callback.h"
 #include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/json/json_reader.h"
 #include "base/scoped_native_library.h"
+#include "base/stl_util.h"
 #include "base/synchronization/lock.h"
 #include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_types.h"
@@ -29,26 +34,112 @@ namespace {
 XWalkExtensionService::RegisterExtensionsCallback
 g_register_extensions_callback;
 
+const char kProcessPerExtensionModel[] = "process-per-extension";
+const char kGroupsModel[] = "groups";
+const char kSingleProcessModel[] = "single";
+
+typedef std::vector<base::FilePath> LibraryGroup;
+
+// Reads the file passed with --extension-process-groups, mapping each library
+// file name listed there to the index of its group. Returns the number of
+// groups, or zero if the file couldn't be used.
+size_t ReadExtensionProcessGroups(
+    const base::FilePath& path,
+    std::map<base::FilePath::StringType, size_t>* group_by_library) {
+  std::string contents;
+  if (!file_util::ReadFileToString(path, &contents)) {
+    LOG(WARNING) << "Couldn't read extension process groups from "
+                 << path.AsUTF8Unsafe();
+    return 0;
+  }
+
+  scoped_ptr<base::Value> value(base::JSONReader::Read(contents));
+  base::ListValue* groups;
+  if (!value || !value->GetAsList(&groups)) {
+    LOG(WARNING) << "Extension process groups must be a list of lists.";
+    return 0;
+  }
+
+  for (size_t i = 0; i < groups->GetSize(); ++i) {
+    base::ListValue* group;
+    if (!groups->GetList(i, &group)) {
+      LOG(WARNING) << "Ignoring extension process group " << i
+                   << " which is not a list.";
+      continue;
+    }
+    for (size_t j = 0; j < group->GetSize(); ++j) {
+      std::string name;
+      if (group->GetString(j, &name))
+        (*group_by_library)[base::FilePath::FromUTF8Unsafe(name).value()] = i;
+    }
+  }
+  return groups->GetSize();
+}
+
+// Splits |libraries| in groups, each group will be loaded in its own extension
+// process.
+std::vector<LibraryGroup> GroupExternalExtensionLibraries(
+    const std::vector<base::FilePath>& libraries) {
+  std::vector<LibraryGroup> groups;
+  if (libraries.empty())
+    return groups;
+
+  CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  std::string model =
+      cmd_line->GetSwitchValueASCII(switches::kXWalkExtensionProcessModel);
+
+  if (model == kProcessPerExtensionModel) {
+    for (size_t i = 0; i < libraries.size(); ++i)
+      groups.push_back(LibraryGroup(1, libraries[i]));
+    return groups;
+  }
+
+  std::map<base::FilePath::StringType, size_t> group_by_library;
+  size_t groups_count = 0;
+  if (model == kGroupsModel) {
+    groups_count = ReadExtensionProcessGroups(
+        cmd_line->GetSwitchValuePath(switches::kXWalkExtensionProcessGroups),
+        &group_by_library);
+  } else if (!model.empty() && model != kSingleProcessModel) {
+    LOG(WARNING) << "Unknown extension process model " << model
+                 << ", using a single extension process.";
+  }
+
+  // The last group holds the libraries not listed in any group.
+  groups.resize(groups_count + 1);
+  for (size_t i = 0; i < libraries.size(); ++i) {
+    std::map<base::FilePath::StringType, size_t>::const_iterator it =
+        group_by_library.find(libraries[i].BaseName().value());
+    size_t index = it != group_by_library.end() ? it->second : groups_count;
+    groups[index].push_back(libraries[i]);
+  }
+
+  std::vector<LibraryGroup> non_empty_groups;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    if (!groups[i].empty())
+      non_empty_groups.push_back(groups[i]);
+  }
+  return non_empty_groups;
 }
 
+}  // namespace
+
 // This object intercepts messages destined to a XWalkExtensionServer and
-// dispatch them to its task runner. A message loop proxy of a thread is a
-// task runner. Like other filters, this filter will run in the IO-thread.
+// routes them, still in the IO-thread, to the task runners of the instances
+// they are meant to. A message loop proxy of a thread is a task runner. Like
+// other filters, this filter will run in the IO-thread.
 //
-// In the case of in process extensions, we will pass the task runner of the
-// extension thread.
+// In the case of in process extensions, the task runner of the server is the
+// one of the extension thread.
 class ExtensionServerMessageFilter : public IPC::ChannelProxy::MessageFilter {
  public:
-  ExtensionServerMessageFilter(
-      scoped_refptr<base::SequencedTaskRunner> task_runner,
-      XWalkExtensionServer* server)
-      : task_runner_(task_runner),
-        server_(server) {}
+  explicit ExtensionServerMessageFilter(
+      scoped_refptr<XWalkExtensionServer> server)
+      : server_(server) {}
 
   // Tells the filter to stop dispatching messages to the server.
   void Invalidate() {
     base::AutoLock l(lock_);
-    task_runner_ = NULL;
     server_ = NULL;
   }
 
@@ -56,16 +147,18 @@ class ExtensionServerMessageFilter : public IPC::ChannelProxy::MessageFilter {
   virtual ~ExtensionServerMessageFilter() {}
 
   // IPC::ChannelProxy::MessageFilter implementation.
+  virtual void OnChannelConnected(int32 peer_pid) OVERRIDE {
+    base::AutoLock l(lock_);
+    if (server_)
+      server_->SetPeerProcess(peer_pid);
+  }
+
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE {
     if (IPC_MESSAGE_CLASS(message) == XWalkExtensionClientServerMsgStart) {
       base::AutoLock l(lock_);
       if (!server_)
         return false;
-      task_runner_->PostTask(
-          FROM_HERE,
-          base::Bind(
-              base::IgnoreResult(&XWalkExtensionServer::OnMessageReceived),
-              base::Unretained(server_), message));
+      server_->RouteMessageFromIOThread(message);
       return true;
     }
     return false;
@@ -74,76 +167,96 @@ class ExtensionServerMessageFilter : public IPC::ChannelProxy::MessageFilter {
   // This lock is used to protect access to filter members.
   base::Lock lock_;
 
-  scoped_refptr<base::SequencedTaskRunner> task_runner_;
-  XWalkExtensionServer* server_;
+  scoped_refptr<XWalkExtensionServer> server_;
 };
 
 XWalkExtensionService::XWalkExtensionService()
-    : render_process_host_(NULL),
-      extension_thread_("XWalkExtensionThread"),
-      in_process_server_message_filter_(NULL) {
-  CommandLine* cmd_line = CommandLine::ForCurrentProcess();
-  if (!cmd_line->HasSwitch(switches::kXWalkDisableExtensionProcess))
-    extension_process_host_.reset(new XWalkExtensionProcessHost());
-
+    : extension_thread_("XWalkExtensionThread") {
   registrar_.Add(this, content::NOTIFICATION_RENDERER_PROCESS_TERMINATED,
                  content::NotificationService::AllBrowserContextsAndSources());
 
   extension_thread_.Start();
 
-  // The server is created here but will live on the extension thread.
-  in_process_extensions_server_.reset(new XWalkExtensionServer());
-
   if (!g_register_extensions_callback.is_null())
     g_register_extensions_callback.Run(this);
 }
 
 XWalkExtensionService::~XWalkExtensionService() {
-  // This object should already be released and asked to be deleted in the
-  // extension thread.
-  CHECK(!in_process_extensions_server_);
+  // Render processes are usually gone by now, but make sure the servers of
+  // any remaining one are not used anymore.
+  InProcessServerMap::iterator it = in_process_servers_.begin();
+  for (; it != in_process_servers_.end(); ++it)
+    ReleaseInProcessServer(it->second);
+  in_process_servers_.clear();
+
+  // The instances of the servers are deleted from the extension thread and use
+  // the extensions, so stop it before deleting them.
+  extension_thread_.Stop();
+  STLDeleteValues(&in_process_extensions_);
+
+  for (size_t i = 0; i < extension_process_hosts_.size(); ++i) {
+    BrowserThread::DeleteSoon(BrowserThread::IO, FROM_HERE,
+                              extension_process_hosts_[i]);
+  }
 }
 
 bool XWalkExtensionService::RegisterExtension(
     scoped_ptr<XWalkExtension> extension) {
   // Note: for now we only support registering new extensions before
   // render process hosts were created.
-  CHECK(!render_process_host_);
-  return in_process_extensions_server_->RegisterExtension(extension.Pass());
+  CHECK(in_process_servers_.empty());
+  return RegisterExtensionInMap(extension.Pass(), &in_process_extensions_);
 }
 
 void XWalkExtensionService::RegisterExternalExtensionsForPath(
     const base::FilePath& path) {
-  if (extension_process_host_) {
-    extension_process_host_->RegisterExternalExtensions(path);
-  } else {
-    RegisterExternalExtensionsInDirectory(in_process_extensions_server_.get(),
-                                          path);
+  CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  if (cmd_line->HasSwitch(switches::kXWalkDisableExtensionProcess)) {
+    RegisterExternalExtensionsInDirectory(&in_process_extensions_, path);
+    return;
+  }
+
+  std::vector<LibraryGroup> groups = GroupExternalExtensionLibraries(
+      GetExternalExtensionLibrariesInDirectory(path));
+
+  for (size_t i = 0; i < groups.size(); ++i) {
+    XWalkExtensionProcessHost* host = new XWalkExtensionProcessHost();
+    extension_process_hosts_.push_back(host);
+    host->RegisterExternalExtensions(groups[i]);
+
+    // Render processes that already exist need a channel to it as well.
+    InProcessServerMap::iterator it = in_process_servers_.begin();
+    for (; it != in_process_servers_.end(); ++it)
+      host->OnRenderProcessHostCreated(it->first);
   }
 }
 
 void XWalkExtensionService::OnRenderProcessHostCreated(
     content::RenderProcessHost* host) {
-  // FIXME(cmarcelo): For now we support only one render process host.
-  if (render_process_host_)
+  if (in_process_servers_.find(host) != in_process_servers_.end())
     return;
 
-  render_process_host_ = host;
+  IPC::ChannelProxy* channel = host->GetChannel();
 
-  IPC::ChannelProxy* channel = render_process_host_->GetChannel();
+  // The server is created here but will live on the extension thread. The
+  // filter is owned by the IPC channel but we keep a reference to remove it
+  // from the Channel later during a RenderProcess shutdown.
+  InProcessServerData data;
+  data.server = new XWalkExtensionServer();
+  data.filter = new ExtensionServerMessageFilter(data.server);
+  in_process_servers_[host] = data;
 
-  // The filter is owned by the IPC channel but we keep a reference to remove
-  // it from the Channel later during a RenderProcess shutdown.
-  in_process_server_message_filter_ =
-      new ExtensionServerMessageFilter(extension_thread_.message_loop_proxy(),
-                                       in_process_extensions_server_.get());
-  channel->AddFilter(in_process_server_message_filter_);
-  in_process_extensions_server_->Initialize(channel);
+  data.server->SetExtensions(in_process_extensions_);
+  channel->AddFilter(data.filter);
+  data.server->Initialize(channel, extension_thread_.message_loop_proxy());
+  data.server->SetIOTaskRunner(
+      BrowserThread::GetMessageLoopProxyForThread(BrowserThread::IO));
 
-  in_process_extensions_server_->RegisterExtensionsInRenderProcess();
+  // On Windows this waits until the filter knows the render process.
+  data.server->RegisterExtensionsInRenderProcess();
 
-  if (extension_process_host_)
-    extension_process_host_->OnRenderProcessHostCreated(host);
+  for (size_t i = 0; i < extension_process_hosts_.size(); ++i)
+    extension_process_hosts_[i]->OnRenderProcessHostCreated(host);
 }
 
 // static
@@ -170,26 +283,34 @@ void XWalkExtensionService::Observe(int type,
 
 void XWalkExtensionService::OnRenderProcessHostClosed(
     content::RenderProcessHost* host) {
-  // FIXME(cmarcelo): For now we support only one render process host.
-  if (host != render_process_host_)
+  InProcessServerMap::iterator it = in_process_servers_.find(host);
+  if (it == in_process_servers_.end())
     return;
 
+  InProcessServerData data = it->second;
+  in_process_servers_.erase(it);
+  ReleaseInProcessServer(data);
+
+  // This will caused the filter to be deleted in the IO-thread.
+  if (IPC::ChannelProxy* channel = host->GetChannel())
+    channel->RemoveFilter(data.filter);
+
+  for (size_t i = 0; i < extension_process_hosts_.size(); ++i)
+    extension_process_hosts_[i]->OnRenderProcessHostClosed(host);
+}
+
+void XWalkExtensionService::ReleaseInProcessServer(
+    const InProcessServerData& data) {
   // Invalidate the objects in the different threads so they stop posting
   // messages to each other. This is important because we'll schedule the
   // deletion of both objects to their respective threads.
-  in_process_server_message_filter_->Invalidate();
-  in_process_extensions_server_->Invalidate();
-
-  // This will caused the filter to be deleted in the IO-thread.
-  render_process_host_->GetChannel()->RemoveFilter(
-      in_process_server_message_filter_);
-  extension_thread_.message_loop()->DeleteSoon(
-      FROM_HERE, in_process_extensions_server_.release());
+  data.filter->Invalidate();
+  data.server->Invalidate();
 
-  if (extension_process_host_) {
-    BrowserThread::DeleteSoon(BrowserThread::IO, FROM_HERE,
-                              extension_process_host_.release());
-  }
+  // The server itself goes away once the tasks still using it are done.
+  extension_thread_.message_loop()->PostTask(
+      FROM_HERE,
+      base::Bind(&XWalkExtensionServer::DeleteInstances, data.server));
 }
 
 }  // namespace extensions
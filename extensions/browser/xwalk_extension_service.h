@@ -6,12 +6,16 @@
 #define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_SERVICE_H_
 
 #include <stdint.h>
+#include <map>
 #include <string>
+#include <vector>
 #include "base/callback_forward.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/threading/thread.h"
 #include "content/public/browser/notification_observer.h"
 #include "content/public/browser/notification_registrar.h"
+#include "xwalk/extensions/common/xwalk_extension_server.h"
 
 namespace base {
 class FilePath;
@@ -28,7 +32,6 @@ namespace extensions {
 class ExtensionServerMessageFilter;
 class XWalkExtension;
 class XWalkExtensionProcessHost;
-class XWalkExtensionServer;
 
 // This is the entry point for Crosswalk extensions. Its responsible for keeping
 // track of the extensions, and enable them on WebContents once they are
@@ -42,6 +45,9 @@ class XWalkExtensionService : public content::NotificationObserver {
   // same name exists, otherwise returns true.
   bool RegisterExtension(scoped_ptr<XWalkExtension> extension);
 
+  // Loads the external extensions found in |path|. Unless the extension
+  // process is disabled, they are placed in one or more extension processes
+  // according to the --extension-process-model switch.
   void RegisterExternalExtensionsForPath(const base::FilePath& path);
 
   // To be called when a new RenderProcessHost is created, will plug the
@@ -54,6 +60,11 @@ class XWalkExtensionService : public content::NotificationObserver {
   static void SetRegisterExtensionsCallbackForTesting(
       const RegisterExtensionsCallback& callback);
 
+  const std::vector<XWalkExtensionProcessHost*>&
+  GetExtensionProcessHostsForTesting() const {
+    return extension_process_hosts_;
+  }
+
  private:
   // NotificationObserver implementation.
   virtual void Observe(int type, const content::NotificationSource& source,
@@ -61,19 +72,29 @@ class XWalkExtensionService : public content::NotificationObserver {
 
   void OnRenderProcessHostClosed(content::RenderProcessHost* host);
 
-  // FIXME(cmarcelo): For now we support only one render process host.
-  content::RenderProcessHost* render_process_host_;
+  // Each render process has its own server handling the in process
+  // extensions, which lives in the extension_thread_, and its own filter,
+  // which lives on the IO-thread.
+  struct InProcessServerData {
+    scoped_refptr<XWalkExtensionServer> server;
+    ExtensionServerMessageFilter* filter;
+  };
+
+  // Stops |data| from dispatching messages and schedules the deletion of the
+  // instances of its server from the extension thread.
+  void ReleaseInProcessServer(const InProcessServerData& data);
 
-  // The server that handles in process extensions will live in the
-  // extension_thread_.
   base::Thread extension_thread_;
-  scoped_ptr<XWalkExtensionServer> in_process_extensions_server_;
 
-  // This object lives on the IO-thread.
-  ExtensionServerMessageFilter* in_process_server_message_filter_;
+  // Shared by all the in process servers.
+  XWalkExtensionServer::ExtensionMap in_process_extensions_;
+
+  typedef std::map<content::RenderProcessHost*, InProcessServerData>
+      InProcessServerMap;
+  InProcessServerMap in_process_servers_;
 
-  // This object lives on the IO-thread.
-  scoped_ptr<XWalkExtensionProcessHost> extension_process_host_;
+  // These objects live on the IO-thread.
+  std::vector<XWalkExtensionProcessHost*> extension_process_hosts_;
 
   content::NotificationRegistrar registrar_;
 
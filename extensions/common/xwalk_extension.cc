@@ -5,15 +5,38 @@
 #include "xwalk/extensions/common/xwalk_extension.h"
 
 #include "base/logging.h"
+#include "base/message_loop.h"
+#include "base/threading/thread.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
 
 namespace xwalk {
 namespace extensions {
 
-XWalkExtension::XWalkExtension() {}
+XWalkExtension::XWalkExtension()
+    : threading_model_(SHARED_THREAD) {}
 
 XWalkExtension::~XWalkExtension() {}
 
-XWalkExtensionInstance::XWalkExtensionInstance() {}
+scoped_refptr<base::SequencedTaskRunner>
+XWalkExtension::GetDedicatedTaskRunner() {
+  base::AutoLock l(dedicated_thread_lock_);
+  if (!dedicated_thread_) {
+    dedicated_thread_.reset(new base::Thread("XWalkExtension_" + name_));
+    // An IO message loop lets external extensions watch file descriptors
+    // in the thread running their instances.
+    base::Thread::Options options(base::MessageLoop::TYPE_IO, 0);
+    if (!dedicated_thread_->StartWithOptions(options))
+      LOG(ERROR) << "Couldn't start thread for extension " << name_;
+  }
+  return dedicated_thread_->message_loop_proxy();
+}
+
+const XWalkExtensionInstance::SyncReplyToken
+    XWalkExtensionInstance::kOldestSyncReply;
+
+XWalkExtensionInstance::XWalkExtensionInstance()
+    : writable_to_js_(1),
+      next_stream_id_(1) {}
 
 XWalkExtensionInstance::~XWalkExtensionInstance() {}
 
@@ -22,15 +45,142 @@ void XWalkExtensionInstance::SetPostMessageCallback(
   post_message_ = callback;
 }
 
+void XWalkExtensionInstance::SetPostMessagesCallback(
+    const PostMessagesCallback& callback) {
+  post_messages_ = callback;
+}
+
 void XWalkExtensionInstance::SetSendSyncReplyCallback(
     const SendSyncReplyCallback& callback) {
   send_sync_reply_ = callback;
 }
 
+void XWalkExtensionInstance::SetCoalesceMessagesCallback(
+    const CoalesceMessagesCallback& callback) {
+  coalesce_messages_ = callback;
+}
+
+void XWalkExtensionInstance::SetStreamToJSCallback(
+    const StreamToJSCallback& callback) {
+  stream_to_js_ = callback;
+}
+
+void XWalkExtensionInstance::SetSharedBufferToJSCallback(
+    const SharedBufferToJSCallback& callback) {
+  shared_buffer_to_js_ = callback;
+}
+
+void XWalkExtensionInstance::SetWritableToJS(bool writable) {
+  base::subtle::Release_Store(&writable_to_js_, writable ? 1 : 0);
+}
+
+void XWalkExtensionInstance::NotifyWritableToJS() {
+  // Nothing to tell if it went above the high-water mark again meanwhile.
+  if (IsWritableToJS())
+    OnWritableToJS();
+}
+
+void XWalkExtensionInstance::NotifyStreamWritableToJS(StreamId stream) {
+  OnStreamWritableToJS(stream);
+}
+
+void XWalkExtensionInstance::NotifySharedBufferReleased(BufferId buffer) {
+  OnSharedBufferReleased(buffer);
+}
+
+bool XWalkExtensionInstance::IsWritableToJS() const {
+  return base::subtle::Acquire_Load(&writable_to_js_) != 0;
+}
+
+void XWalkExtensionInstance::SetCoalesceMessagesToJS(bool coalesce) {
+  if (!coalesce_messages_.is_null())
+    coalesce_messages_.Run(coalesce);
+}
+
+XWalkExtensionInstance::StreamId XWalkExtensionInstance::OpenStreamToJS() {
+  const StreamId stream = next_stream_id_++;
+  if (!stream_to_js_.is_null())
+    stream_to_js_.Run(OPEN_STREAM, stream, NULL);
+  return stream;
+}
+
+bool XWalkExtensionInstance::WriteSerializedStreamToJS(StreamId stream,
+                                                       std::string* data) {
+  if (stream_to_js_.is_null())
+    return false;
+  return stream_to_js_.Run(WRITE_STREAM, stream, data);
+}
+
+void XWalkExtensionInstance::CloseStreamToJS(StreamId stream) {
+  if (!stream_to_js_.is_null())
+    stream_to_js_.Run(CLOSE_STREAM, stream, NULL);
+}
+
+void XWalkExtensionInstance::PostSerializedMessagesToJS(
+    std::vector<std::string>* data) {
+  if (!post_messages_.is_null()) {
+    post_messages_.Run(data);
+    return;
+  }
+  for (size_t i = 0; i < data->size(); ++i)
+    post_message_.Run(&(*data)[i]);
+}
+
+bool XWalkExtensionInstance::PostSharedBufferToJS(BufferId buffer,
+    base::SharedMemory* memory, size_t size) {
+  if (shared_buffer_to_js_.is_null())
+    return false;
+  return shared_buffer_to_js_.Run(buffer, memory, size);
+}
+
 void XWalkExtensionInstance::HandleSyncMessage(
     scoped_ptr<base::Value> msg) {
   LOG(FATAL) << "Sending sync message to extension which doesn't support it!";
 }
 
+void XWalkExtensionInstance::HandleSyncMessageWithToken(
+    scoped_ptr<base::Value> msg, SyncReplyToken token) {
+  HandleSyncMessage(msg.Pass());
+}
+
+void XWalkExtensionInstance::HandleSerializedMessage(const std::string& data) {
+  scoped_ptr<base::Value> msg(WireFormatToValue(data));
+  if (!msg) {
+    LOG(WARNING) << "Ignoring malformed message.";
+    return;
+  }
+  HandleMessage(msg.Pass());
+}
+
+void XWalkExtensionInstance::HandleSerializedSyncMessage(
+    const std::string& data, SyncReplyToken token) {
+  scoped_ptr<base::Value> msg(WireFormatToValue(data));
+  if (!msg) {
+    // The renderer is still waiting, so it gets a null reply.
+    LOG(WARNING) << "Replying null to malformed sync message.";
+    SendSyncReplyToJS(token, scoped_ptr<base::Value>(
+        base::Value::CreateNullValue()));
+    return;
+  }
+  HandleSyncMessageWithToken(msg.Pass(), token);
+}
+
+void XWalkExtensionInstance::PostMessageToJS(scoped_ptr<base::Value> msg) {
+  std::string data;
+  ValueToWireFormat(*msg, &data);
+  PostSerializedMessageToJS(&data);
+}
+
+void XWalkExtensionInstance::SendSyncReplyToJS(scoped_ptr<base::Value> reply) {
+  SendSyncReplyToJS(kOldestSyncReply, reply.Pass());
+}
+
+void XWalkExtensionInstance::SendSyncReplyToJS(SyncReplyToken token,
+                                               scoped_ptr<base::Value> reply) {
+  std::string data;
+  ValueToWireFormat(*reply, &data);
+  SendSerializedSyncReplyToJS(token, &data);
+}
+
 }  // namespace extensions
 }  // namespace xwalk
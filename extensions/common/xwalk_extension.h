@@ -5,10 +5,22 @@
 #ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_H_
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_H_
 
+#include <stdint.h>
 #include <string>
+#include <vector>
+#include "base/atomicops.h"
 #include "base/callback.h"
+#include "base/memory/shared_memory.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/sequenced_task_runner.h"
+#include "base/synchronization/lock.h"
 #include "base/values.h"
 
+namespace base {
+class Thread;
+}
+
 namespace xwalk {
 namespace extensions {
 
@@ -31,6 +43,24 @@ class XWalkExtensionInstance;
 // XWalkExtensionInstance.
 class XWalkExtension {
  public:
+  // Where the instances of the extension run. Messages for an instance are
+  // always handled in order, in the same thread it was created.
+  enum ThreadingModel {
+    // Instances share the thread of the XWalkExtensionServer with all the
+    // other extensions using this model. This is the default.
+    SHARED_THREAD,
+    // All the instances of the extension run in a thread of its own, so a
+    // blocking extension doesn't stall the others.
+    DEDICATED_THREAD,
+    // Each instance runs in its own sequence of a worker pool, different
+    // instances can run in parallel so the extension must be thread-safe.
+    WORKER_POOL,
+    // Instances run in the IO thread of the browser process, getting messages
+    // without any thread hop. They must never block. Only in process
+    // extensions can use it, elsewhere it behaves like SHARED_THREAD.
+    IO_THREAD,
+  };
+
   virtual ~XWalkExtension();
 
   // Returns the JavaScript API code that will be executed in the render
@@ -38,18 +68,33 @@ class XWalkExtension {
   // interface on top of the message passing.
   virtual const char* GetJavaScriptAPI() = 0;
 
+  // May return NULL if the extension can't create instances anymore, e.g. an
+  // external extension whose library failed to load on demand.
   virtual XWalkExtensionInstance* CreateInstance() = 0;
 
   std::string name() const { return name_; }
+  ThreadingModel threading_model() const { return threading_model_; }
+
+  // Returns the task runner of the thread used by DEDICATED_THREAD extensions,
+  // starting the thread on first use. Can be called from any thread.
+  scoped_refptr<base::SequencedTaskRunner> GetDedicatedTaskRunner();
 
  protected:
   XWalkExtension();
   void set_name(const std::string& name) { name_ = name; }
 
+  // Must be called before the extension is registered.
+  void set_threading_model(ThreadingModel model) { threading_model_ = model; }
+
  private:
   // Name of extension, used for dispatching messages.
   std::string name_;
 
+  ThreadingModel threading_model_;
+
+  base::Lock dedicated_thread_lock_;
+  scoped_ptr<base::Thread> dedicated_thread_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExtension);
 };
 
@@ -67,20 +112,88 @@ class XWalkExtensionInstance {
   // process.
   virtual void HandleMessage(scoped_ptr<base::Value> msg) = 0;
 
+  // Identifies a synchronous message waiting for its reply. Tokens are never
+  // zero, see kOldestSyncReply.
+  typedef int32_t SyncReplyToken;
+  static const SyncReplyToken kOldestSyncReply = 0;
+
   // Allow to handle synchronous messages sent from JavaScript code. Renderer
   // will block until SendSyncReplyToJS() is called with the reply. The reply
   // can be sent after HandleSyncMessage() function returns.
   virtual void HandleSyncMessage(scoped_ptr<base::Value> msg);
 
+  // Like HandleSyncMessage(), but also gets the |token| identifying the
+  // message. Many synchronous messages can wait for a reply at the same time,
+  // and passing their token to SendSyncReplyToJS() answers them in any order
+  // and from any thread. Calls HandleSyncMessage() by default.
+  virtual void HandleSyncMessageWithToken(scoped_ptr<base::Value> msg,
+                                          SyncReplyToken token);
+
+  // Messages arrive encoded with XWalkExtensionWireWriter. By default they
+  // are converted to base::Value and passed to the functions above,
+  // extensions can read |data| in place with XWalkExtensionWireReader
+  // instead.
+  virtual void HandleSerializedMessage(const std::string& data);
+  virtual void HandleSerializedSyncMessage(const std::string& data,
+                                           SyncReplyToken token);
+
+  // Identifies a stream of the instance. Streams opened by JavaScript and by
+  // the instance have separated ids.
+  typedef int32_t StreamId;
+
+  // Allow to handle streams opened by JavaScript, for transfers too large
+  // for a single message. Each chunk of data is encoded with
+  // XWalkExtensionWireWriter, and the next ones are sent once it's handled.
+  virtual void HandleStreamOpened(StreamId stream) {}
+  virtual void HandleStreamData(StreamId stream, const std::string& data) {}
+  virtual void HandleStreamClosed(StreamId stream) {}
+
   // Callbacks used by extension instance to communicate back to JS. These are
-  // set by the extension system. Callbacks will take the ownership of the
-  // message.
-  typedef base::Callback<void(scoped_ptr<base::Value> msg)> PostMessageCallback;
-  typedef base::Callback<void(scoped_ptr<base::Value> msg)>
+  // set by the extension system. Callbacks take the contents of |data|, a
+  // message encoded with XWalkExtensionWireWriter.
+  typedef base::Callback<void(std::string* data)> PostMessageCallback;
+  // Takes the contents of all the messages in |data|.
+  typedef base::Callback<void(std::vector<std::string>* data)>
+      PostMessagesCallback;
+  typedef base::Callback<void(SyncReplyToken token, std::string* data)>
       SendSyncReplyCallback;
 
+  typedef base::Callback<void(bool coalesce)> CoalesceMessagesCallback;
+
+  // Streams opened by the instance. Writing takes the contents of |data| and
+  // returns true, unless the stream has too much data in flight.
+  enum StreamOperation { OPEN_STREAM, WRITE_STREAM, CLOSE_STREAM };
+  typedef base::Callback<bool(StreamOperation operation, StreamId stream,
+                              std::string* data)> StreamToJSCallback;
+
   void SetPostMessageCallback(const PostMessageCallback& callback);
+  void SetPostMessagesCallback(const PostMessagesCallback& callback);
   void SetSendSyncReplyCallback(const SendSyncReplyCallback& callback);
+  void SetCoalesceMessagesCallback(const CoalesceMessagesCallback& callback);
+  void SetStreamToJSCallback(const StreamToJSCallback& callback);
+
+  // Identifies a shared buffer of the instance, chosen by the instance.
+  typedef int32_t BufferId;
+
+  // Shares |memory| with the render process, where JavaScript gets it.
+  typedef base::Callback<bool(BufferId buffer, base::SharedMemory* memory,
+                              size_t size)> SharedBufferToJSCallback;
+  void SetSharedBufferToJSCallback(const SharedBufferToJSCallback& callback);
+
+  // Called by the extension system from any thread when the messages posted
+  // to JavaScript go above or back below the high-water mark, see
+  // XWalkExtensionFlowControl. Must be followed by NotifyWritableToJS() in the
+  // thread of the instance when it becomes writable again.
+  void SetWritableToJS(bool writable);
+  void NotifyWritableToJS();
+
+  // Called by the extension system in the thread of the instance when a
+  // stream that was full can be written again.
+  void NotifyStreamWritableToJS(StreamId stream);
+
+  // Called by the extension system in the thread of the instance when
+  // JavaScript released a shared buffer.
+  void NotifySharedBufferReleased(BufferId buffer);
 
  protected:
   XWalkExtensionInstance();
@@ -88,18 +201,70 @@ class XWalkExtensionInstance {
   // Function to be used by extensions Instances to post messages back to
   // JavaScript in the renderer process. This function will take the ownership
   // of the message.
-  void PostMessageToJS(scoped_ptr<base::Value> msg) {
-    post_message_.Run(msg.Pass());
-  }
+  void PostMessageToJS(scoped_ptr<base::Value> msg);
+
+  // Unblocks the renderer waiting on the oldest pending SyncMessage.
+  void SendSyncReplyToJS(scoped_ptr<base::Value> reply);
 
-  // Unblocks the renderer waiting on a SyncMessage.
-  void SendSyncReplyToJS(scoped_ptr<base::Value> reply) {
-    send_sync_reply_.Run(reply.Pass());
+  // Unblocks the renderer waiting on the SyncMessage identified by |token|.
+  void SendSyncReplyToJS(SyncReplyToken token, scoped_ptr<base::Value> reply);
+
+  // Same as above for messages already encoded with XWalkExtensionWireWriter,
+  // the contents of |data| are taken.
+  void PostSerializedMessageToJS(std::string* data) {
+    post_message_.Run(data);
+  }
+  // Posts all the messages in |data| in one go, in order.
+  void PostSerializedMessagesToJS(std::vector<std::string>* data);
+  void SendSerializedSyncReplyToJS(SyncReplyToken token, std::string* data) {
+    send_sync_reply_.Run(token, data);
   }
 
+  // Messages posted to JavaScript are sent as the client handles the previous
+  // ones. Posting still works when this returns false, but the messages then
+  // wait in the browser or extension process, so instances producing them
+  // faster than JavaScript consumes them should wait for OnWritableToJS().
+  // Past XWalkExtensionFlowControl::kMaxWaitingMessages waiting messages,
+  // the new ones are dropped. Sending a sync reply first sends all the
+  // messages waiting, regardless of the credits, to keep them in order.
+  bool IsWritableToJS() const;
+  virtual void OnWritableToJS() {}
+
+  // When enabled, only the latest message waiting to be sent is kept, for
+  // instances posting a stream of states where only the last one matters.
+  void SetCoalesceMessagesToJS(bool coalesce);
+
+  // Streams let instances send data too large for a single message in
+  // chunks, without holding all of it in memory. Chunks are encoded with
+  // XWalkExtensionWireWriter, and WriteSerializedStreamToJS() takes the
+  // contents of |data|. When it returns false the chunk was not written, it
+  // must be written again after OnStreamWritableToJS(). Streams must be used
+  // in the thread of the instance.
+  StreamId OpenStreamToJS();
+  bool WriteSerializedStreamToJS(StreamId stream, std::string* data);
+  void CloseStreamToJS(StreamId stream);
+  virtual void OnStreamWritableToJS(StreamId stream) {}
+
+  // Gives JavaScript an ArrayBuffer backed by the first |size| bytes of
+  // |memory|, without copying them. The instance must not touch the memory
+  // until OnSharedBufferReleased() is called for |buffer|, it can then fill
+  // it again and post it with the same id. Ids must be unique among the
+  // buffers held by JavaScript, a duplicate is released right away without
+  // reaching JavaScript. Returns false if the buffer couldn't be shared, and
+  // OnSharedBufferReleased() won't be called then.
+  bool PostSharedBufferToJS(BufferId buffer, base::SharedMemory* memory,
+                            size_t size);
+  virtual void OnSharedBufferReleased(BufferId buffer) {}
+
  private:
   PostMessageCallback post_message_;
+  PostMessagesCallback post_messages_;
   SendSyncReplyCallback send_sync_reply_;
+  CoalesceMessagesCallback coalesce_messages_;
+  StreamToJSCallback stream_to_js_;
+  SharedBufferToJSCallback shared_buffer_to_js_;
+  base::subtle::Atomic32 writable_to_js_;
+  StreamId next_stream_id_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionInstance);
 };
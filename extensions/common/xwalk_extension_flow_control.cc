@@ -0,0 +1,248 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_flow_control.h"
+
+#include "base/logging.h"
+
+namespace xwalk {
+namespace extensions {
+
+const int XWalkExtensionFlowControl::kCredits = 64;
+const int XWalkExtensionFlowControl::kMessagesPerAck = kCredits / 2;
+const size_t XWalkExtensionFlowControl::kHighWaterMark = 256;
+const size_t XWalkExtensionFlowControl::kLowWaterMark = 64;
+const size_t XWalkExtensionFlowControl::kMaxWaitingMessages = 4096;
+const size_t XWalkExtensionFlowControl::kStreamWindowBytes = 1024 * 1024;
+
+XWalkExtensionFlowControl::InstanceState::InstanceState()
+    : in_flight(0),
+      coalesce(false),
+      high_priority(false),
+      writable(true),
+      dropping(false) {}
+
+XWalkExtensionFlowControl::StreamState::StreamState()
+    : in_flight(0),
+      full(false) {}
+
+XWalkExtensionFlowControl::XWalkExtensionFlowControl() {}
+
+XWalkExtensionFlowControl::~XWalkExtensionFlowControl() {}
+
+bool XWalkExtensionFlowControl::Post(int64_t instance_id, std::string* msg) {
+  InstanceStateMap::iterator it = GetInstance(instance_id);
+  if (it == instances_.end()) {
+    msg->clear();
+    return false;
+  }
+  InstanceState& state = it->second;
+
+  // Waiting messages go first, so the order is kept.
+  if (state.waiting.empty() && state.in_flight < kCredits) {
+    state.in_flight++;
+    UpdateInstance(it);
+    return true;
+  }
+
+  if (state.coalesce)
+    state.waiting.clear();
+  if (state.waiting.size() >= kMaxWaitingMessages) {
+    if (!state.dropping) {
+      LOG(WARNING) << "Dropping messages of instance " << instance_id
+                   << ", it has " << state.waiting.size()
+                   << " messages waiting for JavaScript.";
+      state.dropping = true;
+    }
+    msg->clear();
+    return false;
+  }
+  state.dropping = false;
+  state.waiting.push_back(std::string());
+  state.waiting.back().swap(*msg);
+  UpdateInstance(it);
+  return false;
+}
+
+void XWalkExtensionFlowControl::OnMessagesHandled(
+    int64_t instance_id, int count, std::vector<std::string>* msgs) {
+  InstanceStateMap::iterator it = instances_.find(instance_id);
+  if (it == instances_.end())
+    return;
+  InstanceState& state = it->second;
+
+  if (count > state.in_flight) {
+    LOG(WARNING) << "Client handled " << count << " messages of instance "
+                 << instance_id << " but only " << state.in_flight
+                 << " were sent.";
+    count = state.in_flight;
+  }
+  state.in_flight -= count;
+
+  while (!state.waiting.empty() && state.in_flight < kCredits) {
+    msgs->push_back(std::string());
+    msgs->back().swap(state.waiting.front());
+    state.waiting.pop_front();
+    state.in_flight++;
+  }
+  UpdateInstance(it);
+}
+
+void XWalkExtensionFlowControl::TakeWaitingMessages(
+    int64_t instance_id, std::vector<std::string>* msgs) {
+  InstanceStateMap::iterator it = instances_.find(instance_id);
+  if (it == instances_.end())
+    return;
+  InstanceState& state = it->second;
+
+  while (!state.waiting.empty()) {
+    msgs->push_back(std::string());
+    msgs->back().swap(state.waiting.front());
+    state.waiting.pop_front();
+    state.in_flight++;
+  }
+  UpdateInstance(it);
+}
+
+void XWalkExtensionFlowControl::SetCoalesceMessages(int64_t instance_id,
+                                                    bool coalesce) {
+  InstanceStateMap::iterator it = GetInstance(instance_id);
+  if (it == instances_.end())
+    return;
+  InstanceState& state = it->second;
+  state.coalesce = coalesce;
+  if (coalesce && state.waiting.size() > 1)
+    state.waiting.erase(state.waiting.begin(), state.waiting.end() - 1);
+  UpdateInstance(it);
+}
+
+void XWalkExtensionFlowControl::SetHighPriority(int64_t instance_id,
+                                                bool high_priority) {
+  InstanceStateMap::iterator it = GetInstance(instance_id);
+  if (it == instances_.end())
+    return;
+  it->second.high_priority = high_priority;
+  UpdateInstance(it);
+}
+
+bool XWalkExtensionFlowControl::IsHighPriority(int64_t instance_id) const {
+  InstanceStateMap::const_iterator it = instances_.find(instance_id);
+  return it != instances_.end() && it->second.high_priority;
+}
+
+void XWalkExtensionFlowControl::RemoveInstance(int64_t instance_id) {
+  removed_instances_.insert(instance_id);
+  instances_.erase(instance_id);
+  streams_.erase(
+      streams_.lower_bound(std::make_pair(instance_id, kint32min)),
+      streams_.upper_bound(std::make_pair(instance_id, kint32max)));
+}
+
+void XWalkExtensionFlowControl::ForgetRemovedInstances() {
+  removed_instances_.clear();
+}
+
+bool XWalkExtensionFlowControl::OpenStream(int64_t instance_id,
+                                           int32_t stream_id) {
+  if (removed_instances_.count(instance_id))
+    return false;
+  return streams_.insert(std::make_pair(std::make_pair(instance_id, stream_id),
+                                        StreamState())).second;
+}
+
+bool XWalkExtensionFlowControl::WriteStream(int64_t instance_id,
+                                            int32_t stream_id, size_t size) {
+  StreamStateMap::iterator it =
+      streams_.find(std::make_pair(instance_id, stream_id));
+  if (it == streams_.end()) {
+    LOG(WARNING) << "Ignoring write to stream " << stream_id
+                 << " of instance " << instance_id << ", it is not open.";
+    return false;
+  }
+  StreamState& state = it->second;
+  // A single chunk can go over the window, so chunks of any size get through.
+  if (state.in_flight >= kStreamWindowBytes) {
+    state.full = true;
+    return false;
+  }
+  state.in_flight += size;
+  return true;
+}
+
+bool XWalkExtensionFlowControl::OnStreamDataHandled(int64_t instance_id,
+                                                    int32_t stream_id,
+                                                    size_t size) {
+  StreamStateMap::iterator it =
+      streams_.find(std::make_pair(instance_id, stream_id));
+  if (it == streams_.end())
+    return false;
+  StreamState& state = it->second;
+
+  if (size > state.in_flight) {
+    LOG(WARNING) << "Receiver handled " << size << " bytes of stream "
+                 << stream_id << " but only " << state.in_flight
+                 << " were sent.";
+    size = state.in_flight;
+  }
+  state.in_flight -= size;
+
+  if (!state.full || state.in_flight >= kStreamWindowBytes)
+    return false;
+  state.full = false;
+  return true;
+}
+
+bool XWalkExtensionFlowControl::RemoveStream(int64_t instance_id,
+                                             int32_t stream_id) {
+  return streams_.erase(std::make_pair(instance_id, stream_id)) > 0;
+}
+
+void XWalkExtensionFlowControl::TakeWritabilityChanges(
+    WritabilityChanges* changes) {
+  changes->swap(changes_);
+  changes_.clear();
+}
+
+size_t XWalkExtensionFlowControl::GetWaitingMessagesCountForTesting(
+    int64_t instance_id) const {
+  InstanceStateMap::const_iterator it = instances_.find(instance_id);
+  return it == instances_.end() ? 0 : it->second.waiting.size();
+}
+
+size_t XWalkExtensionFlowControl::GetRemovedInstancesCountForTesting() const {
+  return removed_instances_.size();
+}
+
+XWalkExtensionFlowControl::InstanceStateMap::iterator
+XWalkExtensionFlowControl::GetInstance(int64_t instance_id) {
+  std::pair<InstanceStateMap::iterator, bool> result =
+      instances_.insert(std::make_pair(instance_id, InstanceState()));
+  // Removed instances never have a state, so only new ones are checked.
+  if (result.second && removed_instances_.count(instance_id)) {
+    instances_.erase(result.first);
+    return instances_.end();
+  }
+  return result.first;
+}
+
+void XWalkExtensionFlowControl::UpdateInstance(
+    InstanceStateMap::iterator it) {
+  InstanceState& state = it->second;
+  const size_t pending = state.in_flight + state.waiting.size();
+
+  if (state.writable && pending >= kHighWaterMark) {
+    state.writable = false;
+    changes_.push_back(std::make_pair(it->first, false));
+  } else if (!state.writable && pending <= kLowWaterMark) {
+    state.writable = true;
+    changes_.push_back(std::make_pair(it->first, true));
+  }
+
+  if (pending == 0 && state.writable && !state.coalesce &&
+      !state.high_priority)
+    instances_.erase(it);
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,152 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FLOW_CONTROL_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FLOW_CONTROL_H_
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Credit-based flow control of the messages the instances post to
+// JavaScript. Each instance can have up to kCredits messages sent and not yet
+// handled by the client, which gives the credits back as it handles them, see
+// XWalkExtensionServerMsg_MessagesHandled. Further messages wait in the
+// server instead of piling up in the IPC channel and the render process.
+//
+// An instance is not writable anymore once it has kHighWaterMark messages
+// sent or waiting, and becomes writable again when they go down to
+// kLowWaterMark. In coalescing mode only the latest waiting message is kept,
+// for streams of state where only the last value matters. Instances that keep
+// posting while not writable can't have more than kMaxWaitingMessages
+// waiting, the ones posted past that are dropped.
+//
+// Instances can be given a high priority, the server then sends their
+// messages ahead of the ones of other instances posted before them.
+//
+// Streams are limited by bytes instead: each one can have up to
+// kStreamWindowBytes of data sent and not yet handled by the receiver.
+//
+// Not thread-safe, the server uses it with |sender_lock_| held.
+class XWalkExtensionFlowControl {
+ public:
+  static const int kCredits;
+  // The client gives credits back in groups of this size.
+  static const int kMessagesPerAck;
+  static const size_t kHighWaterMark;
+  static const size_t kLowWaterMark;
+  static const size_t kMaxWaitingMessages;
+  static const size_t kStreamWindowBytes;
+
+  // Instances whose writability changed, with their new state, in order.
+  typedef std::vector<std::pair<int64_t, bool> > WritabilityChanges;
+
+  XWalkExtensionFlowControl();
+  ~XWalkExtensionFlowControl();
+
+  // Returns true if |msg| can be sent now, it's counted as in flight then.
+  // Otherwise takes the contents of |msg| to send them later, or drops them
+  // if the instance was removed or has too many messages waiting.
+  bool Post(int64_t instance_id, std::string* msg);
+
+  // Gives back the credits of |count| messages handled by the client, and
+  // appends to |msgs| the waiting messages that can be sent now.
+  void OnMessagesHandled(int64_t instance_id, int count,
+                         std::vector<std::string>* msgs);
+
+  // Appends to |msgs| all the waiting messages of the instance, counting them
+  // as in flight even past its credits.
+  void TakeWaitingMessages(int64_t instance_id,
+                           std::vector<std::string>* msgs);
+
+  void SetCoalesceMessages(int64_t instance_id, bool coalesce);
+
+  void SetHighPriority(int64_t instance_id, bool high_priority);
+  bool IsHighPriority(int64_t instance_id) const;
+
+  // Forgets the instance, dropping its waiting messages and its streams.
+  // Messages, credits and stream writes that still arrive for it afterwards
+  // are ignored, until ForgetRemovedInstances() is called.
+  void RemoveInstance(int64_t instance_id);
+
+  // Stops remembering the removed instances. To be called once nothing
+  // posted by them can arrive anymore, like when all the messages queued
+  // before their removal were posted.
+  void ForgetRemovedInstances();
+
+  // Streams must be opened before being written, and their state is dropped
+  // when removed. Returns false if the stream is already open or its instance
+  // was removed.
+  bool OpenStream(int64_t instance_id, int32_t stream_id);
+
+  // Returns true if |size| bytes can be written to the stream now, they are
+  // counted as in flight then. Otherwise the stream is full and they must be
+  // written again once OnStreamDataHandled() returns true, or the stream is
+  // not open and the write is rejected.
+  bool WriteStream(int64_t instance_id, int32_t stream_id, size_t size);
+
+  // Returns true when the stream was full and can be written again.
+  bool OnStreamDataHandled(int64_t instance_id, int32_t stream_id,
+                           size_t size);
+
+  // Returns false if the stream was not open.
+  bool RemoveStream(int64_t instance_id, int32_t stream_id);
+
+  void TakeWritabilityChanges(WritabilityChanges* changes);
+
+  size_t GetWaitingMessagesCountForTesting(int64_t instance_id) const;
+  size_t GetRemovedInstancesCountForTesting() const;
+
+ private:
+  struct InstanceState {
+    InstanceState();
+
+    int in_flight;
+    std::deque<std::string> waiting;
+    bool coalesce;
+    bool high_priority;
+    bool writable;
+    // Messages are being dropped because |waiting| is full.
+    bool dropping;
+  };
+
+  typedef std::map<int64_t, InstanceState> InstanceStateMap;
+
+  struct StreamState {
+    StreamState();
+
+    size_t in_flight;
+    bool full;
+  };
+
+  typedef std::map<std::pair<int64_t, int32_t>, StreamState> StreamStateMap;
+
+  // Returns the state of the instance, creating it if needed, or
+  // instances_.end() if the instance was removed.
+  InstanceStateMap::iterator GetInstance(int64_t instance_id);
+
+  // Records a writability change of the instance, if any, and forgets its
+  // state when there is nothing left to remember.
+  void UpdateInstance(InstanceStateMap::iterator it);
+
+  InstanceStateMap instances_;
+  std::set<int64_t> removed_instances_;
+  StreamStateMap streams_;
+  WritabilityChanges changes_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionFlowControl);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FLOW_CONTROL_H_
@@ -0,0 +1,247 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_flow_control.h"
+
+#include <string>
+#include <vector>
+#include "base/strings/string_number_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionFlowControl;
+
+namespace {
+
+// Posts |count| messages numbered from |first|, returns how many can be sent
+// right away.
+int PostMessages(XWalkExtensionFlowControl* flow_control, int64_t instance_id,
+                 int first, int count) {
+  int sent = 0;
+  for (int i = first; i < first + count; ++i) {
+    std::string msg = base::IntToString(i);
+    if (flow_control->Post(instance_id, &msg))
+      sent++;
+  }
+  return sent;
+}
+
+}  // namespace
+
+TEST(XWalkExtensionFlowControlTest, MessagesWaitForCredits) {
+  XWalkExtensionFlowControl flow_control;
+  const int credits = XWalkExtensionFlowControl::kCredits;
+  EXPECT_EQ(credits, PostMessages(&flow_control, 1, 0, credits + 10));
+  EXPECT_EQ(10u, flow_control.GetWaitingMessagesCountForTesting(1));
+
+  // Other instances have their own credits.
+  EXPECT_EQ(1, PostMessages(&flow_control, 2, 0, 1));
+
+  std::vector<std::string> msgs;
+  flow_control.OnMessagesHandled(1, 4, &msgs);
+  ASSERT_EQ(4u, msgs.size());
+  EXPECT_EQ(base::IntToString(credits), msgs[0]);
+  EXPECT_EQ(base::IntToString(credits + 3), msgs[3]);
+
+  // New messages keep waiting behind the older ones.
+  EXPECT_EQ(0, PostMessages(&flow_control, 1, credits + 10, 1));
+  EXPECT_EQ(7u, flow_control.GetWaitingMessagesCountForTesting(1));
+
+  // Handling more messages than sent can't release more than the credits.
+  msgs.clear();
+  flow_control.OnMessagesHandled(1, 1000, &msgs);
+  EXPECT_EQ(7u, msgs.size());
+  EXPECT_EQ(base::IntToString(credits + 10), msgs.back());
+}
+
+TEST(XWalkExtensionFlowControlTest, WritabilityFollowsWaterMarks) {
+  XWalkExtensionFlowControl flow_control;
+  XWalkExtensionFlowControl::WritabilityChanges changes;
+  const int high = XWalkExtensionFlowControl::kHighWaterMark;
+  const int low = XWalkExtensionFlowControl::kLowWaterMark;
+
+  PostMessages(&flow_control, 1, 0, high - 1);
+  flow_control.TakeWritabilityChanges(&changes);
+  EXPECT_TRUE(changes.empty());
+
+  PostMessages(&flow_control, 1, high - 1, 10);
+  flow_control.TakeWritabilityChanges(&changes);
+  ASSERT_EQ(1u, changes.size());
+  EXPECT_EQ(1, changes[0].first);
+  EXPECT_FALSE(changes[0].second);
+
+  // Each round gives back the credits of all the messages in flight.
+  std::vector<std::string> msgs;
+  int pending = high + 9;
+  while (pending > low) {
+    flow_control.TakeWritabilityChanges(&changes);
+    EXPECT_TRUE(changes.empty());
+    msgs.clear();
+    flow_control.OnMessagesHandled(1, XWalkExtensionFlowControl::kCredits,
+                                   &msgs);
+    pending -= XWalkExtensionFlowControl::kCredits;
+  }
+  flow_control.TakeWritabilityChanges(&changes);
+  ASSERT_EQ(1u, changes.size());
+  EXPECT_TRUE(changes[0].second);
+}
+
+TEST(XWalkExtensionFlowControlTest, CoalescingKeepsLatestMessage) {
+  XWalkExtensionFlowControl flow_control;
+  const int credits = XWalkExtensionFlowControl::kCredits;
+  PostMessages(&flow_control, 1, 0, credits + 5);
+  flow_control.SetCoalesceMessages(1, true);
+  EXPECT_EQ(1u, flow_control.GetWaitingMessagesCountForTesting(1));
+
+  PostMessages(&flow_control, 1, credits + 5, 3);
+  EXPECT_EQ(1u, flow_control.GetWaitingMessagesCountForTesting(1));
+
+  std::vector<std::string> msgs;
+  flow_control.OnMessagesHandled(1, credits, &msgs);
+  ASSERT_EQ(1u, msgs.size());
+  EXPECT_EQ(base::IntToString(credits + 7), msgs[0]);
+
+  flow_control.RemoveInstance(1);
+  EXPECT_EQ(0u, flow_control.GetWaitingMessagesCountForTesting(1));
+}
+
+TEST(XWalkExtensionFlowControlTest, HighPriorityIsKeptUntilRemoved) {
+  XWalkExtensionFlowControl flow_control;
+  EXPECT_FALSE(flow_control.IsHighPriority(1));
+  flow_control.SetHighPriority(1, true);
+  EXPECT_TRUE(flow_control.IsHighPriority(1));
+
+  // Even once all its messages were handled.
+  EXPECT_EQ(1, PostMessages(&flow_control, 1, 0, 1));
+  std::vector<std::string> msgs;
+  flow_control.OnMessagesHandled(1, 1, &msgs);
+  EXPECT_TRUE(flow_control.IsHighPriority(1));
+
+  flow_control.SetHighPriority(1, false);
+  EXPECT_FALSE(flow_control.IsHighPriority(1));
+
+  flow_control.SetHighPriority(1, true);
+  flow_control.RemoveInstance(1);
+  EXPECT_FALSE(flow_control.IsHighPriority(1));
+  flow_control.SetHighPriority(1, true);
+  EXPECT_FALSE(flow_control.IsHighPriority(1));
+}
+
+TEST(XWalkExtensionFlowControlTest, WaitingMessagesCanBeTakenPastCredits) {
+  XWalkExtensionFlowControl flow_control;
+  const int credits = XWalkExtensionFlowControl::kCredits;
+  EXPECT_EQ(credits, PostMessages(&flow_control, 1, 0, credits + 3));
+
+  // Taken in order, and counted as in flight.
+  std::vector<std::string> msgs;
+  flow_control.TakeWaitingMessages(1, &msgs);
+  ASSERT_EQ(3u, msgs.size());
+  for (int i = 0; i < 3; ++i)
+    EXPECT_EQ(base::IntToString(credits + i), msgs[i]);
+  EXPECT_EQ(0u, flow_control.GetWaitingMessagesCountForTesting(1));
+
+  // Credits come back for all of them before new messages can be sent.
+  msgs.clear();
+  flow_control.OnMessagesHandled(1, 3, &msgs);
+  EXPECT_EQ(0, PostMessages(&flow_control, 1, credits + 3, 1));
+  flow_control.OnMessagesHandled(1, 1, &msgs);
+  ASSERT_EQ(1u, msgs.size());
+  EXPECT_EQ(base::IntToString(credits + 3), msgs[0]);
+}
+
+TEST(XWalkExtensionFlowControlTest, WaitingMessagesAreLimited) {
+  XWalkExtensionFlowControl flow_control;
+  const int credits = XWalkExtensionFlowControl::kCredits;
+  const int max_waiting = XWalkExtensionFlowControl::kMaxWaitingMessages;
+
+  // Posting past the limit drops the new messages.
+  EXPECT_EQ(credits,
+            PostMessages(&flow_control, 1, 0, credits + max_waiting + 10));
+  EXPECT_EQ(static_cast<size_t>(max_waiting),
+            flow_control.GetWaitingMessagesCountForTesting(1));
+
+  // The messages kept are the oldest ones, and posting works again once
+  // there is room.
+  std::vector<std::string> msgs;
+  flow_control.OnMessagesHandled(1, 1, &msgs);
+  ASSERT_EQ(1u, msgs.size());
+  EXPECT_EQ(base::IntToString(credits), msgs[0]);
+  EXPECT_EQ(0, PostMessages(&flow_control, 1, 0, 2));
+  EXPECT_EQ(static_cast<size_t>(max_waiting),
+            flow_control.GetWaitingMessagesCountForTesting(1));
+}
+
+TEST(XWalkExtensionFlowControlTest, RemovedInstanceIsIgnored) {
+  XWalkExtensionFlowControl flow_control;
+  XWalkExtensionFlowControl::WritabilityChanges changes;
+  const int high = XWalkExtensionFlowControl::kHighWaterMark;
+  PostMessages(&flow_control, 1, 0, high);
+  flow_control.RemoveInstance(1);
+  flow_control.TakeWritabilityChanges(&changes);
+
+  // Messages flushed after the instance was removed are dropped, and don't
+  // bring its state back.
+  EXPECT_EQ(0, PostMessages(&flow_control, 1, high, high));
+  EXPECT_EQ(0u, flow_control.GetWaitingMessagesCountForTesting(1));
+  flow_control.SetCoalesceMessages(1, true);
+  EXPECT_EQ(0, PostMessages(&flow_control, 1, 2 * high, 1));
+
+  // So do the credits given back for the messages sent before.
+  std::vector<std::string> msgs;
+  flow_control.OnMessagesHandled(1, XWalkExtensionFlowControl::kCredits,
+                                 &msgs);
+  EXPECT_TRUE(msgs.empty());
+  flow_control.TakeWritabilityChanges(&changes);
+  EXPECT_TRUE(changes.empty());
+
+  EXPECT_EQ(1, PostMessages(&flow_control, 2, 0, 1));
+
+  // Once nothing can arrive for it anymore, the instance isn't remembered.
+  EXPECT_EQ(1u, flow_control.GetRemovedInstancesCountForTesting());
+  flow_control.ForgetRemovedInstances();
+  EXPECT_EQ(0u, flow_control.GetRemovedInstancesCountForTesting());
+}
+
+TEST(XWalkExtensionFlowControlTest, StreamsHaveWindowOfBytes) {
+  XWalkExtensionFlowControl flow_control;
+  const size_t window = XWalkExtensionFlowControl::kStreamWindowBytes;
+  ASSERT_TRUE(flow_control.OpenStream(1, 1));
+  ASSERT_TRUE(flow_control.OpenStream(1, 2));
+  ASSERT_TRUE(flow_control.OpenStream(2, 1));
+  EXPECT_TRUE(flow_control.WriteStream(1, 1, window - 1));
+  EXPECT_TRUE(flow_control.WriteStream(1, 1, 10));
+  EXPECT_FALSE(flow_control.WriteStream(1, 1, 10));
+
+  // Other streams have their own window.
+  EXPECT_TRUE(flow_control.WriteStream(1, 2, window));
+  EXPECT_TRUE(flow_control.WriteStream(2, 1, window));
+
+  // Writable again once below the window.
+  EXPECT_FALSE(flow_control.OnStreamDataHandled(1, 1, 9));
+  EXPECT_TRUE(flow_control.OnStreamDataHandled(1, 1, 1));
+  EXPECT_FALSE(flow_control.OnStreamDataHandled(1, 1, 1));
+  EXPECT_TRUE(flow_control.WriteStream(1, 1, 10));
+
+  flow_control.RemoveInstance(1);
+  EXPECT_FALSE(flow_control.WriteStream(2, 1, 1));
+  EXPECT_FALSE(flow_control.WriteStream(1, 2, 1));
+}
+
+TEST(XWalkExtensionFlowControlTest, OnlyOpenStreamsCanBeWritten) {
+  XWalkExtensionFlowControl flow_control;
+  EXPECT_FALSE(flow_control.WriteStream(1, 1, 1));
+  EXPECT_FALSE(flow_control.RemoveStream(1, 1));
+
+  EXPECT_TRUE(flow_control.OpenStream(1, 1));
+  EXPECT_FALSE(flow_control.OpenStream(1, 1));
+  EXPECT_TRUE(flow_control.WriteStream(1, 1, 1));
+
+  // Closing drops the state of the stream, data handled late is ignored.
+  EXPECT_TRUE(flow_control.RemoveStream(1, 1));
+  EXPECT_FALSE(flow_control.WriteStream(1, 1, 1));
+  EXPECT_FALSE(flow_control.OnStreamDataHandled(1, 1, 1));
+  EXPECT_FALSE(flow_control.RemoveStream(1, 1));
+
+  flow_control.RemoveInstance(2);
+  EXPECT_FALSE(flow_control.OpenStream(2, 1));
+}
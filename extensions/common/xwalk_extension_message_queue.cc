@@ -0,0 +1,138 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_message_queue.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+template <typename T>
+base::subtle::AtomicWord ToAtomicWord(T* pointer) {
+  return reinterpret_cast<base::subtle::AtomicWord>(pointer);
+}
+
+}  // namespace
+
+XWalkExtensionMessageQueue::Stats::Stats()
+    : pushes(0),
+      concurrent_pushes(0),
+      batches(0),
+      incomplete_pops(0) {}
+
+XWalkExtensionMessageQueue::XWalkExtensionMessageQueue()
+    : head_(ToAtomicWord(&stub_)),
+      tail_(&stub_),
+      size_(0),
+      pushes_in_progress_(0),
+      pushes_(0),
+      concurrent_pushes_(0),
+      batches_(0),
+      incomplete_pops_(0) {
+  stub_.next = 0;
+  stub_.instance_id = 0;
+}
+
+XWalkExtensionMessageQueue::~XWalkExtensionMessageQueue() {
+  // No producer is left, so every node is reachable.
+  while (Node* node = PopNode())
+    delete node;
+}
+
+void XWalkExtensionMessageQueue::PushNode(Node* node) {
+  base::subtle::NoBarrier_Store(&node->next, 0);
+  // The next producer links to |node| as soon as it swaps the head, so
+  // clearing the link must be visible before.
+  base::subtle::MemoryBarrier();
+  Node* previous = reinterpret_cast<Node*>(
+      base::subtle::NoBarrier_AtomicExchange(&head_, ToAtomicWord(node)));
+  // Publishes |node| and its contents to the consumer.
+  base::subtle::Release_Store(&previous->next, ToAtomicWord(node));
+}
+
+XWalkExtensionMessageQueue::Node* XWalkExtensionMessageQueue::PopNode() {
+  Node* tail = tail_;
+  Node* next = reinterpret_cast<Node*>(base::subtle::Acquire_Load(&tail->next));
+
+  if (tail == &stub_) {
+    if (!next)
+      return NULL;
+    tail_ = next;
+    tail = next;
+    next = reinterpret_cast<Node*>(base::subtle::Acquire_Load(&tail->next));
+  }
+
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+
+  // |tail| is the last reachable node. It can only be taken if it's also the
+  // head, otherwise a push is in progress and must be completed first.
+  if (tail != reinterpret_cast<Node*>(base::subtle::Acquire_Load(&head_)))
+    return NULL;
+
+  // The stub takes the place of |tail|, so it can be unlinked.
+  PushNode(&stub_);
+  next = reinterpret_cast<Node*>(base::subtle::Acquire_Load(&tail->next));
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  return NULL;
+}
+
+bool XWalkExtensionMessageQueue::Push(int64_t instance_id, std::string* msg) {
+  if (base::subtle::Barrier_AtomicIncrement(&pushes_in_progress_, 1) > 1)
+    base::subtle::NoBarrier_AtomicIncrement(&concurrent_pushes_, 1);
+  base::subtle::NoBarrier_AtomicIncrement(&pushes_, 1);
+
+  Node* node = new Node;
+  node->instance_id = instance_id;
+  node->msg.swap(*msg);
+
+  const bool was_empty =
+      base::subtle::Barrier_AtomicIncrement(&size_, 1) == 1;
+  PushNode(node);
+
+  base::subtle::Barrier_AtomicIncrement(&pushes_in_progress_, -1);
+  return was_empty;
+}
+
+bool XWalkExtensionMessageQueue::Pop(size_t max_messages,
+                                     std::vector<int64_t>* instance_ids,
+                                     std::vector<std::string>* msgs) {
+  int32_t count = 0;
+  while (static_cast<size_t>(count) < max_messages) {
+    Node* node = PopNode();
+    if (!node)
+      break;
+    instance_ids->push_back(node->instance_id);
+    msgs->push_back(std::string());
+    msgs->back().swap(node->msg);
+    delete node;
+    count++;
+  }
+
+  if (count > 0)
+    base::subtle::NoBarrier_AtomicIncrement(&batches_, 1);
+
+  const int32_t left = base::subtle::Barrier_AtomicIncrement(&size_, -count);
+  if (left > 0 && static_cast<size_t>(count) < max_messages)
+    base::subtle::NoBarrier_AtomicIncrement(&incomplete_pops_, 1);
+  return left > 0;
+}
+
+XWalkExtensionMessageQueue::Stats XWalkExtensionMessageQueue::GetStats() const {
+  Stats stats;
+  stats.pushes = base::subtle::NoBarrier_Load(&pushes_);
+  stats.concurrent_pushes = base::subtle::NoBarrier_Load(&concurrent_pushes_);
+  stats.batches = base::subtle::NoBarrier_Load(&batches_);
+  stats.incomplete_pops = base::subtle::NoBarrier_Load(&incomplete_pops_);
+  return stats;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
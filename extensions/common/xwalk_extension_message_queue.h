@@ -0,0 +1,95 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGE_QUEUE_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGE_QUEUE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Queue of the messages posted to JavaScript by the instances, which may post
+// from any thread. Pushing never blocks: producers only swap a pointer, so
+// they don't wait for each other nor for the thread sending the messages.
+// Messages are taken in batches by a single consumer at a time, the caller
+// is responsible for serializing the calls to Pop().
+//
+// This is an intrusive multi-producer single-consumer linked list. A push
+// first swaps the head and then links the previous head to the new node, so
+// for a moment a pushed node may not be reachable yet.
+class XWalkExtensionMessageQueue {
+ public:
+  // Counters to tell how much producers overlap. They are only statistics:
+  // updated without ordering and wrapping around on overflow.
+  struct Stats {
+    Stats();
+
+    int32_t pushes;
+    // Pushes that happened while another push was in progress, which would
+    // have waited on each other with a lock.
+    int32_t concurrent_pushes;
+    // Calls to Pop() that took at least one message.
+    int32_t batches;
+    // Calls to Pop() that found a message still being pushed, so the caller
+    // had to try again later.
+    int32_t incomplete_pops;
+  };
+
+  XWalkExtensionMessageQueue();
+  ~XWalkExtensionMessageQueue();
+
+  // Takes the contents of |msg|. Can be called from any thread. Returns true
+  // if the queue was empty, in that case the caller is responsible for
+  // scheduling a Pop().
+  bool Push(int64_t instance_id, std::string* msg);
+
+  // Appends up to |max_messages| messages to |instance_ids| and |msgs|, in
+  // the order they were pushed by each thread. Returns true if messages are
+  // left in the queue, either because there are more than |max_messages| or
+  // because some are still being pushed, so Pop() must be called again.
+  bool Pop(size_t max_messages, std::vector<int64_t>* instance_ids,
+           std::vector<std::string>* msgs);
+
+  Stats GetStats() const;
+
+ private:
+  struct Node {
+    base::subtle::AtomicWord next;
+    int64_t instance_id;
+    std::string msg;
+  };
+
+  void PushNode(Node* node);
+  Node* PopNode();
+
+  // Last pushed node, written by the producers.
+  base::subtle::AtomicWord head_;
+  // Oldest node, only used by the consumer.
+  Node* tail_;
+  // Placeholder keeping the list non-empty, so producers and the consumer
+  // don't touch the same pointer when there is a single message.
+  Node stub_;
+
+  // Messages pushed and not popped yet. Incremented before the node is
+  // linked, so it's never smaller than the number of reachable nodes.
+  base::subtle::Atomic32 size_;
+
+  base::subtle::Atomic32 pushes_in_progress_;
+  base::subtle::Atomic32 pushes_;
+  base::subtle::Atomic32 concurrent_pushes_;
+  base::subtle::Atomic32 batches_;
+  base::subtle::Atomic32 incomplete_pops_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionMessageQueue);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGE_QUEUE_H_
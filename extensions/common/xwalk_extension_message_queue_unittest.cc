@@ -0,0 +1,94 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_message_queue.h"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/simple_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionMessageQueue;
+
+namespace {
+
+const int kProducerCount = 4;
+const int kMessagesPerProducer = 10000;
+
+class Producer : public base::DelegateSimpleThread::Delegate {
+ public:
+  Producer(XWalkExtensionMessageQueue* queue, int64_t id)
+      : queue_(queue), id_(id) {}
+
+  virtual void Run() OVERRIDE {
+    for (int i = 0; i < kMessagesPerProducer; ++i) {
+      std::string msg = base::IntToString(i);
+      queue_->Push(id_, &msg);
+    }
+  }
+
+ private:
+  XWalkExtensionMessageQueue* queue_;
+  int64_t id_;
+};
+
+}  // namespace
+
+TEST(XWalkExtensionMessageQueueTest, PushSchedulesOnlyWhenEmpty) {
+  XWalkExtensionMessageQueue queue;
+  std::string first = "first";
+  std::string second = "second";
+  EXPECT_TRUE(queue.Push(1, &first));
+  EXPECT_TRUE(first.empty());
+  EXPECT_FALSE(queue.Push(2, &second));
+
+  std::vector<int64_t> instance_ids;
+  std::vector<std::string> msgs;
+  EXPECT_TRUE(queue.Pop(1, &instance_ids, &msgs));
+  EXPECT_FALSE(queue.Pop(1, &instance_ids, &msgs));
+  ASSERT_EQ(2u, msgs.size());
+  EXPECT_EQ(1, instance_ids[0]);
+  EXPECT_EQ("first", msgs[0]);
+  EXPECT_EQ(2, instance_ids[1]);
+  EXPECT_EQ("second", msgs[1]);
+
+  std::string third = "third";
+  EXPECT_TRUE(queue.Push(3, &third));
+}
+
+TEST(XWalkExtensionMessageQueueTest, ManyProducers) {
+  XWalkExtensionMessageQueue queue;
+  ScopedVector<Producer> producers;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 0; i < kProducerCount; ++i) {
+    producers.push_back(new Producer(&queue, i));
+    threads.push_back(
+        new base::DelegateSimpleThread(producers[i], "ExtensionProducer"));
+    threads[i]->Start();
+  }
+
+  // Messages of each producer must arrive in the order they were pushed.
+  std::vector<int> next_message(kProducerCount, 0);
+  int received = 0;
+  while (received < kProducerCount * kMessagesPerProducer) {
+    std::vector<int64_t> instance_ids;
+    std::vector<std::string> msgs;
+    queue.Pop(64, &instance_ids, &msgs);
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      ASSERT_EQ(next_message[instance_ids[i]], atoi(msgs[i].c_str()));
+      next_message[instance_ids[i]]++;
+      received++;
+    }
+  }
+
+  for (int i = 0; i < kProducerCount; ++i)
+    threads[i]->Join();
+
+  XWalkExtensionMessageQueue::Stats stats = queue.GetStats();
+  EXPECT_EQ(kProducerCount * kMessagesPerProducer, stats.pushes);
+  EXPECT_LE(stats.concurrent_pushes, stats.pushes);
+}
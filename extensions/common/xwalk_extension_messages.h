@@ -4,7 +4,8 @@
 
 #include <stdint.h>
 #include <string>
-#include "base/values.h"
+#include <vector>
+#include "base/memory/shared_memory.h"
 #include "ipc/ipc_channel_handle.h"
 #include "ipc/ipc_message_macros.h"
 
@@ -20,9 +21,32 @@ enum {
 #define IPC_MESSAGE_START XWalkExtensionMsgStart
 
 IPC_MESSAGE_CONTROL1(XWalkExtensionProcessMsg_RegisterExtensions,  // NOLINT(*)
-                     base::FilePath /* extensions path */)
+                     std::vector<base::FilePath> /* extension libraries */)
 
-IPC_MESSAGE_CONTROL1(XWalkExtensionProcessHostMsg_RenderProcessChannelCreated, // NOLINT(*)
+// Asks the extension process for a new channel to be used by the given render
+// process. The handle of the channel is sent back to the browser with
+// XWalkExtensionProcessHostMsg_RenderProcessChannelCreated.
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessMsg_CreateRenderProcessChannel,  // NOLINT(*)
+                     int /* render process id */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessMsg_CloseRenderProcessChannel,  // NOLINT(*)
+                     int /* render process id */)
+
+// Asks the extension process for a channel that isn't used by any render
+// process yet. The handle is sent back to the browser with
+// XWalkExtensionProcessHostMsg_SpareRenderProcessChannelCreated, so the next
+// render process gets a channel without waiting for the extension process.
+IPC_MESSAGE_CONTROL0(XWalkExtensionProcessMsg_CreateSpareRenderProcessChannel)  // NOLINT(*)
+
+// Gives the spare channel to the given render process.
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessMsg_AssignSpareRenderProcessChannel,  // NOLINT(*)
+                     int /* render process id */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionProcessHostMsg_RenderProcessChannelCreated, // NOLINT(*)
+                     int /* render process id */,
+                     IPC::ChannelHandle /* channel id */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessHostMsg_SpareRenderProcessChannelCreated, // NOLINT(*)
                      IPC::ChannelHandle /* channel id */)
 
 IPC_MESSAGE_CONTROL1(XWalkViewMsg_ExtensionProcessChannelCreated, // NOLINT(*)
@@ -34,30 +58,149 @@ IPC_MESSAGE_CONTROL1(XWalkViewMsg_ExtensionProcessChannelCreated, // NOLINT(*)
 #undef IPC_MESSAGE_START
 #define IPC_MESSAGE_START XWalkExtensionClientServerMsgStart
 
-IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_RegisterExtension,  // NOLINT(*)
-                     std::string /* extension */,
-                     std::string /* JS API code for extension */)
+// Registers all the extensions of a server at once. The JS API code of the
+// extensions is stored one after the other in the shared memory, with the
+// given sizes, so the client only needs to copy the code it hasn't seen yet.
+// It recognizes the code by its SHA-1 hash.
+IPC_MESSAGE_CONTROL4(XWalkExtensionClientMsg_RegisterExtensions,  // NOLINT(*)
+                     std::vector<std::string> /* extension names */,
+                     std::vector<std::string> /* JS API code hashes */,
+                     std::vector<uint32> /* JS API code sizes */,
+                     base::SharedMemoryHandle /* JS API code for all */)
 
 
 IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_CreateInstance,  // NOLINT(*)
                      int64_t /* instance id */,
                      std::string /* extension name */)
 
+// Creates several instances at once, the i-th instance id is for the i-th
+// extension name.
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_CreateInstances,  // NOLINT(*)
+                     std::vector<int64_t> /* instance ids */,
+                     std::vector<std::string> /* extension names */)
+
+// The contents of the messages exchanged with the instances are encoded with
+// XWalkExtensionWireWriter.
 IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_PostMessageToNative,  // NOLINT(*)
                      int64_t /* instance id */,
-                     base::ListValue /* contents */)
+                     std::string /* contents */)
 
 IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_PostMessageToJS,  // NOLINT(*)
                      int64_t /* instance id */,
-                     base::ListValue /* contents */)
+                     std::string /* contents */)
+
+// Batched versions of the messages above, sent when more than one message was
+// posted during the same task. The i-th message in the list is for the i-th
+// instance id, and they are handled in order.
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_PostMessagesToNative,  // NOLINT(*)
+                     std::vector<int64_t> /* instance ids */,
+                     std::vector<std::string> /* contents */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_PostMessagesToJS,  // NOLINT(*)
+                     std::vector<int64_t> /* instance ids */,
+                     std::vector<std::string> /* contents */)
 
 IPC_SYNC_MESSAGE_CONTROL2_1(XWalkExtensionServerMsg_SendSyncMessageToNative,  // NOLINT(*)
                             int64_t /* instance id */,
-                            base::ListValue /* input contents */,
-                            base::ListValue /* output contents */)
+                            std::string /* input contents */,
+                            std::string /* output contents */)
 
 IPC_MESSAGE_CONTROL1(XWalkExtensionServerMsg_DestroyInstance,  // NOLINT(*)
                      int64_t /* instance id */)
 
 IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_InstanceDestroyed,  // NOLINT(*)
                      int64_t /* instance id */)
+
+// Gives back to the server the credits of the messages posted to JavaScript
+// by the instance that the client already handled, see
+// XWalkExtensionFlowControl.
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_MessagesHandled,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* count */)
+
+// Messages posted to JavaScript by high priority instances are sent ahead of
+// the ones other instances posted before them.
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_SetHighPriority,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     bool /* high priority */)
+
+// Streams carry data in chunks encoded with XWalkExtensionWireWriter. Streams
+// opened by JavaScript and by the instances have ids of their own. The
+// receiver tells how many bytes of each chunk it handled, so the writer never
+// has more than XWalkExtensionFlowControl::kStreamWindowBytes in flight.
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_OpenStreamToNative,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionServerMsg_StreamDataToNative,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */,
+                     std::string /* chunk */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_CloseStreamToNative,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_StreamDataHandled,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */,
+                     uint32 /* size */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_OpenStreamToJS,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_StreamDataToJS,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */,
+                     std::string /* chunk */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_CloseStreamToJS,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionServerMsg_StreamDataHandled,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* stream id */,
+                     uint32 /* size */)
+
+// Shares a buffer with JavaScript, which maps it instead of copying its
+// contents. The instance must not touch it until the client releases it.
+IPC_MESSAGE_CONTROL4(XWalkExtensionClientMsg_SharedBufferToJS,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* buffer id */,
+                     base::SharedMemoryHandle /* buffer */,
+                     uint32 /* size */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_SharedBufferReleased,  // NOLINT(*)
+                     int64_t /* instance id */,
+                     int32 /* buffer id */)
+
+// Messages used to setup and drive XWalkExtensionSharedTransport. The server
+// only writes to the transport after the client confirms it was mapped. The
+// DataAvailable messages are sent when the consumer side of a ring is parked
+// and new messages were written to it.
+IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_SharedTransportCreated,  // NOLINT(*)
+                     base::SharedMemoryHandle /* client incoming ring */,
+                     base::SharedMemoryHandle /* client outgoing ring */)
+
+IPC_MESSAGE_CONTROL0(XWalkExtensionServerMsg_SharedTransportMapped)  // NOLINT(*)
+
+IPC_MESSAGE_CONTROL0(XWalkExtensionClientMsg_SharedTransportDataAvailable)  // NOLINT(*)
+
+IPC_MESSAGE_CONTROL0(XWalkExtensionServerMsg_SharedTransportDataAvailable)  // NOLINT(*)
+
+// Sent through the IPC channel after a message that couldn't go through the
+// transport. The producer keeps using the channel until the consumer echoes
+// the sequence back, meaning it handled all the messages sent before.
+IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_SharedTransportPaused,  // NOLINT(*)
+                     uint32 /* sequence */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionServerMsg_SharedTransportPauseAcknowledged,  // NOLINT(*)
+                     uint32 /* sequence */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionServerMsg_SharedTransportPaused,  // NOLINT(*)
+                     uint32 /* sequence */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_SharedTransportPauseAcknowledged,  // NOLINT(*)
+                     uint32 /* sequence */)
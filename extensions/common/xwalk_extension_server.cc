@@ -4,41 +4,198 @@
 
 #include "xwalk/extensions/common/xwalk_extension_server.h"
 
+#include <algorithm>
+
+#include "base/atomic_ref_count.h"
+#include "base/debug/trace_event.h"
 #include "base/file_util.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/lazy_instance.h"
+#include "base/location.h"
+#include "base/memory/shared_memory.h"
+#include "base/process_util.h"
+#include "base/sha1.h"
+#include "base/stl_util.h"
 #include "base/strings/string16.h"
 #include "base/strings/utf_string_conversions.h"
-#include "base/stl_util.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "content/public/browser/render_process_host.h"
 #include "ipc/ipc_sender.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_shared_transport.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Maximum number of messages posted by the instances that are sent to the
+// client in a single IPC message.
+const size_t kMaxBatchedMessages = 64;
+
+const size_t kMaxWorkerPoolThreads = 4;
+
+// Runs the instances of WORKER_POOL extensions. Each instance gets its own
+// sequence, so its messages are still handled in order. Their tasks block
+// shutdown, so the tasks deleting the instances always run.
+class ExtensionWorkerPool {
+ public:
+  ExtensionWorkerPool()
+      : pool_(new base::SequencedWorkerPool(kMaxWorkerPoolThreads,
+                                            "XWalkExtensionWorker")) {}
+
+  scoped_refptr<base::SequencedTaskRunner> CreateSequence() {
+    return pool_->GetSequencedTaskRunnerWithShutdownBehavior(
+        pool_->GetSequenceToken(), base::SequencedWorkerPool::BLOCK_SHUTDOWN);
+  }
+
+  bool PostTask(const base::Closure& task) {
+    return pool_->PostWorkerTask(FROM_HERE, task);
+  }
+
+ private:
+  scoped_refptr<base::SequencedWorkerPool> pool_;
+};
+
+base::LazyInstance<ExtensionWorkerPool>::Leaky g_worker_pool =
+    LAZY_INSTANCE_INITIALIZER;
+
+void RunInstanceTask(scoped_refptr<base::SequencedTaskRunner> task_runner,
+                     const base::Closure& task) {
+  if (task_runner->RunsTasksOnCurrentThread())
+    task.Run();
+  else
+    task_runner->PostTask(FROM_HERE, task);
+}
+
+// The instance is owned by the task, so it's deleted once the task runs, or
+// along with the task if it's dropped instead.
+void DeleteOwnedInstance(XWalkExtensionInstance* instance) {}
+
+}  // namespace
+
 XWalkExtensionServer::XWalkExtensionServer()
-    : sender_(NULL) {}
+    : sender_(NULL),
+      peer_process_(base::kNullProcessHandle),
+      register_when_connected_(false),
+      shared_transport_mapped_(false),
+      route_in_server_thread_(false),
+      next_sync_reply_token_(1) {}
 
 XWalkExtensionServer::~XWalkExtensionServer() {
-  DeleteInstanceMap();
-  STLDeleteValues(&extensions_);
+  if (peer_process_ != base::kNullProcessHandle)
+    base::CloseProcessHandle(peer_process_);
 }
 
 bool XWalkExtensionServer::OnMessageReceived(const IPC::Message& message) {
+  // Messages written to the shared transport before |message| was sent must
+  // be handled first to preserve ordering.
+  ReceiveFromSharedTransport();
+  return OnMessageReceivedInternal(message);
+}
+
+void XWalkExtensionServer::RouteMessageFromIOThread(
+    const IPC::Message& message) {
+  // Once the client uses the shared transport, the messages read from it must
+  // be ordered with the ones received here, so everything goes through the
+  // thread of the server, which reads the transport.
+  bool route_in_server_thread;
+  {
+    base::AutoLock l(instances_lock_);
+    if (message.type() == XWalkExtensionServerMsg_SharedTransportMapped::ID)
+      route_in_server_thread_ = true;
+    route_in_server_thread = route_in_server_thread_;
+  }
+
+  if (route_in_server_thread || message.type() ==
+      XWalkExtensionServerMsg_SharedTransportDataAvailable::ID) {
+    task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(base::IgnoreResult(&XWalkExtensionServer::OnMessageReceived),
+                   this, message));
+    return;
+  }
+
+  OnMessageReceivedInternal(message);
+}
+
+void XWalkExtensionServer::SetIOTaskRunner(
+    scoped_refptr<base::SequencedTaskRunner> io_task_runner) {
+  io_task_runner_ = io_task_runner;
+}
+
+scoped_refptr<base::SequencedTaskRunner>
+XWalkExtensionServer::GetTaskRunnerForExtension(XWalkExtension* extension) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner;
+  switch (extension->threading_model()) {
+    case XWalkExtension::DEDICATED_THREAD:
+      task_runner = extension->GetDedicatedTaskRunner();
+      break;
+    case XWalkExtension::WORKER_POOL:
+      task_runner = g_worker_pool.Get().CreateSequence();
+      break;
+    case XWalkExtension::IO_THREAD:
+      task_runner = io_task_runner_;
+      break;
+    case XWalkExtension::SHARED_THREAD:
+      break;
+  }
+  return task_runner ? task_runner : task_runner_;
+}
+
+scoped_refptr<base::SequencedTaskRunner>
+XWalkExtensionServer::GetTaskRunnerForInstance(int64_t instance_id) {
+  base::AutoLock l(instances_lock_);
+  TaskRunnerMap::const_iterator it = instance_task_runners_.find(instance_id);
+  if (it == instance_task_runners_.end())
+    return NULL;
+  return it->second;
+}
+
+bool XWalkExtensionServer::OnMessageReceivedInternal(
+    const IPC::Message& message) {
   bool handled = true;
   IPC_BEGIN_MESSAGE_MAP(XWalkExtensionServer, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_SharedTransportMapped,
+        OnSharedTransportMapped)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_SharedTransportDataAvailable,
+        OnSharedTransportDataAvailable)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_SharedTransportPaused,
+        OnSharedTransportPaused)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionServerMsg_SharedTransportPauseAcknowledged,
+        OnSharedTransportPauseAcknowledged)
     IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_CreateInstance,
         OnCreateInstance)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_CreateInstances,
+        OnCreateInstances)
     IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_DestroyInstance,
         OnDestroyInstance)
     IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostMessageToNative,
         OnPostMessageToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostMessagesToNative,
+        OnPostMessagesToNative)
     IPC_MESSAGE_HANDLER_DELAY_REPLY(
         XWalkExtensionServerMsg_SendSyncMessageToNative,
         OnSendSyncMessageToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_MessagesHandled,
+        OnMessagesHandled)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_SetHighPriority,
+        OnSetHighPriority)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_OpenStreamToNative,
+        OnOpenStreamToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_StreamDataToNative,
+        OnStreamDataToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_CloseStreamToNative,
+        OnCloseStreamToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_StreamDataHandled,
+        OnStreamDataHandled)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_SharedBufferReleased,
+        OnSharedBufferReleased)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
 
@@ -55,55 +212,556 @@ void XWalkExtensionServer::OnCreateInstance(int64_t instance_id,
     return;
   }
 
-  XWalkExtensionInstance* instance = it->second->CreateInstance();
+  // The task runner is chosen when routing, so the messages routed right
+  // after this one follow the instance.
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForExtension(it->second);
+  {
+    base::AutoLock l(instances_lock_);
+    if (instance_task_runners_.find(instance_id) !=
+        instance_task_runners_.end()) {
+      LOG(WARNING) << "Can't create instance with existing id: "
+                   << instance_id;
+      return;
+    }
+    instance_task_runners_[instance_id] = task_runner;
+  }
+
+  RunInstanceTask(task_runner,
+                  base::Bind(&XWalkExtensionServer::CreateInstance,
+                             this, instance_id, it->second));
+}
+
+void XWalkExtensionServer::CreateInstance(int64_t instance_id,
+                                          XWalkExtension* extension) {
+  {
+    // DeleteInstances() may have run since the creation was routed, the
+    // extension may be gone as well then.
+    base::AutoLock l(instances_lock_);
+    if (instance_task_runners_.find(instance_id) ==
+        instance_task_runners_.end())
+      return;
+  }
+
+  XWalkExtensionInstance* instance = extension->CreateInstance();
+  if (!instance) {
+    // Extensions loaded on demand may fail here. Messages for the instance
+    // will be dropped as for an invalid id.
+    LOG(WARNING) << "Couldn't create instance of extension: "
+                 << extension->name();
+    return;
+  }
+
   instance->SetPostMessageCallback(
       base::Bind(&XWalkExtensionServer::PostMessageToJSCallback,
-                 base::Unretained(this), instance_id));
+                 this, instance_id));
+
+  instance->SetPostMessagesCallback(
+      base::Bind(&XWalkExtensionServer::PostMessagesToJSCallback,
+                 this, instance_id));
 
   instance->SetSendSyncReplyCallback(
       base::Bind(&XWalkExtensionServer::SendSyncReplyToJSCallback,
-                 base::Unretained(this), instance_id));
+                 this, instance_id));
+
+  instance->SetCoalesceMessagesCallback(
+      base::Bind(&XWalkExtensionServer::CoalesceMessagesCallback,
+                 this, instance_id));
+
+  instance->SetStreamToJSCallback(
+      base::Bind(&XWalkExtensionServer::StreamToJSCallback,
+                 this, instance_id));
+
+  instance->SetSharedBufferToJSCallback(
+      base::Bind(&XWalkExtensionServer::SharedBufferToJSCallback,
+                 this, instance_id));
+
+  {
+    base::AutoLock l(instances_lock_);
+    if (instance_task_runners_.find(instance_id) !=
+        instance_task_runners_.end()) {
+      instances_[instance_id].instance = instance;
+      return;
+    }
+  }
+
+  // The instances were deleted while this one was being created.
+  delete instance;
+}
+
+void XWalkExtensionServer::OnCreateInstances(
+    const std::vector<int64_t>& instance_ids,
+    const std::vector<std::string>& names) {
+  if (instance_ids.size() != names.size()) {
+    LOG(WARNING) << "Ignoring creation of " << instance_ids.size()
+                 << " instances for " << names.size() << " extensions.";
+    return;
+  }
 
-  InstanceExecutionData data;
-  data.instance = instance;
-  data.pending_reply = NULL;
+  for (size_t i = 0; i < instance_ids.size(); ++i)
+    OnCreateInstance(instance_ids[i], names[i]);
+}
+
+namespace {
 
-  instances_[instance_id] = data;
+// The const_cast is needed to take the contents of a message parameter. It is
+// safe to do this because |msg| won't be used anywhere else once the handler
+// returns. Saves copying the message, which can be large.
+scoped_ptr<std::string> TakeMessageContents(const std::string& msg) {
+  scoped_ptr<std::string> contents(new std::string);
+  contents->swap(const_cast<std::string&>(msg));
+  return contents.Pass();
 }
 
+}  // namespace
+
 void XWalkExtensionServer::OnPostMessageToNative(int64_t instance_id,
-    const base::ListValue& msg) {
-  InstanceMap::const_iterator it = instances_.find(instance_id);
-  if (it == instances_.end()) {
+    const std::string& msg) {
+  RouteMessageToInstance(instance_id, TakeMessageContents(msg));
+}
+
+void XWalkExtensionServer::OnPostMessagesToNative(
+    const std::vector<int64_t>& instance_ids,
+    const std::vector<std::string>& msgs) {
+  if (instance_ids.size() != msgs.size()) {
+    LOG(WARNING) << "Ignoring batch of messages with " << msgs.size()
+                 << " messages for " << instance_ids.size() << " instances.";
+    return;
+  }
+
+  for (size_t i = 0; i < instance_ids.size(); ++i)
+    RouteMessageToInstance(instance_ids[i], TakeMessageContents(msgs[i]));
+}
+
+void XWalkExtensionServer::RouteMessageToInstance(int64_t instance_id,
+    scoped_ptr<std::string> msg) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner) {
     LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
                  << instance_id;
     return;
   }
 
-  const InstanceExecutionData& data = it->second;
+  RunInstanceTask(task_runner,
+                  base::Bind(&XWalkExtensionServer::HandleMessageForInstance,
+                             this, instance_id, base::Passed(&msg)));
+}
 
-  // The const_cast is needed to remove the only Value contained by the
-  // ListValue (which is solely used as wrapper, since Value doesn't
-  // have param traits for serialization) and we pass the ownership to to
-  // HandleMessage. It is safe to do this because the |msg| won't be used
-  // anywhere else when this function returns. Saves a DeepCopy(), which
-  // can be costly depending on the size of Value.
-  base::Value* value;
-  const_cast<base::ListValue*>(&msg)->Remove(0, &value);
-  data.instance->HandleMessage(scoped_ptr<base::Value>(value));
+void XWalkExtensionServer::HandleMessageForInstance(int64_t instance_id,
+    scoped_ptr<std::string> msg) {
+  XWalkExtensionInstance* instance;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::const_iterator it = instances_.find(instance_id);
+    if (it == instances_.end()) {
+      LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
+                   << instance_id;
+      return;
+    }
+    instance = it->second.instance;
+  }
+
+  // Only tasks running in the task runner of the instance delete it.
+  instance->HandleSerializedMessage(*msg);
+}
+
+void XWalkExtensionServer::OnOpenStreamToNative(int64_t instance_id,
+                                                int32 stream_id) {
+  RouteStreamToInstance(instance_id, XWalkExtensionInstance::OPEN_STREAM,
+                        stream_id, scoped_ptr<std::string>());
 }
 
-void XWalkExtensionServer::Initialize(IPC::Sender* sender) {
+void XWalkExtensionServer::OnStreamDataToNative(int64_t instance_id,
+                                                int32 stream_id,
+                                                const std::string& data) {
+  RouteStreamToInstance(instance_id, XWalkExtensionInstance::WRITE_STREAM,
+                        stream_id, TakeMessageContents(data));
+}
+
+void XWalkExtensionServer::OnCloseStreamToNative(int64_t instance_id,
+                                                 int32 stream_id) {
+  RouteStreamToInstance(instance_id, XWalkExtensionInstance::CLOSE_STREAM,
+                        stream_id, scoped_ptr<std::string>());
+}
+
+void XWalkExtensionServer::RouteStreamToInstance(int64_t instance_id,
+    XWalkExtensionInstance::StreamOperation operation, int32 stream_id,
+    scoped_ptr<std::string> data) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner) {
+    LOG(WARNING) << "Can't use stream of invalid Extension instance id: "
+                 << instance_id;
+    return;
+  }
+
+  RunInstanceTask(task_runner,
+                  base::Bind(&XWalkExtensionServer::HandleStreamForInstance,
+                             this, instance_id, operation, stream_id,
+                             base::Passed(&data)));
+}
+
+void XWalkExtensionServer::HandleStreamForInstance(int64_t instance_id,
+    XWalkExtensionInstance::StreamOperation operation, int32 stream_id,
+    scoped_ptr<std::string> data) {
+  XWalkExtensionInstance* instance;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::const_iterator it = instances_.find(instance_id);
+    if (it == instances_.end()) {
+      LOG(WARNING) << "Can't use stream of invalid Extension instance id: "
+                   << instance_id;
+      return;
+    }
+    instance = it->second.instance;
+  }
+
+  switch (operation) {
+    case XWalkExtensionInstance::OPEN_STREAM:
+      instance->HandleStreamOpened(stream_id);
+      break;
+    case XWalkExtensionInstance::WRITE_STREAM:
+      instance->HandleStreamData(stream_id, *data);
+      // The client sends more data once this one was handled.
+      Send(new XWalkExtensionClientMsg_StreamDataHandled(
+          instance_id, stream_id, static_cast<uint32>(data->size())));
+      break;
+    case XWalkExtensionInstance::CLOSE_STREAM:
+      instance->HandleStreamClosed(stream_id);
+      break;
+  }
+}
+
+void XWalkExtensionServer::OnStreamDataHandled(int64_t instance_id,
+                                               int32 stream_id, uint32 size) {
+  {
+    base::AutoLock l(sender_lock_);
+    if (!flow_control_.OnStreamDataHandled(instance_id, stream_id, size))
+      return;
+  }
+
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner)
+    return;
+  RunInstanceTask(
+      task_runner,
+      base::Bind(&XWalkExtensionServer::NotifyStreamWritableForInstance,
+                 this, instance_id, stream_id));
+}
+
+void XWalkExtensionServer::NotifyStreamWritableForInstance(
+    int64_t instance_id, int32 stream_id) {
+  XWalkExtensionInstance* instance;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end())
+      return;
+    instance = it->second.instance;
+  }
+  instance->NotifyStreamWritableToJS(stream_id);
+}
+
+void XWalkExtensionServer::OnSharedBufferReleased(int64_t instance_id,
+                                                  int32 buffer_id) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner)
+    return;
+  RunInstanceTask(
+      task_runner,
+      base::Bind(&XWalkExtensionServer::NotifySharedBufferReleasedForInstance,
+                 this, instance_id, buffer_id));
+}
+
+void XWalkExtensionServer::NotifySharedBufferReleasedForInstance(
+    int64_t instance_id, int32 buffer_id) {
+  XWalkExtensionInstance* instance;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end())
+      return;
+    instance = it->second.instance;
+  }
+  instance->NotifySharedBufferReleased(buffer_id);
+}
+
+void XWalkExtensionServer::Initialize(IPC::Sender* sender,
+    scoped_refptr<base::SequencedTaskRunner> task_runner) {
   base::AutoLock l(sender_lock_);
   DCHECK(!sender_);
   sender_ = sender;
+  task_runner_ = task_runner;
 }
 
 bool XWalkExtensionServer::Send(IPC::Message* msg) {
   base::AutoLock l(sender_lock_);
-  if (!sender_)
+  FlushPendingMessagesLocked();
+  return SendLocked(msg);
+}
+
+bool XWalkExtensionServer::SendLocked(IPC::Message* msg) {
+  sender_lock_.AssertAcquired();
+  if (!sender_) {
+    delete msg;
     return false;
-  return sender_->Send(msg);
+  }
+
+  if (!shared_transport_mapped_)
+    return sender_->Send(msg);
+
+  if (XWalkExtensionSharedTransport::CanSend(*msg)) {
+    bool wake_up_client = false;
+    if (shared_transport_->Send(*msg, &wake_up_client)) {
+      delete msg;
+      if (wake_up_client)
+        sender_->Send(new XWalkExtensionClientMsg_SharedTransportDataAvailable);
+      return true;
+    }
+  }
+
+  // Synchronous messages and their replies block the sender, so nothing
+  // can overtake them.
+  const bool ordered = !msg->is_sync() && !msg->is_reply();
+  const bool sent = sender_->Send(msg);
+  uint32 sequence;
+  if (ordered && shared_transport_->OnSentThroughChannel(&sequence))
+    sender_->Send(new XWalkExtensionClientMsg_SharedTransportPaused(sequence));
+  return sent;
+}
+
+void XWalkExtensionServer::FlushPendingMessages() {
+  base::AutoLock l(sender_lock_);
+  FlushPendingMessagesLocked();
+}
+
+void XWalkExtensionServer::FlushPendingMessagesLocked() {
+  sender_lock_.AssertAcquired();
+
+  // The whole queue is taken, so the messages of high priority instances
+  // can go ahead of the ones posted before them.
+  std::vector<int64_t> instance_ids;
+  std::vector<std::string> msgs;
+  bool messages_left = true;
+  while (messages_left) {
+    const size_t popped = instance_ids.size();
+    messages_left =
+        pending_messages_.Pop(kMaxBatchedMessages, &instance_ids, &msgs);
+
+    if (instance_ids.size() == popped) {
+      // The messages left are still being pushed, their producers may have
+      // seen a non-empty queue and won't schedule a flush.
+      if (messages_left)
+        ScheduleFlushPendingMessages();
+      break;
+    }
+  }
+
+  // Each instance has a single priority, so its messages stay in order.
+  PostMessagesToJSLocked(instance_ids, &msgs, true);
+  PostMessagesToJSLocked(instance_ids, &msgs, false);
+
+  // Messages of the instances destroyed so far were all posted or dropped,
+  // nothing else can arrive for them.
+  if (!messages_left)
+    flow_control_.ForgetRemovedInstances();
+
+  ScheduleWritabilityUpdatesLocked();
+}
+
+void XWalkExtensionServer::PostMessagesToJSLocked(
+    const std::vector<int64_t>& instance_ids, std::vector<std::string>* msgs,
+    bool high_priority) {
+  // Messages of instances without credits left wait in |flow_control_|.
+  std::vector<int64_t> ids_to_send;
+  std::vector<std::string> msgs_to_send;
+  for (size_t i = 0; i < instance_ids.size(); ++i) {
+    if (flow_control_.IsHighPriority(instance_ids[i]) != high_priority)
+      continue;
+    if (!flow_control_.Post(instance_ids[i], &(*msgs)[i]))
+      continue;
+    ids_to_send.push_back(instance_ids[i]);
+    msgs_to_send.push_back(std::string());
+    msgs_to_send.back().swap((*msgs)[i]);
+    if (msgs_to_send.size() == kMaxBatchedMessages) {
+      SendMessagesToJSLocked(ids_to_send, msgs_to_send);
+      ids_to_send.clear();
+      msgs_to_send.clear();
+    }
+  }
+  SendMessagesToJSLocked(ids_to_send, msgs_to_send);
+}
+
+void XWalkExtensionServer::SendMessagesToJSLocked(
+    const std::vector<int64_t>& instance_ids,
+    const std::vector<std::string>& msgs) {
+  if (instance_ids.empty())
+    return;
+
+  // A single message is sent with the regular message.
+  if (instance_ids.size() == 1) {
+    SendLocked(new XWalkExtensionClientMsg_PostMessageToJS(
+        instance_ids[0], msgs[0]));
+  } else {
+    SendLocked(new XWalkExtensionClientMsg_PostMessagesToJS(
+        instance_ids, msgs));
+  }
+}
+
+void XWalkExtensionServer::ScheduleWritabilityUpdatesLocked() {
+  sender_lock_.AssertAcquired();
+  XWalkExtensionFlowControl::WritabilityChanges changes;
+  flow_control_.TakeWritabilityChanges(&changes);
+  if (changes.empty() || !task_runner_)
+    return;
+  task_runner_->PostTask(
+      FROM_HERE, base::Bind(&XWalkExtensionServer::UpdateWritability,
+                            this, changes));
+}
+
+void XWalkExtensionServer::UpdateWritability(
+    const XWalkExtensionFlowControl::WritabilityChanges& changes) {
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const int64_t instance_id = changes[i].first;
+    const bool writable = changes[i].second;
+    scoped_refptr<base::SequencedTaskRunner> task_runner;
+    {
+      base::AutoLock l(instances_lock_);
+      InstanceMap::iterator it = instances_.find(instance_id);
+      TaskRunnerMap::iterator runner_it =
+          instance_task_runners_.find(instance_id);
+      if (it == instances_.end() || runner_it == instance_task_runners_.end())
+        continue;
+      it->second.instance->SetWritableToJS(writable);
+      task_runner = runner_it->second;
+    }
+
+    if (writable) {
+      RunInstanceTask(
+          task_runner,
+          base::Bind(&XWalkExtensionServer::NotifyWritableForInstance,
+                     this, instance_id));
+    }
+  }
+}
+
+void XWalkExtensionServer::NotifyWritableForInstance(int64_t instance_id) {
+  // Instances are only deleted in their task runner, which is this one.
+  XWalkExtensionInstance* instance;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end())
+      return;
+    instance = it->second.instance;
+  }
+  instance->NotifyWritableToJS();
+}
+
+void XWalkExtensionServer::OnMessagesHandled(int64_t instance_id,
+                                             int32 count) {
+  base::AutoLock l(sender_lock_);
+  std::vector<std::string> msgs;
+  // At most XWalkExtensionFlowControl::kCredits messages are released.
+  flow_control_.OnMessagesHandled(instance_id, count, &msgs);
+  SendMessagesToJSLocked(std::vector<int64_t>(msgs.size(), instance_id),
+                         msgs);
+  ScheduleWritabilityUpdatesLocked();
+}
+
+void XWalkExtensionServer::OnSetHighPriority(int64_t instance_id,
+                                             bool high_priority) {
+  {
+    // The state kept for the priority is only dropped with the instance. The
+    // instance itself may still be being created in its task runner.
+    base::AutoLock l(instances_lock_);
+    if (!instance_task_runners_.count(instance_id)) {
+      LOG(WARNING) << "Can't set priority of invalid instance id: "
+                   << instance_id;
+      return;
+    }
+  }
+
+  base::AutoLock l(sender_lock_);
+  flow_control_.SetHighPriority(instance_id, high_priority);
+}
+
+void XWalkExtensionServer::ScheduleFlushPendingMessages() {
+  // The flushes posted once the server is invalidated find no sender, and
+  // drop the messages.
+  task_runner_->PostTask(
+      FROM_HERE, base::Bind(&XWalkExtensionServer::FlushPendingMessages,
+                            this));
+}
+
+XWalkExtensionMessageQueue::Stats
+XWalkExtensionServer::GetPendingMessagesStats() const {
+  return pending_messages_.GetStats();
+}
+
+void XWalkExtensionServer::CreateSharedTransport(
+    base::ProcessHandle peer_process) {
+  if (!XWalkExtensionSharedTransport::IsEnabled())
+    return;
+
+  scoped_ptr<XWalkExtensionSharedTransport> transport(
+      XWalkExtensionSharedTransport::Create());
+  base::SharedMemoryHandle client_incoming;
+  base::SharedMemoryHandle client_outgoing;
+  if (!transport || !transport->ShareWithPeer(peer_process, &client_incoming,
+                                              &client_outgoing)) {
+    LOG(WARNING) << "Couldn't create shared transport for extensions, "
+                 << "falling back to IPC channel.";
+    return;
+  }
+
+  base::AutoLock l(sender_lock_);
+  if (!sender_)
+    return;
+  sender_->Send(new XWalkExtensionClientMsg_SharedTransportCreated(
+      client_incoming, client_outgoing));
+  shared_transport_.reset(transport.release());
+}
+
+void XWalkExtensionServer::OnSharedTransportMapped() {
+  base::AutoLock l(sender_lock_);
+  if (shared_transport_)
+    shared_transport_mapped_ = true;
+}
+
+void XWalkExtensionServer::OnSharedTransportPaused(uint32 sequence) {
+  // The messages the client sent before were already handled.
+  base::AutoLock l(sender_lock_);
+  if (sender_) {
+    sender_->Send(
+        new XWalkExtensionClientMsg_SharedTransportPauseAcknowledged(sequence));
+  }
+}
+
+void XWalkExtensionServer::OnSharedTransportPauseAcknowledged(
+    uint32 sequence) {
+  base::AutoLock l(sender_lock_);
+  if (!shared_transport_mapped_ || !sender_)
+    return;
+  uint32 next_sequence;
+  if (shared_transport_->OnPauseAcknowledged(sequence, &next_sequence)) {
+    sender_->Send(
+        new XWalkExtensionClientMsg_SharedTransportPaused(next_sequence));
+  }
+}
+
+void XWalkExtensionServer::ReceiveFromSharedTransport() {
+  if (!shared_transport_)
+    return;
+
+  std::string buffer;
+  while (shared_transport_->Receive(&buffer)) {
+    IPC::Message message(buffer.data(), static_cast<int>(buffer.size()));
+    OnMessageReceivedInternal(message);
+  }
 }
 
 namespace {
@@ -139,70 +797,167 @@ bool ValidateExtensionName(const std::string& extension_name) {
 
 }  // namespace
 
-bool XWalkExtensionServer::RegisterExtension(
-    scoped_ptr<XWalkExtension> extension) {
-  if (!ValidateExtensionName(extension->name())) {
-    LOG(WARNING) << "Ignoring extension with invalid name: "
-                 << extension->name();
-    return false;
+void XWalkExtensionServer::SetExtensions(const ExtensionMap& extensions) {
+  extensions_ = extensions;
+}
+
+void XWalkExtensionServer::PostMessageToJSCallback(
+    int64_t instance_id, std::string* msg) {
+  // Only the first message of a batch schedules the flush. The messages
+  // pushed after Invalidate() are dropped when flushed.
+  if (pending_messages_.Push(instance_id, msg))
+    ScheduleFlushPendingMessages();
+}
+
+void XWalkExtensionServer::PostMessagesToJSCallback(
+    int64_t instance_id, std::vector<std::string>* msgs) {
+  base::AutoLock l(sender_lock_);
+  // Messages posted before the batch are sent first, then the whole batch
+  // goes through the flow control and out in as few IPC messages as
+  // possible, without passing by |pending_messages_|.
+  FlushPendingMessagesLocked();
+
+  PostMessagesToJSLocked(std::vector<int64_t>(msgs->size(), instance_id),
+                         msgs, flow_control_.IsHighPriority(instance_id));
+  ScheduleWritabilityUpdatesLocked();
+}
+
+void XWalkExtensionServer::CoalesceMessagesCallback(
+    int64_t instance_id, bool coalesce) {
+  base::AutoLock l(sender_lock_);
+  // Flushing first, so the messages already posted are coalesced as well.
+  FlushPendingMessagesLocked();
+  flow_control_.SetCoalesceMessages(instance_id, coalesce);
+  ScheduleWritabilityUpdatesLocked();
+}
+
+bool XWalkExtensionServer::StreamToJSCallback(
+    int64_t instance_id, XWalkExtensionInstance::StreamOperation operation,
+    XWalkExtensionInstance::StreamId stream_id, std::string* data) {
+  base::AutoLock l(sender_lock_);
+  // Messages posted before the stream was used are sent first.
+  FlushPendingMessagesLocked();
+
+  switch (operation) {
+    case XWalkExtensionInstance::OPEN_STREAM:
+      if (!flow_control_.OpenStream(instance_id, stream_id))
+        return false;
+      return SendLocked(
+          new XWalkExtensionClientMsg_OpenStreamToJS(instance_id, stream_id));
+    case XWalkExtensionInstance::WRITE_STREAM: {
+      if (!flow_control_.WriteStream(instance_id, stream_id, data->size()))
+        return false;
+      IPC::Message* msg = new XWalkExtensionClientMsg_StreamDataToJS(
+          instance_id, stream_id, *data);
+      data->clear();
+      SendLocked(msg);
+      return true;
+    }
+    case XWalkExtensionInstance::CLOSE_STREAM:
+      if (!flow_control_.RemoveStream(instance_id, stream_id)) {
+        LOG(WARNING) << "Ignoring close of stream " << stream_id
+                     << ", it is not open.";
+        return false;
+      }
+      return SendLocked(
+          new XWalkExtensionClientMsg_CloseStreamToJS(instance_id, stream_id));
   }
+  return false;
+}
 
-  if (extensions_.find(extension->name()) != extensions_.end()) {
-    LOG(WARNING) << "Ignoring extension with name already registered: "
-                 << extension->name();
+bool XWalkExtensionServer::SharedBufferToJSCallback(
+    int64_t instance_id, XWalkExtensionInstance::BufferId buffer_id,
+    base::SharedMemory* memory, size_t size) {
+  base::AutoLock l(sender_lock_);
+
+  // The duplicated handle is closed once sent to the client.
+  base::SharedMemoryHandle handle;
+  if (!CanShareWithPeerLocked() ||
+      !memory->ShareToProcess(peer_process_, &handle)) {
+    LOG(WARNING) << "Couldn't share buffer " << buffer_id
+                 << " with the render process.";
     return false;
   }
 
-  std::string name = extension->name();
-  extensions_[name] = extension.release();
-  return true;
-}
-
-void XWalkExtensionServer::PostMessageToJSCallback(
-    int64_t instance_id, scoped_ptr<base::Value> msg) {
-  base::ListValue wrapped_msg;
-  wrapped_msg.Append(msg.release());
-  Send(new XWalkExtensionClientMsg_PostMessageToJS(instance_id, wrapped_msg));
+  // Messages carrying handles never go through the shared transport, but they
+  // still go after the messages posted before them.
+  FlushPendingMessagesLocked();
+  return SendLocked(new XWalkExtensionClientMsg_SharedBufferToJS(
+      instance_id, buffer_id, handle, static_cast<uint32>(size)));
 }
 
 void XWalkExtensionServer::SendSyncReplyToJSCallback(
-    int64_t instance_id, scoped_ptr<base::Value> reply) {
+    int64_t instance_id, XWalkExtensionInstance::SyncReplyToken token,
+    std::string* reply) {
+  IPC::Message* pending_reply;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end()) {
+      LOG(WARNING) << "Can't SendSyncMessage to invalid Extension instance id: "
+                   << instance_id;
+      return;
+    }
 
-  InstanceMap::iterator it = instances_.find(instance_id);
-  if (it == instances_.end()) {
-    LOG(WARNING) << "Can't SendSyncMessage to invalid Extension instance id: "
-                 << instance_id;
-    return;
-  }
+    PendingReplyMap& pending_replies = it->second.pending_replies;
+    PendingReplyMap::iterator reply_it =
+        token == XWalkExtensionInstance::kOldestSyncReply ?
+        pending_replies.begin() : pending_replies.find(token);
+    if (reply_it == pending_replies.end()) {
+      LOG(WARNING) << "There's no pending SyncMessage with token " << token
+                   << " for instance id: " << instance_id;
+      return;
+    }
 
-  InstanceExecutionData& data = it->second;
-  if (!data.pending_reply) {
-    LOG(WARNING) << "There's no pending SyncMessage for instance id: "
-                 << instance_id;
-    return;
+    pending_reply = reply_it->second;
+    pending_replies.erase(reply_it);
   }
 
-  base::ListValue wrapped_reply;
-  wrapped_reply.Append(reply.release());
-  IPC::WriteParam(data.pending_reply, wrapped_reply);
-  Send(data.pending_reply);
+  IPC::WriteParam(pending_reply, *reply);
 
-  data.pending_reply = NULL;
+  // The messages the instance posted before the reply are sent before it,
+  // even those held back by the flow control.
+  base::AutoLock l(sender_lock_);
+  FlushPendingMessagesLocked();
+  std::vector<std::string> msgs;
+  flow_control_.TakeWaitingMessages(instance_id, &msgs);
+  SendMessagesToJSLocked(std::vector<int64_t>(msgs.size(), instance_id), msgs);
+  SendLocked(pending_reply);
 }
 
-void XWalkExtensionServer::DeleteInstanceMap() {
-  InstanceMap::iterator it = instances_.begin();
+void XWalkExtensionServer::DeleteInstances() {
+  DCHECK(!task_runner_ || task_runner_->RunsTasksOnCurrentThread());
+  InstanceMap instances;
+  TaskRunnerMap task_runners;
+  {
+    base::AutoLock l(instances_lock_);
+    instances.swap(instances_);
+    task_runners.swap(instance_task_runners_);
+  }
+
+  // The tasks still routed to the instances find nothing from now on. The
+  // instances living in other task runners are deleted there, after those
+  // tasks. The remaining ones live in this thread, they are deleted without
+  // holding the lock since they may still call us back.
   int pending_replies_left = 0;
+  InstanceMap::iterator it = instances.begin();
+  for (; it != instances.end(); ++it) {
+    pending_replies_left += it->second.pending_replies.size();
+    STLDeleteValues(&it->second.pending_replies);
 
-  for (; it != instances_.end(); ++it) {
-    delete it->second.instance;
-    if (it->second.pending_reply) {
-      pending_replies_left++;
-      delete it->second.pending_reply;
+    TaskRunnerMap::iterator runner_it = task_runners.find(it->first);
+    if (runner_it == task_runners.end() ||
+        runner_it->second->RunsTasksOnCurrentThread()) {
+      delete it->second.instance;
+      continue;
     }
-  }
 
-  instances_.clear();
+    // A task runner that is going away drops the task, and the instance
+    // with it.
+    runner_it->second->PostTask(
+        FROM_HERE, base::Bind(&DeleteOwnedInstance,
+                              base::Owned(it->second.instance)));
+  }
 
   if (pending_replies_left > 0) {
     LOG(WARNING) << pending_replies_left
@@ -211,72 +966,196 @@ void XWalkExtensionServer::DeleteInstanceMap() {
 }
 
 void XWalkExtensionServer::OnSendSyncMessageToNative(int64_t instance_id,
-    const base::ListValue& msg, IPC::Message* ipc_reply) {
-  InstanceMap::iterator it = instances_.find(instance_id);
-  if (it == instances_.end()) {
+    const std::string& msg, IPC::Message* ipc_reply) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner) {
     LOG(WARNING) << "Can't SendSyncMessage to invalid Extension instance id: "
                  << instance_id;
+    ipc_reply->set_reply_error();
+    Send(ipc_reply);
     return;
   }
 
-  InstanceExecutionData& data = it->second;
-  if (data.pending_reply) {
-    LOG(WARNING) << "There's already a pending Sync Message for "
-                 << "Extension instance id: " << instance_id;
-    return;
-  }
+  scoped_ptr<std::string> contents(TakeMessageContents(msg));
+  RunInstanceTask(
+      task_runner,
+      base::Bind(&XWalkExtensionServer::HandleSyncMessageForInstance,
+                 this, instance_id,
+                 base::Passed(&contents), ipc_reply));
+}
 
-  data.pending_reply = ipc_reply;
+void XWalkExtensionServer::HandleSyncMessageForInstance(int64_t instance_id,
+    scoped_ptr<std::string> msg, IPC::Message* ipc_reply) {
+  XWalkExtensionInstance* instance;
+  XWalkExtensionInstance::SyncReplyToken token;
+  {
+    base::AutoLock l(instances_lock_);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end()) {
+      LOG(WARNING) << "Can't SendSyncMessage to invalid Extension instance id: "
+                   << instance_id;
+      ipc_reply->set_reply_error();
+      Send(ipc_reply);
+      return;
+    }
 
-  // The const_cast is needed to remove the only Value contained by the
-  // ListValue (which is solely used as wrapper, since Value doesn't
-  // have param traits for serialization) and we pass the ownership to to
-  // HandleMessage. It is safe to do this because the |msg| won't be used
-  // anywhere else when this function returns. Saves a DeepCopy(), which
-  // can be costly depending on the size of Value.
-  base::Value* value;
-  const_cast<base::ListValue*>(&msg)->Remove(0, &value);
-  XWalkExtensionInstance* instance = data.instance;
+    // Tokens are unique in the server, skipping kOldestSyncReply when they
+    // wrap around.
+    token = next_sync_reply_token_++;
+    if (next_sync_reply_token_ <= XWalkExtensionInstance::kOldestSyncReply)
+      next_sync_reply_token_ = XWalkExtensionInstance::kOldestSyncReply + 1;
+
+    it->second.pending_replies[token] = ipc_reply;
+    instance = it->second.instance;
+  }
 
-  instance->HandleSyncMessage(scoped_ptr<base::Value>(value));
+  instance->HandleSerializedSyncMessage(*msg, token);
 }
 
 void XWalkExtensionServer::OnDestroyInstance(int64_t instance_id) {
-  InstanceMap::iterator it = instances_.find(instance_id);
-  if (it == instances_.end()) {
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      GetTaskRunnerForInstance(instance_id);
+  if (!task_runner) {
     LOG(WARNING) << "Can't destroy inexistent instance:" << instance_id;
     return;
   }
 
-  InstanceExecutionData& data = it->second;
+  RunInstanceTask(task_runner,
+                  base::Bind(&XWalkExtensionServer::DestroyInstance,
+                             this, instance_id));
+}
 
-  delete data.instance;
-  instances_.erase(it);
+void XWalkExtensionServer::DestroyInstance(int64_t instance_id) {
+  XWalkExtensionInstance* instance;
+  PendingReplyMap pending_replies;
+  {
+    base::AutoLock l(instances_lock_);
+    instance_task_runners_.erase(instance_id);
+    InstanceMap::iterator it = instances_.find(instance_id);
+    if (it == instances_.end()) {
+      LOG(WARNING) << "Can't destroy inexistent instance:" << instance_id;
+      return;
+    }
+    instance = it->second.instance;
+    pending_replies.swap(it->second.pending_replies);
+    instances_.erase(it);
+  }
+
+  delete instance;
+
+  // Unblock whoever is still waiting for a reply from the instance.
+  PendingReplyMap::iterator reply_it = pending_replies.begin();
+  for (; reply_it != pending_replies.end(); ++reply_it) {
+    reply_it->second->set_reply_error();
+    Send(reply_it->second);
+  }
 
   Send(new XWalkExtensionClientMsg_InstanceDestroyed(instance_id));
+
+  base::AutoLock l(sender_lock_);
+  flow_control_.RemoveInstance(instance_id);
 }
 
 void XWalkExtensionServer::RegisterExtensionsInRenderProcess() {
   // Having a sender means we have a RenderProcessHost ready.
   DCHECK(sender_);
 
+  base::ProcessHandle peer_process;
+  {
+    base::AutoLock l(sender_lock_);
+    if (!CanShareWithPeerLocked()) {
+      register_when_connected_ = true;
+      return;
+    }
+    peer_process = peer_process_;
+  }
+
+  CreateSharedTransport(peer_process);
+
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  size_t total_size = 0;
   ExtensionMap::iterator it = extensions_.begin();
   for (; it != extensions_.end(); ++it) {
     XWalkExtension* extension = it->second;
-    Send(new XWalkExtensionClientMsg_RegisterExtension(
-        extension->name(), extension->GetJavaScriptAPI()));
+    const char* api = extension->GetJavaScriptAPI();
+    names.push_back(extension->name());
+    apis.push_back(api ? api : "");
+    total_size += apis.back().size();
+  }
+
+  std::vector<std::string> api_hashes;
+  std::vector<uint32> api_sizes;
+  for (size_t i = 0; i < apis.size(); ++i) {
+    api_hashes.push_back(base::SHA1HashString(apis[i]));
+    api_sizes.push_back(static_cast<uint32>(apis[i].size()));
+  }
+
+  // The client maps the shared memory read-only and copies what it needs, so
+  // it can be released as soon as the message is sent.
+  base::SharedMemory api_blob;
+  base::SharedMemoryHandle api_blob_handle = base::SharedMemory::NULLHandle();
+  if (total_size > 0) {
+    if (!api_blob.CreateAndMapAnonymous(total_size) ||
+        !api_blob.ShareToProcess(peer_process, &api_blob_handle)) {
+      LOG(WARNING) << "Couldn't share JS API code of extensions with the "
+                   << "render process.";
+      return;
+    }
+
+    char* data = static_cast<char*>(api_blob.memory());
+    for (size_t i = 0; i < apis.size(); ++i) {
+      memcpy(data, apis[i].data(), apis[i].size());
+      data += apis[i].size();
+    }
   }
+
+  Send(new XWalkExtensionClientMsg_RegisterExtensions(
+      names, api_hashes, api_sizes, api_blob_handle));
 }
 
 void XWalkExtensionServer::Invalidate() {
   base::AutoLock l(sender_lock_);
   sender_ = NULL;
+  FlushPendingMessagesLocked();
 }
 
 void XWalkExtensionServer::OnChannelConnected(int32 peer_pid) {
+  SetPeerProcess(peer_pid);
   RegisterExtensionsInRenderProcess();
 }
 
+void XWalkExtensionServer::SetPeerProcess(base::ProcessId peer_pid) {
+  bool register_extensions;
+  {
+    base::AutoLock l(sender_lock_);
+    if (peer_process_ != base::kNullProcessHandle)
+      return;
+    if (!base::OpenProcessHandle(peer_pid, &peer_process_)) {
+      LOG(WARNING) << "Couldn't open render process " << peer_pid
+                   << " to share memory with it.";
+      peer_process_ = base::kNullProcessHandle;
+    }
+    register_extensions = register_when_connected_;
+    register_when_connected_ = false;
+  }
+
+  if (register_extensions)
+    RegisterExtensionsInRenderProcess();
+}
+
+bool XWalkExtensionServer::CanShareWithPeerLocked() const {
+  sender_lock_.AssertAcquired();
+#if defined(OS_WIN)
+  return peer_process_ != base::kNullProcessHandle;
+#else
+  // The file descriptor is duplicated when sent through the channel, the
+  // process isn't needed.
+  return true;
+#endif
+}
+
 namespace {
 base::FilePath::StringType GetNativeLibraryPattern() {
   const base::string16 library_pattern = base::GetNativeLibraryName(
@@ -289,28 +1168,106 @@ base::FilePath::StringType GetNativeLibraryPattern() {
 }
 }  // namespace
 
-void RegisterExternalExtensionsInDirectory(
-    XWalkExtensionServer* server, const base::FilePath& dir) {
-  CHECK(server);
+bool RegisterExtensionInMap(scoped_ptr<XWalkExtension> extension,
+                            XWalkExtensionServer::ExtensionMap* extensions) {
+  if (!ValidateExtensionName(extension->name())) {
+    LOG(WARNING) << "Ignoring extension with invalid name: "
+                 << extension->name();
+    return false;
+  }
 
+  if (extensions->find(extension->name()) != extensions->end()) {
+    LOG(WARNING) << "Ignoring extension with name already registered: "
+                 << extension->name();
+    return false;
+  }
+
+  std::string name = extension->name();
+  (*extensions)[name] = extension.release();
+  return true;
+}
+
+std::vector<base::FilePath> GetExternalExtensionLibrariesInDirectory(
+    const base::FilePath& dir) {
+  std::vector<base::FilePath> libraries;
   if (!file_util::DirectoryExists(dir)) {
     LOG(WARNING) << "Couldn't load external extensions from non-existent"
                  << " directory " << dir.AsUTF8Unsafe();
-    return;
+    return libraries;
   }
 
-  base::FileEnumerator libraries(
+  base::FileEnumerator enumerator(
       dir, false, base::FileEnumerator::FILES, GetNativeLibraryPattern());
 
-  for (base::FilePath extension_path = libraries.Next();
-        !extension_path.empty(); extension_path = libraries.Next()) {
-    scoped_ptr<XWalkExternalExtension> extension(
-        new XWalkExternalExtension(extension_path));
+  for (base::FilePath extension_path = enumerator.Next();
+        !extension_path.empty(); extension_path = enumerator.Next())
+    libraries.push_back(extension_path);
+
+  // Keep the order stable, it decides which extension wins a name conflict.
+  std::sort(libraries.begin(), libraries.end());
+  return libraries;
+}
+
+namespace {
+
+// Libraries are loaded in parallel, the last one to finish signals |done|.
+struct ExternalExtensionLoads {
+  explicit ExternalExtensionLoads(size_t count)
+      : extensions(count),
+        pending(count),
+        done(false, false) {}
+
+  std::vector<XWalkExternalExtension*> extensions;
+  base::AtomicRefCount pending;
+  base::WaitableEvent done;
+};
+
+void LoadExternalExtension(const base::FilePath& library, size_t index,
+                           ExternalExtensionLoads* loads) {
+  loads->extensions[index] = new XWalkExternalExtension(library);
+  if (!base::AtomicRefCountDec(&loads->pending))
+    loads->done.Signal();
+}
+
+}  // namespace
+
+void RegisterExternalExtensionLibraries(
+    XWalkExtensionServer::ExtensionMap* extensions,
+    const std::vector<base::FilePath>& libraries) {
+  CHECK(extensions);
+  TRACE_EVENT1("xwalk", "RegisterExternalExtensionLibraries",
+               "count", static_cast<int>(libraries.size()));
+
+  if (libraries.empty())
+    return;
+
+  // Relocations and static initializers make loading large libraries slow,
+  // mostly waiting on the disk, so they are loaded by the worker pool. Tasks
+  // the pool refuses, e.g. during shutdown, are run here.
+  ExternalExtensionLoads loads(libraries.size());
+  for (size_t i = 0; i < libraries.size(); ++i) {
+    base::Closure task = base::Bind(&LoadExternalExtension, libraries[i], i,
+                                    base::Unretained(&loads));
+    if (!g_worker_pool.Get().PostTask(task))
+      task.Run();
+  }
+  loads.done.Wait();
+
+  // Registering in the order of |libraries| keeps the winner of a name
+  // conflict independent of which load finished first.
+  for (size_t i = 0; i < libraries.size(); ++i) {
+    scoped_ptr<XWalkExternalExtension> extension(loads.extensions[i]);
     if (extension->is_valid())
-      server->RegisterExtension(extension.PassAs<XWalkExtension>());
+      RegisterExtensionInMap(extension.PassAs<XWalkExtension>(), extensions);
   }
 }
 
+void RegisterExternalExtensionsInDirectory(
+    XWalkExtensionServer::ExtensionMap* extensions, const base::FilePath& dir) {
+  RegisterExternalExtensionLibraries(
+      extensions, GetExternalExtensionLibrariesInDirectory(dir));
+}
+
 bool ValidateExtensionNameForTesting(const std::string& extension_name) {
   return ValidateExtensionName(extension_name);
 }
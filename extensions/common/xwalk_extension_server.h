@@ -8,15 +8,20 @@
 #include <stdint.h>
 #include <map>
 #include <string>
+#include <vector>
 
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/process.h"
+#include "base/sequenced_task_runner.h"
 #include "base/synchronization/lock.h"
 #include "base/values.h"
 #include "ipc/ipc_channel_proxy.h"
 #include "ipc/ipc_listener.h"
-
-namespace base {
-class FilePath;
-}
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_flow_control.h"
+#include "xwalk/extensions/common/xwalk_extension_message_queue.h"
 
 namespace content {
 class RenderProcessHost;
@@ -30,63 +35,274 @@ namespace xwalk {
 namespace extensions {
 
 class XWalkExtension;
-class XWalkExtensionInstance;
+class XWalkExtensionSharedTransport;
 
 // Manages the instances for a set of extensions. It communicates with one
-// XWalkExtensionClient by means of IPC channel.
+// XWalkExtensionClient by means of IPC channel, so there's one server for each
+// render process. The extensions themselves are shared by all the servers of a
+// process and are not owned by them.
 //
 // This class is used both by in-process extensions running in the Browser
 // Process, and by the external extensions running in the Extension Process.
-class XWalkExtensionServer : public IPC::Listener {
+//
+// Messages for an instance are routed to the task runner chosen by the
+// threading model of its extension, see XWalkExtension::ThreadingModel. Unless
+// they are routed from the IO thread, the routing happens in the thread of the
+// server, which is also where SHARED_THREAD instances run.
+//
+// Messages posted to JavaScript go through XWalkExtensionFlowControl, so an
+// instance can't have more than a few of them waiting for the client. The
+// ones held back are sent before a reply to a synchronous message of the
+// instance, even past its credits, and are dropped when the instance is
+// destroyed. Stream data isn't held back with them, only by the window of its
+// stream. Messages of the instances the client gave a high priority are sent
+// ahead of the ones other instances posted before them.
+//
+// The tasks routed to the instances and the callbacks given to them hold a
+// reference to the server, so it stays alive while other threads use it. Its
+// owner calls Invalidate() and then DeleteInstances() when done with it.
+class XWalkExtensionServer
+    : public IPC::Listener,
+      public base::RefCountedThreadSafe<XWalkExtensionServer> {
  public:
+  typedef std::map<std::string, XWalkExtension*> ExtensionMap;
+
   XWalkExtensionServer();
-  virtual ~XWalkExtensionServer();
 
   // IPC::Listener Implementation.
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
   virtual void OnChannelConnected(int32 peer_pid) OVERRIDE;
 
-  void Initialize(IPC::Sender* sender);
+  // |task_runner| must run tasks in the thread handling the messages of this
+  // server, it is used to flush batched messages and to run the SHARED_THREAD
+  // instances.
+  void Initialize(IPC::Sender* sender,
+                  scoped_refptr<base::SequencedTaskRunner> task_runner);
+
+  // To be called by an IPC filter, in the order messages were received, so
+  // they reach the task runner of their instance without passing by the
+  // thread of the server. See SetIOTaskRunner().
+  void RouteMessageFromIOThread(const IPC::Message& message);
+
+  // Sets the task runner of the IO thread where RouteMessageFromIOThread() is
+  // called, used by IO_THREAD extensions. Without it they run in the thread of
+  // the server.
+  void SetIOTaskRunner(
+      scoped_refptr<base::SequencedTaskRunner> io_task_runner);
+
+  // Sends |msg| to the client. Messages batched by PostMessageToJSCallback()
+  // are sent before it, so the order seen by the client is preserved.
   bool Send(IPC::Message* msg);
 
-  bool RegisterExtension(scoped_ptr<XWalkExtension> extension);
+  // Sets the extensions available to the client. They must outlive the
+  // server, see RegisterExtensionInMap().
+  void SetExtensions(const ExtensionMap& extensions);
   void RegisterExtensionsInRenderProcess();
 
+  // Opens the process of the client once the channel is connected, the
+  // memory shared with the client is duplicated for it. On Windows, where the
+  // process is needed for that, registering the extensions waits for it.
+  void SetPeerProcess(base::ProcessId peer_pid);
+
+  // Stops sending to the client, what is posted afterwards is dropped.
   void Invalidate();
 
+  // Hands each instance to a task that deletes it in its task runner, without
+  // waiting for those tasks. Must be called in the thread of the server,
+  // where the SHARED_THREAD instances are deleted right away.
+  void DeleteInstances();
+
+  // Tells how much the instances posting messages from different threads
+  // overlap, see XWalkExtensionMessageQueue::Stats.
+  XWalkExtensionMessageQueue::Stats GetPendingMessagesStats() const;
+
  private:
+  friend class base::RefCountedThreadSafe<XWalkExtensionServer>;
+  virtual ~XWalkExtensionServer();
+
+  // Replies of the synchronous messages an instance is handling, by token.
+  // Tokens grow with each message, so the first reply is the oldest one.
+  typedef std::map<XWalkExtensionInstance::SyncReplyToken, IPC::Message*>
+      PendingReplyMap;
+
   struct InstanceExecutionData {
     XWalkExtensionInstance* instance;
-    IPC::Message* pending_reply;
+    PendingReplyMap pending_replies;
   };
 
+  bool OnMessageReceivedInternal(const IPC::Message& message);
+
+  // Must be called with |sender_lock_| held.
+  bool SendLocked(IPC::Message* msg);
+
+  // Sends the messages batched by PostMessageToJSCallback(), if any.
+  void FlushPendingMessages();
+  void FlushPendingMessagesLocked();
+  void ScheduleFlushPendingMessages();
+
+  // Posts to |flow_control_| the messages of the instances with the given
+  // priority, and sends the ones that have credits in batches. The contents
+  // of those messages are taken.
+  void PostMessagesToJSLocked(const std::vector<int64_t>& instance_ids,
+                              std::vector<std::string>* msgs,
+                              bool high_priority);
+  void SendMessagesToJSLocked(const std::vector<int64_t>& instance_ids,
+                              const std::vector<std::string>& msgs);
+
+  // Tells the instances whose writability changed in |flow_control_|, in
+  // the thread of the server.
+  void ScheduleWritabilityUpdatesLocked();
+  void UpdateWritability(
+      const XWalkExtensionFlowControl::WritabilityChanges& changes);
+
+  // Creates the shared transport if enabled and shares it with the client
+  // in |peer_process|.
+  void CreateSharedTransport(base::ProcessHandle peer_process);
+
+  // Whether memory can be duplicated for the client yet. Must be called with
+  // |sender_lock_| held.
+  bool CanShareWithPeerLocked() const;
+
+  // Handles the messages the client wrote to the shared transport. These
+  // must be handled before any message received from the IPC channel.
+  void ReceiveFromSharedTransport();
+
   // Message Handlers
+  void OnSharedTransportMapped();
+  void OnSharedTransportDataAvailable() {}
+  void OnSharedTransportPaused(uint32 sequence);
+  void OnSharedTransportPauseAcknowledged(uint32 sequence);
   void OnCreateInstance(int64_t instance_id, std::string name);
+  void OnCreateInstances(const std::vector<int64_t>& instance_ids,
+                         const std::vector<std::string>& names);
   void OnDestroyInstance(int64_t instance_id);
-  void OnPostMessageToNative(int64_t instance_id, const base::ListValue& msg);
+  void OnPostMessageToNative(int64_t instance_id, const std::string& msg);
+  void OnPostMessagesToNative(const std::vector<int64_t>& instance_ids,
+                              const std::vector<std::string>& msgs);
   void OnSendSyncMessageToNative(int64_t instance_id,
-      const base::ListValue& msg, IPC::Message* ipc_reply);
+      const std::string& msg, IPC::Message* ipc_reply);
+  void OnMessagesHandled(int64_t instance_id, int32 count);
+  void OnSetHighPriority(int64_t instance_id, bool high_priority);
+  void OnOpenStreamToNative(int64_t instance_id, int32 stream_id);
+  void OnStreamDataToNative(int64_t instance_id, int32 stream_id,
+                            const std::string& data);
+  void OnCloseStreamToNative(int64_t instance_id, int32 stream_id);
+  void OnStreamDataHandled(int64_t instance_id, int32 stream_id, uint32 size);
+  void OnSharedBufferReleased(int64_t instance_id, int32 buffer_id);
 
-  void PostMessageToJSCallback(int64_t instance_id,
-                               scoped_ptr<base::Value> msg);
+  scoped_refptr<base::SequencedTaskRunner> GetTaskRunnerForExtension(
+      XWalkExtension* extension);
+  scoped_refptr<base::SequencedTaskRunner> GetTaskRunnerForInstance(
+      int64_t instance_id);
 
-  void SendSyncReplyToJSCallback(int64_t instance_id,
-                                 scoped_ptr<base::Value> reply);
+  void RouteMessageToInstance(int64_t instance_id,
+                              scoped_ptr<std::string> msg);
+  void RouteStreamToInstance(int64_t instance_id,
+                             XWalkExtensionInstance::StreamOperation operation,
+                             int32 stream_id, scoped_ptr<std::string> data);
 
-  void DeleteInstanceMap();
+  // These run in the task runner of the instance.
+  void CreateInstance(int64_t instance_id, XWalkExtension* extension);
+  void DestroyInstance(int64_t instance_id);
+  void HandleMessageForInstance(int64_t instance_id,
+                                scoped_ptr<std::string> msg);
+  void HandleSyncMessageForInstance(int64_t instance_id,
+                                    scoped_ptr<std::string> msg,
+                                    IPC::Message* ipc_reply);
+  void NotifyWritableForInstance(int64_t instance_id);
+  void HandleStreamForInstance(
+      int64_t instance_id, XWalkExtensionInstance::StreamOperation operation,
+      int32 stream_id, scoped_ptr<std::string> data);
+  void NotifyStreamWritableForInstance(int64_t instance_id, int32 stream_id);
+  void NotifySharedBufferReleasedForInstance(int64_t instance_id,
+                                             int32 buffer_id);
+
+  void PostMessageToJSCallback(int64_t instance_id, std::string* msg);
+  void PostMessagesToJSCallback(int64_t instance_id,
+                                std::vector<std::string>* msgs);
+  void CoalesceMessagesCallback(int64_t instance_id, bool coalesce);
+  bool StreamToJSCallback(int64_t instance_id,
+                          XWalkExtensionInstance::StreamOperation operation,
+                          XWalkExtensionInstance::StreamId stream_id,
+                          std::string* data);
+  bool SharedBufferToJSCallback(int64_t instance_id,
+                                XWalkExtensionInstance::BufferId buffer_id,
+                                base::SharedMemory* memory, size_t size);
+
+  // Can be called from any thread. A |token| of kOldestSyncReply answers the
+  // oldest pending message of the instance.
+  void SendSyncReplyToJSCallback(
+      int64_t instance_id, XWalkExtensionInstance::SyncReplyToken token,
+      std::string* reply);
 
   base::Lock sender_lock_;
   IPC::Sender* sender_;
 
-  typedef std::map<std::string, XWalkExtension*> ExtensionMap;
+  // The client process, and whether the extensions are registered once it's
+  // known. Protected by |sender_lock_|.
+  base::ProcessHandle peer_process_;
+  bool register_when_connected_;
+
+  // Writing to the shared transport is protected by |sender_lock_| and only
+  // allowed once the client mapped it. Reading from it only happens in the
+  // thread handling our messages.
+  scoped_ptr<XWalkExtensionSharedTransport> shared_transport_;
+  bool shared_transport_mapped_;
+
+  // Messages posted by the instances are batched and sent once per task of
+  // |task_runner_|, or before any other message. Instances can post messages
+  // from any thread without locking, only taking them from the queue is
+  // protected by |sender_lock_|.
+  XWalkExtensionMessageQueue pending_messages_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+
+  // Protected by |sender_lock_|.
+  XWalkExtensionFlowControl flow_control_;
+
   ExtensionMap extensions_;
 
+  scoped_refptr<base::SequencedTaskRunner> io_task_runner_;
+
+  // Protects the maps below, |route_in_server_thread_| and
+  // |next_sync_reply_token_|. Instances are only
+  // used and deleted in their task runner, but the maps are shared by all of
+  // them.
+  base::Lock instances_lock_;
+
   typedef std::map<int64_t, InstanceExecutionData> InstanceMap;
   InstanceMap instances_;
+
+  // Filled when routing the creation of an instance, so it's already known
+  // when routing the messages following it.
+  typedef std::map<int64_t, scoped_refptr<base::SequencedTaskRunner> >
+      TaskRunnerMap;
+  TaskRunnerMap instance_task_runners_;
+
+  // Set once the client starts using the shared transport, see
+  // RouteMessageFromIOThread().
+  bool route_in_server_thread_;
+
+  XWalkExtensionInstance::SyncReplyToken next_sync_reply_token_;
 };
 
+// Adds |extension| to |extensions| if its name is valid and not used by
+// another extension, returns false otherwise. The caller is responsible for
+// deleting the extensions in the map.
+bool RegisterExtensionInMap(scoped_ptr<XWalkExtension> extension,
+                            XWalkExtensionServer::ExtensionMap* extensions);
+
+// Returns the native libraries in |dir| that may contain external extensions.
+std::vector<base::FilePath> GetExternalExtensionLibrariesInDirectory(
+    const base::FilePath& dir);
+
+// Loads |libraries| in parallel in the worker pool and waits for them. The
+// extensions are added to |extensions| in the order of |libraries|.
+void RegisterExternalExtensionLibraries(
+    XWalkExtensionServer::ExtensionMap* extensions,
+    const std::vector<base::FilePath>& libraries);
+
 void RegisterExternalExtensionsInDirectory(
-    XWalkExtensionServer* server, const base::FilePath& dir);
+    XWalkExtensionServer::ExtensionMap* extensions, const base::FilePath& dir);
 
 bool ValidateExtensionNameForTesting(const std::string& extension_name);
 
@@ -4,10 +4,70 @@
 
 #include "xwalk/extensions/common/xwalk_extension_server.h"
 
+#include <vector>
+
 #include "base/basictypes.h"
+#include "base/message_loop.h"
+#include "base/stl_util.h"
+#include "ipc/ipc_sender.h"
+#include "ipc/ipc_sync_message.h"
 #include "testing/gtest/include/gtest/gtest.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
 
 using xwalk::extensions::ValidateExtensionNameForTesting;
+using xwalk::extensions::XWalkExtension;
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkExtensionServer;
+using xwalk::extensions::XWalkExtensionWireWriter;
+
+namespace {
+
+// Keeps the tokens of the sync messages it gets without replying to them.
+class TokenRecordingInstance : public XWalkExtensionInstance {
+ public:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {}
+  virtual void HandleSyncMessageWithToken(scoped_ptr<base::Value> msg,
+                                          SyncReplyToken token) OVERRIDE {
+    tokens.push_back(token);
+  }
+
+  void Reply(SyncReplyToken token) {
+    SendSyncReplyToJS(token, scoped_ptr<base::Value>(
+        base::Value::CreateIntegerValue(token)));
+  }
+
+  std::vector<SyncReplyToken> tokens;
+};
+
+class TokenRecordingExtension : public XWalkExtension {
+ public:
+  TokenRecordingExtension() : instance(NULL) {
+    set_name("tokens");
+  }
+
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance() OVERRIDE {
+    instance = new TokenRecordingInstance;
+    return instance;
+  }
+
+  TokenRecordingInstance* instance;
+};
+
+class RecordingSender : public IPC::Sender {
+ public:
+  virtual ~RecordingSender() { STLDeleteElements(&messages); }
+  virtual bool Send(IPC::Message* msg) OVERRIDE {
+    messages.push_back(msg);
+    return true;
+  }
+
+  std::vector<IPC::Message*> messages;
+};
+
+}  // namespace
 
 TEST(XWalkExtensionServerTest, ValidateExtensionName) {
   const std::string valid_names[] = {
@@ -42,3 +102,52 @@ TEST(XWalkExtensionServerTest, ValidateExtensionName) {
         << "Extension name should be invalid: " << invalid_names[i];
   }
 }
+
+TEST(XWalkExtensionServerTest, SyncRepliesOutOfOrder) {
+  base::MessageLoop message_loop;
+  TokenRecordingExtension extension;
+  XWalkExtensionServer::ExtensionMap extensions;
+  extensions[extension.name()] = &extension;
+  RecordingSender sender;
+
+  scoped_refptr<XWalkExtensionServer> server(new XWalkExtensionServer);
+  server->Initialize(&sender, message_loop.message_loop_proxy());
+  server->SetExtensions(extensions);
+
+  const int64_t kInstanceId = 1;
+  server->OnMessageReceived(
+      XWalkExtensionServerMsg_CreateInstance(kInstanceId, extension.name()));
+  ASSERT_TRUE(extension.instance);
+
+  std::string msg;
+  XWalkExtensionWireWriter(&msg).WriteString("ping", 4);
+  std::string unused_reply;
+  XWalkExtensionServerMsg_SendSyncMessageToNative first(
+      kInstanceId, msg, &unused_reply);
+  XWalkExtensionServerMsg_SendSyncMessageToNative second(
+      kInstanceId, msg, &unused_reply);
+  server->OnMessageReceived(first);
+  server->OnMessageReceived(second);
+
+  // Both messages wait for a reply at the same time.
+  const std::vector<XWalkExtensionInstance::SyncReplyToken>& tokens =
+      extension.instance->tokens;
+  ASSERT_EQ(2u, tokens.size());
+  EXPECT_NE(tokens[0], tokens[1]);
+
+  extension.instance->Reply(tokens[1]);
+  extension.instance->Reply(tokens[0]);
+
+  ASSERT_EQ(2u, sender.messages.size());
+  EXPECT_EQ(IPC::SyncMessage::GetMessageId(second),
+            IPC::SyncMessage::GetMessageId(*sender.messages[0]));
+  EXPECT_EQ(IPC::SyncMessage::GetMessageId(first),
+            IPC::SyncMessage::GetMessageId(*sender.messages[1]));
+
+  // Replying twice to the same message does nothing.
+  extension.instance->Reply(tokens[0]);
+  EXPECT_EQ(2u, sender.messages.size());
+
+  server->Invalidate();
+  server->DeleteInstances();
+}
@@ -0,0 +1,306 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_shared_transport.h"
+
+#include <string.h>
+#include "base/atomicops.h"
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "ipc/ipc_message.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// Size of the data area of each ring. Must be a power of two so positions can
+// wrap around without breaking the offset calculation.
+const uint32 kRingCapacity = 256 * 1024;
+
+// Bigger messages are sent through the IPC channel, so a single message can't
+// starve the ring.
+const uint32 kMaxMessageSize = kRingCapacity / 4;
+
+// Each record starts with its payload size. Records are aligned to the size of
+// this header, so there's always room for a padding record at the end of the
+// data area when a record doesn't fit there.
+const uint32 kRecordHeaderSize = sizeof(uint32);
+const uint32 kPaddingRecord = 0xffffffff;
+
+struct RingHeader {
+  // Positions grow monotonically and wrap around at 2^32, the offset in the
+  // data area is the position modulo kRingCapacity.
+  base::subtle::Atomic32 write_position;
+  base::subtle::Atomic32 read_position;
+
+  // Set by the consumer when it has nothing else to read. The producer clears
+  // it after writing and, if it was set, wakes up the consumer.
+  base::subtle::Atomic32 consumer_parked;
+
+  uint32 reserved;
+};
+
+const size_t kMappedSize = sizeof(RingHeader) + kRingCapacity;
+
+uint32 GetRecordSize(uint32 payload_size) {
+  return kRecordHeaderSize +
+      ((payload_size + kRecordHeaderSize - 1) & ~(kRecordHeaderSize - 1));
+}
+
+}  // namespace
+
+// One direction of the transport. Only one side writes and only one side
+// reads, so the positions are the only state shared between processes. The
+// peer is not trusted: everything read from the shared memory is validated.
+class XWalkExtensionSharedTransport::Ring {
+ public:
+  static scoped_ptr<Ring> Create() {
+    scoped_ptr<base::SharedMemory> memory(new base::SharedMemory);
+    if (!memory->CreateAndMapAnonymous(kMappedSize))
+      return scoped_ptr<Ring>();
+    scoped_ptr<Ring> ring(new Ring(memory.Pass()));
+    base::subtle::NoBarrier_Store(&ring->header()->consumer_parked, 1);
+    return ring.Pass();
+  }
+
+  static scoped_ptr<Ring> CreateFromHandle(base::SharedMemoryHandle handle) {
+    scoped_ptr<base::SharedMemory> memory(
+        new base::SharedMemory(handle, false));
+    if (!memory->Map(kMappedSize))
+      return scoped_ptr<Ring>();
+    return scoped_ptr<Ring>(new Ring(memory.Pass()));
+  }
+
+  // The duplicated handle is closed once sent through the IPC channel.
+  bool Share(base::ProcessHandle process, base::SharedMemoryHandle* handle) {
+    return memory_->ShareToProcess(process, handle);
+  }
+
+  bool Write(const char* data, uint32 size, bool* wake_up_consumer) {
+    const uint32 record_size = GetRecordSize(size);
+    uint32 offset = position_ & (kRingCapacity - 1);
+    const uint32 tail = kRingCapacity - offset;
+    const uint32 needed =
+        record_size <= tail ? record_size : tail + record_size;
+
+    const uint32 read_position =
+        base::subtle::Acquire_Load(&header()->read_position);
+    const uint32 used = position_ - read_position;
+    if (used > kRingCapacity || kRingCapacity - used < needed)
+      return false;
+
+    if (record_size > tail) {
+      WriteRecordHeader(offset, kPaddingRecord);
+      position_ += tail;
+      offset = 0;
+    }
+
+    WriteRecordHeader(offset, size);
+    memcpy(data_area() + offset + kRecordHeaderSize, data, size);
+    position_ += record_size;
+
+    base::subtle::Release_Store(&header()->write_position, position_);
+
+    // The store above must be visible before we check whether the consumer is
+    // parked, otherwise it could park after checking the ring was empty and
+    // we would miss waking it up.
+    base::subtle::MemoryBarrier();
+    *wake_up_consumer = base::subtle::NoBarrier_AtomicExchange(
+        &header()->consumer_parked, 0) != 0;
+    return true;
+  }
+
+  bool Read(std::string* buffer) {
+    if (broken_)
+      return false;
+
+    const uint32 write_position =
+        base::subtle::Acquire_Load(&header()->write_position);
+    if (write_position == position_)
+      return false;
+
+    uint32 offset = position_ & (kRingCapacity - 1);
+    uint32 size = ReadRecordHeader(offset);
+    if (size == kPaddingRecord) {
+      position_ += kRingCapacity - offset;
+      offset = 0;
+      if (write_position == position_)
+        return MarkBroken();
+      size = ReadRecordHeader(offset);
+    }
+
+    // Records never wrap around the end of the data area, the producer
+    // writes a padding record instead.
+    if (size > kMaxMessageSize ||
+        GetRecordSize(size) > kRingCapacity - offset ||
+        write_position - position_ < GetRecordSize(size))
+      return MarkBroken();
+
+    buffer->assign(data_area() + offset + kRecordHeaderSize, size);
+    position_ += GetRecordSize(size);
+    base::subtle::Release_Store(&header()->read_position, position_);
+    return true;
+  }
+
+  void Park() {
+    base::subtle::NoBarrier_Store(&header()->consumer_parked, 1);
+    // Pairs with the barrier in Write(), see comment there.
+    base::subtle::MemoryBarrier();
+  }
+
+  void Unpark() {
+    base::subtle::NoBarrier_Store(&header()->consumer_parked, 0);
+  }
+
+ private:
+  explicit Ring(scoped_ptr<base::SharedMemory> memory)
+      : memory_(memory.Pass()),
+        position_(0),
+        broken_(false) {}
+
+  RingHeader* header() {
+    return static_cast<RingHeader*>(memory_->memory());
+  }
+
+  char* data_area() {
+    return static_cast<char*>(memory_->memory()) + sizeof(RingHeader);
+  }
+
+  void WriteRecordHeader(uint32 offset, uint32 size) {
+    memcpy(data_area() + offset, &size, kRecordHeaderSize);
+  }
+
+  uint32 ReadRecordHeader(uint32 offset) {
+    uint32 size;
+    memcpy(&size, data_area() + offset, kRecordHeaderSize);
+    return size;
+  }
+
+  bool MarkBroken() {
+    LOG(ERROR) << "Invalid data found in extension shared transport, "
+               << "ignoring further messages from it.";
+    broken_ = true;
+    return false;
+  }
+
+  scoped_ptr<base::SharedMemory> memory_;
+
+  // Write position when this side is the producer, read position when it is
+  // the consumer. Kept locally so the peer can't change it under our feet.
+  uint32 position_;
+
+  bool broken_;
+
+  DISALLOW_COPY_AND_ASSIGN(Ring);
+};
+
+// static
+bool XWalkExtensionSharedTransport::IsEnabled() {
+#if defined(OS_POSIX)
+  return CommandLine::ForCurrentProcess()->HasSwitch(
+      switches::kXWalkExtensionSharedTransport);
+#else
+  return false;
+#endif
+}
+
+// static
+scoped_ptr<XWalkExtensionSharedTransport>
+XWalkExtensionSharedTransport::Create() {
+  scoped_ptr<Ring> incoming(Ring::Create());
+  scoped_ptr<Ring> outgoing(Ring::Create());
+  if (!incoming || !outgoing)
+    return scoped_ptr<XWalkExtensionSharedTransport>();
+  return scoped_ptr<XWalkExtensionSharedTransport>(
+      new XWalkExtensionSharedTransport(incoming.Pass(), outgoing.Pass()));
+}
+
+// static
+scoped_ptr<XWalkExtensionSharedTransport>
+XWalkExtensionSharedTransport::CreateFromHandles(
+    base::SharedMemoryHandle incoming_handle,
+    base::SharedMemoryHandle outgoing_handle) {
+  scoped_ptr<Ring> incoming(Ring::CreateFromHandle(incoming_handle));
+  scoped_ptr<Ring> outgoing(Ring::CreateFromHandle(outgoing_handle));
+  if (!incoming || !outgoing)
+    return scoped_ptr<XWalkExtensionSharedTransport>();
+  return scoped_ptr<XWalkExtensionSharedTransport>(
+      new XWalkExtensionSharedTransport(incoming.Pass(), outgoing.Pass()));
+}
+
+XWalkExtensionSharedTransport::XWalkExtensionSharedTransport(
+    scoped_ptr<Ring> incoming, scoped_ptr<Ring> outgoing)
+    : incoming_(incoming.Pass()),
+      outgoing_(outgoing.Pass()),
+      paused_(false),
+      channel_sequence_(0) {}
+
+XWalkExtensionSharedTransport::~XWalkExtensionSharedTransport() {}
+
+bool XWalkExtensionSharedTransport::ShareWithPeer(
+    base::ProcessHandle peer_process,
+    base::SharedMemoryHandle* peer_incoming,
+    base::SharedMemoryHandle* peer_outgoing) {
+  return outgoing_->Share(peer_process, peer_incoming) &&
+         incoming_->Share(peer_process, peer_outgoing);
+}
+
+// static
+bool XWalkExtensionSharedTransport::CanSend(const IPC::Message& msg) {
+  if (msg.is_sync() || msg.is_reply())
+    return false;
+#if defined(OS_POSIX)
+  if (msg.HasFileDescriptors())
+    return false;
+#endif
+  return msg.size() <= kMaxMessageSize;
+}
+
+bool XWalkExtensionSharedTransport::Send(const IPC::Message& msg,
+                                         bool* wake_up_peer) {
+  DCHECK(CanSend(msg));
+  if (paused_)
+    return false;
+  return outgoing_->Write(static_cast<const char*>(msg.data()), msg.size(),
+                          wake_up_peer);
+}
+
+bool XWalkExtensionSharedTransport::OnSentThroughChannel(uint32* sequence) {
+  channel_sequence_++;
+  if (paused_)
+    return false;
+  paused_ = true;
+  *sequence = channel_sequence_;
+  return true;
+}
+
+bool XWalkExtensionSharedTransport::OnPauseAcknowledged(
+    uint32 sequence, uint32* next_sequence) {
+  if (!paused_)
+    return false;
+  if (sequence == channel_sequence_) {
+    paused_ = false;
+    return false;
+  }
+  *next_sequence = channel_sequence_;
+  return true;
+}
+
+bool XWalkExtensionSharedTransport::Receive(std::string* buffer) {
+  if (incoming_->Read(buffer))
+    return true;
+
+  // Park and check again, a message could have been written after our read
+  // but before the producer could see we are parked.
+  incoming_->Park();
+  if (!incoming_->Read(buffer))
+    return false;
+  incoming_->Unpark();
+  return true;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,109 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_TRANSPORT_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_TRANSPORT_H_
+
+#include <string>
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/shared_memory.h"
+
+namespace IPC {
+class Message;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Optional transport used between XWalkExtensionServer and
+// XWalkExtensionClient to exchange asynchronous messages without paying one
+// socket write per message. Each direction is a single-producer
+// single-consumer ring buffer living in shared memory, the IPC channel is
+// still used as control plane and to wake up the consumer.
+//
+// The consumer is only woken up when it has drained the ring and parked, so a
+// burst of messages costs a single wake up message in the IPC channel. The
+// consumer must drain the ring before handling any message received from the
+// IPC channel, this keeps the order between messages sent through the ring
+// and the ones that had to go through the channel (e.g. when the ring is
+// full). Once a message went through the channel, the following ones also do
+// until the consumer acknowledges it handled them, otherwise they could be
+// read from the ring before it.
+//
+// The server side creates the shared memory and shares it with the client
+// side, see XWalkExtensionClientMsg_SharedTransportCreated.
+class XWalkExtensionSharedTransport {
+ public:
+  // Returns true if the transport was enabled in the command line and is
+  // supported by the platform.
+  static bool IsEnabled();
+
+  // Creates a new transport, allocating the shared memory for both rings.
+  static scoped_ptr<XWalkExtensionSharedTransport> Create();
+
+  // Creates a transport from the handles shared by the peer in
+  // ShareWithPeer(). Note that the peer's outgoing ring is our incoming ring.
+  static scoped_ptr<XWalkExtensionSharedTransport> CreateFromHandles(
+      base::SharedMemoryHandle incoming, base::SharedMemoryHandle outgoing);
+
+  ~XWalkExtensionSharedTransport();
+
+  // Duplicates the handles of the rings for |peer_process|, so they can be
+  // sent to the peer.
+  bool ShareWithPeer(base::ProcessHandle peer_process,
+                     base::SharedMemoryHandle* peer_incoming,
+                     base::SharedMemoryHandle* peer_outgoing);
+
+  // Returns whether |msg| can be sent using the shared transport. Messages
+  // carrying handles and synchronous messages must use the IPC channel.
+  static bool CanSend(const IPC::Message& msg);
+
+  // Writes |msg| to the outgoing ring, |wake_up_peer| is set when the
+  // consumer is parked and a wake up message should be sent to it through
+  // the IPC channel. Returns false if there's no room for the message, in that
+  // case it should go through the IPC channel. Should be called by only one
+  // thread at a time.
+  bool Send(const IPC::Message& msg, bool* wake_up_peer);
+
+  // Must be called for each asynchronous message sent through the IPC channel
+  // while the transport is in use, except for the ones driving the
+  // transport. Send()
+  // then fails until the peer acknowledges it handled them. Returns true when
+  // the peer should be asked to, with a SharedTransportPaused message
+  // carrying |sequence|.
+  bool OnSentThroughChannel(uint32* sequence);
+
+  // Called when the peer acknowledged the SharedTransportPaused message with
+  // |sequence|. Returns true if more messages went through the channel
+  // meanwhile, and the peer should be asked again with |next_sequence|.
+  bool OnPauseAcknowledged(uint32 sequence, uint32* next_sequence);
+
+  // Reads the next message from the incoming ring into |buffer|, which can be
+  // used to create an IPC::Message. Returns false when the ring is empty, in
+  // that case the consumer is parked and the peer will wake it up when new
+  // messages are written.
+  bool Receive(std::string* buffer);
+
+ private:
+  class Ring;
+
+  XWalkExtensionSharedTransport(scoped_ptr<Ring> incoming,
+                                scoped_ptr<Ring> outgoing);
+
+  scoped_ptr<Ring> incoming_;
+  scoped_ptr<Ring> outgoing_;
+
+  // Whether messages are sent through the IPC channel until the peer
+  // acknowledges |channel_sequence_|, the count of messages sent through it.
+  bool paused_;
+  uint32 channel_sequence_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionSharedTransport);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_TRANSPORT_H_
@@ -0,0 +1,117 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_shared_transport.h"
+
+#include <string.h>
+#include <string>
+#include "base/memory/shared_memory.h"
+#include "base/process_util.h"
+#include "ipc/ipc_message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionSharedTransport;
+
+namespace {
+
+// Must match the layout of the rings in xwalk_extension_shared_transport.cc.
+const uint32 kRingHeaderSize = 16;
+const uint32 kRingCapacity = 256 * 1024;
+const uint32 kRecordHeaderSize = 4;
+
+// Writes a record header of |size| at |offset| of the data area.
+void ForgeRecordHeader(char* ring, uint32 offset, uint32 size) {
+  memcpy(ring + kRingHeaderSize + offset, &size, kRecordHeaderSize);
+}
+
+void ForgeWritePosition(char* ring, uint32 position) {
+  memcpy(ring, &position, sizeof(position));
+}
+
+IPC::Message* CreateMessage() {
+  IPC::Message* msg =
+      new IPC::Message(MSG_ROUTING_CONTROL, 1, IPC::Message::PRIORITY_NORMAL);
+  msg->WriteInt(42);
+  return msg;
+}
+
+}  // namespace
+
+TEST(XWalkExtensionSharedTransportTest, RejectsRecordsPastEndOfRing) {
+  scoped_ptr<XWalkExtensionSharedTransport> producer(
+      XWalkExtensionSharedTransport::Create());
+  ASSERT_TRUE(producer);
+
+  // Both ends are in this process.
+  const base::ProcessHandle process = base::GetCurrentProcessHandle();
+  base::SharedMemoryHandle incoming;
+  base::SharedMemoryHandle outgoing;
+  ASSERT_TRUE(producer->ShareWithPeer(process, &incoming, &outgoing));
+  scoped_ptr<XWalkExtensionSharedTransport> consumer(
+      XWalkExtensionSharedTransport::CreateFromHandles(incoming, outgoing));
+  ASSERT_TRUE(consumer);
+
+  // A second mapping of the ring read by |consumer|, playing a malicious
+  // producer.
+  ASSERT_TRUE(producer->ShareWithPeer(process, &incoming, &outgoing));
+  base::SharedMemory ring_memory(incoming, false);
+  base::SharedMemory unused_memory(outgoing, false);
+  ASSERT_TRUE(ring_memory.Map(kRingHeaderSize + kRingCapacity));
+  char* ring = static_cast<char*>(ring_memory.memory());
+
+  // Valid records filling the ring up to 8 bytes before its end.
+  const uint32 kFullRecord = 64 * 1024;
+  uint32 position = 0;
+  for (int i = 0; i < 3; ++i) {
+    ForgeRecordHeader(ring, position, kFullRecord - kRecordHeaderSize);
+    position += kFullRecord;
+  }
+  const uint32 last_size = kRingCapacity - 8 - position - kRecordHeaderSize;
+  ForgeRecordHeader(ring, position, last_size);
+  position += kRecordHeaderSize + last_size;
+  ASSERT_EQ(kRingCapacity - 8, position);
+
+  // Then one claiming to go past the end of the mapping.
+  const uint32 bad_size = 1000;
+  ForgeRecordHeader(ring, position, bad_size);
+  ForgeWritePosition(ring, position + kRecordHeaderSize + bad_size);
+
+  std::string buffer;
+  for (int i = 0; i < 4; ++i)
+    EXPECT_TRUE(consumer->Receive(&buffer));
+  EXPECT_EQ(last_size, buffer.size());
+  EXPECT_FALSE(consumer->Receive(&buffer));
+
+  // The ring is not read anymore, even if valid data comes later.
+  ForgeRecordHeader(ring, position, 4);
+  ForgeWritePosition(ring, position + 8);
+  EXPECT_FALSE(consumer->Receive(&buffer));
+}
+
+TEST(XWalkExtensionSharedTransportTest, PausesAfterChannelFallback) {
+  scoped_ptr<XWalkExtensionSharedTransport> transport(
+      XWalkExtensionSharedTransport::Create());
+  ASSERT_TRUE(transport);
+
+  scoped_ptr<IPC::Message> msg(CreateMessage());
+  bool wake_up_peer = false;
+  EXPECT_TRUE(transport->Send(*msg, &wake_up_peer));
+
+  uint32 sequence = 0;
+  EXPECT_TRUE(transport->OnSentThroughChannel(&sequence));
+  EXPECT_FALSE(transport->Send(*msg, &wake_up_peer));
+
+  // Already waiting for the peer, no need to ask again.
+  uint32 unused = 0;
+  EXPECT_FALSE(transport->OnSentThroughChannel(&unused));
+
+  // The acknowledgement doesn't cover the second message yet.
+  uint32 next_sequence = 0;
+  EXPECT_TRUE(transport->OnPauseAcknowledged(sequence, &next_sequence));
+  EXPECT_NE(sequence, next_sequence);
+  EXPECT_FALSE(transport->Send(*msg, &wake_up_peer));
+
+  EXPECT_FALSE(transport->OnPauseAcknowledged(next_sequence, &unused));
+  EXPECT_TRUE(transport->Send(*msg, &wake_up_peer));
+}
@@ -16,4 +16,23 @@ const char kXWalkDisableExtensionProcess[] =
 // Used internally to launch an extension process.
 const char kXWalkExtensionProcess[] = "xwalk-extension-process";
 
+// Exchange asynchronous extension messages using shared memory ring buffers
+// instead of one IPC message per extension message.
+const char kXWalkExtensionSharedTransport[] = "extension-shared-transport";
+
+// Decides how external extensions are placed in extension processes: "single"
+// (the default) loads all of them in one process, "process-per-extension"
+// gives each extension library its own process and "groups" follows the file
+// passed with --extension-process-groups.
+const char kXWalkExtensionProcessModel[] = "extension-process-model";
+
+// JSON file listing the groups of extension libraries sharing a process, e.g.
+// [["libfoo.so", "libbar.so"], ["libbaz.so"]]. Libraries not listed share one
+// more process.
+const char kXWalkExtensionProcessGroups[] = "extension-process-groups";
+
+// Keeps a render process channel ready in each extension process, so a new
+// render process gets one without waiting for the extension process.
+const char kXWalkExtensionProcessWarmSpare[] = "extension-process-warm-spare";
+
 }  // namespace switches
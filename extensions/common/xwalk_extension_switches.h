@@ -10,6 +10,10 @@ namespace switches {
 
 extern const char kXWalkDisableExtensionProcess[];
 extern const char kXWalkExtensionProcess[];
+extern const char kXWalkExtensionSharedTransport[];
+extern const char kXWalkExtensionProcessModel[];
+extern const char kXWalkExtensionProcessGroups[];
+extern const char kXWalkExtensionProcessWarmSpare[];
 
 }  // namespace switches
 
@@ -0,0 +1,462 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
+
+#include <string.h>
+#include <vector>
+#include "base/logging.h"
+#include "base/values.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+enum Tag {
+  kTagNull = 0,
+  kTagFalse,
+  kTagTrue,
+  kTagInteger,
+  kTagDouble,
+  kTagString,
+  kTagBinary,
+  kTagArray,
+  kTagObject,
+  kTagEnd,
+};
+
+uint64_t ZigZagEncode(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+      static_cast<uint32_t>(value >> 31);
+}
+
+int32_t ZigZagDecode(uint64_t value) {
+  const uint32_t bits = static_cast<uint32_t>(value);
+  return static_cast<int32_t>((bits >> 1) ^ (~(bits & 1) + 1));
+}
+
+}  // namespace
+
+XWalkExtensionWireWriter::XWalkExtensionWireWriter(std::string* data)
+    : data_(data) {}
+
+void XWalkExtensionWireWriter::WriteTag(uint8 tag) {
+  data_->push_back(static_cast<char>(tag));
+}
+
+void XWalkExtensionWireWriter::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    data_->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  data_->push_back(static_cast<char>(value));
+}
+
+void XWalkExtensionWireWriter::WriteNull() {
+  WriteTag(kTagNull);
+}
+
+void XWalkExtensionWireWriter::WriteBoolean(bool value) {
+  WriteTag(value ? kTagTrue : kTagFalse);
+}
+
+void XWalkExtensionWireWriter::WriteInteger(int32_t value) {
+  WriteTag(kTagInteger);
+  WriteVarint(ZigZagEncode(value));
+}
+
+void XWalkExtensionWireWriter::WriteDouble(double value) {
+  WriteTag(kTagDouble);
+  data_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void XWalkExtensionWireWriter::WriteString(const char* value,
+                                           size_t length) {
+  memcpy(AllocateString(length), value, length);
+}
+
+char* XWalkExtensionWireWriter::AllocateString(size_t length) {
+  WriteTag(kTagString);
+  WriteVarint(length);
+  const size_t offset = data_->size();
+  // The terminator is already in place, the caller only fills the bytes.
+  data_->resize(offset + length + 1);
+  return &(*data_)[offset];
+}
+
+void XWalkExtensionWireWriter::WriteBinary(const char* value, size_t size) {
+  WriteTag(kTagBinary);
+  WriteVarint(size);
+  data_->append(value, size);
+}
+
+void XWalkExtensionWireWriter::BeginArray() {
+  WriteTag(kTagArray);
+}
+
+void XWalkExtensionWireWriter::BeginObject() {
+  WriteTag(kTagObject);
+}
+
+void XWalkExtensionWireWriter::EndContainer() {
+  WriteTag(kTagEnd);
+}
+
+XWalkExtensionWireReader::XWalkExtensionWireReader(const char* data,
+                                                   size_t size)
+    : position_(data),
+      end_(data + size) {}
+
+XWalkExtensionWireReader::XWalkExtensionWireReader(const std::string& data)
+    : position_(data.data()),
+      end_(data.data() + data.size()) {}
+
+XWalkExtensionWireReader::Type XWalkExtensionWireReader::PeekType() const {
+  if (position_ == end_)
+    return TYPE_INVALID;
+
+  switch (static_cast<uint8>(*position_)) {
+    case kTagNull:
+      return TYPE_NULL;
+    case kTagFalse:
+    case kTagTrue:
+      return TYPE_BOOLEAN;
+    case kTagInteger:
+      return TYPE_INTEGER;
+    case kTagDouble:
+      return TYPE_DOUBLE;
+    case kTagString:
+      return TYPE_STRING;
+    case kTagBinary:
+      return TYPE_BINARY;
+    case kTagArray:
+      return TYPE_ARRAY;
+    case kTagObject:
+      return TYPE_OBJECT;
+    case kTagEnd:
+      return TYPE_END;
+  }
+  return TYPE_INVALID;
+}
+
+bool XWalkExtensionWireReader::ReadVarint(const char** position,
+                                          uint64_t* value) const {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*position == end_)
+      return false;
+    const uint8 byte = static_cast<uint8>(*(*position)++);
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool XWalkExtensionWireReader::ReadSizedBytes(const char** position,
+                                              const char** bytes,
+                                              size_t* size) const {
+  uint64_t length;
+  if (!ReadVarint(position, &length) ||
+      length > static_cast<uint64_t>(end_ - *position))
+    return false;
+  *bytes = *position;
+  *size = static_cast<size_t>(length);
+  *position += *size;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadNull() {
+  if (PeekType() != TYPE_NULL)
+    return false;
+  position_++;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadBoolean(bool* value) {
+  if (PeekType() != TYPE_BOOLEAN)
+    return false;
+  *value = *position_++ == kTagTrue;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadInteger(int32_t* value) {
+  if (PeekType() != TYPE_INTEGER)
+    return false;
+  const char* position = position_ + 1;
+  uint64_t encoded;
+  if (!ReadVarint(&position, &encoded) || encoded > 0xffffffffULL)
+    return false;
+  *value = ZigZagDecode(encoded);
+  position_ = position;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadDouble(double* value) {
+  if (PeekType() != TYPE_DOUBLE ||
+      static_cast<size_t>(end_ - position_) < 1 + sizeof(*value))
+    return false;
+  memcpy(value, position_ + 1, sizeof(*value));
+  position_ += 1 + sizeof(*value);
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadString(const char** value,
+                                          size_t* length) {
+  if (PeekType() != TYPE_STRING)
+    return false;
+  const char* position = position_ + 1;
+  // The terminator must be there, so the string can be used as a C string.
+  if (!ReadSizedBytes(&position, value, length) || position == end_ ||
+      *position != '\0')
+    return false;
+  position_ = position + 1;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadBinary(const char** value, size_t* size) {
+  if (PeekType() != TYPE_BINARY)
+    return false;
+  const char* position = position_ + 1;
+  if (!ReadSizedBytes(&position, value, size))
+    return false;
+  position_ = position;
+  return true;
+}
+
+bool XWalkExtensionWireReader::EnterArray() {
+  if (PeekType() != TYPE_ARRAY)
+    return false;
+  position_++;
+  return true;
+}
+
+bool XWalkExtensionWireReader::EnterObject() {
+  if (PeekType() != TYPE_OBJECT)
+    return false;
+  position_++;
+  return true;
+}
+
+bool XWalkExtensionWireReader::ReadEnd() {
+  if (PeekType() != TYPE_END)
+    return false;
+  position_++;
+  return true;
+}
+
+bool XWalkExtensionWireReader::SkipValue() {
+  const char* start = position_;
+  // Whether each container being skipped is an object, whose values are
+  // preceded by their keys.
+  std::vector<bool> in_object;
+  do {
+    if (!in_object.empty() && ReadEnd()) {
+      in_object.pop_back();
+      continue;
+    }
+
+    const char* bytes;
+    size_t size;
+    bool skipped = in_object.empty() || !in_object.back() ||
+        ReadString(&bytes, &size);
+    switch (skipped ? PeekType() : TYPE_INVALID) {
+      case TYPE_NULL:
+        skipped = ReadNull();
+        break;
+      case TYPE_BOOLEAN: {
+        bool value;
+        skipped = ReadBoolean(&value);
+        break;
+      }
+      case TYPE_INTEGER: {
+        int32_t value;
+        skipped = ReadInteger(&value);
+        break;
+      }
+      case TYPE_DOUBLE: {
+        double value;
+        skipped = ReadDouble(&value);
+        break;
+      }
+      case TYPE_STRING:
+        skipped = ReadString(&bytes, &size);
+        break;
+      case TYPE_BINARY:
+        skipped = ReadBinary(&bytes, &size);
+        break;
+      case TYPE_ARRAY:
+        skipped = EnterArray();
+        in_object.push_back(false);
+        break;
+      case TYPE_OBJECT:
+        skipped = EnterObject();
+        in_object.push_back(true);
+        break;
+      case TYPE_END:
+      case TYPE_INVALID:
+        skipped = false;
+        break;
+    }
+
+    if (!skipped) {
+      position_ = start;
+      return false;
+    }
+  } while (!in_object.empty());
+  return true;
+}
+
+namespace {
+
+void WriteValue(const base::Value& value, XWalkExtensionWireWriter* writer) {
+  switch (value.GetType()) {
+    case base::Value::TYPE_BOOLEAN: {
+      bool boolean_value = false;
+      value.GetAsBoolean(&boolean_value);
+      writer->WriteBoolean(boolean_value);
+      break;
+    }
+    case base::Value::TYPE_INTEGER: {
+      int integer_value = 0;
+      value.GetAsInteger(&integer_value);
+      writer->WriteInteger(integer_value);
+      break;
+    }
+    case base::Value::TYPE_DOUBLE: {
+      double double_value = 0;
+      value.GetAsDouble(&double_value);
+      writer->WriteDouble(double_value);
+      break;
+    }
+    case base::Value::TYPE_STRING: {
+      std::string string_value;
+      value.GetAsString(&string_value);
+      writer->WriteString(string_value.data(), string_value.size());
+      break;
+    }
+    case base::Value::TYPE_BINARY: {
+      const base::BinaryValue& binary_value =
+          static_cast<const base::BinaryValue&>(value);
+      writer->WriteBinary(binary_value.GetBuffer(), binary_value.GetSize());
+      break;
+    }
+    case base::Value::TYPE_LIST: {
+      const base::ListValue& list_value =
+          static_cast<const base::ListValue&>(value);
+      writer->BeginArray();
+      for (base::ListValue::const_iterator it = list_value.begin();
+           it != list_value.end(); ++it)
+        WriteValue(**it, writer);
+      writer->EndContainer();
+      break;
+    }
+    case base::Value::TYPE_DICTIONARY: {
+      const base::DictionaryValue& dictionary_value =
+          static_cast<const base::DictionaryValue&>(value);
+      writer->BeginObject();
+      for (base::DictionaryValue::Iterator it(dictionary_value);
+           !it.IsAtEnd(); it.Advance()) {
+        writer->WriteString(it.key().data(), it.key().size());
+        WriteValue(it.value(), writer);
+      }
+      writer->EndContainer();
+      break;
+    }
+    default:
+      writer->WriteNull();
+      break;
+  }
+}
+
+base::Value* ReadValue(XWalkExtensionWireReader* reader, int depth) {
+  const char* bytes;
+  size_t size;
+  switch (reader->PeekType()) {
+    case XWalkExtensionWireReader::TYPE_NULL:
+      reader->ReadNull();
+      return base::Value::CreateNullValue();
+    case XWalkExtensionWireReader::TYPE_BOOLEAN: {
+      bool value;
+      if (!reader->ReadBoolean(&value))
+        return NULL;
+      return base::Value::CreateBooleanValue(value);
+    }
+    case XWalkExtensionWireReader::TYPE_INTEGER: {
+      int32_t value;
+      if (!reader->ReadInteger(&value))
+        return NULL;
+      return base::Value::CreateIntegerValue(value);
+    }
+    case XWalkExtensionWireReader::TYPE_DOUBLE: {
+      double value;
+      if (!reader->ReadDouble(&value))
+        return NULL;
+      return base::Value::CreateDoubleValue(value);
+    }
+    case XWalkExtensionWireReader::TYPE_STRING:
+      if (!reader->ReadString(&bytes, &size))
+        return NULL;
+      return new base::StringValue(std::string(bytes, size));
+    case XWalkExtensionWireReader::TYPE_BINARY:
+      if (!reader->ReadBinary(&bytes, &size))
+        return NULL;
+      return base::BinaryValue::CreateWithCopiedBuffer(bytes, size);
+    case XWalkExtensionWireReader::TYPE_ARRAY: {
+      if (depth >= XWalkExtensionWireReader::kMaxNestingDepth ||
+          !reader->EnterArray())
+        return NULL;
+      scoped_ptr<base::ListValue> list(new base::ListValue);
+      while (!reader->ReadEnd()) {
+        base::Value* item = ReadValue(reader, depth + 1);
+        if (!item)
+          return NULL;
+        list->Append(item);
+      }
+      return list.release();
+    }
+    case XWalkExtensionWireReader::TYPE_OBJECT: {
+      if (depth >= XWalkExtensionWireReader::kMaxNestingDepth ||
+          !reader->EnterObject())
+        return NULL;
+      scoped_ptr<base::DictionaryValue> dictionary(new base::DictionaryValue);
+      while (!reader->ReadEnd()) {
+        if (!reader->ReadString(&bytes, &size))
+          return NULL;
+        base::Value* item = ReadValue(reader, depth + 1);
+        if (!item)
+          return NULL;
+        dictionary->SetWithoutPathExpansion(std::string(bytes, size), item);
+      }
+      return dictionary.release();
+    }
+    default:
+      return NULL;
+  }
+}
+
+}  // namespace
+
+void ValueToWireFormat(const base::Value& value, std::string* data) {
+  XWalkExtensionWireWriter writer(data);
+  WriteValue(value, &writer);
+}
+
+scoped_ptr<base::Value> WireFormatToValue(const std::string& data) {
+  XWalkExtensionWireReader reader(data);
+  scoped_ptr<base::Value> value(ReadValue(&reader, 0));
+  if (!reader.IsAtEnd())
+    return scoped_ptr<base::Value>();
+  return value.Pass();
+}
+
+scoped_ptr<base::Value> ReadWireFormatValue(XWalkExtensionWireReader* reader) {
+  return make_scoped_ptr(ReadValue(reader, 0));
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,143 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_WIRE_FORMAT_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_WIRE_FORMAT_H_
+
+#include <stdint.h>
+#include <string>
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+
+namespace base {
+class Value;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Compact binary encoding of the messages exchanged between the JavaScript
+// code of an extension and its native side. The render process writes it
+// directly from V8 values and reads it directly into V8 values, see
+// renderer/xwalk_v8_wire_format.h. The native side can read it in place with
+// XWalkExtensionWireReader, base::Value is only an adapter for the extensions
+// that still use it.
+//
+// A message is a single value. Each value starts with a tag byte, followed by
+// its payload:
+//
+// - null, false and true have no payload.
+// - integers are stored as zigzag varints, doubles as 8 bytes in host order
+//   since both sides always run in the same machine.
+// - strings are UTF-8, stored as a varint length followed by the bytes and a
+//   NUL terminator not included in the length, so they can be handed out as
+//   C strings without copying.
+// - binary data is stored as a varint size followed by the bytes.
+// - arrays are a sequence of values closed by an end tag, objects a sequence
+//   of string keys each followed by its value, closed by an end tag.
+class XWalkExtensionWireWriter {
+ public:
+  // Appends to |data|, which must outlive the writer.
+  explicit XWalkExtensionWireWriter(std::string* data);
+
+  void WriteNull();
+  void WriteBoolean(bool value);
+  void WriteInteger(int32_t value);
+  void WriteDouble(double value);
+  void WriteString(const char* value, size_t length);
+  void WriteBinary(const char* value, size_t size);
+
+  // Writes the header of a string of |length| bytes and returns where its
+  // bytes must be written. The pointer is only valid until the next write.
+  char* AllocateString(size_t length);
+
+  // Object keys are written with WriteString() or AllocateString().
+  void BeginArray();
+  void BeginObject();
+  void EndContainer();
+
+ private:
+  void WriteTag(uint8 tag);
+  void WriteVarint(uint64_t value);
+
+  std::string* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionWireWriter);
+};
+
+// Reads values written by XWalkExtensionWireWriter from a buffer, without
+// copying them. Pointers returned point into the buffer, which must outlive
+// the reader. All the Read functions return false if the next value is not of
+// the expected type or is malformed, in that case nothing is consumed.
+class XWalkExtensionWireReader {
+ public:
+  enum Type {
+    TYPE_NULL,
+    TYPE_BOOLEAN,
+    TYPE_INTEGER,
+    TYPE_DOUBLE,
+    TYPE_STRING,
+    TYPE_BINARY,
+    TYPE_ARRAY,
+    TYPE_OBJECT,
+    // Closes the array or object being read.
+    TYPE_END,
+    // The buffer is exhausted or corrupted.
+    TYPE_INVALID,
+  };
+
+  // Deepest nesting of arrays and objects decoders should accept, deeper
+  // values are likely cycles or malicious.
+  static const int kMaxNestingDepth = 100;
+
+  XWalkExtensionWireReader(const char* data, size_t size);
+  explicit XWalkExtensionWireReader(const std::string& data);
+
+  // Returns the type of the next value without consuming it.
+  Type PeekType() const;
+
+  bool ReadNull();
+  bool ReadBoolean(bool* value);
+  bool ReadInteger(int32_t* value);
+  bool ReadDouble(double* value);
+  // |value| is NUL terminated, |length| doesn't count the terminator.
+  bool ReadString(const char** value, size_t* length);
+  bool ReadBinary(const char** value, size_t* size);
+
+  // After entering a container its values are read until ReadEnd() succeeds.
+  // Objects alternate ReadString() for the key with reading a value.
+  bool EnterArray();
+  bool EnterObject();
+  bool ReadEnd();
+
+  // Skips the next value, including everything inside it.
+  bool SkipValue();
+
+  // Returns whether the whole buffer was consumed.
+  bool IsAtEnd() const { return position_ == end_; }
+
+ private:
+  bool ReadVarint(const char** position, uint64_t* value) const;
+  bool ReadSizedBytes(const char** position, const char** bytes,
+                      size_t* size) const;
+
+  const char* position_;
+  const char* end_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionWireReader);
+};
+
+// Adapters for the extensions using base::Value.
+void ValueToWireFormat(const base::Value& value, std::string* data);
+
+// Returns NULL if |data| is not a single valid value.
+scoped_ptr<base::Value> WireFormatToValue(const std::string& data);
+
+// Reads the next value of |reader|, returns NULL if it is malformed.
+scoped_ptr<base::Value> ReadWireFormatValue(XWalkExtensionWireReader* reader);
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_WIRE_FORMAT_H_
@@ -0,0 +1,102 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
+
+#include <string.h>
+#include <string>
+
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::ValueToWireFormat;
+using xwalk::extensions::WireFormatToValue;
+using xwalk::extensions::XWalkExtensionWireReader;
+using xwalk::extensions::XWalkExtensionWireWriter;
+
+TEST(XWalkExtensionWireFormatTest, ValueRoundTrip) {
+  base::DictionaryValue dictionary;
+  dictionary.SetWithoutPathExpansion("key.with.dots",
+                                     base::Value::CreateIntegerValue(-42));
+  dictionary.SetDouble("double", 0.5);
+  dictionary.SetString("string", "text");
+  dictionary.SetBoolean("boolean", true);
+  dictionary.Set("null", base::Value::CreateNullValue());
+  dictionary.Set("binary",
+                 base::BinaryValue::CreateWithCopiedBuffer("\0\1\2", 3));
+  base::ListValue* list = new base::ListValue;
+  list->AppendInteger(2147483647);
+  list->AppendInteger(-2147483647 - 1);
+  list->Append(new base::DictionaryValue);
+  dictionary.Set("list", list);
+
+  std::string data;
+  ValueToWireFormat(dictionary, &data);
+  scoped_ptr<base::Value> value(WireFormatToValue(data));
+  ASSERT_TRUE(value);
+  EXPECT_TRUE(dictionary.Equals(value.get()));
+}
+
+TEST(XWalkExtensionWireFormatTest, ReadInPlace) {
+  std::string data;
+  XWalkExtensionWireWriter writer(&data);
+  writer.BeginObject();
+  writer.WriteString("first", 5);
+  writer.BeginArray();
+  writer.WriteInteger(1);
+  writer.WriteString("nested", 6);
+  writer.EndContainer();
+  writer.WriteString("second", 6);
+  writer.WriteString("value", 5);
+  writer.EndContainer();
+
+  XWalkExtensionWireReader reader(data);
+  const char* string;
+  size_t length;
+  ASSERT_TRUE(reader.EnterObject());
+  ASSERT_TRUE(reader.ReadString(&string, &length));
+  EXPECT_STREQ("first", string);
+  EXPECT_TRUE(reader.SkipValue());
+  ASSERT_TRUE(reader.ReadString(&string, &length));
+  EXPECT_STREQ("second", string);
+
+  // Strings point into the buffer and are NUL terminated.
+  ASSERT_TRUE(reader.ReadString(&string, &length));
+  EXPECT_EQ(5u, length);
+  EXPECT_STREQ("value", string);
+  EXPECT_GE(string, data.data());
+  EXPECT_LT(string, data.data() + data.size());
+
+  EXPECT_TRUE(reader.ReadEnd());
+  EXPECT_TRUE(reader.IsAtEnd());
+}
+
+TEST(XWalkExtensionWireFormatTest, RejectMalformed) {
+  std::string data;
+  XWalkExtensionWireWriter writer(&data);
+  writer.BeginArray();
+  writer.WriteString("text", 4);
+  writer.WriteDouble(1.5);
+  writer.EndContainer();
+
+  // Every truncation of a valid message is rejected.
+  for (size_t size = 0; size < data.size(); ++size) {
+    EXPECT_FALSE(WireFormatToValue(data.substr(0, size)))
+        << "Truncated at " << size;
+    XWalkExtensionWireReader reader(data.data(), size);
+    EXPECT_FALSE(reader.SkipValue()) << "Truncated at " << size;
+  }
+
+  // Trailing bytes are not part of any value.
+  EXPECT_FALSE(WireFormatToValue(data + data));
+
+  // Too deep nesting is rejected.
+  std::string deep;
+  XWalkExtensionWireWriter deep_writer(&deep);
+  for (int i = 0; i <= XWalkExtensionWireReader::kMaxNestingDepth; ++i)
+    deep_writer.BeginArray();
+  for (int i = 0; i <= XWalkExtensionWireReader::kMaxNestingDepth; ++i)
+    deep_writer.EndContainer();
+  EXPECT_FALSE(WireFormatToValue(deep));
+}
@@ -9,9 +9,7 @@
 namespace xwalk {
 namespace extensions {
 
-XWalkExternalAdapter::XWalkExternalAdapter()
-    : next_xw_extension_(1),
-      next_xw_instance_(1) {}
+XWalkExternalAdapter::XWalkExternalAdapter() {}
 
 XWalkExternalAdapter::~XWalkExternalAdapter() {}
 
@@ -19,42 +17,27 @@ XWalkExternalAdapter* XWalkExternalAdapter::GetInstance() {
   return Singleton<XWalkExternalAdapter>::get();
 }
 
-XW_Extension XWalkExternalAdapter::GetNextXWExtension() {
-  return next_xw_extension_++;
-}
-
-XW_Instance XWalkExternalAdapter::GetNextXWInstance() {
-  return next_xw_instance_++;
-}
-
-void XWalkExternalAdapter::RegisterExtension(
+XW_Extension XWalkExternalAdapter::RegisterExtension(
     XWalkExternalExtension* extension) {
-  XW_Extension xw_extension = extension->xw_extension_;
-  CHECK(IsValidXWExtension(xw_extension));
-  CHECK(extension_map_.find(xw_extension) == extension_map_.end());
-  extension_map_[xw_extension] = extension;
+  XW_Extension xw_extension = extensions_.Add(extension);
+  CHECK(xw_extension) << "Too many external extensions.";
+  return xw_extension;
 }
 
 void XWalkExternalAdapter::UnregisterExtension(
     XWalkExternalExtension* extension) {
-  XW_Extension xw_extension = extension->xw_extension_;
-  CHECK(IsValidXWExtension(xw_extension));
-  CHECK(extension_map_.find(xw_extension) != extension_map_.end());
-  extension_map_.erase(xw_extension);
+  CHECK(extensions_.Remove(extension->xw_extension_));
 }
 
-void XWalkExternalAdapter::RegisterInstance(XWalkExternalInstance* context) {
-  XW_Instance xw_instance = context->xw_instance_;
-  CHECK(IsValidXWInstance(xw_instance));
-  CHECK(instance_map_.find(xw_instance) == instance_map_.end());
-  instance_map_[xw_instance] = context;
+XW_Instance XWalkExternalAdapter::RegisterInstance(
+    XWalkExternalInstance* context) {
+  XW_Instance xw_instance = instances_.Add(context);
+  CHECK(xw_instance) << "Too many external extension instances.";
+  return xw_instance;
 }
 
 void XWalkExternalAdapter::UnregisterInstance(XWalkExternalInstance* context) {
-  XW_Instance xw_instance = context->xw_instance_;
-  CHECK(IsValidXWInstance(xw_instance));
-  CHECK(instance_map_.find(xw_instance) != instance_map_.end());
-  instance_map_.erase(xw_instance);
+  CHECK(instances_.Remove(context->xw_instance_));
 }
 
 const void* XWalkExternalAdapter::GetInterface(const char* name) {
@@ -78,6 +61,23 @@ const void* XWalkExternalAdapter::GetInterface(const char* name) {
     return &messagingInterface1;
   }
 
+  if (!strcmp(name, XW_MESSAGING_INTERFACE_2)) {
+    static const XW_MessagingInterface_2 messagingInterface2 = {
+      MessagingRegister,
+      MessagingPostMessage,
+      MessagingPostMessages
+    };
+    return &messagingInterface2;
+  }
+
+  if (!strcmp(name, XW_BINARY_MESSAGING_INTERFACE_1)) {
+    static const XW_BinaryMessagingInterface_1 binaryMessagingInterface1 = {
+      BinaryMessagingRegister,
+      BinaryMessagingPostMessage
+    };
+    return &binaryMessagingInterface1;
+  }
+
   if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1)) {
     static const XW_Internal_SyncMessagingInterface_1
         syncMessagingInterface1 = {
@@ -87,34 +87,77 @@ const void* XWalkExternalAdapter::GetInterface(const char* name) {
     return &syncMessagingInterface1;
   }
 
-  LOG(WARNING) << "Interface '" << name << "' is not supported.";
-  return NULL;
-}
+  if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2)) {
+    static const XW_Internal_SyncMessagingInterface_2
+        syncMessagingInterface2 = {
+      SyncMessagingRegisterWithToken,
+      SyncMessagingSetSyncReplyWithToken
+    };
+    return &syncMessagingInterface2;
+  }
 
-bool XWalkExternalAdapter::IsValidXWExtension(XW_Extension xw_extension) {
-  return xw_extension > 0 && xw_extension < next_xw_extension_;
-}
+  if (!strcmp(name, XW_INTERNAL_THREADING_INTERFACE_1)) {
+    static const XW_Internal_ThreadingInterface_1 threadingInterface1 = {
+      ThreadingSetThreadingModel
+    };
+    return &threadingInterface1;
+  }
+
+  if (!strcmp(name, XW_INTERNAL_EVENT_LOOP_INTERFACE_1)) {
+    static const XW_Internal_EventLoopInterface_1 eventLoopInterface1 = {
+      EventLoopWatchFileDescriptor,
+      EventLoopCancelWatch,
+      EventLoopStartTimer,
+      EventLoopCancelTimer
+    };
+    return &eventLoopInterface1;
+  }
+
+  if (!strcmp(name, XW_INTERNAL_FLOW_CONTROL_INTERFACE_1)) {
+    static const XW_Internal_FlowControlInterface_1 flowControlInterface1 = {
+      FlowControlRegisterWritableCallback,
+      FlowControlIsWritable,
+      FlowControlSetCoalesceMessages
+    };
+    return &flowControlInterface1;
+  }
 
-bool XWalkExternalAdapter::IsValidXWInstance(XW_Instance xw_instance) {
-  return xw_instance > 0 && xw_instance < next_xw_instance_;
+  if (!strcmp(name, XW_INTERNAL_STREAM_INTERFACE_1)) {
+    static const XW_Internal_StreamInterface_1 streamInterface1 = {
+      StreamRegisterStreamCallbacks,
+      StreamRegisterWritableCallback,
+      StreamOpen,
+      StreamWrite,
+      StreamClose
+    };
+    return &streamInterface1;
+  }
+
+  if (!strcmp(name, XW_INTERNAL_SHARED_BUFFER_INTERFACE_1)) {
+    static const XW_Internal_SharedBufferInterface_1 sharedBufferInterface1 = {
+      SharedBufferRegisterReleasedCallback,
+      SharedBufferCreate,
+      SharedBufferGetData,
+      SharedBufferPost,
+      SharedBufferDestroy
+    };
+    return &sharedBufferInterface1;
+  }
+
+  LOG(WARNING) << "Interface '" << name << "' is not supported.";
+  return NULL;
 }
 
 XWalkExternalExtension* XWalkExternalAdapter::GetExtension(
     XW_Extension xw_extension) {
-  XWalkExternalAdapter* adapter = XWalkExternalAdapter::GetInstance();
-  ExtensionMap::iterator it = adapter->extension_map_.find(xw_extension);
-  if (it == adapter->extension_map_.end())
-    return NULL;
-  return it->second;
+  return static_cast<XWalkExternalExtension*>(
+      XWalkExternalAdapter::GetInstance()->extensions_.Lookup(xw_extension));
 }
 
 XWalkExternalInstance* XWalkExternalAdapter::GetInstance(
     XW_Instance xw_instance) {
-  XWalkExternalAdapter* adapter = XWalkExternalAdapter::GetInstance();
-  InstanceMap::iterator it = adapter->instance_map_.find(xw_instance);
-  if (it == adapter->instance_map_.end())
-    return NULL;
-  return it->second;
+  return static_cast<XWalkExternalInstance*>(
+      XWalkExternalAdapter::GetInstance()->instances_.Lookup(xw_instance));
 }
 
 // static
@@ -5,11 +5,16 @@
 #ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_ADAPTER_H_
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_ADAPTER_H_
 
-#include <map>
 #include "base/memory/singleton.h"
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_EventLoop.h"
+#include "xwalk/extensions/public/XW_Extension_FlowControl.h"
+#include "xwalk/extensions/public/XW_Extension_SharedBuffer.h"
+#include "xwalk/extensions/public/XW_Extension_Stream.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
+#include "xwalk/extensions/public/XW_Extension_Threading.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
+#include "xwalk/extensions/common/xwalk_external_handle_table.h"
 #include "xwalk/extensions/common/xwalk_external_instance.h"
 
 // NOTE: Those macros define functions that are used in the structs by
@@ -34,13 +39,74 @@
       ptr->INTERFACE ## NAME(arg1, arg2);                                \
   }
 
+#define DEFINE_FUNCTION_3(TYPE, INTERFACE, NAME, ARG1, ARG2, ARG3)       \
+  static void INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2,    \
+                                ARG3 arg3) {                             \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                       \
+    if (!ptr)                                                            \
+      LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                      \
+    else                                                                 \
+      ptr->INTERFACE ## NAME(arg1, arg2, arg3);                          \
+  }
+
 #define DEFINE_RET_FUNCTION_0(TYPE, INTERFACE, NAME, RET_ARG)   \
   static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw) {            \
     XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);              \
     if (ptr)                                                    \
       return ptr->INTERFACE ## NAME();                          \
     LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);               \
-    return NULL;                                                \
+    return 0;                                                   \
+  }
+
+#define DEFINE_RET_FUNCTION_1(TYPE, INTERFACE, NAME, RET_ARG, ARG1)          \
+  static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1) {              \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                           \
+    if (ptr)                                                                 \
+      return ptr->INTERFACE ## NAME(arg1);                                   \
+    LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                            \
+    return 0;                                                                \
+  }
+
+#define DEFINE_RET_FUNCTION_2(TYPE, INTERFACE, NAME, RET_ARG, ARG1, ARG2)    \
+  static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2) {   \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                           \
+    if (ptr)                                                                 \
+      return ptr->INTERFACE ## NAME(arg1, arg2);                             \
+    LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                            \
+    return 0;                                                                \
+  }
+
+#define DEFINE_RET_FUNCTION_3(TYPE, INTERFACE, NAME, RET_ARG,                \
+                              ARG1, ARG2, ARG3)                              \
+  static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2,     \
+                                   ARG3 arg3) {                              \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                           \
+    if (ptr)                                                                 \
+      return ptr->INTERFACE ## NAME(arg1, arg2, arg3);                       \
+    LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                            \
+    return 0;                                                                \
+  }
+
+#define DEFINE_RET_FUNCTION_4(TYPE, INTERFACE, NAME, RET_ARG,                \
+                              ARG1, ARG2, ARG3, ARG4)                        \
+  static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2,     \
+                                   ARG3 arg3, ARG4 arg4) {                   \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                           \
+    if (ptr)                                                                 \
+      return ptr->INTERFACE ## NAME(arg1, arg2, arg3, arg4);                 \
+    LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                            \
+    return 0;                                                                \
+  }
+
+#define DEFINE_RET_FUNCTION_5(TYPE, INTERFACE, NAME, RET_ARG,                \
+                              ARG1, ARG2, ARG3, ARG4, ARG5)                  \
+  static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2,     \
+                                   ARG3 arg3, ARG4 arg4, ARG5 arg5) {        \
+    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                           \
+    if (ptr)                                                                 \
+      return ptr->INTERFACE ## NAME(arg1, arg2, arg3, arg4, arg5);           \
+    LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                            \
+    return 0;                                                                \
   }
 
 template <typename T> struct DefaultSingletonTraits;
@@ -54,22 +120,20 @@ class XWalkExternalInstance;
 // Provides the "C Interfaces" defined in XW_Extension.h and maps the
 // functions from external extension to their implementations in
 // XWalkExternalExtension and XWalkExternalInstance. We have only one
-// adapter per process.
+// adapter per process, and it can be used from any thread since instances may
+// run in different threads.
 class XWalkExternalAdapter {
  public:
   static XWalkExternalAdapter* GetInstance();
 
-  XW_Extension GetNextXWExtension();
-  XW_Instance GetNextXWInstance();
-
-  // This adds the extension to the adapter's mapping, so C calls to
-  // its corresponding XW_Extension are correctly dispatched.
-  void RegisterExtension(XWalkExternalExtension* extension);
+  // This adds the extension to the adapter's mapping and returns its
+  // XW_Extension, so C calls to it are correctly dispatched.
+  XW_Extension RegisterExtension(XWalkExternalExtension* extension);
   void UnregisterExtension(XWalkExternalExtension* extension);
 
-  // This adds the context to the adapter's mapping, so C calls to
-  // its corresponding XW_Instance are correctly dispatched.
-  void RegisterInstance(XWalkExternalInstance* context);
+  // This adds the context to the adapter's mapping and returns its
+  // XW_Instance, so C calls to it are correctly dispatched.
+  XW_Instance RegisterInstance(XWalkExternalInstance* context);
   void UnregisterInstance(XWalkExternalInstance* context);
 
   // Returns the correct struct according to interface asked. This is
@@ -82,11 +146,9 @@ class XWalkExternalAdapter {
   XWalkExternalAdapter();
   ~XWalkExternalAdapter();
 
-  bool IsValidXWExtension(XW_Extension xw_extension);
-  bool IsValidXWInstance(XW_Instance xw_instance);
-
   // Used by the DEFINE_* macros to bridge the calls using C API identifiers
-  // XW_Extension and XW_Instance to the right C++ object.
+  // XW_Extension and XW_Instance to the right C++ object. They don't lock,
+  // so calls from any thread are cheap.
   static XWalkExternalExtension* GetExtension(XW_Extension xw_extension);
   static XWalkExternalInstance* GetInstance(XW_Instance xw_instance);
   static void LogInvalidCall(int32_t value, const char* type,
@@ -102,23 +164,69 @@ class XWalkExternalAdapter {
   DEFINE_FUNCTION_1(Instance, Core, SetInstanceData, void*);
   DEFINE_RET_FUNCTION_0(Instance, Core, GetInstanceData, void*);
 
-  // XW_MessagingInterface_1 from XW_Extension.h.
+  // XW_MessagingInterface_1 and XW_MessagingInterface_2 from XW_Extension.h.
   DEFINE_FUNCTION_1(Extension, Messaging, Register, XW_HandleMessageCallback);
   DEFINE_FUNCTION_1(Instance, Messaging, PostMessage, const char*);
+  DEFINE_FUNCTION_2(Instance, Messaging, PostMessages, const char**, size_t);
+
+  // XW_BinaryMessagingInterface_1 from XW_Extension.h.
+  DEFINE_FUNCTION_1(Extension, BinaryMessaging, Register,
+                    XW_HandleBinaryMessageCallback);
+  DEFINE_FUNCTION_2(Instance, BinaryMessaging, PostMessage, const char*,
+                    size_t);
 
   // XW_Internal_SyncMessaging_1 from XW_Extension_SyncMessage.h.
   DEFINE_FUNCTION_1(Extension, SyncMessaging, Register,
                     XW_HandleSyncMessageCallback);
   DEFINE_FUNCTION_1(Instance, SyncMessaging, SetSyncReply, const char*);
 
-  typedef std::map<XW_Extension, XWalkExternalExtension*> ExtensionMap;
-  ExtensionMap extension_map_;
-
-  typedef std::map<XW_Instance, XWalkExternalInstance*> InstanceMap;
-  InstanceMap instance_map_;
-
-  XW_Extension next_xw_extension_;
-  XW_Instance next_xw_instance_;
+  // XW_Internal_SyncMessaging_2 from XW_Extension_SyncMessage.h.
+  DEFINE_FUNCTION_1(Extension, SyncMessaging, RegisterWithToken,
+                    XW_HandleSyncMessageWithTokenCallback);
+  DEFINE_FUNCTION_2(Instance, SyncMessaging, SetSyncReplyWithToken, int32_t,
+                    const char*);
+
+  // XW_Internal_ThreadingInterface_1 from XW_Extension_Threading.h.
+  DEFINE_FUNCTION_1(Extension, Threading, SetThreadingModel, int32_t);
+
+  // XW_Internal_EventLoopInterface_1 from XW_Extension_EventLoop.h.
+  DEFINE_RET_FUNCTION_4(Extension, EventLoop, WatchFileDescriptor, XW_Watch,
+                        int, int32_t, XW_FileDescriptorCallback, void*);
+  DEFINE_FUNCTION_1(Extension, EventLoop, CancelWatch, XW_Watch);
+  DEFINE_RET_FUNCTION_5(Extension, EventLoop, StartTimer, XW_Timer,
+                        int64_t, int64_t, int32_t, XW_TimerCallback, void*);
+  DEFINE_FUNCTION_1(Extension, EventLoop, CancelTimer, XW_Timer);
+
+  // XW_Internal_FlowControlInterface_1 from XW_Extension_FlowControl.h.
+  DEFINE_FUNCTION_1(Extension, FlowControl, RegisterWritableCallback,
+                    XW_WritableCallback);
+  DEFINE_RET_FUNCTION_0(Instance, FlowControl, IsWritable, int32_t);
+  DEFINE_FUNCTION_1(Instance, FlowControl, SetCoalesceMessages, int32_t);
+
+  // XW_Internal_StreamInterface_1 from XW_Extension_Stream.h.
+  DEFINE_FUNCTION_3(Extension, Stream, RegisterStreamCallbacks,
+                    XW_StreamOpenedCallback, XW_StreamDataCallback,
+                    XW_StreamClosedCallback);
+  DEFINE_FUNCTION_1(Extension, Stream, RegisterWritableCallback,
+                    XW_StreamWritableCallback);
+  DEFINE_RET_FUNCTION_0(Instance, Stream, Open, XW_Stream);
+  DEFINE_RET_FUNCTION_3(Instance, Stream, Write, int32_t, XW_Stream,
+                        const char*, size_t);
+  DEFINE_FUNCTION_1(Instance, Stream, Close, XW_Stream);
+
+  // XW_Internal_SharedBufferInterface_1 from XW_Extension_SharedBuffer.h.
+  DEFINE_FUNCTION_1(Extension, SharedBuffer, RegisterReleasedCallback,
+                    XW_SharedBufferReleasedCallback);
+  DEFINE_RET_FUNCTION_1(Instance, SharedBuffer, Create, XW_SharedBuffer,
+                        size_t);
+  DEFINE_RET_FUNCTION_1(Instance, SharedBuffer, GetData, void*,
+                        XW_SharedBuffer);
+  DEFINE_RET_FUNCTION_2(Instance, SharedBuffer, Post, int32_t,
+                        XW_SharedBuffer, size_t);
+  DEFINE_FUNCTION_1(Instance, SharedBuffer, Destroy, XW_SharedBuffer);
+
+  XWalkExternalHandleTable extensions_;
+  XWalkExternalHandleTable instances_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalAdapter);
 };
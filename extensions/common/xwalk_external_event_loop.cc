@@ -0,0 +1,224 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_event_loop.h"
+
+#include <algorithm>
+#include <vector>
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/stl_util.h"
+#include "base/synchronization/waitable_event.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+void DeleteAndSignal(XWalkExternalEventLoop* event_loop,
+                     base::WaitableEvent* done) {
+  XWalkExternalEventLoop::Destroy(event_loop);
+  done->Signal();
+}
+
+}  // namespace
+
+#if defined(OS_POSIX)
+class XWalkExternalEventLoop::Watch : public base::MessageLoopForIO::Watcher {
+ public:
+  Watch(XW_Extension xw_extension, XW_FileDescriptorCallback callback,
+        void* user_data)
+      : xw_extension_(xw_extension),
+        callback_(callback),
+        user_data_(user_data) {}
+
+  base::MessageLoopForIO::FileDescriptorWatcher* controller() {
+    return &controller_;
+  }
+
+  // base::MessageLoopForIO::Watcher implementation. The callback may cancel
+  // the watch, deleting it, so nothing is used after calling it.
+  virtual void OnFileCanReadWithoutBlocking(int fd) OVERRIDE {
+    callback_(xw_extension_, fd, XW_EVENT_LOOP_READ, user_data_);
+  }
+
+  virtual void OnFileCanWriteWithoutBlocking(int fd) OVERRIDE {
+    callback_(xw_extension_, fd, XW_EVENT_LOOP_WRITE, user_data_);
+  }
+
+ private:
+  XW_Extension xw_extension_;
+  XW_FileDescriptorCallback callback_;
+  void* user_data_;
+  base::MessageLoopForIO::FileDescriptorWatcher controller_;
+};
+#else
+class XWalkExternalEventLoop::Watch {};
+#endif
+
+XWalkExternalEventLoop::XWalkExternalEventLoop(XW_Extension xw_extension)
+    : xw_extension_(xw_extension),
+      message_loop_(base::MessageLoopProxy::current()),
+      next_id_(1) {}
+
+XWalkExternalEventLoop::~XWalkExternalEventLoop() {
+  STLDeleteValues(&watches_);
+}
+
+bool XWalkExternalEventLoop::RunsTasksOnCurrentThread() const {
+  return message_loop_->BelongsToCurrentThread();
+}
+
+// static
+void XWalkExternalEventLoop::Destroy(XWalkExternalEventLoop* event_loop) {
+  if (event_loop->RunsTasksOnCurrentThread()) {
+    delete event_loop;
+    return;
+  }
+
+  base::WaitableEvent done(false, false);
+  if (!event_loop->message_loop_->PostTask(
+          FROM_HERE, base::Bind(&DeleteAndSignal, event_loop, &done))) {
+    // The thread is gone, so are its watches and timers. The event loop is
+    // leaked, since its watchers can't be touched from another thread.
+    return;
+  }
+  done.Wait();
+}
+
+XW_Watch XWalkExternalEventLoop::WatchFileDescriptor(
+    int fd, int32_t events, XW_FileDescriptorCallback callback,
+    void* user_data) {
+#if defined(OS_POSIX)
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  if (!message_loop || message_loop->type() != base::MessageLoop::TYPE_IO) {
+    LOG(WARNING) << "Can't watch file descriptors in this thread, use "
+                 << "XW_THREADING_MODEL_DEDICATED_THREAD.";
+    return 0;
+  }
+
+  base::MessageLoopForIO::Mode mode;
+  switch (events) {
+    case XW_EVENT_LOOP_READ:
+      mode = base::MessageLoopForIO::WATCH_READ;
+      break;
+    case XW_EVENT_LOOP_WRITE:
+      mode = base::MessageLoopForIO::WATCH_WRITE;
+      break;
+    case XW_EVENT_LOOP_READ | XW_EVENT_LOOP_WRITE:
+      mode = base::MessageLoopForIO::WATCH_READ_WRITE;
+      break;
+    default:
+      LOG(WARNING) << "Invalid events " << events << " to watch.";
+      return 0;
+  }
+
+  Watch* watch = new Watch(xw_extension_, callback, user_data);
+  if (!base::MessageLoopForIO::current()->WatchFileDescriptor(
+          fd, true, mode, watch->controller(), watch)) {
+    LOG(WARNING) << "Couldn't watch file descriptor " << fd << ".";
+    delete watch;
+    return 0;
+  }
+
+  XW_Watch id = next_id_++;
+  watches_[id] = watch;
+  return id;
+#else
+  LOG(WARNING) << "Watching file descriptors is not supported.";
+  return 0;
+#endif
+}
+
+void XWalkExternalEventLoop::CancelWatch(XW_Watch watch) {
+  WatchMap::iterator it = watches_.find(watch);
+  if (it == watches_.end()) {
+    LOG(WARNING) << "Ignoring cancel of invalid watch " << watch << ".";
+    return;
+  }
+  delete it->second;
+  watches_.erase(it);
+}
+
+XW_Timer XWalkExternalEventLoop::StartTimer(
+    base::TimeDelta delay, base::TimeDelta leeway, bool repeating,
+    XW_TimerCallback callback, void* user_data) {
+  Timer timer;
+  timer.callback = callback;
+  timer.user_data = user_data;
+  timer.deadline = base::TimeTicks::Now() + delay;
+  timer.leeway = leeway;
+  if (repeating)
+    timer.interval = delay;
+
+  XW_Timer id = next_id_++;
+  timers_[id] = timer;
+  ScheduleWakeUp();
+  return id;
+}
+
+void XWalkExternalEventLoop::CancelTimer(XW_Timer timer) {
+  if (!timers_.erase(timer)) {
+    LOG(WARNING) << "Ignoring cancel of invalid timer " << timer << ".";
+    return;
+  }
+  ScheduleWakeUp();
+}
+
+void XWalkExternalEventLoop::ScheduleWakeUp() {
+  if (timers_.empty()) {
+    wake_up_timer_.Stop();
+    return;
+  }
+
+  base::TimeTicks wake_up_time;
+  for (TimerMap::const_iterator it = timers_.begin(); it != timers_.end();
+       ++it) {
+    const base::TimeTicks latest = it->second.deadline + it->second.leeway;
+    if (wake_up_time.is_null() || latest < wake_up_time)
+      wake_up_time = latest;
+  }
+
+  if (wake_up_timer_.IsRunning() && wake_up_time == wake_up_time_)
+    return;
+
+  wake_up_time_ = wake_up_time;
+  wake_up_timer_.Start(
+      FROM_HERE,
+      std::max(base::TimeDelta(), wake_up_time - base::TimeTicks::Now()),
+      this, &XWalkExternalEventLoop::OnWakeUp);
+}
+
+void XWalkExternalEventLoop::OnWakeUp() {
+  const base::TimeTicks now = base::TimeTicks::Now();
+
+  // Callbacks may start and cancel timers, so the expired ones are collected
+  // first and looked up again before running each one.
+  std::vector<XW_Timer> expired;
+  for (TimerMap::const_iterator it = timers_.begin(); it != timers_.end();
+       ++it) {
+    if (it->second.deadline <= now)
+      expired.push_back(it->first);
+  }
+
+  for (size_t i = 0; i < expired.size(); ++i) {
+    TimerMap::iterator it = timers_.find(expired[i]);
+    if (it == timers_.end())
+      continue;
+    XW_TimerCallback callback = it->second.callback;
+    void* user_data = it->second.user_data;
+    if (it->second.interval > base::TimeDelta())
+      it->second.deadline = now + it->second.interval;
+    else
+      timers_.erase(it);
+    callback(xw_extension_, user_data);
+  }
+
+  ScheduleWakeUp();
+}
+
+}  // namespace extensions
+}  // namespace xwalk
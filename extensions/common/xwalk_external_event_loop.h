@@ -0,0 +1,90 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EVENT_LOOP_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EVENT_LOOP_H_
+
+#include <map>
+#include "base/memory/ref_counted.h"
+#include "base/time.h"
+#include "base/timer.h"
+#include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_EventLoop.h"
+
+namespace base {
+class MessageLoopProxy;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Implements XW_Internal_EventLoopInterface_1 for an external extension, on
+// top of the message loop of the thread running its instances. It must be
+// created and used in that thread, which must have a message loop.
+//
+// File descriptors are watched with MessageLoopForIO, so they need an IO
+// message loop, like the one of the thread of DEDICATED_THREAD extensions.
+// Timers share a single base::Timer, which wakes up once for all the timers
+// whose leeway allows it.
+class XWalkExternalEventLoop {
+ public:
+  explicit XWalkExternalEventLoop(XW_Extension xw_extension);
+
+  // Deletes |event_loop| in its thread, and waits for it when called from
+  // another thread, so no callback runs after this returns.
+  static void Destroy(XWalkExternalEventLoop* event_loop);
+
+  bool RunsTasksOnCurrentThread() const;
+
+  XW_Watch WatchFileDescriptor(int fd, int32_t events,
+                               XW_FileDescriptorCallback callback,
+                               void* user_data);
+  void CancelWatch(XW_Watch watch);
+
+  XW_Timer StartTimer(base::TimeDelta delay, base::TimeDelta leeway,
+                      bool repeating, XW_TimerCallback callback,
+                      void* user_data);
+  void CancelTimer(XW_Timer timer);
+
+ private:
+  class Watch;
+
+  ~XWalkExternalEventLoop();
+
+  struct Timer {
+    XW_TimerCallback callback;
+    void* user_data;
+    base::TimeTicks deadline;
+    base::TimeDelta leeway;
+    // Zero for timers that only run once.
+    base::TimeDelta interval;
+  };
+
+  // Makes |wake_up_timer_| fire at the earliest time where a timer must run,
+  // that is, the earliest deadline plus leeway of all timers.
+  void ScheduleWakeUp();
+
+  // Runs all the timers whose deadline passed.
+  void OnWakeUp();
+
+  XW_Extension xw_extension_;
+  scoped_refptr<base::MessageLoopProxy> message_loop_;
+  int32_t next_id_;
+
+  typedef std::map<XW_Watch, Watch*> WatchMap;
+  WatchMap watches_;
+
+  typedef std::map<XW_Timer, Timer> TimerMap;
+  TimerMap timers_;
+
+  base::OneShotTimer<XWalkExternalEventLoop> wake_up_timer_;
+  base::TimeTicks wake_up_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExternalEventLoop);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EVENT_LOOP_H_
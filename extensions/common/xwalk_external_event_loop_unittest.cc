@@ -0,0 +1,226 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_event_loop.h"
+
+#include "base/bind.h"
+#include "base/message_loop.h"
+#include "base/run_loop.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/thread.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+#if defined(OS_POSIX)
+#include <unistd.h>
+#endif
+
+using xwalk::extensions::XWalkExternalEventLoop;
+
+namespace {
+
+const XW_Extension kExtension = 1;
+
+// Runs the message loop of the current thread for |delay|.
+void RunFor(base::TimeDelta delay) {
+  base::RunLoop run_loop;
+  base::MessageLoop::current()->PostDelayedTask(
+      FROM_HERE, run_loop.QuitClosure(), delay);
+  run_loop.Run();
+}
+
+struct TimerState {
+  TimerState()
+      : event_loop(NULL), timer(0), count(0), stop_at(0),
+        cancel_on_run(NULL) {}
+
+  XWalkExternalEventLoop* event_loop;
+  XW_Timer timer;
+  int count;
+  base::TimeTicks last_run;
+  // The timer cancels itself on this run, if not zero.
+  int stop_at;
+  // Cancelled on the first run, if not NULL.
+  TimerState* cancel_on_run;
+};
+
+void OnTimer(XW_Extension extension, void* user_data) {
+  EXPECT_EQ(kExtension, extension);
+  TimerState* state = static_cast<TimerState*>(user_data);
+  state->count++;
+  state->last_run = base::TimeTicks::Now();
+  if (state->count == state->stop_at)
+    state->event_loop->CancelTimer(state->timer);
+  if (state->cancel_on_run && state->count == 1)
+    state->event_loop->CancelTimer(state->cancel_on_run->timer);
+}
+
+void StartTimer(XWalkExternalEventLoop* event_loop, TimerState* state,
+                int delay_ms, int leeway_ms, bool repeating) {
+  state->event_loop = event_loop;
+  state->timer = event_loop->StartTimer(
+      base::TimeDelta::FromMilliseconds(delay_ms),
+      base::TimeDelta::FromMilliseconds(leeway_ms), repeating, OnTimer, state);
+  EXPECT_NE(0, state->timer);
+}
+
+}  // namespace
+
+TEST(XWalkExternalEventLoopTest, TimerRunsOnce) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  TimerState state;
+  StartTimer(event_loop, &state, 10, 0, false);
+  RunFor(base::TimeDelta::FromMilliseconds(50));
+  EXPECT_EQ(1, state.count);
+  EXPECT_GE(state.last_run - start, base::TimeDelta::FromMilliseconds(10));
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+TEST(XWalkExternalEventLoopTest, RepeatingTimerRunsUntilCancelled) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  TimerState state;
+  state.stop_at = 3;
+  StartTimer(event_loop, &state, 5, 0, true);
+  RunFor(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_EQ(3, state.count);
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+TEST(XWalkExternalEventLoopTest, CancelledTimerDoesNotRun) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  TimerState cancelled;
+  TimerState other;
+  StartTimer(event_loop, &cancelled, 10, 0, false);
+  StartTimer(event_loop, &other, 20, 0, false);
+  event_loop->CancelTimer(cancelled.timer);
+
+  // Cancelling twice is ignored.
+  event_loop->CancelTimer(cancelled.timer);
+
+  RunFor(base::TimeDelta::FromMilliseconds(50));
+  EXPECT_EQ(0, cancelled.count);
+  EXPECT_EQ(1, other.count);
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+TEST(XWalkExternalEventLoopTest, LeewayCoalescesWakeUps) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  // The first timer can wait for the second one, so both run in the same
+  // wake up, when the second one is due.
+  const base::TimeTicks start = base::TimeTicks::Now();
+  TimerState lenient;
+  TimerState strict;
+  StartTimer(event_loop, &lenient, 10, 200, false);
+  StartTimer(event_loop, &strict, 40, 0, false);
+  RunFor(base::TimeDelta::FromMilliseconds(100));
+
+  EXPECT_EQ(1, lenient.count);
+  EXPECT_EQ(1, strict.count);
+  EXPECT_GE(lenient.last_run - start, base::TimeDelta::FromMilliseconds(40));
+  EXPECT_LE(lenient.last_run, strict.last_run);
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+TEST(XWalkExternalEventLoopTest, CancelFromCallback) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  // Both timers are due in the same wake up, the first one to run cancels the
+  // other.
+  TimerState first;
+  TimerState second;
+  StartTimer(event_loop, &first, 10, 20, false);
+  StartTimer(event_loop, &second, 10, 20, false);
+  first.cancel_on_run = &second;
+  RunFor(base::TimeDelta::FromMilliseconds(100));
+
+  EXPECT_EQ(1, first.count);
+  EXPECT_EQ(0, second.count);
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+#if defined(OS_POSIX)
+namespace {
+
+struct WatchState {
+  WatchState()
+      : event_loop(NULL), watch(0), byte_read(0), done(false, false) {}
+
+  XWalkExternalEventLoop* event_loop;
+  XW_Watch watch;
+  char byte_read;
+  base::WaitableEvent done;
+};
+
+void OnFileDescriptorReady(XW_Extension extension, int fd, int32_t events,
+                           void* user_data) {
+  EXPECT_EQ(kExtension, extension);
+  EXPECT_EQ(XW_EVENT_LOOP_READ, events);
+  WatchState* state = static_cast<WatchState*>(user_data);
+  EXPECT_EQ(1, read(fd, &state->byte_read, 1));
+  state->event_loop->CancelWatch(state->watch);
+  state->done.Signal();
+}
+
+void WatchReadEnd(WatchState* state, int fd) {
+  state->event_loop = new XWalkExternalEventLoop(kExtension);
+  state->watch = state->event_loop->WatchFileDescriptor(
+      fd, XW_EVENT_LOOP_READ, OnFileDescriptorReady, state);
+  EXPECT_NE(0, state->watch);
+}
+
+}  // namespace
+
+TEST(XWalkExternalEventLoopTest, WatchFileDescriptorNeedsIOMessageLoop) {
+  base::MessageLoop message_loop;
+  XWalkExternalEventLoop* event_loop = new XWalkExternalEventLoop(kExtension);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  EXPECT_EQ(0, event_loop->WatchFileDescriptor(
+      fds[0], XW_EVENT_LOOP_READ, OnFileDescriptorReady, NULL));
+  close(fds[0]);
+  close(fds[1]);
+
+  XWalkExternalEventLoop::Destroy(event_loop);
+}
+
+// Extensions using XW_THREADING_MODEL_DEDICATED_THREAD run in a thread with
+// an IO message loop, and are destroyed from the extension process thread.
+TEST(XWalkExternalEventLoopTest, WatchFileDescriptorInDedicatedThread) {
+  base::Thread thread("XWalkExternalEventLoopTest");
+  ASSERT_TRUE(thread.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0)));
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+
+  WatchState state;
+  thread.message_loop()->PostTask(
+      FROM_HERE, base::Bind(&WatchReadEnd, &state, fds[0]));
+  const char byte = 'x';
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+  state.done.Wait();
+  EXPECT_EQ(byte, state.byte_read);
+
+  XWalkExternalEventLoop::Destroy(state.event_loop);
+  thread.Stop();
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif  // defined(OS_POSIX)
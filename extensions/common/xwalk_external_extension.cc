@@ -5,63 +5,157 @@
 #include "xwalk/extensions/common/xwalk_external_extension.h"
 
 #include <string>
+#include "base/debug/trace_event.h"
+#include "base/file_util.h"
+#include "base/json/json_reader.h"
 #include "base/logging.h"
-#include "base/files/file_path.h"
 #include "base/lazy_instance.h"
+#include "base/message_loop.h"
 #include "xwalk/extensions/common/xwalk_external_adapter.h"
+#include "xwalk/extensions/common/xwalk_external_event_loop.h"
 
 namespace xwalk {
 namespace extensions {
 
+const base::FilePath::CharType
+XWalkExternalExtension::kMetadataFileExtension[] = FILE_PATH_LITERAL(".json");
+
 XWalkExternalExtension::XWalkExternalExtension(const base::FilePath& path)
-    : xw_extension_(0),
+    : path_(path),
+      xw_extension_(0),
+      has_metadata_(false),
+      load_attempted_(false),
       created_instance_callback_(NULL),
       destroyed_instance_callback_(NULL),
       shutdown_callback_(NULL),
       handle_msg_callback_(NULL),
+      handle_binary_msg_callback_(NULL),
       handle_sync_msg_callback_(NULL),
-      initialized_(false) {
+      handle_sync_msg_with_token_callback_(NULL),
+      writable_callback_(NULL),
+      stream_opened_callback_(NULL),
+      stream_data_callback_(NULL),
+      stream_closed_callback_(NULL),
+      stream_writable_callback_(NULL),
+      shared_buffer_released_callback_(NULL),
+      initialized_(false),
+      event_loop_(NULL) {
+  has_metadata_ = ReadMetadata();
+  if (!has_metadata_)
+    Load();
+}
+
+bool XWalkExternalExtension::ReadMetadata() {
+  const base::FilePath metadata_path =
+      path_.ReplaceExtension(kMetadataFileExtension);
+  if (!file_util::PathExists(metadata_path))
+    return false;
+
+  std::string contents;
+  if (!file_util::ReadFileToString(metadata_path, &contents)) {
+    LOG(WARNING) << "Couldn't read extension metadata '"
+                 << metadata_path.AsUTF8Unsafe() << "'.";
+    return false;
+  }
+
+  scoped_ptr<base::Value> value(base::JSONReader::Read(contents));
+  base::DictionaryValue* metadata;
+  std::string name;
+  if (!value || !value->GetAsDictionary(&metadata) ||
+      !metadata->GetString("name", &name)) {
+    LOG(WARNING) << "Ignoring extension metadata '"
+                 << metadata_path.AsUTF8Unsafe() << "' without a name.";
+    return false;
+  }
+
+  std::string js_api;
+  std::string js_api_file;
+  if (metadata->GetString("jsapi_file", &js_api_file)) {
+    const base::FilePath js_api_path = metadata_path.DirName().Append(
+        base::FilePath::FromUTF8Unsafe(js_api_file));
+    if (!file_util::ReadFileToString(js_api_path, &js_api)) {
+      LOG(WARNING) << "Couldn't read JavaScript API of extension '" << name
+                   << "' from '" << js_api_path.AsUTF8Unsafe() << "'.";
+      return false;
+    }
+  } else if (!metadata->GetString("jsapi", &js_api)) {
+    LOG(WARNING) << "Ignoring extension metadata '"
+                 << metadata_path.AsUTF8Unsafe()
+                 << "' without a JavaScript API.";
+    return false;
+  }
+
+  ThreadingModel threading_model = SHARED_THREAD;
+  std::string threading_model_name;
+  if (metadata->GetString("threading_model", &threading_model_name)) {
+    if (threading_model_name == "dedicated_thread") {
+      threading_model = DEDICATED_THREAD;
+    } else if (threading_model_name == "worker_pool") {
+      threading_model = WORKER_POOL;
+    } else if (threading_model_name != "shared_thread") {
+      LOG(WARNING) << "Ignoring extension metadata '"
+                   << metadata_path.AsUTF8Unsafe()
+                   << "' with invalid threading model '"
+                   << threading_model_name << "'.";
+      return false;
+    }
+  }
+
+  set_name(name);
+  js_api_ = js_api;
+  set_threading_model(threading_model);
+  return true;
+}
+
+bool XWalkExternalExtension::Load() {
+  TRACE_EVENT1("xwalk", "XWalkExternalExtension::Load",
+               "path", path_.AsUTF8Unsafe());
+  load_attempted_ = true;
+
   std::string error;
-  base::ScopedNativeLibrary library(base::LoadNativeLibrary(path, &error));
+  base::ScopedNativeLibrary library(base::LoadNativeLibrary(path_, &error));
   if (!library.is_valid()) {
-    LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
-                 << error;
-    return;
+    LOG(WARNING) << "Error loading extension '" << path_.AsUTF8Unsafe()
+                 << "': " << error;
+    return false;
   }
 
   XW_Initialize_Func initialize = reinterpret_cast<XW_Initialize_Func>(
       library.GetFunctionPointer("XW_Initialize"));
   if (!initialize) {
-    LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
-                 << "couldn't get XW_Initialize function.";
-    return;
+    LOG(WARNING) << "Error loading extension '" << path_.AsUTF8Unsafe()
+                 << "': couldn't get XW_Initialize function.";
+    return false;
   }
 
   XWalkExternalAdapter* external_adapter = XWalkExternalAdapter::GetInstance();
-  xw_extension_ = external_adapter->GetNextXWExtension();
-  external_adapter->RegisterExtension(this);
+  xw_extension_ = external_adapter->RegisterExtension(this);
   int ret = initialize(xw_extension_, XWalkExternalAdapter::GetInterface);
   if (ret != XW_OK) {
-    LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
-                 << "XW_Initialize function returned error value.";
-    return;
+    LOG(WARNING) << "Error loading extension '" << path_.AsUTF8Unsafe()
+                 << "': XW_Initialize function returned error value.";
+    return false;
   }
 
   library_.Reset(library.Release());
   initialized_ = true;
+  return true;
 }
 
 XWalkExternalExtension::~XWalkExternalExtension() {
-  if (!initialized_)
-    return;
-
-  if (shutdown_callback_)
+  // No watch or timer callback may run once the library is shut down.
+  if (event_loop_)
+    XWalkExternalEventLoop::Destroy(event_loop_);
+  if (initialized_ && shutdown_callback_)
     shutdown_callback_(xw_extension_);
-  XWalkExternalAdapter::GetInstance()->UnregisterExtension(this);
+  // The extension is registered even if XW_Initialize() failed, its handle
+  // must not outlive it.
+  if (xw_extension_)
+    XWalkExternalAdapter::GetInstance()->UnregisterExtension(this);
 }
 
 bool XWalkExternalExtension::is_valid() {
-  return initialized_;
+  return has_metadata_ || initialized_;
 }
 
 const char* XWalkExternalExtension::GetJavaScriptAPI() {
@@ -69,9 +163,16 @@ const char* XWalkExternalExtension::GetJavaScriptAPI() {
 }
 
 XWalkExtensionInstance* XWalkExternalExtension::CreateInstance() {
-  XW_Instance xw_instance =
-      XWalkExternalAdapter::GetInstance()->GetNextXWInstance();
-  return new XWalkExternalInstance(this, xw_instance);
+  if (has_metadata_) {
+    base::AutoLock l(load_lock_);
+    if (!load_attempted_ && !Load()) {
+      LOG(WARNING) << "Instances of extension '" << name()
+                   << "' can't be created, its library failed to load.";
+    }
+  }
+  if (!initialized_)
+    return NULL;
+  return new XWalkExternalInstance(this);
 }
 
 #define RETURN_IF_INITIALIZED(FUNCTION)                          \
@@ -82,13 +183,27 @@ XWalkExtensionInstance* XWalkExternalExtension::CreateInstance() {
     return;                                                      \
   }
 
+// The metadata was already used to register the extension, so it wins over
+// what the library sets.
+#define RETURN_IF_DECLARED_IN_METADATA(WHAT, SAME)               \
+  if (has_metadata_) {                                           \
+    if (!(SAME)) {                                               \
+      LOG(WARNING) << "Ignoring " WHAT " set by extension '"     \
+                   << this->name() << "', which differs from"    \
+                   << " the one in its metadata file.";          \
+    }                                                            \
+    return;                                                      \
+  }
+
 void XWalkExternalExtension::CoreSetExtensionName(const char* name) {
   RETURN_IF_INITIALIZED("SetExtensionName from CoreInterface");
+  RETURN_IF_DECLARED_IN_METADATA("name", this->name() == name);
   set_name(name);
 }
 
 void XWalkExternalExtension::CoreSetJavaScriptAPI(const char* js_api) {
   RETURN_IF_INITIALIZED("SetJavaScriptAPI from CoreInterface");
+  RETURN_IF_DECLARED_IN_METADATA("JavaScript API", js_api_ == js_api);
   js_api_ = std::string(js_api);
 }
 
@@ -112,11 +227,145 @@ void XWalkExternalExtension::MessagingRegister(
   handle_msg_callback_ = callback;
 }
 
+void XWalkExternalExtension::BinaryMessagingRegister(
+    XW_HandleBinaryMessageCallback callback) {
+  RETURN_IF_INITIALIZED("Register from BinaryMessagingInterface");
+  handle_binary_msg_callback_ = callback;
+}
+
 void XWalkExternalExtension::SyncMessagingRegister(
     XW_HandleSyncMessageCallback callback) {
   RETURN_IF_INITIALIZED("Register from Internal_SyncMessagingInterface");
   handle_sync_msg_callback_ = callback;
 }
 
+void XWalkExternalExtension::SyncMessagingRegisterWithToken(
+    XW_HandleSyncMessageWithTokenCallback callback) {
+  RETURN_IF_INITIALIZED("Register from Internal_SyncMessagingInterface");
+  handle_sync_msg_with_token_callback_ = callback;
+}
+
+void XWalkExternalExtension::ThreadingSetThreadingModel(
+    int32_t threading_model) {
+  RETURN_IF_INITIALIZED("SetThreadingModel from Internal_ThreadingInterface");
+  ThreadingModel model;
+  switch (threading_model) {
+    case XW_THREADING_MODEL_SHARED_THREAD:
+      model = SHARED_THREAD;
+      break;
+    case XW_THREADING_MODEL_DEDICATED_THREAD:
+      model = DEDICATED_THREAD;
+      break;
+    case XW_THREADING_MODEL_WORKER_POOL:
+      model = WORKER_POOL;
+      break;
+    default:
+      LOG(WARNING) << "Ignoring invalid threading model " << threading_model
+                   << " for extension '" << name() << "'.";
+      return;
+  }
+  RETURN_IF_DECLARED_IN_METADATA("threading model",
+                                 this->threading_model() == model);
+  set_threading_model(model);
+}
+
+XWalkExternalEventLoop* XWalkExternalExtension::GetEventLoop(
+    const char* function) {
+  if (!initialized_) {
+    LOG(WARNING) << "Error: can't call " << function
+                 << " from EventLoopInterface for extension '" << name()
+                 << "' before XW_Initialize returned.";
+    return NULL;
+  }
+
+  base::AutoLock l(event_loop_lock_);
+  if (!event_loop_) {
+    // Threads from the worker pool don't have a message loop.
+    if (!base::MessageLoop::current()) {
+      LOG(WARNING) << "Error: can't call " << function
+                   << " from EventLoopInterface for extension '" << name()
+                   << "' from a thread without message loop.";
+      return NULL;
+    }
+    event_loop_ = new XWalkExternalEventLoop(xw_extension_);
+  }
+  if (!event_loop_->RunsTasksOnCurrentThread()) {
+    LOG(WARNING) << "Error: can't call " << function
+                 << " from EventLoopInterface for extension '" << name()
+                 << "' outside of the thread running its instances.";
+    return NULL;
+  }
+  return event_loop_;
+}
+
+XW_Watch XWalkExternalExtension::EventLoopWatchFileDescriptor(
+    int fd, int32_t events, XW_FileDescriptorCallback callback,
+    void* user_data) {
+  XWalkExternalEventLoop* event_loop = GetEventLoop("WatchFileDescriptor");
+  if (!event_loop)
+    return 0;
+  return event_loop->WatchFileDescriptor(fd, events, callback, user_data);
+}
+
+void XWalkExternalExtension::EventLoopCancelWatch(XW_Watch watch) {
+  XWalkExternalEventLoop* event_loop = GetEventLoop("CancelWatch");
+  if (event_loop)
+    event_loop->CancelWatch(watch);
+}
+
+XW_Timer XWalkExternalExtension::EventLoopStartTimer(
+    int64_t delay_ms, int64_t leeway_ms, int32_t repeating,
+    XW_TimerCallback callback, void* user_data) {
+  if (delay_ms < 0 || leeway_ms < 0 || (repeating && delay_ms == 0)) {
+    LOG(WARNING) << "Ignoring timer with invalid delay " << delay_ms
+                 << " or leeway " << leeway_ms << " for extension '"
+                 << name() << "'.";
+    return 0;
+  }
+  XWalkExternalEventLoop* event_loop = GetEventLoop("StartTimer");
+  if (!event_loop)
+    return 0;
+  return event_loop->StartTimer(base::TimeDelta::FromMilliseconds(delay_ms),
+                                base::TimeDelta::FromMilliseconds(leeway_ms),
+                                repeating != 0, callback, user_data);
+}
+
+void XWalkExternalExtension::EventLoopCancelTimer(XW_Timer timer) {
+  XWalkExternalEventLoop* event_loop = GetEventLoop("CancelTimer");
+  if (event_loop)
+    event_loop->CancelTimer(timer);
+}
+
+void XWalkExternalExtension::FlowControlRegisterWritableCallback(
+    XW_WritableCallback callback) {
+  RETURN_IF_INITIALIZED(
+      "RegisterWritableCallback from Internal_FlowControlInterface");
+  writable_callback_ = callback;
+}
+
+void XWalkExternalExtension::StreamRegisterStreamCallbacks(
+    XW_StreamOpenedCallback opened, XW_StreamDataCallback data,
+    XW_StreamClosedCallback closed) {
+  RETURN_IF_INITIALIZED(
+      "RegisterStreamCallbacks from Internal_StreamInterface");
+  stream_opened_callback_ = opened;
+  stream_data_callback_ = data;
+  stream_closed_callback_ = closed;
+}
+
+void XWalkExternalExtension::StreamRegisterWritableCallback(
+    XW_StreamWritableCallback callback) {
+  RETURN_IF_INITIALIZED(
+      "RegisterWritableCallback from Internal_StreamInterface");
+  stream_writable_callback_ = callback;
+}
+
+void XWalkExternalExtension::SharedBufferRegisterReleasedCallback(
+    XW_SharedBufferReleasedCallback callback) {
+  RETURN_IF_INITIALIZED(
+      "RegisterReleasedCallback from Internal_SharedBufferInterface");
+  shared_buffer_released_callback_ = callback;
+}
+
 }  // namespace extensions
 }  // namespace xwalk
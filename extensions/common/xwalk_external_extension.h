@@ -6,19 +6,23 @@
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EXTENSION_H_
 
 #include <string>
+#include "base/files/file_path.h"
 #include "base/scoped_native_library.h"
+#include "base/synchronization/lock.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_EventLoop.h"
+#include "xwalk/extensions/public/XW_Extension_FlowControl.h"
+#include "xwalk/extensions/public/XW_Extension_SharedBuffer.h"
+#include "xwalk/extensions/public/XW_Extension_Stream.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
-
-namespace base {
-class FilePath;
-};
+#include "xwalk/extensions/public/XW_Extension_Threading.h"
 
 namespace xwalk {
 namespace extensions {
 
 class XWalkExternalAdapter;
+class XWalkExternalEventLoop;
 class XWalkExternalInstance;
 
 // XWalkExternalExtension implements an XWalkExtension backed by a shared
@@ -28,8 +32,19 @@ class XWalkExternalInstance;
 // library, and store the callbacks to call it back later. The associated
 // XW_Extension is used to identify this extension when calling the shared
 // library.
+//
+// When a metadata file sits next to the library, the extension is registered
+// with what the file declares, and the library is only loaded and initialized
+// when the first instance is created.
 class XWalkExternalExtension : public XWalkExtension {
  public:
+  // The metadata file of "libfoo.so" is "libfoo.json". It holds a JSON
+  // dictionary with the "name" of the extension, its JavaScript API either
+  // inline as "jsapi" or as a "jsapi_file" path relative to the metadata, and
+  // optionally its "threading_model": "shared_thread", "dedicated_thread" or
+  // "worker_pool".
+  static const base::FilePath::CharType kMetadataFileExtension[];
+
   explicit XWalkExternalExtension(const base::FilePath& path);
 
   virtual ~XWalkExternalExtension();
@@ -44,6 +59,14 @@ class XWalkExternalExtension : public XWalkExtension {
   virtual const char* GetJavaScriptAPI() OVERRIDE;
   virtual XWalkExtensionInstance* CreateInstance() OVERRIDE;
 
+  // Reads the metadata file next to |path_|, returns false if there is none
+  // or it's not valid.
+  bool ReadMetadata();
+
+  // Loads the library and calls XW_Initialize(). With metadata, runs in the
+  // thread creating the first instance, under |load_lock_|.
+  bool Load();
+
   // XW_CoreInterface_1 (from XW_Extension.h) implementation.
   void CoreSetExtensionName(const char* name);
   void CoreSetJavaScriptAPI(const char* js_api);
@@ -55,21 +78,82 @@ class XWalkExternalExtension : public XWalkExtension {
   // XW_MessagingInterface_1 (from XW_Extension.h) implementation.
   void MessagingRegister(XW_HandleMessageCallback callback);
 
+  // XW_BinaryMessagingInterface_1 (from XW_Extension.h) implementation.
+  void BinaryMessagingRegister(XW_HandleBinaryMessageCallback callback);
+
   // XW_Internal_SyncMessagingInterface_1 (from XW_Extension.h) implementation.
   void SyncMessagingRegister(XW_HandleSyncMessageCallback callback);
 
+  // XW_Internal_SyncMessagingInterface_2 (from XW_Extension.h) implementation.
+  void SyncMessagingRegisterWithToken(
+      XW_HandleSyncMessageWithTokenCallback callback);
+
+  // XW_Internal_ThreadingInterface_1 (from XW_Extension_Threading.h)
+  // implementation.
+  void ThreadingSetThreadingModel(int32_t threading_model);
+
+  // XW_Internal_EventLoopInterface_1 (from XW_Extension_EventLoop.h)
+  // implementation.
+  XW_Watch EventLoopWatchFileDescriptor(int fd, int32_t events,
+                                        XW_FileDescriptorCallback callback,
+                                        void* user_data);
+  void EventLoopCancelWatch(XW_Watch watch);
+  XW_Timer EventLoopStartTimer(int64_t delay_ms, int64_t leeway_ms,
+                               int32_t repeating, XW_TimerCallback callback,
+                               void* user_data);
+  void EventLoopCancelTimer(XW_Timer timer);
+
+  // XW_Internal_FlowControlInterface_1 (from XW_Extension_FlowControl.h)
+  // implementation.
+  void FlowControlRegisterWritableCallback(XW_WritableCallback callback);
+
+  // XW_Internal_StreamInterface_1 (from XW_Extension_Stream.h) implementation.
+  void StreamRegisterStreamCallbacks(XW_StreamOpenedCallback opened,
+                                     XW_StreamDataCallback data,
+                                     XW_StreamClosedCallback closed);
+  void StreamRegisterWritableCallback(XW_StreamWritableCallback callback);
+
+  // XW_Internal_SharedBufferInterface_1 (from XW_Extension_SharedBuffer.h)
+  // implementation.
+  void SharedBufferRegisterReleasedCallback(
+      XW_SharedBufferReleasedCallback callback);
+
+  // Returns the event loop of the thread running the instances, creating it
+  // in the first call from that thread. Returns NULL when called from any
+  // other thread.
+  XWalkExternalEventLoop* GetEventLoop(const char* function);
+
+  base::FilePath path_;
   base::ScopedNativeLibrary library_;
   XW_Extension xw_extension_;
 
+  // True when the name, JavaScript API and threading model come from the
+  // metadata file, the library can't change them then.
+  bool has_metadata_;
+  // Set once Load() was called, successful or not.
+  bool load_attempted_;
+  base::Lock load_lock_;
+
   XW_CreatedInstanceCallback created_instance_callback_;
   XW_DestroyedInstanceCallback destroyed_instance_callback_;
   XW_ShutdownCallback shutdown_callback_;
   XW_HandleMessageCallback handle_msg_callback_;
+  XW_HandleBinaryMessageCallback handle_binary_msg_callback_;
   XW_HandleSyncMessageCallback handle_sync_msg_callback_;
+  XW_HandleSyncMessageWithTokenCallback handle_sync_msg_with_token_callback_;
+  XW_WritableCallback writable_callback_;
+  XW_StreamOpenedCallback stream_opened_callback_;
+  XW_StreamDataCallback stream_data_callback_;
+  XW_StreamClosedCallback stream_closed_callback_;
+  XW_StreamWritableCallback stream_writable_callback_;
+  XW_SharedBufferReleasedCallback shared_buffer_released_callback_;
 
   std::string js_api_;
   bool initialized_;
 
+  base::Lock event_loop_lock_;
+  XWalkExternalEventLoop* event_loop_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalExtension);
 };
 
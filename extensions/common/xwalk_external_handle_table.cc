@@ -0,0 +1,120 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_handle_table.h"
+
+#include <string.h>
+#include "base/logging.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+const int32_t kNoSlot = -1;
+
+}  // namespace
+
+XWalkExternalHandleTable::XWalkExternalHandleTable()
+    : next_unused_slot_(0),
+      first_free_slot_(kNoSlot),
+      last_free_slot_(kNoSlot),
+      free_slot_count_(0) {
+  memset(chunks_, 0, sizeof(chunks_));
+}
+
+XWalkExternalHandleTable::~XWalkExternalHandleTable() {
+  for (int32_t i = 0; i < kChunkCount; ++i)
+    delete[] reinterpret_cast<Slot*>(chunks_[i]);
+}
+
+XWalkExternalHandleTable::Slot* XWalkExternalHandleTable::GetSlot(
+    int32_t index) const {
+  Slot* chunk = reinterpret_cast<Slot*>(
+      base::subtle::Acquire_Load(&chunks_[index >> kChunkBits]));
+  if (!chunk)
+    return NULL;
+  return &chunk[index & (kChunkSize - 1)];
+}
+
+int32_t XWalkExternalHandleTable::Add(void* object) {
+  base::AutoLock lock(lock_);
+
+  int32_t index;
+  if (free_slot_count_ >= kMinFreeSlots || next_unused_slot_ == kMaxSlots) {
+    if (first_free_slot_ == kNoSlot)
+      return 0;
+    index = first_free_slot_;
+    first_free_slot_ = GetSlot(index)->next_free;
+    if (first_free_slot_ == kNoSlot)
+      last_free_slot_ = kNoSlot;
+    free_slot_count_--;
+  } else {
+    index = next_unused_slot_++;
+    if (!GetSlot(index)) {
+      Slot* chunk = new Slot[kChunkSize];
+      memset(chunk, 0, sizeof(Slot) * kChunkSize);
+      base::subtle::Release_Store(&chunks_[index >> kChunkBits],
+                                  reinterpret_cast<base::subtle::AtomicWord>(
+                                      chunk));
+    }
+  }
+
+  Slot* slot = GetSlot(index);
+  slot->generation = slot->generation % kMaxGeneration + 1;
+  const int32_t handle = (slot->generation << kIndexBits) | index;
+
+  // The handle is published last, lookups only read the object after
+  // matching it.
+  base::subtle::NoBarrier_Store(
+      &slot->object, reinterpret_cast<base::subtle::AtomicWord>(object));
+  base::subtle::Release_Store(&slot->handle, handle);
+  return handle;
+}
+
+bool XWalkExternalHandleTable::Remove(int32_t handle) {
+  base::AutoLock lock(lock_);
+
+  if (!Lookup(handle))
+    return false;
+
+  const int32_t index = handle & kIndexMask;
+  Slot* slot = GetSlot(index);
+
+  // Lookups racing with this one check the handle again after reading the
+  // object, the barrier makes sure they see it cleared before the object
+  // changes.
+  base::subtle::NoBarrier_Store(&slot->handle, 0);
+  base::subtle::MemoryBarrier();
+  base::subtle::NoBarrier_Store(&slot->object, 0);
+
+  slot->next_free = kNoSlot;
+  if (last_free_slot_ == kNoSlot)
+    first_free_slot_ = index;
+  else
+    GetSlot(last_free_slot_)->next_free = index;
+  last_free_slot_ = index;
+  free_slot_count_++;
+  return true;
+}
+
+void* XWalkExternalHandleTable::Lookup(int32_t handle) const {
+  if (handle <= 0)
+    return NULL;
+
+  const Slot* slot = GetSlot(handle & kIndexMask);
+  if (!slot || base::subtle::Acquire_Load(&slot->handle) != handle)
+    return NULL;
+
+  void* object =
+      reinterpret_cast<void*>(base::subtle::Acquire_Load(&slot->object));
+
+  // The slot may have been reused while the object was read.
+  if (base::subtle::Acquire_Load(&slot->handle) != handle)
+    return NULL;
+  return object;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
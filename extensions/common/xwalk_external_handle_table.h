@@ -0,0 +1,83 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
+
+#include <stdint.h>
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/synchronization/lock.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Maps the handles given to external extensions, XW_Extension and
+// XW_Instance, to their objects. A handle packs the index of the slot holding
+// the object with the generation of the slot, which changes every time the
+// slot is reused, so stale handles are detected.
+//
+// Lookup() is wait-free and can be called from any thread, it only does a few
+// atomic loads. Add() and Remove() are serialized by a lock. The slots are
+// allocated in chunks that are never moved, so lookups never see a slot being
+// reallocated. Like with any handle, the caller is responsible for not using
+// the object after it is removed by another thread.
+class XWalkExternalHandleTable {
+ public:
+  XWalkExternalHandleTable();
+  ~XWalkExternalHandleTable();
+
+  // Returns the handle for |object|, which is never 0, or 0 if the table is
+  // full.
+  int32_t Add(void* object);
+
+  // Returns false if |handle| is not in the table.
+  bool Remove(int32_t handle);
+
+  // Returns NULL if |handle| is not in the table, which includes the handles
+  // already removed.
+  void* Lookup(int32_t handle) const;
+
+ private:
+  struct Slot {
+    // The handle of the object in the slot, 0 when the slot is free.
+    base::subtle::Atomic32 handle;
+    base::subtle::AtomicWord object;
+    // Only accessed with |lock_| held.
+    int32_t generation;
+    int32_t next_free;
+  };
+
+  static const int kIndexBits = 16;
+  static const int32_t kIndexMask = (1 << kIndexBits) - 1;
+  static const int32_t kMaxSlots = 1 << kIndexBits;
+  // Generations use the remaining bits but the sign bit, and start at 1 so
+  // handles are always positive.
+  static const int32_t kMaxGeneration = (1 << (31 - kIndexBits)) - 1;
+  static const int kChunkBits = 8;
+  static const int32_t kChunkSize = 1 << kChunkBits;
+  static const int32_t kChunkCount = kMaxSlots / kChunkSize;
+  // Free slots are reused in FIFO order, and only once there are this many,
+  // so a slot goes through its generations slowly and a stale handle needs
+  // millions of reuses to match again.
+  static const int32_t kMinFreeSlots = 1024;
+
+  Slot* GetSlot(int32_t index) const;
+
+  // Pointers to arrays of kChunkSize slots, allocated as needed.
+  base::subtle::AtomicWord chunks_[kChunkCount];
+
+  base::Lock lock_;
+  int32_t next_unused_slot_;
+  int32_t first_free_slot_;
+  int32_t last_free_slot_;
+  int32_t free_slot_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExternalHandleTable);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
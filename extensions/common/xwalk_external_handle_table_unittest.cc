@@ -0,0 +1,55 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_handle_table.h"
+
+#include <set>
+#include <vector>
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExternalHandleTable;
+
+TEST(XWalkExternalHandleTableTest, AddLookupRemove) {
+  XWalkExternalHandleTable table;
+  int first = 1;
+  int second = 2;
+
+  int32_t first_handle = table.Add(&first);
+  int32_t second_handle = table.Add(&second);
+  EXPECT_GT(first_handle, 0);
+  EXPECT_GT(second_handle, 0);
+  EXPECT_NE(first_handle, second_handle);
+
+  EXPECT_EQ(&first, table.Lookup(first_handle));
+  EXPECT_EQ(&second, table.Lookup(second_handle));
+  EXPECT_EQ(NULL, table.Lookup(0));
+  EXPECT_EQ(NULL, table.Lookup(-1));
+
+  EXPECT_TRUE(table.Remove(first_handle));
+  EXPECT_FALSE(table.Remove(first_handle));
+  EXPECT_EQ(NULL, table.Lookup(first_handle));
+  EXPECT_EQ(&second, table.Lookup(second_handle));
+}
+
+TEST(XWalkExternalHandleTableTest, StaleHandlesAreRejected) {
+  XWalkExternalHandleTable table;
+  int object = 0;
+
+  // Cycle through enough handles to make the table reuse its slots, no
+  // handle should be given twice nor resolve after being removed.
+  std::set<int32_t> seen;
+  std::vector<int32_t> removed;
+  for (int i = 0; i < 10000; ++i) {
+    int32_t handle = table.Add(&object);
+    ASSERT_GT(handle, 0);
+    EXPECT_TRUE(seen.insert(handle).second);
+    EXPECT_TRUE(table.Remove(handle));
+    removed.push_back(handle);
+  }
+
+  int32_t handle = table.Add(&object);
+  EXPECT_EQ(&object, table.Lookup(handle));
+  for (size_t i = 0; i < removed.size(); ++i)
+    EXPECT_EQ(NULL, table.Lookup(removed[i]));
+}
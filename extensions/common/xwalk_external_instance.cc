@@ -4,8 +4,12 @@
 
 #include "xwalk/extensions/common/xwalk_external_instance.h"
 
+#include <string.h>
 #include <string>
+#include <vector>
 #include "base/logging.h"
+#include "base/stl_util.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
 #include "xwalk/extensions/common/xwalk_external_adapter.h"
 
@@ -13,12 +17,13 @@ namespace xwalk {
 namespace extensions {
 
 XWalkExternalInstance::XWalkExternalInstance(
-    XWalkExternalExtension* extension, XW_Instance xw_instance)
-    : xw_instance_(xw_instance),
+    XWalkExternalExtension* extension)
+    : xw_instance_(0),
       extension_(extension),
       instance_data_(NULL),
-      is_handling_sync_msg_(false) {
-  XWalkExternalAdapter::GetInstance()->RegisterInstance(this);
+      is_handling_sync_msg_(false),
+      next_shared_buffer_(1) {
+  xw_instance_ = XWalkExternalAdapter::GetInstance()->RegisterInstance(this);
   XW_CreatedInstanceCallback callback = extension_->created_instance_callback_;
   if (callback)
     callback(xw_instance_);
@@ -30,9 +35,33 @@ XWalkExternalInstance::~XWalkExternalInstance() {
   if (callback)
     callback(xw_instance_);
   XWalkExternalAdapter::GetInstance()->UnregisterInstance(this);
+  STLDeleteValues(&shared_buffers_);
 }
 
 void XWalkExternalInstance::HandleMessage(scoped_ptr<base::Value> msg) {
+  std::string data;
+  ValueToWireFormat(*msg, &data);
+  HandleSerializedMessage(data);
+}
+
+void XWalkExternalInstance::HandleSerializedMessage(const std::string& data) {
+  // Strings and binary data are passed pointing into |data|, no copies or
+  // conversions are made.
+  XWalkExtensionWireReader reader(data);
+  const char* bytes;
+  size_t size;
+  if (reader.ReadBinary(&bytes, &size)) {
+    XW_HandleBinaryMessageCallback callback =
+        extension_->handle_binary_msg_callback_;
+    if (!callback) {
+      LOG(WARNING) << "Ignoring binary message sent for external extension '"
+                   << extension_->name() << "' which doesn't support it.";
+      return;
+    }
+    callback(xw_instance_, bytes, size);
+    return;
+  }
+
   XW_HandleMessageCallback callback = extension_->handle_msg_callback_;
   if (!callback) {
     LOG(WARNING) << "Ignoring message sent for external extension '"
@@ -40,12 +69,27 @@ void XWalkExternalInstance::HandleMessage(scoped_ptr<base::Value> msg) {
     return;
   }
 
-  std::string string_msg;
-  msg->GetAsString(&string_msg);
-  callback(xw_instance_, string_msg.c_str());
+  // Messages that are not strings arrive as empty strings.
+  if (!reader.ReadString(&bytes, &size))
+    bytes = "";
+  callback(xw_instance_, bytes);
 }
 
-void XWalkExternalInstance::HandleSyncMessage(scoped_ptr<base::Value> msg) {
+void XWalkExternalInstance::HandleSerializedSyncMessage(
+    const std::string& data, SyncReplyToken token) {
+  XWalkExtensionWireReader reader(data);
+  const char* msg;
+  size_t size;
+  if (!reader.ReadString(&msg, &size))
+    msg = "";
+
+  XW_HandleSyncMessageWithTokenCallback token_callback =
+      extension_->handle_sync_msg_with_token_callback_;
+  if (token_callback) {
+    token_callback(xw_instance_, msg, token);
+    return;
+  }
+
   XW_HandleSyncMessageCallback callback = extension_->handle_sync_msg_callback_;
   if (!callback) {
     LOG(WARNING) << "Ignoring sync message sent for external extension '"
@@ -53,10 +97,70 @@ void XWalkExternalInstance::HandleSyncMessage(scoped_ptr<base::Value> msg) {
     return;
   }
 
-  std::string string_msg;
-  msg->GetAsString(&string_msg);
+  callback(xw_instance_, msg);
+}
+
+void XWalkExternalInstance::OnWritableToJS() {
+  XW_WritableCallback callback = extension_->writable_callback_;
+  if (callback)
+    callback(xw_instance_);
+}
+
+void XWalkExternalInstance::HandleStreamOpened(StreamId stream) {
+  XW_StreamOpenedCallback callback = extension_->stream_opened_callback_;
+  if (!callback) {
+    LOG(WARNING) << "Ignoring stream opened for external extension '"
+                 << extension_->name() << "' which doesn't support it.";
+    return;
+  }
+  callback(xw_instance_, stream);
+}
+
+void XWalkExternalInstance::HandleStreamData(StreamId stream,
+                                             const std::string& data) {
+  XW_StreamDataCallback callback = extension_->stream_data_callback_;
+  if (!callback)
+    return;
+
+  // Like messages, chunks are passed pointing into |data|. Chunks that are
+  // neither strings nor binary data arrive empty.
+  XWalkExtensionWireReader reader(data);
+  const char* bytes;
+  size_t size;
+  if (!reader.ReadBinary(&bytes, &size) && !reader.ReadString(&bytes, &size)) {
+    bytes = "";
+    size = 0;
+  }
+  callback(xw_instance_, stream, bytes, size);
+}
+
+void XWalkExternalInstance::HandleStreamClosed(StreamId stream) {
+  XW_StreamClosedCallback callback = extension_->stream_closed_callback_;
+  if (callback)
+    callback(xw_instance_, stream);
+}
+
+void XWalkExternalInstance::OnStreamWritableToJS(StreamId stream) {
+  XW_StreamWritableCallback callback = extension_->stream_writable_callback_;
+  if (callback)
+    callback(xw_instance_, stream);
+}
+
+void XWalkExternalInstance::OnSharedBufferReleased(BufferId buffer) {
+  SharedBufferMap::iterator it = shared_buffers_.find(buffer);
+  if (it == shared_buffers_.end())
+    return;
+  if (it->second->destroyed) {
+    delete it->second;
+    shared_buffers_.erase(it);
+    return;
+  }
 
-  callback(xw_instance_, string_msg.c_str());
+  it->second->held_by_js = false;
+  XW_SharedBufferReleasedCallback callback =
+      extension_->shared_buffer_released_callback_;
+  if (callback)
+    callback(xw_instance_, buffer);
 }
 
 void XWalkExternalInstance::CoreSetInstanceData(void* data) {
@@ -68,11 +172,102 @@ void* XWalkExternalInstance::CoreGetInstanceData() {
 }
 
 void XWalkExternalInstance::MessagingPostMessage(const char* msg) {
-  PostMessageToJS(scoped_ptr<base::Value>(new base::StringValue(msg)));
+  std::string data;
+  XWalkExtensionWireWriter(&data).WriteString(msg, strlen(msg));
+  PostSerializedMessageToJS(&data);
+}
+
+void XWalkExternalInstance::MessagingPostMessages(const char** msgs,
+                                                  size_t count) {
+  // Handed to the server at once, which sends them together.
+  std::vector<std::string> data(count);
+  for (size_t i = 0; i < count; ++i)
+    XWalkExtensionWireWriter(&data[i]).WriteString(msgs[i], strlen(msgs[i]));
+  PostSerializedMessagesToJS(&data);
+}
+
+void XWalkExternalInstance::BinaryMessagingPostMessage(const char* data,
+                                                       size_t size) {
+  std::string serialized;
+  XWalkExtensionWireWriter(&serialized).WriteBinary(data, size);
+  PostSerializedMessageToJS(&serialized);
 }
 
 void XWalkExternalInstance::SyncMessagingSetSyncReply(const char* reply) {
-  SendSyncReplyToJS(scoped_ptr<base::Value>(new base::StringValue(reply)));
+  SyncMessagingSetSyncReplyWithToken(kOldestSyncReply, reply);
+}
+
+void XWalkExternalInstance::SyncMessagingSetSyncReplyWithToken(
+    int32_t token, const char* reply) {
+  std::string data;
+  XWalkExtensionWireWriter(&data).WriteString(reply, strlen(reply));
+  SendSerializedSyncReplyToJS(token, &data);
+}
+
+int32_t XWalkExternalInstance::FlowControlIsWritable() {
+  return IsWritableToJS() ? 1 : 0;
+}
+
+void XWalkExternalInstance::FlowControlSetCoalesceMessages(int32_t coalesce) {
+  SetCoalesceMessagesToJS(coalesce != 0);
+}
+
+XW_Stream XWalkExternalInstance::StreamOpen() {
+  return OpenStreamToJS();
+}
+
+int32_t XWalkExternalInstance::StreamWrite(XW_Stream stream, const char* data,
+                                           size_t size) {
+  std::string serialized;
+  XWalkExtensionWireWriter(&serialized).WriteBinary(data, size);
+  return WriteSerializedStreamToJS(stream, &serialized) ? 1 : 0;
+}
+
+void XWalkExternalInstance::StreamClose(XW_Stream stream) {
+  CloseStreamToJS(stream);
+}
+
+XW_SharedBuffer XWalkExternalInstance::SharedBufferCreate(size_t size) {
+  scoped_ptr<SharedBuffer> shared_buffer(new SharedBuffer);
+  if (!size || !shared_buffer->memory.CreateAndMapAnonymous(size)) {
+    LOG(WARNING) << "Couldn't create shared buffer of " << size << " bytes.";
+    return 0;
+  }
+  shared_buffer->size = size;
+  const XW_SharedBuffer buffer = next_shared_buffer_++;
+  shared_buffers_[buffer] = shared_buffer.release();
+  return buffer;
+}
+
+void* XWalkExternalInstance::SharedBufferGetData(XW_SharedBuffer buffer) {
+  SharedBufferMap::iterator it = shared_buffers_.find(buffer);
+  if (it == shared_buffers_.end() || it->second->held_by_js)
+    return NULL;
+  return it->second->memory.memory();
+}
+
+int32_t XWalkExternalInstance::SharedBufferPost(XW_SharedBuffer buffer,
+                                                size_t size) {
+  SharedBufferMap::iterator it = shared_buffers_.find(buffer);
+  if (it == shared_buffers_.end() || it->second->held_by_js ||
+      size > it->second->size)
+    return 0;
+  if (!PostSharedBufferToJS(buffer, &it->second->memory, size))
+    return 0;
+  it->second->held_by_js = true;
+  return 1;
+}
+
+void XWalkExternalInstance::SharedBufferDestroy(XW_SharedBuffer buffer) {
+  SharedBufferMap::iterator it = shared_buffers_.find(buffer);
+  if (it == shared_buffers_.end())
+    return;
+  if (it->second->held_by_js) {
+    it->second->destroyed = true;
+    return;
+  }
+  delete it->second;
+  shared_buffers_.erase(it);
 }
 
 }  // namespace extensions
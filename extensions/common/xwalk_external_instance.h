@@ -5,9 +5,13 @@
 #ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_INSTANCE_H_
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_INSTANCE_H_
 
+#include <map>
 #include <string>
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_FlowControl.h"
+#include "xwalk/extensions/public/XW_Extension_SharedBuffer.h"
+#include "xwalk/extensions/public/XW_Extension_Stream.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
 
 namespace xwalk {
@@ -25,8 +29,7 @@ class XWalkExternalExtension;
 // calling the shared library.
 class XWalkExternalInstance : public XWalkExtensionInstance {
  public:
-  XWalkExternalInstance(XWalkExternalExtension* extension,
-                        XW_Instance xw_instance);
+  explicit XWalkExternalInstance(XWalkExternalExtension* extension);
   virtual ~XWalkExternalInstance();
 
  private:
@@ -34,25 +37,72 @@ class XWalkExternalInstance : public XWalkExtensionInstance {
 
   // XWalkExtensionInstance implementation.
   virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE;
-  virtual void HandleSyncMessage(scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleSerializedMessage(const std::string& data) OVERRIDE;
+  virtual void HandleSerializedSyncMessage(const std::string& data,
+                                           SyncReplyToken token) OVERRIDE;
+  virtual void OnWritableToJS() OVERRIDE;
+  virtual void HandleStreamOpened(StreamId stream) OVERRIDE;
+  virtual void HandleStreamData(StreamId stream,
+                                const std::string& data) OVERRIDE;
+  virtual void HandleStreamClosed(StreamId stream) OVERRIDE;
+  virtual void OnStreamWritableToJS(StreamId stream) OVERRIDE;
+  virtual void OnSharedBufferReleased(BufferId buffer) OVERRIDE;
 
   // XW_CoreInterface_1 (from XW_Extension.h) implementation.
   void CoreSetInstanceData(void* data);
   void* CoreGetInstanceData();
 
-  // XW_MessagingInterface_1 (from XW_Extension.h) implementation.
+  // XW_MessagingInterface_2 (from XW_Extension.h) implementation.
   void MessagingPostMessage(const char* msg);
+  void MessagingPostMessages(const char** msgs, size_t count);
+
+  // XW_BinaryMessagingInterface_1 (from XW_Extension.h) implementation.
+  void BinaryMessagingPostMessage(const char* data, size_t size);
 
   // XW_Internal_SyncMessagingInterface_1 (from XW_Extension_SyncMessage.h)
   // implementation.
   void SyncMessagingSetSyncReply(const char* reply);
 
+  // XW_Internal_SyncMessagingInterface_2 (from XW_Extension_SyncMessage.h)
+  // implementation.
+  void SyncMessagingSetSyncReplyWithToken(int32_t token, const char* reply);
+
+  // XW_Internal_FlowControlInterface_1 (from XW_Extension_FlowControl.h)
+  // implementation.
+  int32_t FlowControlIsWritable();
+  void FlowControlSetCoalesceMessages(int32_t coalesce);
+
+  // XW_Internal_StreamInterface_1 (from XW_Extension_Stream.h) implementation.
+  XW_Stream StreamOpen();
+  int32_t StreamWrite(XW_Stream stream, const char* data, size_t size);
+  void StreamClose(XW_Stream stream);
+
+  // XW_Internal_SharedBufferInterface_1 (from XW_Extension_SharedBuffer.h)
+  // implementation.
+  XW_SharedBuffer SharedBufferCreate(size_t size);
+  void* SharedBufferGetData(XW_SharedBuffer buffer);
+  int32_t SharedBufferPost(XW_SharedBuffer buffer, size_t size);
+  void SharedBufferDestroy(XW_SharedBuffer buffer);
+
+  struct SharedBuffer {
+    SharedBuffer() : size(0), held_by_js(false), destroyed(false) {}
+    base::SharedMemory memory;
+    size_t size;
+    bool held_by_js;
+    // Destroy() was called while held by JavaScript.
+    bool destroyed;
+  };
+  typedef std::map<XW_SharedBuffer, SharedBuffer*> SharedBufferMap;
+
   XW_Instance xw_instance_;
   std::string sync_reply_;
   XWalkExternalExtension* extension_;
   void* instance_data_;
   bool is_handling_sync_msg_;
 
+  SharedBufferMap shared_buffers_;
+  XW_SharedBuffer next_shared_buffer_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalInstance);
 };
 
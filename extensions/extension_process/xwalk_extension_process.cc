@@ -9,6 +9,8 @@
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/stl_util.h"
 #include "ipc/ipc_switches.h"
 #include "ipc/ipc_message_macros.h"
 #include "ipc/ipc_sync_channel.h"
@@ -24,16 +26,22 @@ XWalkExtensionProcess::XWalkExtensionProcess()
       base::Thread::Options(base::MessageLoop::TYPE_IO, 0));
 
   CreateBrowserProcessChannel();
-  CreateRenderProcessChannel();
 }
 
 XWalkExtensionProcess::~XWalkExtensionProcess() {
   // FIXME(jeez): Move this to OnChannelClosing/Error/Disconnected when we have
   // our MessageFilter set.
-  extensions_server_.Invalidate();
+  RenderProcessChannelMap::iterator it = render_process_channels_.begin();
+  for (; it != render_process_channels_.end(); ++it)
+    DeleteRenderProcessChannel(it->second);
+  render_process_channels_.clear();
+  if (spare_channel_)
+    DeleteRenderProcessChannel(spare_channel_.release());
 
   shutdown_event_.Signal();
   io_thread_.Stop();
+
+  STLDeleteValues(&extensions_);
 }
 
 bool XWalkExtensionProcess::OnMessageReceived(const IPC::Message& message) {
@@ -41,14 +49,24 @@ bool XWalkExtensionProcess::OnMessageReceived(const IPC::Message& message) {
   IPC_BEGIN_MESSAGE_MAP(XWalkExtensionProcess, message)
     IPC_MESSAGE_HANDLER(XWalkExtensionProcessMsg_RegisterExtensions,
                         OnRegisterExtensions)
+    IPC_MESSAGE_HANDLER(XWalkExtensionProcessMsg_CreateRenderProcessChannel,
+                        OnCreateRenderProcessChannel)
+    IPC_MESSAGE_HANDLER(XWalkExtensionProcessMsg_CloseRenderProcessChannel,
+                        OnCloseRenderProcessChannel)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionProcessMsg_CreateSpareRenderProcessChannel,
+        OnCreateSpareRenderProcessChannel)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionProcessMsg_AssignSpareRenderProcessChannel,
+        OnAssignSpareRenderProcessChannel)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
   return handled;
 }
 
 void XWalkExtensionProcess::OnRegisterExtensions(
-    const base::FilePath& path) {
-  RegisterExternalExtensionsInDirectory(&extensions_server_, path);
+    const std::vector<base::FilePath>& libraries) {
+  RegisterExternalExtensionLibraries(&extensions_, libraries);
 }
 
 void XWalkExtensionProcess::CreateBrowserProcessChannel() {
@@ -60,29 +78,100 @@ void XWalkExtensionProcess::CreateBrowserProcessChannel() {
       true, &shutdown_event_));
 }
 
-void XWalkExtensionProcess::CreateRenderProcessChannel() {
-  IPC::ChannelHandle handle(IPC::Channel::GenerateVerifiedChannelID(
+void XWalkExtensionProcess::OnCreateRenderProcessChannel(
+    int render_process_id) {
+  if (render_process_channels_.find(render_process_id) !=
+      render_process_channels_.end()) {
+    LOG(WARNING) << "Channel for render process " << render_process_id
+                 << " already exists.";
+    return;
+  }
+
+  IPC::ChannelHandle handle;
+  render_process_channels_[render_process_id] =
+      CreateRenderProcessChannel(&handle);
+
+  browser_process_channel_->Send(
+      new XWalkExtensionProcessHostMsg_RenderProcessChannelCreated(
+          render_process_id, handle));
+}
+
+void XWalkExtensionProcess::OnCreateSpareRenderProcessChannel() {
+  if (spare_channel_) {
+    LOG(WARNING) << "Spare render process channel already exists.";
+    return;
+  }
+
+  IPC::ChannelHandle handle;
+  spare_channel_.reset(CreateRenderProcessChannel(&handle));
+
+  browser_process_channel_->Send(
+      new XWalkExtensionProcessHostMsg_SpareRenderProcessChannelCreated(
+          handle));
+}
+
+void XWalkExtensionProcess::OnAssignSpareRenderProcessChannel(
+    int render_process_id) {
+  if (!spare_channel_) {
+    LOG(WARNING) << "No spare channel for render process "
+                 << render_process_id << ".";
+    return;
+  }
+  if (render_process_channels_.find(render_process_id) !=
+      render_process_channels_.end()) {
+    LOG(WARNING) << "Channel for render process " << render_process_id
+                 << " already exists.";
+    return;
+  }
+  render_process_channels_[render_process_id] = spare_channel_.release();
+}
+
+XWalkExtensionProcess::RenderProcessChannel*
+XWalkExtensionProcess::CreateRenderProcessChannel(IPC::ChannelHandle* handle) {
+  RenderProcessChannel* render_process = new RenderProcessChannel;
+  render_process->server->SetExtensions(extensions_);
+
+  *handle = IPC::ChannelHandle(IPC::Channel::GenerateVerifiedChannelID(
       std::string()));
-  rp_channel_handle_ = handle;
 
-  render_process_channel_.reset(new IPC::SyncChannel(rp_channel_handle_,
-      IPC::Channel::MODE_SERVER, &extensions_server_,
+  render_process->channel.reset(new IPC::SyncChannel(*handle,
+      IPC::Channel::MODE_SERVER, render_process->server.get(),
       io_thread_.message_loop_proxy(), true, &shutdown_event_));
 
 #if defined(OS_POSIX)
-    // On POSIX, pass the server-side file descriptor. We use
-    // TakeClientFileDescriptor() instead of GetClientFileDescriptor()
-    // since the client-side channel will take ownership of the fd.
-    rp_channel_handle_.socket =
-       base::FileDescriptor(render_process_channel_->TakeClientFileDescriptor(),
-          true);
+  // On POSIX, pass the server-side file descriptor. We use
+  // TakeClientFileDescriptor() instead of GetClientFileDescriptor()
+  // since the client-side channel will take ownership of the fd.
+  handle->socket = base::FileDescriptor(
+      render_process->channel->TakeClientFileDescriptor(), true);
 #endif
 
-  extensions_server_.Initialize(render_process_channel_.get());
+  render_process->server->Initialize(render_process->channel.get(),
+                                     base::MessageLoopProxy::current());
+  return render_process;
+}
+
+void XWalkExtensionProcess::OnCloseRenderProcessChannel(
+    int render_process_id) {
+  RenderProcessChannelMap::iterator it =
+      render_process_channels_.find(render_process_id);
+  if (it == render_process_channels_.end())
+    return;
 
-  browser_process_channel_->Send(
-      new XWalkExtensionProcessHostMsg_RenderProcessChannelCreated(
-          rp_channel_handle_));
+  RenderProcessChannel* render_process = it->second;
+  render_process_channels_.erase(it);
+  DeleteRenderProcessChannel(render_process);
+}
+
+void XWalkExtensionProcess::DeleteRenderProcessChannel(
+    RenderProcessChannel* render_process) {
+  // The channel goes away right now so no more messages are received. The
+  // server stays alive while tasks posted to this thread or to the instances,
+  // like flushing batched messages, still use it.
+  render_process->server->Invalidate();
+  render_process->channel.reset();
+  render_process->server->DeleteInstances();
+  delete render_process;
 }
 
 }  // namespace extensions
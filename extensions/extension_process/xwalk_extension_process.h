@@ -5,6 +5,9 @@
 #ifndef XWALK_EXTENSIONS_EXTENSION_PROCESS_XWALK_EXTENSION_PROCESS_H_
 #define XWALK_EXTENSIONS_EXTENSION_PROCESS_XWALK_EXTENSION_PROCESS_H_
 
+#include <map>
+#include <vector>
+
 #include "base/values.h"
 #include "base/synchronization/waitable_event.h"
 #include "base/threading/thread.h"
@@ -30,9 +33,9 @@ class XWalkExtensionRunner;
 // This class represents the Extension Process itself.
 // It not only represents the extension side of the browser <->
 // extension process communication channel, but also the extension side
-// of the extension <-> render process channel.
+// of the extension <-> render process channels, one for each render process.
 // It will be responsible for handling the native side (instances) of
-// External extensions through its XWalkExtensionServer.
+// External extensions through one XWalkExtensionServer per channel.
 class XWalkExtensionProcess : public IPC::Listener {
  public:
   XWalkExtensionProcess();
@@ -43,17 +46,42 @@ class XWalkExtensionProcess : public IPC::Listener {
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
 
   // Handlers for IPC messages from XWalkExtensionProcessHost.
-  void OnRegisterExtensions(const base::FilePath& extension_path);
+  void OnRegisterExtensions(const std::vector<base::FilePath>& libraries);
+  void OnCreateRenderProcessChannel(int render_process_id);
+  void OnCloseRenderProcessChannel(int render_process_id);
+  void OnCreateSpareRenderProcessChannel();
+  void OnAssignSpareRenderProcessChannel(int render_process_id);
 
   void CreateBrowserProcessChannel();
-  void CreateRenderProcessChannel();
+
+  // The server and channel used by one render process. The channel is declared
+  // after the server so it is destroyed first, since the server is its
+  // listener.
+  struct RenderProcessChannel {
+    RenderProcessChannel() : server(new XWalkExtensionServer) {}
+
+    scoped_refptr<XWalkExtensionServer> server;
+    scoped_ptr<IPC::SyncChannel> channel;
+  };
+
+  // Returns a channel with its server ready for a render process to connect,
+  // and sets |handle| to what the render process needs to do so.
+  RenderProcessChannel* CreateRenderProcessChannel(IPC::ChannelHandle* handle);
+  void DeleteRenderProcessChannel(RenderProcessChannel* render_process);
 
   base::WaitableEvent shutdown_event_;
   base::Thread io_thread_;
   scoped_ptr<IPC::SyncChannel> browser_process_channel_;
-  XWalkExtensionServer extensions_server_;
-  scoped_ptr<IPC::SyncChannel> render_process_channel_;
-  IPC::ChannelHandle rp_channel_handle_;
+
+  // Shared by the servers of all render processes.
+  XWalkExtensionServer::ExtensionMap extensions_;
+
+  typedef std::map<int, RenderProcessChannel*> RenderProcessChannelMap;
+  RenderProcessChannelMap render_process_channels_;
+
+  // Created ahead of time when the browser asks for it, not assigned to any
+  // render process yet.
+  scoped_ptr<RenderProcessChannel> spare_channel_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionProcess);
 };
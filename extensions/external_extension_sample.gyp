@@ -22,5 +22,27 @@
     ],
     'product_dir': '<(PRODUCT_DIR)/tests/extension/bad_extension/'
   },
+  {
+    # Same library as echo_extension, but loaded on demand thanks to its
+    # metadata file, which must match the library name.
+    'target_name': 'lazy_echo_extension',
+    'type': 'loadable_module',
+    'product_prefix': '',
+    'include_dirs': [
+      '../..',
+    ],
+    'sources': [
+      'test/echo_extension.c',
+    ],
+    'product_dir': '<(PRODUCT_DIR)/tests/extension/lazy_echo_extension/',
+    'copies': [
+      {
+        'destination': '<(PRODUCT_DIR)/tests/extension/lazy_echo_extension/',
+        'files': [
+          'test/lazy_echo_extension.json',
+        ],
+      },
+    ],
+  },
   ],
 }
@@ -16,5 +16,26 @@
         'cc_dir': 'xwalk/extensions/test',
         'root_namespace': 'xwalk::jsapi_test',
       },
-   }],
+      'dependencies': [
+        'api_test_function_ids',
+      ],
+      'export_dependent_settings': [
+        'api_test_function_ids',
+      ],
+    },
+    {
+      'target_name': 'api_test_function_ids',
+      'type': 'none',
+      'sources': [
+        'test/test.idl',
+      ],
+      'includes': [
+        'xwalk_function_ids.gypi',
+      ],
+      'variables': {
+        'cc_dir': 'xwalk/extensions/test',
+        'root_namespace': 'xwalk::jsapi_test',
+      },
+    },
+  ],
 }
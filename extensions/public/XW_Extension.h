@@ -33,6 +33,7 @@ extern "C" {
 #define XW_EXPORT __declspec(dllexport)
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -113,10 +114,13 @@ struct XW_CoreInterface_1 {
   //            extension.
   //
   // - extension.postMessage(): post a string message to the extension native
-  //                            code. See below for details.
+  //                            code. See below for details. ArrayBuffers can
+  //                            also be posted, see
+  //                            XW_BINARY_MESSAGING_INTERFACE.
   // - extension.setMessageListener(): allow setting a callback that is called
   //                                   when the native code sends a message
-  //                                   to JavaScript. Callback takes a string.
+  //                                   to JavaScript. Callback takes a string,
+  //                                   or an ArrayBuffer for binary messages.
   //
   // This function should be called only during XW_Initialize().
   void (*SetJavaScriptAPI)(XW_Extension extension, const char* api);
@@ -154,7 +158,8 @@ typedef struct XW_CoreInterface_1 XW_CoreInterface;
 //
 
 #define XW_MESSAGING_INTERFACE_1 "XW_MessagingInterface_1"
-#define XW_MESSAGING_INTERFACE XW_MESSAGING_INTERFACE_1
+#define XW_MESSAGING_INTERFACE_2 "XW_MessagingInterface_2"
+#define XW_MESSAGING_INTERFACE XW_MESSAGING_INTERFACE_2
 
 typedef void (*XW_HandleMessageCallback)(XW_Instance instance,
                                          const char* message);
@@ -176,7 +181,60 @@ struct XW_MessagingInterface_1 {
   void (*PostMessage)(XW_Instance instance, const char* message);
 };
 
-typedef struct XW_MessagingInterface_1 XW_MessagingInterface;
+struct XW_MessagingInterface_2 {
+  // Same as in XW_MessagingInterface_1.
+  void (*Register)(XW_Extension extension,
+                   XW_HandleMessageCallback handle_message);
+  void (*PostMessage)(XW_Instance instance, const char* message);
+
+  // Post |count| messages from the |messages| array to the web content
+  // associated with the instance, in order. This is cheaper than calling
+  // PostMessage() once for each message when the extension has many messages
+  // to send at once, they are handed over together and sent in as few IPC
+  // messages as possible. Messages posted with both functions are delivered
+  // in the order they were posted.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  void (*PostMessages)(XW_Instance instance, const char** messages,
+                       size_t count);
+};
+
+typedef struct XW_MessagingInterface_2 XW_MessagingInterface;
+
+
+//
+// XW_BINARY_MESSAGING_INTERFACE: Exchange asynchronous messages carrying
+// arbitrary bytes with JavaScript code provided by extension. On the
+// JavaScript side these messages are ArrayBuffer objects.
+//
+
+#define XW_BINARY_MESSAGING_INTERFACE_1 "XW_BinaryMessagingInterface_1"
+#define XW_BINARY_MESSAGING_INTERFACE XW_BINARY_MESSAGING_INTERFACE_1
+
+typedef void (*XW_HandleBinaryMessageCallback)(XW_Instance instance,
+                                               const char* data,
+                                               size_t size);
+
+struct XW_BinaryMessagingInterface_1 {
+  // Register a callback to be called when the JavaScript code associated
+  // with the extension posts an ArrayBuffer using extension.postMessage().
+  // The |data| is only valid during the callback execution and is not NUL
+  // terminated, |size| contains its length in bytes. String messages are
+  // still delivered to the callback registered with XW_MESSAGING_INTERFACE.
+  void (*Register)(XW_Extension extension,
+                   XW_HandleBinaryMessageCallback handle_binary_message);
+
+  // Post |size| bytes from |data| to the web content associated with the
+  // instance. The listener set by extension.setMessageListener() will receive
+  // an ArrayBuffer with a copy of the data.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  void (*PostMessage)(XW_Instance instance, const char* data, size_t size);
+};
+
+typedef struct XW_BinaryMessagingInterface_1 XW_BinaryMessagingInterface;
 
 #ifdef __cplusplus
 }  // extern "C"
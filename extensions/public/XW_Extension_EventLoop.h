@@ -0,0 +1,81 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_EVENTLOOP_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_EVENTLOOP_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_EVENT_LOOP_INTERFACE: allow an extension to wait for file
+// descriptors and timers in the thread running its instances, instead of
+// spawning threads of its own. Callbacks run in that same thread, so they can
+// post messages to the instances right away.
+//
+// All the functions must be called from the thread running the instances,
+// not during XW_Initialize(). Watching file descriptors is only supported by
+// extensions using XW_THREADING_MODEL_DEDICATED_THREAD (see
+// XW_Extension_Threading.h), timers also work with the default shared thread
+// but not with XW_THREADING_MODEL_WORKER_POOL.
+//
+
+#define XW_INTERNAL_EVENT_LOOP_INTERFACE_1 \
+  "XW_InternalEventLoopInterface_1"
+#define XW_INTERNAL_EVENT_LOOP_INTERFACE \
+  XW_INTERNAL_EVENT_LOOP_INTERFACE_1
+
+// Identify a file descriptor watch or a timer. Zero is never a valid value
+// and is returned on errors.
+typedef int32_t XW_Watch;
+typedef int32_t XW_Timer;
+
+// Events for WatchFileDescriptor(), can be combined.
+#define XW_EVENT_LOOP_READ 1
+#define XW_EVENT_LOOP_WRITE 2
+
+// Called with XW_EVENT_LOOP_READ or XW_EVENT_LOOP_WRITE each time |fd| can be
+// read or written without blocking, until the watch is cancelled.
+typedef void (*XW_FileDescriptorCallback)(XW_Extension extension, int fd,
+                                          int32_t event, void* user_data);
+
+typedef void (*XW_TimerCallback)(XW_Extension extension, void* user_data);
+
+struct XW_Internal_EventLoopInterface_1 {
+  XW_Watch (*WatchFileDescriptor)(XW_Extension extension, int fd,
+                                  int32_t events,
+                                  XW_FileDescriptorCallback callback,
+                                  void* user_data);
+
+  // Can be called from the callback of the watch.
+  void (*CancelWatch)(XW_Extension extension, XW_Watch watch);
+
+  // Runs |callback| after |delay_ms| milliseconds, and then every |delay_ms|
+  // if |repeating| is not zero. A timer may run up to |leeway_ms| later than
+  // asked, so timers expiring around the same time run together with a single
+  // wake up of the thread.
+  XW_Timer (*StartTimer)(XW_Extension extension, int64_t delay_ms,
+                         int64_t leeway_ms, int32_t repeating,
+                         XW_TimerCallback callback, void* user_data);
+
+  // Can be called from the callback of the timer.
+  void (*CancelTimer)(XW_Extension extension, XW_Timer timer);
+};
+
+typedef struct XW_Internal_EventLoopInterface_1
+    XW_Internal_EventLoopInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_EVENTLOOP_H_
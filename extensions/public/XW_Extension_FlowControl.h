@@ -0,0 +1,59 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_FLOWCONTROL_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_FLOWCONTROL_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_FLOW_CONTROL_INTERFACE: allow an extension to find out when the
+// JavaScript side doesn't keep up with the messages posted to it. Messages
+// are only sent to JavaScript as the previous ones are handled. Posting never
+// fails, but once an instance has too many messages waiting it stops being
+// writable, and the extension should stop producing messages until its
+// writable callback is called.
+//
+
+#define XW_INTERNAL_FLOW_CONTROL_INTERFACE_1 \
+  "XW_InternalFlowControlInterface_1"
+#define XW_INTERNAL_FLOW_CONTROL_INTERFACE \
+  XW_INTERNAL_FLOW_CONTROL_INTERFACE_1
+
+// Called in the thread running the instance when it becomes writable again.
+typedef void (*XW_WritableCallback)(XW_Instance instance);
+
+struct XW_Internal_FlowControlInterface_1 {
+  void (*RegisterWritableCallback)(XW_Extension extension,
+                                   XW_WritableCallback callback);
+
+  // Returns zero when the instance has too many messages waiting to be
+  // handled by JavaScript. Messages posted meanwhile still wait to be sent,
+  // but only up to a few thousands, the ones past that are dropped. Can be
+  // called from any thread.
+  int32_t (*IsWritable)(XW_Instance instance);
+
+  // When |coalesce| is not zero, only the latest message waiting to be sent is
+  // kept, the ones posted before it are dropped. Useful for instances posting
+  // a stream of states where only the last one matters.
+  void (*SetCoalesceMessages)(XW_Instance instance, int32_t coalesce);
+};
+
+typedef struct XW_Internal_FlowControlInterface_1
+    XW_Internal_FlowControlInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_FLOWCONTROL_H_
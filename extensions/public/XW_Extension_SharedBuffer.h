@@ -0,0 +1,70 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_SHAREDBUFFER_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_SHAREDBUFFER_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_SHARED_BUFFER_INTERFACE: allow an extension to give JavaScript
+// large data, like camera frames or audio samples, without copying it. The
+// extension fills a buffer of shared memory and posts it, JavaScript then
+// sees it as an ArrayBuffer until it releases it. The extension must not
+// touch the buffer in the meantime, but can fill and post it again once the
+// released callback is called, so a few buffers can be recycled forever.
+//
+// The ArrayBuffer isn't owned by Blink, so JavaScript can't give it to DOM
+// APIs like Blob or XMLHttpRequest. It has to copy it with slice() first.
+//
+
+#define XW_INTERNAL_SHARED_BUFFER_INTERFACE_1 \
+  "XW_InternalSharedBufferInterface_1"
+#define XW_INTERNAL_SHARED_BUFFER_INTERFACE \
+  XW_INTERNAL_SHARED_BUFFER_INTERFACE_1
+
+typedef int32_t XW_SharedBuffer;
+
+// Called in the thread running the instance when JavaScript released the
+// buffer, or didn't take it because it had no listener for buffers.
+typedef void (*XW_SharedBufferReleasedCallback)(XW_Instance instance,
+                                                XW_SharedBuffer buffer);
+
+struct XW_Internal_SharedBufferInterface_1 {
+  void (*RegisterReleasedCallback)(XW_Extension extension,
+                                   XW_SharedBufferReleasedCallback callback);
+
+  // Returns a new buffer of |size| bytes, or zero on failure. Must be called
+  // from the thread running the instance, like the functions below.
+  XW_SharedBuffer (*Create)(XW_Instance instance, size_t size);
+
+  // Returns the memory of the buffer, or NULL while it is held by JavaScript.
+  void* (*GetData)(XW_Instance instance, XW_SharedBuffer buffer);
+
+  // Gives the first |size| bytes of the buffer to JavaScript. Returns zero if
+  // the buffer couldn't be posted, the released callback isn't called then.
+  int32_t (*Post)(XW_Instance instance, XW_SharedBuffer buffer, size_t size);
+
+  // If the buffer is held by JavaScript, it is destroyed once released, and
+  // the released callback isn't called for it.
+  void (*Destroy)(XW_Instance instance, XW_SharedBuffer buffer);
+};
+
+typedef struct XW_Internal_SharedBufferInterface_1
+    XW_Internal_SharedBufferInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_SHAREDBUFFER_H_
@@ -0,0 +1,76 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_STREAM_INTERFACE: allow an extension to exchange large payloads
+// with JavaScript in chunks. Each stream goes in one direction only, and has a
+// window of data in flight: once it is full, writing fails until the
+// writable callback is called for the stream. Streams are identified by the
+// instance and the stream id, the ids of streams opened by JavaScript and by
+// the extension are independent.
+//
+
+#define XW_INTERNAL_STREAM_INTERFACE_1 \
+  "XW_InternalStreamInterface_1"
+#define XW_INTERNAL_STREAM_INTERFACE \
+  XW_INTERNAL_STREAM_INTERFACE_1
+
+typedef int32_t XW_Stream;
+
+// Called in the thread running the instance for the streams opened by
+// JavaScript. Chunks are only valid during the callback.
+typedef void (*XW_StreamOpenedCallback)(XW_Instance instance,
+                                        XW_Stream stream);
+typedef void (*XW_StreamDataCallback)(XW_Instance instance, XW_Stream stream,
+                                      const char* data, size_t size);
+typedef void (*XW_StreamClosedCallback)(XW_Instance instance,
+                                        XW_Stream stream);
+
+// Called in the thread running the instance when a stream it opened can be
+// written to again.
+typedef void (*XW_StreamWritableCallback)(XW_Instance instance,
+                                          XW_Stream stream);
+
+struct XW_Internal_StreamInterface_1 {
+  void (*RegisterStreamCallbacks)(XW_Extension extension,
+                                  XW_StreamOpenedCallback opened,
+                                  XW_StreamDataCallback data,
+                                  XW_StreamClosedCallback closed);
+  void (*RegisterWritableCallback)(XW_Extension extension,
+                                   XW_StreamWritableCallback callback);
+
+  // Returns the new stream, or zero on failure. Must be called from the
+  // thread running the instance, like the functions below.
+  XW_Stream (*Open)(XW_Instance instance);
+
+  // Returns zero, without writing the chunk, when the stream has a full
+  // window of data in flight. The chunk arrives in JavaScript as an
+  // ArrayBuffer.
+  int32_t (*Write)(XW_Instance instance, XW_Stream stream, const char* data,
+                   size_t size);
+
+  void (*Close)(XW_Instance instance, XW_Stream stream);
+};
+
+typedef struct XW_Internal_StreamInterface_1 XW_Internal_StreamInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
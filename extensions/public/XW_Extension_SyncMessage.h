@@ -26,8 +26,10 @@ extern "C" {
 
 #define XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1 \
   "XW_InternalSyncMessagingInterface_1"
+#define XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2 \
+  "XW_InternalSyncMessagingInterface_2"
 #define XW_INTERNAL_SYNC_MESSAGING_INTERFACE \
-  XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1
+  XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2
 
 typedef void (*XW_HandleSyncMessageCallback)(XW_Instance instance,
                                              const char* message);
@@ -38,7 +40,22 @@ struct XW_Internal_SyncMessagingInterface_1 {
   void (*SetSyncReply)(XW_Instance instance, const char* reply);
 };
 
-typedef struct XW_Internal_SyncMessagingInterface_1
+// Version 2 passes a token along with each message, and SetSyncReply takes
+// it back to tell which message is being answered. Many messages of the same
+// instance can wait for a reply at the same time, and they can be answered in
+// any order and from any thread. Tokens are never zero.
+
+typedef void (*XW_HandleSyncMessageWithTokenCallback)(XW_Instance instance,
+                                                      const char* message,
+                                                      int32_t token);
+
+struct XW_Internal_SyncMessagingInterface_2 {
+  void (*Register)(XW_Extension extension,
+                   XW_HandleSyncMessageWithTokenCallback handle_sync_message);
+  void (*SetSyncReply)(XW_Instance instance, int32_t token, const char* reply);
+};
+
+typedef struct XW_Internal_SyncMessagingInterface_2
     XW_Internal_SyncMessagingInterface;
 
 #ifdef __cplusplus
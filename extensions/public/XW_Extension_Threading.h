@@ -0,0 +1,53 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_THREADING_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_THREADING_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_THREADING_INTERFACE: allow an extension to choose the thread
+// where its instances run, so a slow or blocking extension doesn't delay the
+// other extensions loaded in the same process. Messages for an instance are
+// always handled in order and in the thread the instance was created. Should
+// be called only during XW_Initialize().
+//
+
+#define XW_INTERNAL_THREADING_INTERFACE_1 \
+  "XW_InternalThreadingInterface_1"
+#define XW_INTERNAL_THREADING_INTERFACE \
+  XW_INTERNAL_THREADING_INTERFACE_1
+
+// Instances share one thread with the other extensions. This is the default.
+#define XW_THREADING_MODEL_SHARED_THREAD 0
+
+// All the instances of the extension run in a thread of its own.
+#define XW_THREADING_MODEL_DEDICATED_THREAD 1
+
+// Each instance runs in a worker pool, different instances may run at the
+// same time so the extension code must be thread-safe.
+#define XW_THREADING_MODEL_WORKER_POOL 2
+
+struct XW_Internal_ThreadingInterface_1 {
+  void (*SetThreadingModel)(XW_Extension extension, int32_t threading_model);
+};
+
+typedef struct XW_Internal_ThreadingInterface_1
+    XW_Internal_ThreadingInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_THREADING_H_
@@ -5,41 +5,244 @@
 var xwalk = xwalk || {};
 
 xwalk._setupExtensionInternal = function(extension_obj) {
-  var callback_listeners = {};
-  var callback_id = 0;
-
-  function wrapCallback(args, callback) {
-    if (callback) {
-      var id = (callback_id++).toString();
-      callback_listeners[id] = callback;
-      args.unshift(id);
+  // Must match XWalkInternalExtensionInstance::kNoCallback.
+  var NO_CALLBACK = -1;
+
+  // The pending callbacks are kept in the slots of an array, so the array
+  // doesn't grow past the number of calls in flight. A free slot holds the
+  // index of the next free slot instead of a callback, chaining the free list
+  // that starts at |next_free_slot|. Promises also keep their reject function
+  // in |rejects|.
+  //
+  // Slots are reused right away, so the callback ID also carries the
+  // generation of its slot, bumped each time the slot is freed. A reply with
+  // an outdated generation, like a second reply for the same call, is
+  // dropped instead of reaching the call now using the slot.
+  var SLOT_BITS = 16;
+  var SLOT_MASK = (1 << SLOT_BITS) - 1;
+  var GENERATION_MASK = 0x7fff;
+
+  var callbacks = [];
+  var rejects = [];
+  var generations = [];
+  var next_free_slot = 0;
+
+  function allocateSlot(callback, reject) {
+    var slot = next_free_slot;
+    if (slot === callbacks.length) {
+      if (slot > SLOT_MASK)
+        throw new Error('Too many calls in flight.');
+      callbacks.push(callback);
+      rejects.push(reject);
+      generations.push(0);
+      next_free_slot = slot + 1;
     } else {
-      // The function name and the callback ID are prepended before
-      // the arguments. If there is no callback, an empty string is
-      // should be used. This will be sorted out by the InternalInstance
-      // message handler.
-      args.unshift("");
+      next_free_slot = callbacks[slot];
+      callbacks[slot] = callback;
+      rejects[slot] = reject;
     }
+    return (generations[slot] << SLOT_BITS) | slot;
   }
 
+  function freeSlot(slot) {
+    callbacks[slot] = next_free_slot;
+    rejects[slot] = null;
+    generations[slot] = (generations[slot] + 1) & GENERATION_MASK;
+    next_free_slot = slot;
+  }
+
+  // Replies are the tuple [callback_id, [results...]], or
+  // [callback_id, null, error_message] when the function failed. Failures
+  // reject promises, callbacks are not called.
   extension_obj.setMessageListener(function(msg) {
-    var args = arguments[0];
-    var id = args.shift();
-    var listener = callback_listeners[id];
+    var id = msg[0];
+    var slot = id & SLOT_MASK;
+    var callback = callbacks[slot];
+    if (typeof callback !== 'function' ||
+        generations[slot] !== id >>> SLOT_BITS)
+      return;
+
+    // The slot is freed first, so the callback can reuse it.
+    var reject = rejects[slot];
+    freeSlot(slot);
 
-    if (listener !== undefined) {
-      listener.apply(null, args);
-      delete callback_listeners[id];
+    var results = msg[1];
+    if (!results) {
+      if (reject)
+        reject(new Error(msg[2]));
+      return;
     }
+
+    if (reject)
+      callback(results.length > 1 ? results : results[0]);
+    else
+      callback.apply(null, results);
   });
 
   // All Internal Extensions functions should only be exposed by
   // this _internal object, acting like a namespace.
   extension_obj._internal = {};
 
-  extension_obj._internal.postMessage = function(function_name, args, callback) {
-    wrapCallback(args, callback);
-    args.unshift(function_name);
-    extension_obj.postMessage(args);
+  // Calls are the tuple [function_id, callback_id, [args...]], where
+  // |function_id| is one of the IDs of the FunctionId object generated from
+  // the IDL describing the extension API.
+  extension_obj._internal.postMessage = function(function_id, args, callback) {
+    var id = callback ? allocateSlot(callback, null) : NO_CALLBACK;
+    extension_obj.postMessage([function_id, id, args]);
+  };
+
+  // The executor runs synchronously inside the Promise constructor, so a
+  // single function is shared by all calls instead of allocating a closure
+  // for each one. It leaves the callback ID in |promise_id|.
+  var promise_id = NO_CALLBACK;
+  function promiseExecutor(resolve, reject) {
+    promise_id = allocateSlot(resolve, reject);
+  }
+
+  // Like postMessage(), but returns a Promise resolved with the result of
+  // the function, or the array of results if there are more than one. The
+  // Promise is rejected if the function fails, see
+  // XWalkInternalExtensionInstance::PostError().
+  extension_obj._internal.postMessageWithPromise = function(function_id,
+                                                            args) {
+    if (typeof Promise !== 'function')
+      throw new Error('Promises are not supported.');
+    var promise = new Promise(promiseExecutor);
+    extension_obj.postMessage([function_id, promise_id, args]);
+    return promise;
+  };
+};
+
+// Wraps the raw stream functions of |extension_obj| in stream objects, which
+// queue the chunks while the stream is full:
+//
+//   var stream = extension.createStream();
+//   if (!stream.write(chunk))
+//     stream.on('drain', writeMore);
+//   stream.end();
+//
+//   extension.setStreamHandler(function(stream) {
+//     stream.on('data', function(chunk) { ... });
+//     stream.on('end', function() { ... });
+//   });
+//
+// The streams take over the stream listener of the extension.
+xwalk._setupExtensionStreams = function(extension_obj) {
+  // Streams opened by JavaScript and by the native side have separated ids.
+  var writables = {};
+  var readables = {};
+  var stream_handler = null;
+
+  function StreamEvents() {
+    this._listeners = {};
+  }
+
+  StreamEvents.prototype.on = function(type, listener) {
+    if (!this._listeners[type])
+      this._listeners[type] = [];
+    this._listeners[type].push(listener);
+    return this;
+  };
+
+  StreamEvents.prototype._emit = function(type, arg) {
+    var listeners = this._listeners[type];
+    if (!listeners)
+      return;
+    for (var i = 0; i < listeners.length; ++i)
+      listeners[i].call(this, arg);
+  };
+
+  // Stream to the native side. Chunks written while it's full wait in
+  // |_queue|, 'drain' is emitted once they were all written.
+  function WritableStream(id) {
+    StreamEvents.call(this);
+    this._id = id;
+    this._queue = [];
+    this._ending = false;
+  }
+  WritableStream.prototype = Object.create(StreamEvents.prototype);
+
+  // Returns false if the chunk had to be queued, further chunks should wait
+  // for 'drain'.
+  WritableStream.prototype.write = function(chunk) {
+    if (this._ending)
+      throw new Error('Write after end of stream.');
+    if (!this._queue.length && extension_obj.writeStream(this._id, chunk))
+      return true;
+    this._queue.push(chunk);
+    return false;
+  };
+
+  // Closes the stream once the queued chunks are written.
+  WritableStream.prototype.end = function() {
+    if (this._ending)
+      return;
+    this._ending = true;
+    if (!this._queue.length)
+      this._close();
+  };
+
+  WritableStream.prototype._close = function() {
+    delete writables[this._id];
+    extension_obj.closeStream(this._id);
+  };
+
+  WritableStream.prototype._onWritable = function() {
+    while (this._queue.length) {
+      if (!extension_obj.writeStream(this._id, this._queue[0]))
+        return;
+      this._queue.shift();
+    }
+    if (this._ending)
+      this._close();
+    else
+      this._emit('drain');
+  };
+
+  // Stream from the native side, emits 'data' for each chunk then 'end'.
+  function ReadableStream() {
+    StreamEvents.call(this);
+  }
+  ReadableStream.prototype = Object.create(StreamEvents.prototype);
+
+  extension_obj.setStreamListener(function(type, id, chunk) {
+    if (type === 'drain') {
+      var writable = writables[id];
+      if (writable)
+        writable._onWritable();
+      return;
+    }
+
+    if (type === 'open') {
+      var stream = new ReadableStream();
+      readables[id] = stream;
+      // The handler runs before any data, so it can add its listeners.
+      if (stream_handler)
+        stream_handler(stream);
+      return;
+    }
+
+    var readable = readables[id];
+    if (!readable)
+      return;
+    if (type === 'data') {
+      readable._emit('data', chunk);
+    } else if (type === 'end') {
+      delete readables[id];
+      readable._emit('end');
+    }
+  });
+
+  extension_obj.createStream = function() {
+    var id = extension_obj.openStream();
+    if (!id)
+      throw new Error('Couldn\'t open stream.');
+    var stream = new WritableStream(id);
+    writables[id] = stream;
+    return stream;
+  };
+
+  extension_obj.setStreamHandler = function(handler) {
+    stream_handler = handler;
   };
 };
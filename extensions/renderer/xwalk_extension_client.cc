@@ -4,63 +4,270 @@
 
 #include "xwalk/extensions/renderer/xwalk_extension_client.h"
 
-#include "base/values.h"
+#include <limits>
+#include "base/bind.h"
+#include "base/lazy_instance.h"
+#include "base/location.h"
+#include "base/message_loop.h"
+#include "base/sha1.h"
 #include "ipc/ipc_sender.h"
+#include "xwalk/extensions/common/xwalk_extension_flow_control.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_shared_transport.h"
 #include "xwalk/extensions/renderer/xwalk_extension_module.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Maximum number of messages batched before they are sent to the server
+// without waiting for the end of the current task.
+const size_t kMaxBatchedMessages = 64;
+
+// JS API code received by all the clients of the render process, keyed by
+// its SHA-1 hash, so the code already seen is not copied again.
+typedef std::map<std::string, std::string> APICodeMap;
+base::LazyInstance<APICodeMap> g_api_code_by_hash = LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
 XWalkExtensionClient::XWalkExtensionClient()
     : sender_(0),
-      next_instance_id_(0) {
+      next_instance_id_(0),
+      next_stream_id_(1),
+      weak_ptr_factory_(this) {
 }
 
 XWalkExtensionClient::~XWalkExtensionClient() {
 }
 
 bool XWalkExtensionClient::Send(IPC::Message* msg) {
+  FlushPendingMessages();
+  return SendToServer(msg);
+}
+
+bool XWalkExtensionClient::SendToServer(IPC::Message* msg) {
   DCHECK(sender_);
 
-  return sender_->Send(msg);
+  if (!shared_transport_)
+    return sender_->Send(msg);
+
+  if (XWalkExtensionSharedTransport::CanSend(*msg)) {
+    bool wake_up_server = false;
+    if (shared_transport_->Send(*msg, &wake_up_server)) {
+      delete msg;
+      if (wake_up_server)
+        sender_->Send(new XWalkExtensionServerMsg_SharedTransportDataAvailable);
+      return true;
+    }
+  }
+
+  // Synchronous messages and their replies block the sender, so nothing
+  // can overtake them.
+  const bool ordered = !msg->is_sync() && !msg->is_reply();
+  const bool sent = sender_->Send(msg);
+  uint32 sequence;
+  if (ordered && shared_transport_->OnSentThroughChannel(&sequence))
+    sender_->Send(new XWalkExtensionServerMsg_SharedTransportPaused(sequence));
+  return sent;
+}
+
+void XWalkExtensionClient::FlushPendingMessages() {
+  if (pending_created_instance_ids_.size() == 1) {
+    SendToServer(new XWalkExtensionServerMsg_CreateInstance(
+        pending_created_instance_ids_[0], pending_created_extension_names_[0]));
+  } else if (!pending_created_instance_ids_.empty()) {
+    SendToServer(new XWalkExtensionServerMsg_CreateInstances(
+        pending_created_instance_ids_, pending_created_extension_names_));
+  }
+  pending_created_instance_ids_.clear();
+  pending_created_extension_names_.clear();
+
+  if (pending_instance_ids_.empty())
+    return;
+
+  // A single message is sent with the regular message.
+  if (pending_instance_ids_.size() == 1) {
+    SendToServer(new XWalkExtensionServerMsg_PostMessageToNative(
+        pending_instance_ids_[0], pending_messages_[0]));
+  } else {
+    SendToServer(new XWalkExtensionServerMsg_PostMessagesToNative(
+        pending_instance_ids_, pending_messages_));
+  }
+
+  pending_instance_ids_.clear();
+  pending_messages_.clear();
+}
+
+void XWalkExtensionClient::ScheduleFlushPendingMessages() {
+  base::MessageLoop::current()->PostTask(
+      FROM_HERE, base::Bind(&XWalkExtensionClient::FlushPendingMessages,
+                            weak_ptr_factory_.GetWeakPtr()));
+}
+
+bool XWalkExtensionClient::HasPendingMessages() const {
+  return !pending_created_instance_ids_.empty() ||
+      !pending_instance_ids_.empty();
 }
 
 XWalkRemoteExtensionRunner* XWalkExtensionClient::CreateRunner(
     const std::string& extension_name,
     XWalkRemoteExtensionRunner::Client* client) {
-  if (!Send(new XWalkExtensionServerMsg_CreateInstance(next_instance_id_,
-    extension_name))) {
-    return 0;
-  }
-
-  XWalkRemoteExtensionRunner* runner = new XWalkRemoteExtensionRunner(client,
-      this, next_instance_id_);
+  // Only the first pending message schedules the flush.
+  if (!HasPendingMessages())
+    ScheduleFlushPendingMessages();
 
-  runners_[next_instance_id_] = runner;
-  next_instance_id_++;
+  const int64_t instance_id = next_instance_id_++;
+  pending_created_instance_ids_.push_back(instance_id);
+  pending_created_extension_names_.push_back(extension_name);
 
+  XWalkRemoteExtensionRunner* runner =
+      new XWalkRemoteExtensionRunner(client, this, instance_id);
+  runners_[instance_id] = runner;
   return runner;
 }
 
 bool XWalkExtensionClient::OnMessageReceived(const IPC::Message& message) {
+  // Messages written to the shared transport before |message| was sent must
+  // be handled first to preserve ordering.
+  ReceiveFromSharedTransport();
+  return OnMessageReceivedInternal(message);
+}
+
+bool XWalkExtensionClient::OnMessageReceivedInternal(
+    const IPC::Message& message) {
   bool handled = true;
   IPC_BEGIN_MESSAGE_MAP(XWalkExtensionClient, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SharedTransportCreated,
+        OnSharedTransportCreated)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SharedTransportDataAvailable,
+        OnSharedTransportDataAvailable)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SharedTransportPaused,
+        OnSharedTransportPaused)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionClientMsg_SharedTransportPauseAcknowledged,
+        OnSharedTransportPauseAcknowledged)
     IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostMessageToJS,
         OnPostMessageToJS)
-    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_RegisterExtension,
-        OnRegisterExtension)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostMessagesToJS,
+        OnPostMessagesToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_RegisterExtensions,
+        OnRegisterExtensions)
     IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_InstanceDestroyed,
         OnInstanceDestroyed)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_OpenStreamToJS,
+        OnOpenStreamToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_StreamDataToJS,
+        OnStreamDataToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_CloseStreamToJS,
+        OnCloseStreamToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_StreamDataHandled,
+        OnStreamDataHandled)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SharedBufferToJS,
+        OnSharedBufferToJS)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
 
   return handled;
 }
 
+void XWalkExtensionClient::ReceiveFromSharedTransport() {
+  if (!shared_transport_)
+    return;
+
+  std::string buffer;
+  while (shared_transport_->Receive(&buffer)) {
+    IPC::Message message(buffer.data(), static_cast<int>(buffer.size()));
+    OnMessageReceivedInternal(message);
+  }
+}
+
+void XWalkExtensionClient::OnSharedTransportPaused(uint32 sequence) {
+  // The messages the server sent before were already handled.
+  sender_->Send(
+      new XWalkExtensionServerMsg_SharedTransportPauseAcknowledged(sequence));
+}
+
+void XWalkExtensionClient::OnSharedTransportPauseAcknowledged(
+    uint32 sequence) {
+  if (!shared_transport_)
+    return;
+  uint32 next_sequence;
+  if (shared_transport_->OnPauseAcknowledged(sequence, &next_sequence)) {
+    sender_->Send(
+        new XWalkExtensionServerMsg_SharedTransportPaused(next_sequence));
+  }
+}
+
+void XWalkExtensionClient::OnSharedTransportCreated(
+    base::SharedMemoryHandle incoming, base::SharedMemoryHandle outgoing) {
+  shared_transport_ =
+      XWalkExtensionSharedTransport::CreateFromHandles(incoming, outgoing);
+  if (!shared_transport_) {
+    LOG(WARNING) << "Couldn't map shared transport for extensions, "
+                 << "falling back to IPC channel.";
+    return;
+  }
+
+  // Sent directly through the channel, the server won't read from the shared
+  // transport before knowing it was mapped.
+  sender_->Send(new XWalkExtensionServerMsg_SharedTransportMapped);
+}
+
+void XWalkExtensionClient::OnRegisterExtensions(
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& api_hashes,
+    const std::vector<uint32>& api_sizes,
+    base::SharedMemoryHandle api_blob_handle) {
+  // Takes ownership of the handle, so it is closed even if never mapped.
+  base::SharedMemory api_blob(api_blob_handle, true);
+
+  if (names.size() != api_hashes.size() || names.size() != api_sizes.size()) {
+    LOG(WARNING) << "Ignoring invalid registration of extensions.";
+    return;
+  }
+
+  size_t total_size = 0;
+  for (size_t i = 0; i < api_sizes.size(); ++i) {
+    if (api_sizes[i] > std::numeric_limits<size_t>::max() - total_size) {
+      LOG(WARNING) << "Ignoring invalid registration of extensions.";
+      return;
+    }
+    total_size += api_sizes[i];
+  }
+
+  APICodeMap& api_code_by_hash = g_api_code_by_hash.Get();
+  size_t offset = 0;
+  for (size_t i = 0; i < names.size(); ++i) {
+    const size_t size = api_sizes[i];
+    APICodeMap::iterator it = api_code_by_hash.find(api_hashes[i]);
+    if (it == api_code_by_hash.end()) {
+      if (size > 0 && !api_blob.memory() && !api_blob.Map(total_size)) {
+        LOG(WARNING) << "Couldn't map JS API code of extensions.";
+        return;
+      }
+
+      std::string api;
+      if (size > 0)
+        api.assign(static_cast<const char*>(api_blob.memory()) + offset, size);
+      if (base::SHA1HashString(api) != api_hashes[i]) {
+        LOG(WARNING) << "Ignoring extension " << names[i]
+                     << " with invalid JS API code hash.";
+        offset += size;
+        continue;
+      }
+      it = api_code_by_hash.insert(std::make_pair(api_hashes[i], api)).first;
+    }
+
+    extension_apis_[names[i]] = it->second;
+    offset += size;
+  }
+}
+
 void XWalkExtensionClient::OnPostMessageToJS(int64_t instance_id,
-    const base::ListValue& msg) {
+    const std::string& msg) {
   RunnerMap::const_iterator it = runners_.find(instance_id);
   if (it == runners_.end() || !it->second) {
     LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
@@ -68,9 +275,52 @@ void XWalkExtensionClient::OnPostMessageToJS(int64_t instance_id,
     return;
   }
 
-  const base::Value* value;
-  msg.Get(0, &value);
-  (it->second)->PostMessageToJS(*value);
+  (it->second)->PostMessageToJS(msg);
+}
+
+void XWalkExtensionClient::OnPostMessagesToJS(
+    const std::vector<int64_t>& instance_ids,
+    const std::vector<std::string>& msgs) {
+  if (instance_ids.size() != msgs.size()) {
+    LOG(WARNING) << "Ignoring batch of messages with " << msgs.size()
+                 << " messages for " << instance_ids.size() << " instances.";
+    return;
+  }
+
+  // The runners are looked up for each message since a listener can destroy
+  // instances while the batch is being dispatched. The server already sent
+  // the messages of high priority instances first.
+  for (size_t i = 0; i < instance_ids.size(); ++i) {
+    RunnerMap::const_iterator it = runners_.find(instance_ids[i]);
+    if (it == runners_.end() || !it->second) {
+      LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
+          << instance_ids[i];
+      continue;
+    }
+    (it->second)->PostMessageToJS(msgs[i]);
+  }
+}
+
+void XWalkExtensionClient::DeliverPendingMessagesToJS(int64_t instance_id) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->DeliverPendingMessagesToJS();
+}
+
+void XWalkExtensionClient::AcknowledgeMessage(int64_t instance_id) {
+  int& handled = handled_messages_[instance_id];
+  if (++handled < XWalkExtensionFlowControl::kMessagesPerAck)
+    return;
+  const int count = handled;
+  handled = 0;
+  Send(new XWalkExtensionServerMsg_MessagesHandled(instance_id, count));
+}
+
+void XWalkExtensionClient::SetHighPriority(int64_t instance_id,
+                                           bool high_priority) {
+  Send(new XWalkExtensionServerMsg_SetHighPriority(instance_id,
+                                                   high_priority));
 }
 
 void XWalkExtensionClient::DestroyInstance(int64_t instance_id) {
@@ -84,6 +334,8 @@ void XWalkExtensionClient::DestroyInstance(int64_t instance_id) {
 
   delete it->second;
   it->second = 0;
+  handled_messages_.erase(instance_id);
+  stream_flow_control_.RemoveInstance(instance_id);
 }
 
 void XWalkExtensionClient::OnInstanceDestroyed(int64_t instance_id) {
@@ -102,9 +354,11 @@ void XWalkExtensionClient::OnInstanceDestroyed(int64_t instance_id) {
 
   // Take it out from the valid runners map.
   runners_.erase(it);
+  handled_messages_.erase(instance_id);
+  stream_flow_control_.RemoveInstance(instance_id);
 }
 
-void XWalkExtensionClient::CreateRunnersForModuleSystem(XWalkModuleSystem*
+void XWalkExtensionClient::CreateModulesForModuleSystem(XWalkModuleSystem*
     module_system) {
   // FIXME(cmarcelo): Load extensions sorted by name so parent comes first, so
   // that we can safely register all them.
@@ -113,46 +367,117 @@ void XWalkExtensionClient::CreateRunnersForModuleSystem(XWalkModuleSystem*
     if (it->second.empty())
       continue;
     scoped_ptr<XWalkExtensionModule> module(
-        new XWalkExtensionModule(module_system, it->first, it->second));
-    XWalkRemoteExtensionRunner* runner = CreateRunner(it->first, module.get());
-    module->set_runner(runner);
+        new XWalkExtensionModule(module_system, this, it->first, it->second));
     module_system->RegisterExtensionModule(module.Pass());
   }
 }
 
-namespace {
-// Regular base::Value doesn't have param traits, so can't be passed as is
-// through IPC. We wrap it in a base::ListValue that have traits before
-// exchanging.
-//
-// Implementing param traits for base::Value is not a viable option at the
-// moment (would require fork base::Value and create a new empty type).
-scoped_ptr<base::ListValue> WrapValueInList(scoped_ptr<base::Value> value) {
-  if (!value)
-    return scoped_ptr<base::ListValue>();
-  scoped_ptr<base::ListValue> list_value(new base::ListValue);
-  list_value->Append(value.release());
-  return list_value.Pass();
+void XWalkExtensionClient::PostMessageToNative(int64_t instance_id,
+    std::string* msg) {
+  // Only the first pending message schedules the flush.
+  if (!HasPendingMessages())
+    ScheduleFlushPendingMessages();
+
+  pending_instance_ids_.push_back(instance_id);
+  pending_messages_.push_back(std::string());
+  pending_messages_.back().swap(*msg);
+
+  if (pending_instance_ids_.size() >= kMaxBatchedMessages)
+    FlushPendingMessages();
 }
 
-}  // namespace
+bool XWalkExtensionClient::SendSyncMessageToNative(int64_t instance_id,
+    const std::string& msg, std::string* reply) {
+  return Send(new XWalkExtensionServerMsg_SendSyncMessageToNative(
+      instance_id, msg, reply));
+}
 
-void XWalkExtensionClient::PostMessageToNative(int64_t instance_id,
-    scoped_ptr<base::Value> msg) {
-  scoped_ptr<base::ListValue> list_msg = WrapValueInList(msg.Pass());
-  Send(new XWalkExtensionServerMsg_PostMessageToNative(instance_id, *list_msg));
+int32_t XWalkExtensionClient::OpenStreamToNative(int64_t instance_id) {
+  const int32_t stream_id = next_stream_id_++;
+  if (!stream_flow_control_.OpenStream(instance_id, stream_id))
+    return 0;
+  Send(new XWalkExtensionServerMsg_OpenStreamToNative(instance_id, stream_id));
+  return stream_id;
 }
 
-scoped_ptr<base::Value> XWalkExtensionClient::SendSyncMessageToNative(
-    int64_t instance_id, scoped_ptr<base::Value> msg) {
-  scoped_ptr<base::ListValue> wrapped_msg = WrapValueInList(msg.Pass());
-  base::ListValue* wrapped_reply = new base::ListValue;
-  Send(new XWalkExtensionServerMsg_SendSyncMessageToNative(instance_id,
-      *wrapped_msg, wrapped_reply));
+bool XWalkExtensionClient::WriteStreamToNative(int64_t instance_id,
+    int32_t stream_id, std::string* data) {
+  if (!stream_flow_control_.WriteStream(instance_id, stream_id, data->size()))
+    return false;
+  IPC::Message* msg = new XWalkExtensionServerMsg_StreamDataToNative(
+      instance_id, stream_id, *data);
+  data->clear();
+  Send(msg);
+  return true;
+}
 
-  base::Value* reply;
-  wrapped_reply->Remove(0, &reply);
-  return scoped_ptr<base::Value>(reply);
+void XWalkExtensionClient::CloseStreamToNative(int64_t instance_id,
+                                               int32_t stream_id) {
+  if (!stream_flow_control_.RemoveStream(instance_id, stream_id)) {
+    LOG(WARNING) << "Ignoring close of stream " << stream_id
+                 << ", it is not open.";
+    return;
+  }
+  Send(new XWalkExtensionServerMsg_CloseStreamToNative(instance_id,
+                                                       stream_id));
+}
+
+void XWalkExtensionClient::ReleaseSharedBufferToNative(int64_t instance_id,
+                                                       int32_t buffer_id) {
+  Send(new XWalkExtensionServerMsg_SharedBufferReleased(instance_id,
+                                                        buffer_id));
+}
+
+void XWalkExtensionClient::OnOpenStreamToJS(int64_t instance_id,
+                                            int32 stream_id) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->StreamEventToJS(XWalkRemoteExtensionRunner::STREAM_OPENED,
+                                stream_id, std::string());
+}
+
+void XWalkExtensionClient::OnStreamDataToJS(int64_t instance_id,
+    int32 stream_id, const std::string& data) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->StreamEventToJS(XWalkRemoteExtensionRunner::STREAM_DATA,
+                                stream_id, data);
+
+  // The server sends more data once this one was handled.
+  Send(new XWalkExtensionServerMsg_StreamDataHandled(
+      instance_id, stream_id, static_cast<uint32>(data.size())));
+}
+
+void XWalkExtensionClient::OnCloseStreamToJS(int64_t instance_id,
+                                             int32 stream_id) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->StreamEventToJS(XWalkRemoteExtensionRunner::STREAM_CLOSED,
+                                stream_id, std::string());
+}
+
+void XWalkExtensionClient::OnStreamDataHandled(int64_t instance_id,
+    int32 stream_id, uint32 size) {
+  if (!stream_flow_control_.OnStreamDataHandled(instance_id, stream_id, size))
+    return;
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->StreamEventToJS(XWalkRemoteExtensionRunner::STREAM_WRITABLE,
+                                stream_id, std::string());
+}
+
+void XWalkExtensionClient::OnSharedBufferToJS(int64_t instance_id,
+    int32 buffer_id, base::SharedMemoryHandle handle, uint32 size) {
+  // Owning the handle closes it if the instance is already gone.
+  scoped_ptr<base::SharedMemory> memory(new base::SharedMemory(handle, false));
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->SharedBufferToJS(buffer_id, memory.Pass(), size);
 }
 
 }  // namespace extensions
@@ -8,15 +8,15 @@
 #include <stdint.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/shared_memory.h"
+#include "base/memory/weak_ptr.h"
 #include "ipc/ipc_listener.h"
+#include "xwalk/extensions/common/xwalk_extension_flow_control.h"
 #include "xwalk/extensions/renderer/xwalk_remote_extension_runner.h"
 
-namespace base {
-class ListValue;
-}
-
 namespace IPC {
 class Sender;
 }
@@ -24,6 +24,7 @@ class Sender;
 namespace xwalk {
 namespace extensions {
 
+class XWalkExtensionSharedTransport;
 class XWalkModuleSystem;
 
 // This class holds the JavaScript context of Extensions. It lives in the
@@ -37,31 +38,95 @@ class XWalkExtensionClient : public IPC::Listener {
   // IPC::Listener Implementation.
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
 
-  void CreateRunnersForModuleSystem(XWalkModuleSystem* module_system);
+  // Registers a module for each extension in |module_system|. The extension
+  // instances are only created once the modules need them, see
+  // CreateRunner().
+  void CreateModulesForModuleSystem(XWalkModuleSystem* module_system);
+
+  // Creates a runner for a new instance of the extension. The message asking
+  // the server to create the instance is batched with the other messages, so
+  // instances created during the same task share a single message.
+  XWalkRemoteExtensionRunner* CreateRunner(const std::string& extension_name,
+      XWalkRemoteExtensionRunner::Client* client);
 
   void DestroyInstance(int64_t instance_id);
 
-  void PostMessageToNative(int64_t instance_id, scoped_ptr<base::Value> msg);
-  scoped_ptr<base::Value> SendSyncMessageToNative(int64_t instance_id,
-      scoped_ptr<base::Value> msg);
+  // Messages are encoded with XWalkExtensionWireWriter. The contents of |msg|
+  // are taken when posting.
+  void PostMessageToNative(int64_t instance_id, std::string* msg);
+  bool SendSyncMessageToNative(int64_t instance_id, const std::string& msg,
+                               std::string* reply);
+
+  // Counts a message posted by the instance as handled, giving the credits
+  // back to the server once enough of them were handled. Called by the
+  // runners when delivering messages.
+  void AcknowledgeMessage(int64_t instance_id);
+
+  // Asks the server to send the messages of the instance ahead of the ones of
+  // other instances. See XWalkRemoteExtensionRunner::DeliveryPolicy.
+  void SetHighPriority(int64_t instance_id, bool high_priority);
+
+  // Delivers the messages the runner of the instance holds back, if it
+  // still exists. See XWalkRemoteExtensionRunner::DeliveryPolicy.
+  void DeliverPendingMessagesToJS(int64_t instance_id);
+
+  // Streams to the instance, with chunks encoded with
+  // XWalkExtensionWireWriter. Opening returns 0 if the instance is gone.
+  // Writing takes the contents of |data| and returns true, unless the stream
+  // has a full window of data in flight or is not open.
+  int32_t OpenStreamToNative(int64_t instance_id);
+  bool WriteStreamToNative(int64_t instance_id, int32_t stream_id,
+                           std::string* data);
+  void CloseStreamToNative(int64_t instance_id, int32_t stream_id);
+
+  void ReleaseSharedBufferToNative(int64_t instance_id, int32_t buffer_id);
 
   void Initialize(IPC::Sender* sender) { sender_ = sender; }
 
  private:
-  XWalkRemoteExtensionRunner* CreateRunner(const std::string& extension_name,
-      XWalkRemoteExtensionRunner::Client* client);
-
+  // Sends |msg| to the server. Messages batched by PostMessageToNative() are
+  // sent before it, so the order seen by the server is preserved.
   bool Send(IPC::Message* msg);
+  bool SendToServer(IPC::Message* msg);
+
+  // Sends the messages batched by CreateRunner() and PostMessageToNative(),
+  // if any. Instances are always created before sending the messages.
+  void FlushPendingMessages();
+  void ScheduleFlushPendingMessages();
+  bool HasPendingMessages() const;
+
+  bool OnMessageReceivedInternal(const IPC::Message& message);
+
+  // Handles the messages the server wrote to the shared transport. These
+  // must be handled before any message received from the IPC channel.
+  void ReceiveFromSharedTransport();
 
   // Message Handlers.
+  void OnSharedTransportCreated(base::SharedMemoryHandle incoming,
+                                base::SharedMemoryHandle outgoing);
+  void OnSharedTransportDataAvailable() {}
+  void OnSharedTransportPaused(uint32 sequence);
+  void OnSharedTransportPauseAcknowledged(uint32 sequence);
   void OnInstanceDestroyed(int64_t instance_id);
-  void OnPostMessageToJS(int64_t instance_id, const base::ListValue& msg);
-  void OnRegisterExtension(const std::string& name, const std::string& api) {
-    extension_apis_[name] = api;
-  }
+  void OnPostMessageToJS(int64_t instance_id, const std::string& msg);
+  void OnPostMessagesToJS(const std::vector<int64_t>& instance_ids,
+                          const std::vector<std::string>& msgs);
+  void OnOpenStreamToJS(int64_t instance_id, int32 stream_id);
+  void OnStreamDataToJS(int64_t instance_id, int32 stream_id,
+                        const std::string& data);
+  void OnCloseStreamToJS(int64_t instance_id, int32 stream_id);
+  void OnStreamDataHandled(int64_t instance_id, int32 stream_id, uint32 size);
+  void OnSharedBufferToJS(int64_t instance_id, int32 buffer_id,
+                          base::SharedMemoryHandle handle, uint32 size);
+  void OnRegisterExtensions(const std::vector<std::string>& names,
+                            const std::vector<std::string>& api_hashes,
+                            const std::vector<uint32>& api_sizes,
+                            base::SharedMemoryHandle api_blob_handle);
 
   IPC::Sender* sender_;
 
+  scoped_ptr<XWalkExtensionSharedTransport> shared_transport_;
+
   typedef std::map<std::string, std::string> ExtensionAPIMap;
   ExtensionAPIMap extension_apis_;
 
@@ -69,6 +134,22 @@ class XWalkExtensionClient : public IPC::Listener {
   RunnerMap runners_;
 
   int64_t next_instance_id_;
+
+  // Messages handled by each instance and not yet acknowledged.
+  std::map<int64_t, int> handled_messages_;
+
+  int32_t next_stream_id_;
+  // Only used for the windows of the streams opened by JavaScript.
+  XWalkExtensionFlowControl stream_flow_control_;
+
+  // Messages posted to the server are batched and sent at the end of the
+  // current task, or earlier if there are too many of them.
+  std::vector<int64_t> pending_created_instance_ids_;
+  std::vector<std::string> pending_created_extension_names_;
+  std::vector<int64_t> pending_instance_ids_;
+  std::vector<std::string> pending_messages_;
+
+  base::WeakPtrFactory<XWalkExtensionClient> weak_ptr_factory_;
 };
 
 }  // namespace extensions
@@ -7,11 +7,12 @@
 
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
-#include "base/values.h"
-#include "content/public/renderer/v8_value_converter.h"
 #include "third_party/WebKit/public/web/WebFrame.h"
 #include "third_party/WebKit/public/web/WebScopedMicrotaskSuppression.h"
+#include "xwalk/extensions/renderer/xwalk_extension_client.h"
+#include "xwalk/extensions/renderer/xwalk_extension_script_cache.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
+#include "xwalk/extensions/renderer/xwalk_v8_wire_format.h"
 
 namespace xwalk {
 namespace extensions {
@@ -22,16 +23,60 @@ namespace {
 // pointer back to XWalkExtensionModule.
 const char* kXWalkExtensionModule = "kXWalkExtensionModule";
 
+// Keys used in the data object passed to AnimationFrameCallback().
+const char* kXWalkExtensionClient = "kXWalkExtensionClient";
+const char* kInstanceId = "kInstanceId";
+
+bool ParseDeliveryPolicy(v8::Handle<v8::Value> value,
+                         XWalkRemoteExtensionRunner::DeliveryPolicy* policy) {
+  if (value->IsUndefined()) {
+    *policy = XWalkRemoteExtensionRunner::DELIVER_IMMEDIATELY;
+    return true;
+  }
+  if (!value->IsString())
+    return false;
+
+  const std::string name = *v8::String::Utf8Value(value);
+  if (name == "immediate")
+    *policy = XWalkRemoteExtensionRunner::DELIVER_IMMEDIATELY;
+  else if (name == "high-priority")
+    *policy = XWalkRemoteExtensionRunner::DELIVER_WITH_HIGH_PRIORITY;
+  else if (name == "animation-frame")
+    *policy = XWalkRemoteExtensionRunner::DELIVER_ON_ANIMATION_FRAME;
+  else if (name == "idle")
+    *policy = XWalkRemoteExtensionRunner::DELIVER_WHEN_IDLE;
+  else
+    return false;
+  return true;
+}
+
+const char* StreamEventName(XWalkRemoteExtensionRunner::StreamEvent event) {
+  switch (event) {
+    case XWalkRemoteExtensionRunner::STREAM_OPENED:
+      return "open";
+    case XWalkRemoteExtensionRunner::STREAM_DATA:
+      return "data";
+    case XWalkRemoteExtensionRunner::STREAM_CLOSED:
+      return "end";
+    case XWalkRemoteExtensionRunner::STREAM_WRITABLE:
+      return "drain";
+  }
+  NOTREACHED();
+  return "";
+}
+
 }  // namespace
 
 XWalkExtensionModule::XWalkExtensionModule(
     XWalkModuleSystem* module_system,
+    XWalkExtensionClient* extension_client,
     const std::string& extension_name,
     const std::string& extension_code)
     : extension_name_(extension_name),
       extension_code_(extension_code),
-      converter_(content::V8ValueConverter::create()),
-      module_system_(module_system) {
+      module_system_(module_system),
+      extension_client_(extension_client),
+      runner_(NULL) {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
   v8::Handle<v8::Object> function_data = v8::Object::New();
@@ -48,6 +93,25 @@ XWalkExtensionModule::XWalkExtensionModule(
   object_template->Set(
       "setMessageListener",
       v8::FunctionTemplate::New(SetMessageListenerCallback, function_data));
+  object_template->Set(
+      "openStream",
+      v8::FunctionTemplate::New(OpenStreamCallback, function_data));
+  object_template->Set(
+      "writeStream",
+      v8::FunctionTemplate::New(WriteStreamCallback, function_data));
+  object_template->Set(
+      "closeStream",
+      v8::FunctionTemplate::New(CloseStreamCallback, function_data));
+  object_template->Set(
+      "setStreamListener",
+      v8::FunctionTemplate::New(SetStreamListenerCallback, function_data));
+  object_template->Set(
+      "setSharedBufferListener",
+      v8::FunctionTemplate::New(SetSharedBufferListenerCallback,
+                                function_data));
+  object_template->Set(
+      "releaseSharedBuffer",
+      v8::FunctionTemplate::New(ReleaseSharedBufferCallback, function_data));
 
   function_data_.Reset(isolate, function_data);
   object_template_.Reset(isolate, object_template);
@@ -73,9 +137,41 @@ XWalkExtensionModule::~XWalkExtensionModule() {
   function_data_.Clear();
   message_listener_.Dispose(isolate);
   message_listener_.Clear();
+  stream_listener_.Dispose(isolate);
+  stream_listener_.Clear();
+  shared_buffer_listener_.Dispose(isolate);
+  shared_buffer_listener_.Clear();
+
+  // The ArrayBuffers may outlive us, so they are detached before the memory
+  // is unmapped. The instance is destroyed below, no need to release them.
+  while (!shared_buffers_.empty())
+    DropSharedBuffer(shared_buffers_.begin()->first);
+
+  // Nothing to destroy if the extension was never used by this context.
+  if (runner_)
+    runner_->Destroy();
+}
 
-  CHECK(runner_);
-  runner_->Destroy();
+XWalkRemoteExtensionRunner* XWalkExtensionModule::GetRunner() {
+  if (!runner_)
+    runner_ = extension_client_->CreateRunner(extension_name_, this);
+  return runner_;
+}
+
+bool XWalkExtensionModule::DropSharedBuffer(int32_t buffer_id) {
+  SharedBufferMap::iterator it = shared_buffers_.find(buffer_id);
+  if (it == shared_buffers_.end())
+    return false;
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  SharedBuffer* buffer = it->second;
+  v8::Handle<v8::ArrayBuffer>::New(isolate, buffer->array_buffer)->Neuter();
+  buffer->array_buffer.Dispose(isolate);
+  buffer->array_buffer.Clear();
+  delete buffer;
+  shared_buffers_.erase(it);
+  return true;
 }
 
 namespace {
@@ -106,6 +202,9 @@ std::string WrapAPICode(const std::string& extension_code,
       "extension._setupExtensionInternal = function() {"
       "  xwalk._setupExtensionInternal(extension);"
       "};"
+      "extension._setupExtensionStreams = function() {"
+      "  xwalk._setupExtensionStreams(extension);"
+      "};"
       "extension.internal = {};"
       "extension.internal.sendSyncMessage = extension.sendSyncMessage;"
       "delete extension.sendSyncMessage;"
@@ -115,17 +214,19 @@ std::string WrapAPICode(const std::string& extension_code,
       extension_name.c_str());
 }
 
-v8::Handle<v8::Value> RunString(const std::string& code,
-                                const std::string& name) {
+v8::Handle<v8::Value> RunString(v8::Handle<v8::String> code,
+                                const std::string& name,
+                                v8::ScriptData* preparse_data) {
   v8::HandleScope handle_scope;
-  v8::Handle<v8::String> v8_code(v8::String::New(code.c_str()));
   v8::Handle<v8::String> v8_name(v8::String::New(name.c_str()));
+  v8::ScriptOrigin origin(v8_name);
 
   WebKit::WebScopedMicrotaskSuppression suppression;
   v8::TryCatch try_catch;
   try_catch.SetVerbose(true);
 
-  v8::Handle<v8::Script> script(v8::Script::New(v8_code, v8_name));
+  v8::Handle<v8::Script> script(
+      v8::Script::New(code, &origin, preparse_data));
   if (try_catch.HasCaught())
     return v8::Undefined();
 
@@ -140,9 +241,21 @@ v8::Handle<v8::Value> RunString(const std::string& code,
 
 void XWalkExtensionModule::LoadExtensionCode(
     v8::Handle<v8::Context> context, v8::Handle<v8::Function> requireNative) {
-  std::string wrapped_api_code = WrapAPICode(extension_code_, extension_name_);
+  // The wrapped code only depends on the extension, so it is built once per
+  // render process and reused by the following contexts.
+  XWalkExtensionScriptCache* cache = XWalkExtensionScriptCache::GetInstance();
+  v8::Handle<v8::String> wrapped_api_code;
+  scoped_ptr<v8::ScriptData> preparse_data;
+  if (!cache->Lookup(extension_name_, extension_code_, &wrapped_api_code,
+                     &preparse_data)) {
+    wrapped_api_code = v8::String::New(
+        WrapAPICode(extension_code_, extension_name_).c_str());
+    cache->Insert(extension_name_, extension_code_, wrapped_api_code);
+  }
+
   v8::Handle<v8::Value> result =
-      RunString(wrapped_api_code, "JS API code for " + extension_name_);
+      RunString(wrapped_api_code, "JS API code for " + extension_name_,
+                preparse_data.get());
   if (!result->IsFunction()) {
     LOG(WARNING) << "Couldn't load JS API code for " << extension_name_;
     return;
@@ -169,7 +282,7 @@ void XWalkExtensionModule::LoadExtensionCode(
   }
 }
 
-void XWalkExtensionModule::HandleMessageFromNative(const base::Value& msg) {
+void XWalkExtensionModule::HandleMessageFromNative(const std::string& msg) {
   if (message_listener_.IsEmpty())
     return;
 
@@ -178,7 +291,11 @@ void XWalkExtensionModule::HandleMessageFromNative(const base::Value& msg) {
   v8::Handle<v8::Context> context = module_system_->GetV8Context();
   v8::Context::Scope context_scope(context);
 
-  v8::Handle<v8::Value> v8_value(converter_->ToV8Value(&msg, context));
+  v8::Handle<v8::Value> v8_value(WireFormatToV8Value(msg));
+  if (v8_value.IsEmpty()) {
+    LOG(WARNING) << "Ignoring malformed message from native.";
+    return;
+  }
   v8::Handle<v8::Function> message_listener =
       v8::Handle<v8::Function>::New(isolate, message_listener_);;
 
@@ -189,6 +306,121 @@ void XWalkExtensionModule::HandleMessageFromNative(const base::Value& msg) {
     LOG(WARNING) << "Exception when running message listener";
 }
 
+void XWalkExtensionModule::HandleStreamEventFromNative(
+    XWalkRemoteExtensionRunner::StreamEvent event, int32_t stream_id,
+    const std::string& data) {
+  if (stream_listener_.IsEmpty())
+    return;
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  v8::Handle<v8::Value> chunk = v8::Undefined();
+  if (event == XWalkRemoteExtensionRunner::STREAM_DATA) {
+    chunk = WireFormatToV8Value(data);
+    if (chunk.IsEmpty()) {
+      LOG(WARNING) << "Ignoring malformed stream data from native.";
+      return;
+    }
+  }
+
+  const int argc = 3;
+  v8::Handle<v8::Value> argv[argc] = {
+    v8::String::New(StreamEventName(event)),
+    v8::Integer::New(stream_id),
+    chunk
+  };
+  v8::Handle<v8::Function> stream_listener =
+      v8::Handle<v8::Function>::New(isolate, stream_listener_);
+
+  WebKit::WebScopedMicrotaskSuppression suppression;
+  v8::TryCatch try_catch;
+  stream_listener->Call(context->Global(), argc, argv);
+  if (try_catch.HasCaught())
+    LOG(WARNING) << "Exception when running stream listener";
+}
+
+void XWalkExtensionModule::HandleSharedBufferFromNative(
+    int32_t buffer_id, scoped_ptr<base::SharedMemory> memory, size_t size) {
+  // Each buffer posted gets released once, so the instance doesn't wait for
+  // a duplicate forever.
+  if (shared_buffers_.count(buffer_id)) {
+    LOG(WARNING) << "Releasing shared buffer " << buffer_id
+                 << " while the JS code still holds one with the same id.";
+    runner_->ReleaseSharedBufferToNative(buffer_id);
+    return;
+  }
+  if (shared_buffer_listener_.IsEmpty()) {
+    runner_->ReleaseSharedBufferToNative(buffer_id);
+    return;
+  }
+  if (!memory->Map(size)) {
+    LOG(WARNING) << "Couldn't map shared buffer " << buffer_id << ".";
+    runner_->ReleaseSharedBufferToNative(buffer_id);
+    return;
+  }
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  // The ArrayBuffer doesn't own the memory, it stays mapped until the buffer
+  // is released. Blink doesn't know about it either, see the class comment.
+  v8::Handle<v8::ArrayBuffer> array_buffer =
+      v8::ArrayBuffer::New(memory->memory(), size);
+  SharedBuffer* buffer = new SharedBuffer;
+  buffer->memory = memory.Pass();
+  buffer->array_buffer.Reset(isolate, array_buffer);
+  shared_buffers_[buffer_id] = buffer;
+
+  const int argc = 2;
+  v8::Handle<v8::Value> argv[argc] = {
+    v8::Integer::New(buffer_id),
+    array_buffer
+  };
+  v8::Handle<v8::Function> shared_buffer_listener =
+      v8::Handle<v8::Function>::New(isolate, shared_buffer_listener_);
+
+  WebKit::WebScopedMicrotaskSuppression suppression;
+  v8::TryCatch try_catch;
+  shared_buffer_listener->Call(context->Global(), argc, argv);
+  if (try_catch.HasCaught())
+    LOG(WARNING) << "Exception when running shared buffer listener";
+}
+
+bool XWalkExtensionModule::RequestAnimationFrame() {
+  if (!runner_)
+    return false;
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  v8::Handle<v8::Value> request_animation_frame =
+      context->Global()->Get(v8::String::New("requestAnimationFrame"));
+  if (request_animation_frame.IsEmpty() ||
+      !request_animation_frame->IsFunction())
+    return false;
+
+  v8::Handle<v8::Object> data = v8::Object::New();
+  data->Set(v8::String::New(kXWalkExtensionClient),
+            v8::External::New(extension_client_));
+  data->Set(v8::String::New(kInstanceId),
+            v8::Number::New(static_cast<double>(runner_->instance_id_)));
+  v8::Handle<v8::Value> callback =
+      v8::FunctionTemplate::New(AnimationFrameCallback, data)->GetFunction();
+
+  WebKit::WebScopedMicrotaskSuppression suppression;
+  v8::TryCatch try_catch;
+  request_animation_frame.As<v8::Function>()->Call(context->Global(), 1,
+                                                   &callback);
+  return !try_catch.HasCaught();
+}
+
 // static
 void XWalkExtensionModule::PostMessageCallback(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
@@ -199,12 +431,9 @@ void XWalkExtensionModule::PostMessageCallback(
     return;
   }
 
-  v8::Handle<v8::Context> context = info.GetIsolate()->GetCurrentContext();
-  scoped_ptr<base::Value> value(
-      module->converter_->FromV8Value(info[0], context));
-
-  CHECK(module->runner_);
-  module->runner_->PostMessageToNative(value.Pass());
+  std::string msg;
+  V8ValueToWireFormat(info[0], &msg);
+  module->GetRunner()->PostMessageToNative(&msg);
   result.Set(true);
 }
 
@@ -218,14 +447,19 @@ void XWalkExtensionModule::SendSyncMessageCallback(
     return;
   }
 
-  v8::Handle<v8::Context> context = info.GetIsolate()->GetCurrentContext();
-  scoped_ptr<base::Value> value(
-      module->converter_->FromV8Value(info[0], context));
+  std::string msg;
+  V8ValueToWireFormat(info[0], &msg);
+  std::string reply;
+  if (!module->GetRunner()->SendSyncMessageToNative(msg, &reply)) {
+    result.SetUndefined();
+    return;
+  }
 
-  CHECK(module->runner_);
-  scoped_ptr<base::Value> reply(
-      module->runner_->SendSyncMessageToNative(value.Pass()));
-  result.Set(module->converter_->ToV8Value(reply.get(), context));
+  v8::Handle<v8::Value> v8_reply(WireFormatToV8Value(reply));
+  if (v8_reply.IsEmpty())
+    result.SetUndefined();
+  else
+    result.Set(v8_reply);
 }
 
 // static
@@ -233,7 +467,7 @@ void XWalkExtensionModule::SetMessageListenerCallback(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
   v8::ReturnValue<v8::Value> result(info.GetReturnValue());
   XWalkExtensionModule* module = GetExtensionModule(info);
-  if (!module || info.Length() != 1) {
+  if (!module || info.Length() < 1 || info.Length() > 2) {
     result.Set(false);
     return;
   }
@@ -244,18 +478,167 @@ void XWalkExtensionModule::SetMessageListenerCallback(
     return;
   }
 
+  XWalkRemoteExtensionRunner::DeliveryPolicy policy;
+  if (!ParseDeliveryPolicy(info[1], &policy)) {
+    LOG(WARNING) << "Trying to set message listener with invalid delivery "
+                 << "policy.";
+    result.Set(false);
+    return;
+  }
+
   v8::Isolate* isolate = info.GetIsolate();
   if (info[0]->IsUndefined()) {
     module->message_listener_.Dispose(isolate);
     module->message_listener_.Clear();
   } else {
+    // The instance must exist to receive messages from native.
+    module->GetRunner();
     module->message_listener_.Dispose(isolate);
     module->message_listener_.Reset(isolate, info[0].As<v8::Function>());
   }
 
+  if (module->runner_)
+    module->runner_->SetDeliveryPolicy(policy);
+
   result.Set(true);
 }
 
+// static
+void XWalkExtensionModule::OpenStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 0) {
+    result.Set(false);
+    return;
+  }
+
+  result.Set(v8::Integer::New(module->GetRunner()->OpenStreamToNative()));
+}
+
+// static
+void XWalkExtensionModule::WriteStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 2 || !info[0]->IsInt32() ||
+      !module->runner_) {
+    result.Set(false);
+    return;
+  }
+
+  std::string chunk;
+  V8ValueToWireFormat(info[1], &chunk);
+  result.Set(module->runner_->WriteStreamToNative(info[0]->Int32Value(),
+                                                  &chunk));
+}
+
+// static
+void XWalkExtensionModule::CloseStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1 || !info[0]->IsInt32() ||
+      !module->runner_) {
+    result.Set(false);
+    return;
+  }
+
+  module->runner_->CloseStreamToNative(info[0]->Int32Value());
+  result.Set(true);
+}
+
+// static
+void XWalkExtensionModule::SetStreamListenerCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1) {
+    result.Set(false);
+    return;
+  }
+
+  if (!info[0]->IsFunction() && !info[0]->IsUndefined()) {
+    LOG(WARNING) << "Trying to set stream listener with invalid value.";
+    result.Set(false);
+    return;
+  }
+
+  // Unlike the message listener, this doesn't create the instance: it has no
+  // streams to JavaScript before being used.
+  v8::Isolate* isolate = info.GetIsolate();
+  module->stream_listener_.Dispose(isolate);
+  module->stream_listener_.Clear();
+  if (info[0]->IsFunction())
+    module->stream_listener_.Reset(isolate, info[0].As<v8::Function>());
+  result.Set(true);
+}
+
+// static
+void XWalkExtensionModule::SetSharedBufferListenerCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1) {
+    result.Set(false);
+    return;
+  }
+
+  if (!info[0]->IsFunction() && !info[0]->IsUndefined()) {
+    LOG(WARNING) << "Trying to set shared buffer listener with invalid value.";
+    result.Set(false);
+    return;
+  }
+
+  // Native can only share buffers with an instance that exists.
+  v8::Isolate* isolate = info.GetIsolate();
+  module->shared_buffer_listener_.Dispose(isolate);
+  module->shared_buffer_listener_.Clear();
+  if (info[0]->IsFunction()) {
+    module->GetRunner();
+    module->shared_buffer_listener_.Reset(isolate,
+                                          info[0].As<v8::Function>());
+  }
+  result.Set(true);
+}
+
+// static
+void XWalkExtensionModule::ReleaseSharedBufferCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1 || !info[0]->IsInt32()) {
+    result.Set(false);
+    return;
+  }
+
+  const int32_t buffer_id = info[0]->Int32Value();
+  if (!module->DropSharedBuffer(buffer_id)) {
+    result.Set(false);
+    return;
+  }
+  module->runner_->ReleaseSharedBufferToNative(buffer_id);
+  result.Set(true);
+}
+
+// static
+void XWalkExtensionModule::AnimationFrameCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::HandleScope handle_scope(info.GetIsolate());
+  v8::Local<v8::Object> data = info.Data().As<v8::Object>();
+  v8::Local<v8::Value> client =
+      data->Get(v8::String::New(kXWalkExtensionClient));
+  v8::Local<v8::Value> instance_id = data->Get(v8::String::New(kInstanceId));
+  if (client.IsEmpty() || !client->IsExternal() || instance_id.IsEmpty() ||
+      !instance_id->IsNumber())
+    return;
+
+  // The client outlives the modules, and ignores instances already gone.
+  static_cast<XWalkExtensionClient*>(client.As<v8::External>()->Value())
+      ->DeliverPendingMessagesToJS(
+          static_cast<int64_t>(instance_id->NumberValue()));
+}
+
 // static
 XWalkExtensionModule* XWalkExtensionModule::GetExtensionModule(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
@@ -5,6 +5,7 @@
 #ifndef XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_MODULE_H_
 #define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_MODULE_H_
 
+#include <map>
 #include <string>
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
 #include "xwalk/extensions/renderer/xwalk_remote_extension_runner.h"
@@ -13,13 +14,10 @@ namespace WebKit {
 class WebFrame;
 }
 
-namespace content {
-class V8ValueConverter;
-}
-
 namespace xwalk {
 namespace extensions {
 
+class XWalkExtensionClient;
 class XWalkModuleSystem;
 
 // Responsible for running the JS code of a XWalkExtension. This includes
@@ -27,10 +25,35 @@ class XWalkModuleSystem;
 // the extension JS code.
 //
 // We'll create one XWalkExtensionModule per extension/frame pair, so
-// there'll be a set of different modules per v8::Context.
+// there'll be a set of different modules per v8::Context. The extension
+// instance for the module is only created when its JS code first posts a
+// message or sets a message listener.
+//
+// 'extension.setMessageListener()' takes an optional delivery policy after
+// the listener: "immediate" (the default), "high-priority", "animation-frame"
+// or "idle". See XWalkRemoteExtensionRunner::DeliveryPolicy.
+//
+// Large payloads can go through streams instead: 'extension.openStream()'
+// returns the id of a new stream to native, 'extension.writeStream(id, chunk)'
+// returns false without writing while the stream has a full window of data in
+// flight, and 'extension.closeStream(id)' ends it. The listener set with
+// 'extension.setStreamListener()' is called with the event, the stream id and
+// the chunk for the streams from native: "open", "data" and "end", and also
+// with "drain" when a stream to native can be written to again.
+//
+// Buffers shared by native arrive to the listener set with
+// 'extension.setSharedBufferListener()' as its id and an ArrayBuffer backed by
+// the shared memory itself. Once done with it, the JS code gives it back with
+// 'extension.releaseSharedBuffer(id)', which also detaches the ArrayBuffer, so
+// native can fill it again.
+//
+// Blink didn't create these ArrayBuffers and can't take them over, so they
+// must not be given to DOM APIs (Blob, XMLHttpRequest.send(), postMessage()
+// transfers...). The JS code copies what it passes to them with slice().
 class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
  public:
   XWalkExtensionModule(XWalkModuleSystem* module_system,
+                       XWalkExtensionClient* extension_client,
                        const std::string& extension_name,
                        const std::string& extension_code);
   virtual ~XWalkExtensionModule();
@@ -41,13 +64,17 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
                          v8::Handle<v8::Function> requireNative);
 
   std::string extension_name() const { return extension_name_; }
-  void set_runner(XWalkRemoteExtensionRunner* runner) {
-    runner_ = runner;
-  }
 
  private:
   // XWalkRemoteExtensionRunner::Client implementation.
-  virtual void HandleMessageFromNative(const base::Value& msg) OVERRIDE;
+  virtual void HandleMessageFromNative(const std::string& msg) OVERRIDE;
+  virtual bool RequestAnimationFrame() OVERRIDE;
+  virtual void HandleStreamEventFromNative(
+      XWalkRemoteExtensionRunner::StreamEvent event, int32_t stream_id,
+      const std::string& data) OVERRIDE;
+  virtual void HandleSharedBufferFromNative(
+      int32_t buffer_id, scoped_ptr<base::SharedMemory> memory,
+      size_t size) OVERRIDE;
 
   // Callbacks for JS functions available in 'extension' object.
   static void PostMessageCallback(
@@ -56,10 +83,40 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
       const v8::FunctionCallbackInfo<v8::Value>& info);
   static void SetMessageListenerCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void OpenStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void WriteStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void CloseStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void SetStreamListenerCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void SetSharedBufferListenerCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void ReleaseSharedBufferCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+
+  // Passed to 'window.requestAnimationFrame()'. It doesn't point back to the
+  // module, which may be gone by the time the frame comes.
+  static void AnimationFrameCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
 
   static XWalkExtensionModule* GetExtensionModule(
       const v8::FunctionCallbackInfo<v8::Value>& info);
 
+  // Returns the runner for the extension instance, creating it if needed.
+  XWalkRemoteExtensionRunner* GetRunner();
+
+  // Detaches the ArrayBuffer from the memory and unmaps it. Returns false if
+  // there's no such buffer.
+  bool DropSharedBuffer(int32_t buffer_id);
+
+  struct SharedBuffer {
+    scoped_ptr<base::SharedMemory> memory;
+    v8::Persistent<v8::ArrayBuffer> array_buffer;
+  };
+  typedef std::map<int32_t, SharedBuffer*> SharedBufferMap;
+
   // Template for the 'extension' object exposed to the extension JS code.
   v8::Persistent<v8::ObjectTemplate> object_template_;
 
@@ -71,14 +128,20 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
   // This value is registered by using 'extension.setMessageListener()'.
   v8::Persistent<v8::Function> message_listener_;
 
+  // Registered by using 'extension.setStreamListener()'.
+  v8::Persistent<v8::Function> stream_listener_;
+
+  // Registered by using 'extension.setSharedBufferListener()'.
+  v8::Persistent<v8::Function> shared_buffer_listener_;
+
+  // Buffers held by the JS code, until it releases them.
+  SharedBufferMap shared_buffers_;
+
   std::string extension_name_;
   std::string extension_code_;
 
-  // TODO(cmarcelo): Move to a single converter, since we always use same
-  // parameters.
-  scoped_ptr<content::V8ValueConverter> converter_;
-
   XWalkModuleSystem* module_system_;
+  XWalkExtensionClient* extension_client_;
   XWalkRemoteExtensionRunner* runner_;
 };
 
@@ -56,11 +56,13 @@ void XWalkExtensionRendererController::DidCreateScriptContext(
   module_system->RegisterNativeModule(
       "v8tools", scoped_ptr<XWalkNativeModule>(new XWalkV8ToolsModule));
 
-  in_browser_process_extensions_client_->CreateRunnersForModuleSystem(
+  in_browser_process_extensions_client_->CreateModulesForModuleSystem(
       module_system);
 
-  if (external_extensions_client_)
-    external_extensions_client_->CreateRunnersForModuleSystem(module_system);
+  for (size_t i = 0; i < external_extensions_clients_.size(); ++i) {
+    external_extensions_clients_[i]->CreateModulesForModuleSystem(
+        module_system);
+  }
 }
 
 void XWalkExtensionRendererController::WillReleaseScriptContext(
@@ -84,14 +86,16 @@ bool XWalkExtensionRendererController::OnControlMessageReceived(
 
 void XWalkExtensionRendererController::OnExtensionProcessChannelCreated(
     const IPC::ChannelHandle& handle) {
-  external_extensions_client_.reset(new XWalkExtensionClient());
+  XWalkExtensionClient* client = new XWalkExtensionClient();
+  external_extensions_clients_.push_back(client);
 
-  extension_process_channel_.reset(new IPC::SyncChannel(handle,
-      IPC::Channel::MODE_CLIENT, external_extensions_client_.get(),
+  IPC::SyncChannel* channel = new IPC::SyncChannel(handle,
+      IPC::Channel::MODE_CLIENT, client,
       content::RenderThread::Get()->GetIOMessageLoopProxy(), true,
-      &shutdown_event_));
+      &shutdown_event_);
+  extension_process_channels_.push_back(channel);
 
-  external_extensions_client_->Initialize(extension_process_channel_.get());
+  client->Initialize(channel);
 }
 
 void XWalkExtensionRendererController::OnRenderProcessShutdown() {
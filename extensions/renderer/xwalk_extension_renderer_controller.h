@@ -10,6 +10,7 @@
 #include <vector>
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/synchronization/waitable_event.h"
 #include "content/public/renderer/render_process_observer.h"
 #include "v8/include/v8.h"
@@ -56,10 +57,14 @@ class XWalkExtensionRendererController : public content::RenderProcessObserver {
   void OnExtensionProcessChannelCreated(const IPC::ChannelHandle& handle);
 
   scoped_ptr<XWalkExtensionClient> in_browser_process_extensions_client_;
-  scoped_ptr<XWalkExtensionClient> external_extensions_client_;
+
+  // External extensions can be spread in many extension processes, there's
+  // one client and one channel for each of them. Channels are declared last
+  // so they are destroyed before their clients.
+  ScopedVector<XWalkExtensionClient> external_extensions_clients_;
 
   base::WaitableEvent shutdown_event_;
-  scoped_ptr<IPC::SyncChannel> extension_process_channel_;
+  ScopedVector<IPC::SyncChannel> extension_process_channels_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionRendererController);
 };
@@ -0,0 +1,87 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/renderer/xwalk_extension_script_cache.h"
+
+#include "base/logging.h"
+#include "base/memory/singleton.h"
+#include "base/stl_util.h"
+
+namespace xwalk {
+namespace extensions {
+
+XWalkExtensionScriptCache::XWalkExtensionScriptCache()
+    : hits_(0),
+      misses_(0) {}
+
+XWalkExtensionScriptCache::~XWalkExtensionScriptCache() {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    it->second->wrapped_code.Dispose(isolate);
+  STLDeleteValues(&entries_);
+}
+
+// static
+XWalkExtensionScriptCache* XWalkExtensionScriptCache::GetInstance() {
+  // V8 may be gone when the process exits, so don't try to dispose the
+  // persistent handles at that point.
+  return Singleton<XWalkExtensionScriptCache,
+                   LeakySingletonTraits<XWalkExtensionScriptCache> >::get();
+}
+
+bool XWalkExtensionScriptCache::Lookup(
+    const std::string& extension_name,
+    const std::string& extension_code,
+    v8::Handle<v8::String>* wrapped_code,
+    scoped_ptr<v8::ScriptData>* preparse_data) {
+  EntryMap::const_iterator it = entries_.find(extension_name);
+  if (it == entries_.end() ||
+      it->second->extension_code != extension_code) {
+    misses_++;
+    return false;
+  }
+
+  hits_++;
+  const Entry* entry = it->second;
+  *wrapped_code = v8::Handle<v8::String>::New(v8::Isolate::GetCurrent(),
+                                              entry->wrapped_code);
+
+  // V8 consumes the preparse data while compiling, so each compilation gets
+  // its own copy.
+  if (!entry->preparse_data.empty()) {
+    preparse_data->reset(v8::ScriptData::New(
+        entry->preparse_data.data(),
+        static_cast<int>(entry->preparse_data.size())));
+  }
+  return true;
+}
+
+void XWalkExtensionScriptCache::Insert(const std::string& extension_name,
+                                       const std::string& extension_code,
+                                       v8::Handle<v8::String> wrapped_code) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+
+  EntryMap::iterator it = entries_.find(extension_name);
+  if (it != entries_.end()) {
+    it->second->wrapped_code.Dispose(isolate);
+    delete it->second;
+    entries_.erase(it);
+  }
+
+  Entry* entry = new Entry;
+  entry->extension_code = extension_code;
+  entry->wrapped_code.Reset(isolate, wrapped_code);
+
+  scoped_ptr<v8::ScriptData> preparse_data(
+      v8::ScriptData::PreCompile(wrapped_code));
+  if (preparse_data && !preparse_data->HasError()) {
+    entry->preparse_data.assign(preparse_data->Data(),
+                                preparse_data->Length());
+  }
+
+  entries_[extension_name] = entry;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,71 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_SCRIPT_CACHE_H_
+#define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_SCRIPT_CACHE_H_
+
+#include <map>
+#include <string>
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "v8/include/v8.h"
+
+template <typename T> struct DefaultSingletonTraits;
+
+namespace xwalk {
+namespace extensions {
+
+// Keeps the wrapped JS API code of the extensions, so every new script
+// context doesn't need to build it again, together with the V8 preparse data
+// for it, used to speed up the compilation. There's one cache per render
+// process, shared by all the contexts.
+//
+// Entries are keyed by extension name, and are only reused when the original
+// API code is the same.
+class XWalkExtensionScriptCache {
+ public:
+  static XWalkExtensionScriptCache* GetInstance();
+
+  // Returns true if there's an entry for |extension_name| built from
+  // |extension_code|. In that case sets |wrapped_code| and |preparse_data|,
+  // the latter can be NULL if V8 couldn't preparse the code.
+  bool Lookup(const std::string& extension_name,
+              const std::string& extension_code,
+              v8::Handle<v8::String>* wrapped_code,
+              scoped_ptr<v8::ScriptData>* preparse_data);
+
+  // Adds |wrapped_code| to the cache, replacing any previous entry for
+  // |extension_name|.
+  void Insert(const std::string& extension_name,
+              const std::string& extension_code,
+              v8::Handle<v8::String> wrapped_code);
+
+  int GetHitsForTesting() const { return hits_; }
+  int GetMissesForTesting() const { return misses_; }
+
+ private:
+  friend struct DefaultSingletonTraits<XWalkExtensionScriptCache>;
+
+  struct Entry {
+    std::string extension_code;
+    v8::Persistent<v8::String> wrapped_code;
+    std::string preparse_data;
+  };
+
+  XWalkExtensionScriptCache();
+  ~XWalkExtensionScriptCache();
+
+  typedef std::map<std::string, Entry*> EntryMap;
+  EntryMap entries_;
+
+  int hits_;
+  int misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionScriptCache);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_SCRIPT_CACHE_H_
@@ -56,6 +56,13 @@ void RequireNativeCallback(const v8::FunctionCallbackInfo<v8::Value>& info) {
   result.Set(object);
 }
 
+std::string GetLastComponent(const std::string& name) {
+  size_t pos = name.rfind('.');
+  if (pos == std::string::npos)
+    return name;
+  return name.substr(pos + 1);
+}
+
 }  // namespace
 
 XWalkModuleSystem::XWalkModuleSystem(v8::Handle<v8::Context> context) {
@@ -123,17 +130,131 @@ void XWalkModuleSystem::ResetModuleSystemFromContext(
 
 void XWalkModuleSystem::RegisterExtensionModule(
     scoped_ptr<XWalkExtensionModule> module) {
-  const std::string& extension_name = module->extension_name();
-  CHECK(extension_modules_.find(extension_name) == extension_modules_.end());
-  // TODO(cmarcelo): Setup lazy loader instead of immediatly running
-  // JS API code.
+  const std::string extension_name = module->extension_name();
+  // Extensions are only known by name once their libraries are loaded, so
+  // two extension processes may provide the same one. The first registered
+  // is kept, as a single extension process would do.
+  if (extension_modules_.find(extension_name) != extension_modules_.end()) {
+    LOG(WARNING) << "Ignoring extension with name already registered: "
+                 << extension_name;
+    return;
+  }
+  extension_modules_[extension_name] = module.release();
+  EnsureLazyNamespace(extension_name);
+}
+
+void XWalkModuleSystem::EnsureLazyNamespace(const std::string& name) {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
-  v8::Handle<v8::FunctionTemplate> require_native_template =
-      v8::Handle<v8::FunctionTemplate>::New(isolate, require_native_template_);
-  module->LoadExtensionCode(GetV8Context(),
-                            require_native_template->GetFunction());
-  extension_modules_[extension_name] = module.release();
+  v8::Handle<v8::Context> context = GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  v8::Handle<v8::Object> holder = context->Global();
+  size_t pos = 0;
+  while (true) {
+    size_t end = name.find('.', pos);
+    const std::string current = name.substr(0, end);
+
+    // The lazy namespace will take care of the nested ones once accessed.
+    if (lazy_namespaces_.find(current) != lazy_namespaces_.end())
+      return;
+
+    v8::Handle<v8::String> property =
+        v8::String::New(name.substr(pos, end - pos).c_str());
+
+    // The extension namespace is always replaced, like it happens when its
+    // code runs. Parent namespaces are only created when missing.
+    v8::Handle<v8::Value> value;
+    if (end != std::string::npos)
+      value = holder->Get(property);
+    if (value.IsEmpty() || !value->IsObject()) {
+      holder->ForceDelete(property);
+      holder->SetAccessor(property, LazyNamespaceGetter, LazyNamespaceSetter,
+                          v8::String::New(current.c_str()));
+      lazy_namespaces_.insert(current);
+      return;
+    }
+
+    holder = value.As<v8::Object>();
+    pos = end + 1;
+  }
+}
+
+v8::Handle<v8::Value> XWalkModuleSystem::LoadLazyNamespace(
+    const std::string& name, v8::Handle<v8::Object> holder) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  // Remove the accessor before running any code, so the extension code can
+  // set the namespace as a regular property.
+  lazy_namespaces_.erase(name);
+  v8::Handle<v8::String> property =
+      v8::String::New(GetLastComponent(name).c_str());
+  holder->ForceDelete(property);
+
+  ExtensionModuleMap::iterator it = extension_modules_.find(name);
+  if (it != extension_modules_.end()) {
+    v8::Handle<v8::FunctionTemplate> require_native_template =
+        v8::Handle<v8::FunctionTemplate>::New(isolate,
+                                              require_native_template_);
+    it->second->LoadExtensionCode(context,
+                                  require_native_template->GetFunction());
+  }
+
+  // Nested extensions are sorted right after their parent namespace in the
+  // map, set up their lazy namespaces now that the parent is available.
+  const std::string prefix = name + ".";
+  for (it = extension_modules_.lower_bound(prefix);
+       it != extension_modules_.end(); ++it) {
+    if (it->first.compare(0, prefix.size(), prefix) != 0)
+      break;
+    if (!holder->Get(property)->IsObject())
+      holder->Set(property, v8::Object::New());
+    EnsureLazyNamespace(it->first);
+  }
+
+  return handle_scope.Close(holder->Get(property));
+}
+
+void XWalkModuleSystem::DiscardLazyNamespace(const std::string& name) {
+  lazy_namespaces_.erase(name);
+}
+
+// static
+void XWalkModuleSystem::LazyNamespaceGetter(
+    v8::Local<v8::String> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info) {
+  v8::HandleScope handle_scope(info.GetIsolate());
+  v8::Handle<v8::Object> holder = info.Holder();
+  XWalkModuleSystem* module_system =
+      GetModuleSystemFromContext(holder->CreationContext());
+  if (!module_system) {
+    LOG(WARNING) << "Trying to load extension from already destroyed "
+                 << "module system!";
+    return;
+  }
+
+  const std::string name = *v8::String::Utf8Value(info.Data());
+  info.GetReturnValue().Set(module_system->LoadLazyNamespace(name, holder));
+}
+
+// static
+void XWalkModuleSystem::LazyNamespaceSetter(
+    v8::Local<v8::String> property, v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<void>& info) {
+  v8::HandleScope handle_scope(info.GetIsolate());
+  v8::Handle<v8::Object> holder = info.Holder();
+  XWalkModuleSystem* module_system =
+      GetModuleSystemFromContext(holder->CreationContext());
+  if (module_system)
+    module_system->DiscardLazyNamespace(*v8::String::Utf8Value(info.Data()));
+
+  // Overwriting the namespace before accessing it means the extension code
+  // is never needed.
+  holder->ForceDelete(property);
+  holder->Set(property, value);
 }
 
 XWalkExtensionModule* XWalkModuleSystem::GetExtensionModule(
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include "base/memory/scoped_ptr.h"
 #include "v8/include/v8.h"
 
@@ -44,6 +45,11 @@ class XWalkModuleSystem {
       v8::Handle<v8::Context> context);
   static void ResetModuleSystemFromContext(v8::Handle<v8::Context> context);
 
+  // Registers the module and sets up a lazy loader for its namespace, its JS
+  // API code only runs the first time the namespace is accessed. Parent
+  // namespaces are also lazily created, loading the parent extension code
+  // first if there's one. Modules with an already registered name are
+  // dropped.
   void RegisterExtensionModule(scoped_ptr<XWalkExtensionModule> module);
   XWalkExtensionModule* GetExtensionModule(const std::string& extension_name);
 
@@ -54,9 +60,36 @@ class XWalkModuleSystem {
   v8::Handle<v8::Context> GetV8Context();
 
  private:
+  // Callbacks of the accessors installed for lazy namespaces.
+  static void LazyNamespaceGetter(
+      v8::Local<v8::String> property,
+      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void LazyNamespaceSetter(
+      v8::Local<v8::String> property, v8::Local<v8::Value> value,
+      const v8::PropertyCallbackInfo<void>& info);
+
+  // Makes sure |name| will be available in the global object, either because
+  // it is already there or because there's a lazy namespace that will create
+  // it once accessed.
+  void EnsureLazyNamespace(const std::string& name);
+
+  // Replaces the lazy namespace |name| in |holder| by its real value, running
+  // the extension code if needed and setting up the lazy namespaces nested
+  // inside it.
+  v8::Handle<v8::Value> LoadLazyNamespace(const std::string& name,
+                                          v8::Handle<v8::Object> holder);
+
+  // Removes the lazy namespace |name| without running any code, since it was
+  // overwritten by JavaScript code.
+  void DiscardLazyNamespace(const std::string& name);
+
   typedef std::map<std::string, XWalkExtensionModule*> ExtensionModuleMap;
   ExtensionModuleMap extension_modules_;
 
+  // Names of the namespaces with accessors installed that were not accessed
+  // yet.
+  std::set<std::string> lazy_namespaces_;
+
   typedef std::map<std::string, XWalkNativeModule*> NativeModuleMap;
   NativeModuleMap native_modules_;
 
@@ -4,34 +4,158 @@
 
 #include "xwalk/extensions/renderer/xwalk_remote_extension_runner.h"
 
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/message_loop.h"
+#include "base/time.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
 #include "xwalk/extensions/renderer/xwalk_extension_client.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Used when animation frames are not available.
+const int kAnimationFrameDelayMs = 16;
+
+// DELIVER_WHEN_IDLE messages wait this long, and are then delivered during
+// at most a slice of this length before waiting again.
+const int kIdleDelayMs = 50;
+const int kIdleSliceMs = 4;
+
+}  // namespace
+
 XWalkRemoteExtensionRunner::XWalkRemoteExtensionRunner(Client* client,
     XWalkExtensionClient* extension_client, int64_t instance_id)
     : client_(client),
       instance_id_(instance_id),
-      extension_client_(extension_client) {}
+      extension_client_(extension_client),
+      delivery_policy_(DELIVER_IMMEDIATELY),
+      delivery_scheduled_(false),
+      weak_factory_(this) {}
 
 XWalkRemoteExtensionRunner::~XWalkRemoteExtensionRunner() {}
 
-void XWalkRemoteExtensionRunner::PostMessageToNative(
-    scoped_ptr<base::Value> msg) {
-  extension_client_->PostMessageToNative(instance_id_, msg.Pass());
+void XWalkRemoteExtensionRunner::PostMessageToNative(std::string* msg) {
+  extension_client_->PostMessageToNative(instance_id_, msg);
 }
 
-scoped_ptr<base::Value> XWalkRemoteExtensionRunner::SendSyncMessageToNative(
-    scoped_ptr<base::Value> msg) {
-  scoped_ptr<base::Value> reply(extension_client_->SendSyncMessageToNative(
-      instance_id_, msg.Pass()));
-  return reply.Pass();
+bool XWalkRemoteExtensionRunner::SendSyncMessageToNative(
+    const std::string& msg, std::string* reply) {
+  return extension_client_->SendSyncMessageToNative(instance_id_, msg, reply);
 }
 
-void XWalkRemoteExtensionRunner::PostMessageToJS(
-    const base::Value& msg) {
+int32_t XWalkRemoteExtensionRunner::OpenStreamToNative() {
+  return extension_client_->OpenStreamToNative(instance_id_);
+}
+
+bool XWalkRemoteExtensionRunner::WriteStreamToNative(int32_t stream_id,
+                                                     std::string* data) {
+  return extension_client_->WriteStreamToNative(instance_id_, stream_id, data);
+}
+
+void XWalkRemoteExtensionRunner::CloseStreamToNative(int32_t stream_id) {
+  extension_client_->CloseStreamToNative(instance_id_, stream_id);
+}
+
+void XWalkRemoteExtensionRunner::StreamEventToJS(StreamEvent event,
+    int32_t stream_id, const std::string& data) {
+  client_->HandleStreamEventFromNative(event, stream_id, data);
+}
+
+void XWalkRemoteExtensionRunner::SharedBufferToJS(int32_t buffer_id,
+    scoped_ptr<base::SharedMemory> memory, size_t size) {
+  client_->HandleSharedBufferFromNative(buffer_id, memory.Pass(), size);
+}
+
+void XWalkRemoteExtensionRunner::ReleaseSharedBufferToNative(
+    int32_t buffer_id) {
+  extension_client_->ReleaseSharedBufferToNative(instance_id_, buffer_id);
+}
+
+void XWalkRemoteExtensionRunner::PostMessageToJS(const std::string& msg) {
+  const bool immediate = delivery_policy_ == DELIVER_IMMEDIATELY ||
+      delivery_policy_ == DELIVER_WITH_HIGH_PRIORITY;
+  if (immediate && pending_messages_.empty()) {
+    DeliverMessageToJS(msg);
+    return;
+  }
+
+  pending_messages_.push_back(msg);
+  ScheduleDelivery();
+}
+
+void XWalkRemoteExtensionRunner::SetDeliveryPolicy(DeliveryPolicy policy) {
+  if (policy == delivery_policy_)
+    return;
+  if (policy == DELIVER_WITH_HIGH_PRIORITY ||
+      delivery_policy_ == DELIVER_WITH_HIGH_PRIORITY) {
+    extension_client_->SetHighPriority(instance_id_,
+                                       policy == DELIVER_WITH_HIGH_PRIORITY);
+  }
+  delivery_policy_ = policy;
+
+  // Whatever was scheduled for the old policy will find nothing to deliver
+  // or deliver early, which is harmless.
+  delivery_scheduled_ = false;
+  if (!pending_messages_.empty())
+    ScheduleDelivery();
+}
+
+void XWalkRemoteExtensionRunner::DeliverPendingMessagesToJS() {
+  delivery_scheduled_ = false;
+
+  base::TimeTicks deadline;
+  if (delivery_policy_ == DELIVER_WHEN_IDLE) {
+    deadline = base::TimeTicks::Now() +
+        base::TimeDelta::FromMilliseconds(kIdleSliceMs);
+  }
+
+  // Listeners may destroy the instance, and this runner with it.
+  base::WeakPtr<XWalkRemoteExtensionRunner> weak_this =
+      weak_factory_.GetWeakPtr();
+  while (!pending_messages_.empty()) {
+    if (!deadline.is_null() && base::TimeTicks::Now() >= deadline) {
+      ScheduleDelivery();
+      return;
+    }
+
+    std::string msg;
+    msg.swap(pending_messages_.front());
+    pending_messages_.pop_front();
+    DeliverMessageToJS(msg);
+    if (!weak_this)
+      return;
+  }
+}
+
+void XWalkRemoteExtensionRunner::ScheduleDelivery() {
+  if (delivery_scheduled_)
+    return;
+  delivery_scheduled_ = true;
+
+  if (delivery_policy_ == DELIVER_ON_ANIMATION_FRAME &&
+      client_->RequestAnimationFrame())
+    return;
+
+  base::TimeDelta delay;
+  if (delivery_policy_ == DELIVER_ON_ANIMATION_FRAME)
+    delay = base::TimeDelta::FromMilliseconds(kAnimationFrameDelayMs);
+  else if (delivery_policy_ == DELIVER_WHEN_IDLE)
+    delay = base::TimeDelta::FromMilliseconds(kIdleDelayMs);
+
+  base::MessageLoop::current()->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&XWalkRemoteExtensionRunner::DeliverPendingMessagesToJS,
+                 weak_factory_.GetWeakPtr()),
+      delay);
+}
+
+void XWalkRemoteExtensionRunner::DeliverMessageToJS(const std::string& msg) {
+  // Acknowledged before running the listener, which may destroy the
+  // instance.
+  extension_client_->AcknowledgeMessage(instance_id_);
   client_->HandleMessageFromNative(msg);
 }
 
@@ -41,4 +165,3 @@ void XWalkRemoteExtensionRunner::Destroy() {
 
 }  // namespace extensions
 }  // namespace xwalk
-
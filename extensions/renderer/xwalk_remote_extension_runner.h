@@ -6,13 +6,12 @@
 #define XWALK_EXTENSIONS_RENDERER_XWALK_REMOTE_EXTENSION_RUNNER_H_
 
 #include <stdint.h>
+#include <deque>
 #include <string>
 #include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
-
-namespace base {
-class Value;
-}
+#include "base/memory/shared_memory.h"
+#include "base/memory/weak_ptr.h"
 
 namespace xwalk {
 namespace extensions {
@@ -30,32 +29,104 @@ class XWalkExtensionModule;
 // XWalkExtensionRunner subclass or simply a separated object.
 class XWalkRemoteExtensionRunner {
  public:
+  // Events of the streams between JavaScript and the instance. STREAM_WRITABLE
+  // tells that a stream opened by JavaScript, whose window was full, can be
+  // written to again.
+  enum StreamEvent {
+    STREAM_OPENED,
+    STREAM_DATA,
+    STREAM_CLOSED,
+    STREAM_WRITABLE
+  };
+
   class Client {
    public:
-    virtual void HandleMessageFromNative(const base::Value& msg) = 0;
+    virtual void HandleMessageFromNative(const std::string& msg) = 0;
+
+    // Asks for DeliverPendingMessagesToJS() to be called on the next
+    // animation frame, returns false if that's not possible.
+    virtual bool RequestAnimationFrame() = 0;
+
+    // |data| is only set for STREAM_DATA.
+    virtual void HandleStreamEventFromNative(StreamEvent event,
+                                             int32_t stream_id,
+                                             const std::string& data) = 0;
+
+    // |memory| isn't mapped yet, and must be given back with
+    // ReleaseSharedBufferToNative() once JavaScript is done with it.
+    virtual void HandleSharedBufferFromNative(
+        int32_t buffer_id, scoped_ptr<base::SharedMemory> memory,
+        size_t size) = 0;
    protected:
     virtual ~Client() {}
   };
 
+  // When the messages from native are given to the Client. Messages are
+  // always delivered in order, the policy only decides when.
+  enum DeliveryPolicy {
+    // As soon as they arrive, the default.
+    DELIVER_IMMEDIATELY,
+    // Same as above, and the server sends them ahead of the messages other
+    // instances posted before them.
+    DELIVER_WITH_HIGH_PRIORITY,
+    // All together on the next animation frame, so they don't compete with
+    // rendering. Like animation frames, delivery stops while the page is
+    // hidden, and flow control stops the instance from posting more.
+    DELIVER_ON_ANIMATION_FRAME,
+    // Later on, in short slices of time, so input handling and rendering go
+    // first.
+    DELIVER_WHEN_IDLE
+  };
+
   XWalkRemoteExtensionRunner(Client* client,
       XWalkExtensionClient* extension_client, int64_t instance_id);
   virtual ~XWalkRemoteExtensionRunner();
 
-  void PostMessageToNative(scoped_ptr<base::Value> msg);
-  scoped_ptr<base::Value> SendSyncMessageToNative(
-      scoped_ptr<base::Value> msg);
+  // Messages are encoded with XWalkExtensionWireWriter. The contents of |msg|
+  // are taken when posting.
+  void PostMessageToNative(std::string* msg);
+  bool SendSyncMessageToNative(const std::string& msg, std::string* reply);
 
-  void PostMessageToJS(const base::Value& msg);
+  void PostMessageToJS(const std::string& msg);
+
+  // Messages waiting for delivery are delivered according to the new policy.
+  void SetDeliveryPolicy(DeliveryPolicy policy);
+
+  void DeliverPendingMessagesToJS();
+
+  // See XWalkExtensionClient::OpenStreamToNative().
+  int32_t OpenStreamToNative();
+  bool WriteStreamToNative(int32_t stream_id, std::string* data);
+  void CloseStreamToNative(int32_t stream_id);
+
+  // Stream events are given to the Client right away, regardless of the
+  // delivery policy. The stream windows already bound how much is buffered.
+  void StreamEventToJS(StreamEvent event, int32_t stream_id,
+                       const std::string& data);
+
+  // Like stream events, shared buffers are given to the Client right away.
+  void SharedBufferToJS(int32_t buffer_id,
+                        scoped_ptr<base::SharedMemory> memory, size_t size);
+  void ReleaseSharedBufferToNative(int32_t buffer_id);
 
  private:
   friend class XWalkExtensionModule;
 
   void Destroy();
 
+  void ScheduleDelivery();
+  void DeliverMessageToJS(const std::string& msg);
+
   Client* client_;
   int64_t instance_id_;
   XWalkExtensionClient* extension_client_;
 
+  DeliveryPolicy delivery_policy_;
+  std::deque<std::string> pending_messages_;
+  bool delivery_scheduled_;
+
+  base::WeakPtrFactory<XWalkRemoteExtensionRunner> weak_factory_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkRemoteExtensionRunner);
 };
 
@@ -0,0 +1,231 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/renderer/xwalk_v8_wire_format.h"
+
+#include <string.h>
+#include <map>
+#include <utility>
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "third_party/WebKit/public/web/WebArrayBuffer.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// Values that are skipped when they are object properties.
+bool IsSkippedProperty(v8::Handle<v8::Value> value) {
+  return value.IsEmpty() || value->IsUndefined() || value->IsFunction();
+}
+
+void WriteString(v8::Handle<v8::String> value,
+                 XWalkExtensionWireWriter* writer) {
+  // The UTF-8 bytes are written straight into the message.
+  const int length = value->Utf8Length();
+  char* bytes = writer->AllocateString(length);
+  value->WriteUtf8(bytes, length, NULL, v8::String::NO_NULL_TERMINATION);
+}
+
+// Objects already written in the current message. A shared object is written
+// only the first time, so cyclic objects and deep graphs of shared objects
+// are written in linear time. The objects are kept alive by |objects_|, which
+// lives in the outermost handle scope, and are found by identity hash, which
+// isn't unique, then compared with StrictEquals().
+class WrittenObjects {
+ public:
+  WrittenObjects() : objects_(v8::Array::New()), count_(0) {}
+
+  // Returns false if |object| was already added.
+  bool Add(v8::Handle<v8::Object> object) {
+    const int hash = object->GetIdentityHash();
+    std::pair<IndexMap::iterator, IndexMap::iterator> range =
+        indexes_.equal_range(hash);
+    for (IndexMap::iterator it = range.first; it != range.second; ++it) {
+      if (objects_->Get(it->second)->StrictEquals(object))
+        return false;
+    }
+    objects_->Set(count_, object);
+    indexes_.insert(std::make_pair(hash, count_++));
+    return true;
+  }
+
+ private:
+  typedef std::multimap<int, uint32_t> IndexMap;
+  v8::Handle<v8::Array> objects_;
+  IndexMap indexes_;
+  uint32_t count_;
+
+  DISALLOW_COPY_AND_ASSIGN(WrittenObjects);
+};
+
+void WriteV8Value(v8::Handle<v8::Value> value, int depth,
+                  WrittenObjects* written, XWalkExtensionWireWriter* writer) {
+  if (IsSkippedProperty(value) || value->IsNull()) {
+    writer->WriteNull();
+    return;
+  }
+
+  if (value->IsBoolean()) {
+    writer->WriteBoolean(value->BooleanValue());
+    return;
+  }
+
+  if (value->IsInt32()) {
+    writer->WriteInteger(value->Int32Value());
+    return;
+  }
+
+  if (value->IsNumber()) {
+    writer->WriteDouble(value->NumberValue());
+    return;
+  }
+
+  if (value->IsString()) {
+    WriteString(value.As<v8::String>(), writer);
+    return;
+  }
+
+  if (depth >= XWalkExtensionWireReader::kMaxNestingDepth ||
+      (value->IsObject() && !written->Add(value.As<v8::Object>()))) {
+    writer->WriteNull();
+    return;
+  }
+
+  if (value->IsArray()) {
+    v8::Handle<v8::Array> array = value.As<v8::Array>();
+    const uint32_t length = array->Length();
+    writer->BeginArray();
+    for (uint32_t i = 0; i < length; ++i) {
+      v8::HandleScope item_scope;
+      WriteV8Value(array->Get(i), depth + 1, written, writer);
+    }
+    writer->EndContainer();
+    return;
+  }
+
+  scoped_ptr<WebKit::WebArrayBuffer> array_buffer(
+      WebKit::WebArrayBuffer::createFromV8Value(value));
+  if (array_buffer) {
+    writer->WriteBinary(static_cast<const char*>(array_buffer->data()),
+                        array_buffer->byteLength());
+    return;
+  }
+
+  if (value->IsObject()) {
+    v8::Handle<v8::Object> object = value.As<v8::Object>();
+    v8::Handle<v8::Array> keys = object->GetOwnPropertyNames();
+    const uint32_t length = keys.IsEmpty() ? 0 : keys->Length();
+    writer->BeginObject();
+    for (uint32_t i = 0; i < length; ++i) {
+      v8::HandleScope item_scope;
+      v8::Handle<v8::Value> key = keys->Get(i);
+      v8::Handle<v8::Value> property = object->Get(key);
+      if (IsSkippedProperty(property))
+        continue;
+      WriteString(key->ToString(), writer);
+      WriteV8Value(property, depth + 1, written, writer);
+    }
+    writer->EndContainer();
+    return;
+  }
+
+  writer->WriteNull();
+}
+
+v8::Handle<v8::Value> ReadV8Value(XWalkExtensionWireReader* reader,
+                                  int depth) {
+  const char* bytes;
+  size_t size;
+  switch (reader->PeekType()) {
+    case XWalkExtensionWireReader::TYPE_NULL:
+      reader->ReadNull();
+      return v8::Null();
+    case XWalkExtensionWireReader::TYPE_BOOLEAN: {
+      bool value;
+      if (!reader->ReadBoolean(&value))
+        break;
+      return v8::Boolean::New(value);
+    }
+    case XWalkExtensionWireReader::TYPE_INTEGER: {
+      int32_t value;
+      if (!reader->ReadInteger(&value))
+        break;
+      return v8::Integer::New(value);
+    }
+    case XWalkExtensionWireReader::TYPE_DOUBLE: {
+      double value;
+      if (!reader->ReadDouble(&value))
+        break;
+      return v8::Number::New(value);
+    }
+    case XWalkExtensionWireReader::TYPE_STRING:
+      if (!reader->ReadString(&bytes, &size))
+        break;
+      return v8::String::New(bytes, size);
+    case XWalkExtensionWireReader::TYPE_BINARY: {
+      if (!reader->ReadBinary(&bytes, &size))
+        break;
+      WebKit::WebArrayBuffer array_buffer =
+          WebKit::WebArrayBuffer::create(size, 1);
+      memcpy(array_buffer.data(), bytes, size);
+      return array_buffer.toV8Value();
+    }
+    case XWalkExtensionWireReader::TYPE_ARRAY: {
+      if (depth >= XWalkExtensionWireReader::kMaxNestingDepth ||
+          !reader->EnterArray())
+        break;
+      v8::Handle<v8::Array> array = v8::Array::New();
+      for (uint32_t i = 0; !reader->ReadEnd(); ++i) {
+        v8::Handle<v8::Value> item = ReadV8Value(reader, depth + 1);
+        if (item.IsEmpty())
+          return v8::Handle<v8::Value>();
+        array->Set(i, item);
+      }
+      return array;
+    }
+    case XWalkExtensionWireReader::TYPE_OBJECT: {
+      if (depth >= XWalkExtensionWireReader::kMaxNestingDepth ||
+          !reader->EnterObject())
+        break;
+      v8::Handle<v8::Object> object = v8::Object::New();
+      while (!reader->ReadEnd()) {
+        if (!reader->ReadString(&bytes, &size))
+          return v8::Handle<v8::Value>();
+        v8::Handle<v8::String> key = v8::String::New(bytes, size);
+        v8::Handle<v8::Value> item = ReadV8Value(reader, depth + 1);
+        if (item.IsEmpty())
+          return v8::Handle<v8::Value>();
+        object->Set(key, item);
+      }
+      return object;
+    }
+    default:
+      break;
+  }
+  return v8::Handle<v8::Value>();
+}
+
+}  // namespace
+
+void V8ValueToWireFormat(v8::Handle<v8::Value> value, std::string* data) {
+  v8::HandleScope handle_scope;
+  XWalkExtensionWireWriter writer(data);
+  WrittenObjects written;
+  WriteV8Value(value, 0, &written, &writer);
+}
+
+v8::Handle<v8::Value> WireFormatToV8Value(const std::string& data) {
+  v8::HandleScope handle_scope;
+  XWalkExtensionWireReader reader(data);
+  v8::Handle<v8::Value> value = ReadV8Value(&reader, 0);
+  if (value.IsEmpty() || !reader.IsAtEnd())
+    return v8::Handle<v8::Value>();
+  return handle_scope.Close(value);
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,30 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_RENDERER_XWALK_V8_WIRE_FORMAT_H_
+#define XWALK_EXTENSIONS_RENDERER_XWALK_V8_WIRE_FORMAT_H_
+
+#include <string>
+#include "v8/include/v8.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Converts between V8 values and the wire format of extension messages, see
+// XWalkExtensionWireWriter. No intermediate base::Value is built.
+//
+// Functions and undefined are written as null, or skipped when they are
+// object properties. ArrayBuffers are written as binary data. Objects are
+// written only the first time they are found, later references to them, like
+// in cyclic objects, are written as null. So are values nested too deep.
+void V8ValueToWireFormat(v8::Handle<v8::Value> value, std::string* data);
+
+// Must be called inside a v8::Context. Returns an empty handle if |data| is
+// not a single valid value.
+v8::Handle<v8::Value> WireFormatToV8Value(const std::string& data);
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_RENDERER_XWALK_V8_WIRE_FORMAT_H_
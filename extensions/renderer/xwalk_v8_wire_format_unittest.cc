@@ -0,0 +1,112 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/renderer/xwalk_v8_wire_format.h"
+
+#include <string>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "xwalk/extensions/common/xwalk_extension_wire_format.h"
+
+using xwalk::extensions::V8ValueToWireFormat;
+using xwalk::extensions::WireFormatToValue;
+
+class XWalkV8WireFormatTest : public testing::Test {
+ public:
+  XWalkV8WireFormatTest() : isolate_(v8::Isolate::GetCurrent()) {}
+
+ protected:
+  virtual void SetUp() OVERRIDE {
+    v8::HandleScope handle_scope(isolate_);
+    context_.Reset(isolate_, v8::Context::New(isolate_));
+  }
+
+  virtual void TearDown() OVERRIDE {
+    context_.Dispose(isolate_);
+  }
+
+  // Runs |source| and returns its result decoded from the wire format.
+  scoped_ptr<base::Value> RunAndConvert(const char* source) {
+    v8::HandleScope handle_scope(isolate_);
+    v8::Local<v8::Context> context =
+        v8::Local<v8::Context>::New(isolate_, context_);
+    v8::Context::Scope context_scope(context);
+
+    std::string data;
+    V8ValueToWireFormat(v8::Script::New(v8::String::New(source))->Run(),
+                        &data);
+    return WireFormatToValue(data);
+  }
+
+  v8::Isolate* isolate_;
+  v8::Persistent<v8::Context> context_;
+};
+
+TEST_F(XWalkV8WireFormatTest, CyclicObject) {
+  scoped_ptr<base::Value> value(RunAndConvert(
+      "var object = { number: 1, list: [] };"
+      "object.self = object;"
+      "object.list.push(object, object.list);"
+      "object;"));
+  ASSERT_TRUE(value);
+
+  base::DictionaryValue* object;
+  ASSERT_TRUE(value->GetAsDictionary(&object));
+  int number;
+  EXPECT_TRUE(object->GetInteger("number", &number));
+  EXPECT_EQ(1, number);
+
+  base::Value* self;
+  ASSERT_TRUE(object->Get("self", &self));
+  EXPECT_TRUE(self->IsType(base::Value::TYPE_NULL));
+
+  base::ListValue* list;
+  ASSERT_TRUE(object->GetList("list", &list));
+  ASSERT_EQ(2u, list->GetSize());
+  for (size_t i = 0; i < list->GetSize(); ++i) {
+    base::Value* item;
+    ASSERT_TRUE(list->Get(i, &item));
+    EXPECT_TRUE(item->IsType(base::Value::TYPE_NULL));
+  }
+}
+
+TEST_F(XWalkV8WireFormatTest, SharedObjects) {
+  // Written as a tree this graph would have 2^64 leaves.
+  scoped_ptr<base::Value> value(RunAndConvert(
+      "var node = { leaf: true };"
+      "for (var i = 0; i < 64; ++i)"
+      "  node = { left: node, right: node };"
+      "node;"));
+  ASSERT_TRUE(value);
+
+  // Only the first reference to each node is written.
+  base::DictionaryValue* node;
+  ASSERT_TRUE(value->GetAsDictionary(&node));
+  for (int i = 0; i < 64; ++i) {
+    base::Value* right;
+    ASSERT_TRUE(node->Get("right", &right));
+    EXPECT_TRUE(right->IsType(base::Value::TYPE_NULL));
+    ASSERT_TRUE(node->GetDictionary("left", &node));
+  }
+  bool leaf;
+  EXPECT_TRUE(node->GetBoolean("leaf", &leaf));
+  EXPECT_TRUE(leaf);
+}
+
+TEST_F(XWalkV8WireFormatTest, EqualButDistinctObjects) {
+  scoped_ptr<base::Value> value(RunAndConvert("[{}, {}, [], []];"));
+  ASSERT_TRUE(value);
+
+  base::ListValue* list;
+  ASSERT_TRUE(value->GetAsList(&list));
+  ASSERT_EQ(4u, list->GetSize());
+  base::DictionaryValue* dictionary;
+  EXPECT_TRUE(list->GetDictionary(0, &dictionary));
+  EXPECT_TRUE(list->GetDictionary(1, &dictionary));
+  base::ListValue* item;
+  EXPECT_TRUE(list->GetList(2, &item));
+  EXPECT_TRUE(list->GetList(3, &item));
+}
@@ -6,6 +6,7 @@
 
 #include "base/logging.h"
 #include "third_party/WebKit/public/web/WebScopedMicrotaskSuppression.h"
+#include "xwalk/extensions/renderer/xwalk_extension_script_cache.h"
 
 namespace xwalk {
 namespace extensions {
@@ -59,6 +60,17 @@ void LifecycleTracker(const v8::FunctionCallbackInfo<v8::Value>& info) {
   info.GetReturnValue().Set(tracker);
 }
 
+void ScriptCacheStatsCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  XWalkExtensionScriptCache* cache = XWalkExtensionScriptCache::GetInstance();
+  v8::Handle<v8::Object> stats = v8::Object::New();
+  stats->Set(v8::String::New("hits"),
+             v8::Integer::New(cache->GetHitsForTesting()));
+  stats->Set(v8::String::New("misses"),
+             v8::Integer::New(cache->GetMissesForTesting()));
+  info.GetReturnValue().Set(stats);
+}
+
 }  // namespace
 
 XWalkV8ToolsModule::XWalkV8ToolsModule() {
@@ -69,6 +81,8 @@ XWalkV8ToolsModule::XWalkV8ToolsModule() {
                         v8::FunctionTemplate::New(ForceSetPropertyCallback));
   object_template->Set("lifecycleTracker",
                        v8::FunctionTemplate::New(LifecycleTracker));
+  object_template->Set("scriptCacheStats",
+                       v8::FunctionTemplate::New(ScriptCacheStatsCallback));
 
   object_template_.Reset(isolate, object_template);
 }
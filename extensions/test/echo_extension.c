@@ -8,13 +8,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_SharedBuffer.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
 
 XW_Extension g_extension = 0;
 const XW_CoreInterface* g_core = NULL;
 const XW_MessagingInterface* g_messaging = NULL;
+const XW_BinaryMessagingInterface* g_binary_messaging = NULL;
 const XW_Internal_SyncMessagingInterface* g_sync_messaging = NULL;
+const XW_Internal_SharedBufferInterface* g_shared_buffer = NULL;
 
 void instance_created(XW_Instance instance) {
   printf("Instance %d created!\n", instance);
@@ -25,11 +29,54 @@ void instance_destroyed(XW_Instance instance) {
 }
 
 void handle_message(XW_Instance instance, const char* message) {
+  // Messages prefixed with "repeat:" are echoed twice without the prefix
+  // using PostMessages().
+  static const char kRepeatPrefix[] = "repeat:";
+  static const size_t kRepeatPrefixLength = sizeof(kRepeatPrefix) - 1;
+  // Messages prefixed with "share:" have the rest of their text sent back in
+  // a shared buffer.
+  static const char kSharePrefix[] = "share:";
+  static const size_t kSharePrefixLength = sizeof(kSharePrefix) - 1;
+  if (!strncmp(message, kRepeatPrefix, kRepeatPrefixLength)) {
+    const char* messages[2];
+    messages[0] = messages[1] = message + kRepeatPrefixLength;
+    g_messaging->PostMessages(instance, messages, 2);
+    return;
+  }
+
+  if (!strncmp(message, kSharePrefix, kSharePrefixLength)) {
+    const char* text = message + kSharePrefixLength;
+    const size_t size = strlen(text);
+    XW_SharedBuffer buffer = g_shared_buffer->Create(instance, size);
+    if (!buffer) {
+      g_messaging->PostMessage(instance, "Fail");
+      return;
+    }
+    memcpy(g_shared_buffer->GetData(instance, buffer), text, size);
+    if (!g_shared_buffer->Post(instance, buffer, size)) {
+      g_shared_buffer->Destroy(instance, buffer);
+      g_messaging->PostMessage(instance, "Fail");
+    }
+    return;
+  }
+
   g_messaging->PostMessage(instance, message);
 }
 
-void handle_sync_message(XW_Instance instance, const char* message) {
-  g_sync_messaging->SetSyncReply(instance, message);
+void handle_shared_buffer_released(XW_Instance instance,
+                                   XW_SharedBuffer buffer) {
+  g_shared_buffer->Destroy(instance, buffer);
+  g_messaging->PostMessage(instance, "released");
+}
+
+void handle_binary_message(XW_Instance instance, const char* data,
+                           size_t size) {
+  g_binary_messaging->PostMessage(instance, data, size);
+}
+
+void handle_sync_message(XW_Instance instance, const char* message,
+                         int32_t token) {
+  g_sync_messaging->SetSyncReply(instance, token, message);
 }
 
 void shutdown(XW_Extension extension) {
@@ -50,6 +97,20 @@ int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
       "};"
       "exports.syncEcho = function(msg) {"
       "  return extension.internal.sendSyncMessage(msg);"
+      "};"
+      "var bufferListener = null;"
+      "extension.setSharedBufferListener(function(id, buffer) {"
+      "  if (bufferListener instanceof Function) {"
+      "    bufferListener(id, buffer);"
+      "  };"
+      "});"
+      "exports.share = function(text, callback) {"
+      "  bufferListener = callback;"
+      "  extension.postMessage('share:' + text);"
+      "};"
+      "exports.release = function(id, callback) {"
+      "  echoListener = callback;"
+      "  extension.releaseSharedBuffer(id);"
       "};";
 
   g_extension = extension;
@@ -63,8 +124,15 @@ int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
   g_messaging = get_interface(XW_MESSAGING_INTERFACE);
   g_messaging->Register(extension, handle_message);
 
+  g_binary_messaging = get_interface(XW_BINARY_MESSAGING_INTERFACE);
+  g_binary_messaging->Register(extension, handle_binary_message);
+
   g_sync_messaging = get_interface(XW_INTERNAL_SYNC_MESSAGING_INTERFACE);
   g_sync_messaging->Register(extension, handle_sync_message);
 
+  g_shared_buffer = get_interface(XW_INTERNAL_SHARED_BUFFER_INTERFACE);
+  g_shared_buffer->RegisterReleasedCallback(extension,
+                                            handle_shared_buffer_released);
+
   return XW_OK;
 }
@@ -0,0 +1,169 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string>
+#include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/path_service.h"
+#include "xwalk/extensions/browser/xwalk_extension_service.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
+#include "xwalk/extensions/test/xwalk_extensions_test_base.h"
+#include "xwalk/runtime/browser/runtime.h"
+#include "xwalk/test/base/xwalk_test_utils.h"
+#include "content/public/test/browser_test_utils.h"
+#include "content/public/test/test_utils.h"
+
+using xwalk::extensions::XWalkExtension;
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkExtensionService;
+
+// Measures the cost of extension messaging with extensions/test/data/
+// extension_benchmark.html, which echoes payloads of several sizes through
+// the "echo" extension. Each test prints a line starting with
+// "EXTENSION_BENCHMARK" followed by the mode and the results as JSON. When
+// --extension-benchmark-results=<file> is given, the same JSON is also
+// appended to that file, one line per test, for CI to keep track of.
+
+namespace {
+
+const char kResultsSwitch[] = "extension-benchmark-results";
+
+// Same API as test/echo_extension.c.
+const char kEchoAPI[] =
+    "var echoListener = null;"
+    "extension.setMessageListener(function(msg) {"
+    "  if (echoListener instanceof Function) {"
+    "    echoListener(msg);"
+    "  };"
+    "});"
+    "exports.echo = function(msg, callback) {"
+    "  echoListener = callback;"
+    "  extension.postMessage(msg);"
+    "};"
+    "exports.syncEcho = function(msg) {"
+    "  return extension.internal.sendSyncMessage(msg);"
+    "};";
+
+// Replies with the messages as they came, without converting them to
+// base::Value.
+class EchoInstance : public XWalkExtensionInstance {
+ public:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    PostMessageToJS(msg.Pass());
+  }
+
+  virtual void HandleSerializedMessage(const std::string& data) OVERRIDE {
+    std::string reply(data);
+    PostSerializedMessageToJS(&reply);
+  }
+
+  virtual void HandleSerializedSyncMessage(const std::string& data,
+                                           SyncReplyToken token) OVERRIDE {
+    std::string reply(data);
+    SendSerializedSyncReplyToJS(token, &reply);
+  }
+};
+
+class EchoExtension : public XWalkExtension {
+ public:
+  EchoExtension() {
+    set_name("echo");
+  }
+
+  virtual const char* GetJavaScriptAPI() OVERRIDE {
+    return kEchoAPI;
+  }
+
+  virtual XWalkExtensionInstance* CreateInstance() OVERRIDE {
+    return new EchoInstance;
+  }
+};
+
+void ReportResults(const std::string& mode, const std::string& results) {
+  const std::string line =
+      "{\"mode\": \"" + mode + "\", \"results\": " + results + "}\n";
+  printf("EXTENSION_BENCHMARK %s", line.c_str());
+
+  const base::FilePath path =
+      CommandLine::ForCurrentProcess()->GetSwitchValuePath(kResultsSwitch);
+  if (path.empty())
+    return;
+  int written = file_util::PathExists(path) ?
+      file_util::AppendToFile(path, line.data(), line.size()) :
+      file_util::WriteFile(path, line.data(), line.size());
+  EXPECT_EQ(static_cast<int>(line.size()), written)
+      << "Couldn't write benchmark results to " << path.AsUTF8Unsafe();
+}
+
+}  // namespace
+
+class ExtensionBenchmark : public XWalkExtensionsTestBase {
+ protected:
+  void RunBenchmark(const std::string& mode) {
+    content::RunAllPendingInMessageLoop();
+    GURL url = GetExtensionsTestURL(
+        base::FilePath(),
+        base::FilePath().AppendASCII("extension_benchmark.html"));
+    content::TitleWatcher title_watcher(runtime()->web_contents(),
+                                        kPassString);
+    title_watcher.AlsoWaitForTitle(kFailString);
+    xwalk_test_utils::NavigateToURL(runtime(), url);
+    ASSERT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+    std::string results;
+    ASSERT_TRUE(content::ExecuteScriptAndExtractString(
+        runtime()->web_contents(),
+        "window.domAutomationController.send(window.benchmarkResults);",
+        &results));
+    ReportResults(mode, results);
+  }
+};
+
+class InternalExtensionBenchmark : public ExtensionBenchmark {
+ public:
+  virtual void RegisterExtensions(
+      XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new EchoExtension));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class ExternalExtensionBenchmark : public ExtensionBenchmark {
+ public:
+  virtual void RegisterExtensions(
+      XWalkExtensionService* extension_service) OVERRIDE {
+    base::FilePath extension_dir;
+    PathService::Get(base::DIR_EXE, &extension_dir);
+
+    extension_dir = extension_dir
+                    .Append(FILE_PATH_LITERAL("tests"))
+                    .Append(FILE_PATH_LITERAL("extension"))
+                    .Append(FILE_PATH_LITERAL("echo_extension"));
+
+    extension_service->RegisterExternalExtensionsForPath(extension_dir);
+  }
+};
+
+class ExternalExtensionInProcessBenchmark : public ExternalExtensionBenchmark {
+ public:
+  virtual void SetUpCommandLine(CommandLine* command_line) OVERRIDE {
+    command_line->AppendSwitch(switches::kXWalkDisableExtensionProcess);
+  }
+};
+
+IN_PROC_BROWSER_TEST_F(InternalExtensionBenchmark, EchoRoundTrips) {
+  RunBenchmark("internal");
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionBenchmark, EchoRoundTrips) {
+  RunBenchmark("external-extension-process");
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionInProcessBenchmark, EchoRoundTrips) {
+  RunBenchmark("external-in-process");
+}
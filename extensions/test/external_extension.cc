@@ -2,18 +2,47 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "base/bind.h"
+#include "base/command_line.h"
 #include "base/native_library.h"
 #include "base/path_service.h"
+#include "base/run_loop.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/platform_thread.h"
+#include "content/public/browser/browser_thread.h"
+#include "content/public/browser/render_process_host.h"
+#include "content/public/browser/web_contents.h"
+#include "xwalk/extensions/browser/xwalk_extension_process_host.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
 #include "xwalk/extensions/test/xwalk_extensions_test_base.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/test/base/xwalk_test_utils.h"
 #include "content/public/test/browser_test_utils.h"
 #include "content/public/test/test_utils.h"
 
+using content::BrowserThread;
+using xwalk::Runtime;
+using xwalk::extensions::XWalkExtensionProcessHost;
 using xwalk::extensions::XWalkExtensionService;
 
+namespace {
+
+struct SpareChannelStats {
+  bool has_spare;
+  int requested;
+  int assigned;
+};
+
+void GetSpareChannelStats(XWalkExtensionProcessHost* host,
+                          SpareChannelStats* stats) {
+  stats->has_spare = host->HasSpareChannelForTesting();
+  stats->requested = host->GetSpareChannelsRequestedForTesting();
+  stats->assigned = host->GetSpareChannelsAssignedForTesting();
+}
+
+}  // namespace
+
 class ExternalExtensionTest : public XWalkExtensionsTestBase {
  public:
   void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
@@ -29,6 +58,66 @@ class ExternalExtensionTest : public XWalkExtensionsTestBase {
   }
 };
 
+// Registers the echo extension from its metadata file, the library is only
+// loaded when the page creates an instance.
+class ExternalExtensionWithMetadataTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    base::FilePath extension_dir;
+    PathService::Get(base::DIR_EXE, &extension_dir);
+
+    extension_dir = extension_dir
+                    .Append(FILE_PATH_LITERAL("tests"))
+                    .Append(FILE_PATH_LITERAL("extension"))
+                    .Append(FILE_PATH_LITERAL("lazy_echo_extension"));
+
+    extension_service->RegisterExternalExtensionsForPath(extension_dir);
+  }
+};
+
+class ExternalExtensionProcessPerExtensionTest : public ExternalExtensionTest {
+ public:
+  virtual void SetUpCommandLine(CommandLine* command_line) OVERRIDE {
+    command_line->AppendSwitchASCII(switches::kXWalkExtensionProcessModel,
+                                    "process-per-extension");
+  }
+};
+
+// Keeps a render process channel ready in the extension process.
+class ExternalExtensionWarmSpareTest : public ExternalExtensionTest {
+ public:
+  ExternalExtensionWarmSpareTest() : extension_service_(NULL) {}
+
+  virtual void SetUpCommandLine(CommandLine* command_line) OVERRIDE {
+    command_line->AppendSwitch(switches::kXWalkExtensionProcessWarmSpare);
+  }
+
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    ExternalExtensionTest::RegisterExtensions(extension_service);
+    extension_service_ = extension_service;
+  }
+
+  // Waits until the extension process has a spare channel ready.
+  SpareChannelStats WaitForSpareChannel() {
+    XWalkExtensionProcessHost* host =
+        extension_service_->GetExtensionProcessHostsForTesting()[0];
+    SpareChannelStats stats;
+    while (true) {
+      base::RunLoop run_loop;
+      BrowserThread::PostTaskAndReply(BrowserThread::IO, FROM_HERE,
+          base::Bind(&GetSpareChannelStats, host, &stats),
+          run_loop.QuitClosure());
+      run_loop.Run();
+      if (stats.has_spare)
+        return stats;
+      base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(10));
+    }
+  }
+
+ protected:
+  XWalkExtensionService* extension_service_;
+};
+
 IN_PROC_BROWSER_TEST_F(ExternalExtensionTest, ExternalExtension) {
   content::RunAllPendingInMessageLoop();
   GURL url = GetExtensionsTestURL(base::FilePath(),
@@ -63,3 +152,113 @@ IN_PROC_BROWSER_TEST_F(ExternalExtensionTest, ExternalExtensionSync) {
   xwalk_test_utils::NavigateToURL(runtime(), url);
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionTest, ExternalExtensionBinary) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(),
+      base::FilePath().AppendASCII("binary_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionTest, ExternalExtensionBurst) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(),
+      base::FilePath().AppendASCII("burst_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionTest, ExternalExtensionSharedBuffer) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(),
+      base::FilePath().AppendASCII("shared_buffer_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+// Navigating away destroys the instance while JavaScript still holds one of
+// its shared buffers, the buffer is freed with the instance and the
+// extension keeps working.
+IN_PROC_BROWSER_TEST_F(ExternalExtensionTest,
+                       DestroyInstanceHoldingSharedBuffer) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(),
+      base::FilePath().AppendASCII("shared_buffer_echo.html"));
+
+  const string16 kHoldingString = ASCIIToUTF16("Holding");
+  content::TitleWatcher hold_title_watcher(runtime()->web_contents(),
+                                           kHoldingString);
+  hold_title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), GURL(url.spec() + "#hold"));
+  EXPECT_EQ(kHoldingString, hold_title_watcher.WaitAndGetTitle());
+
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionProcessPerExtensionTest,
+                       ExternalExtension) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionWithMetadataTest, ExternalExtension) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalExtensionWarmSpareTest,
+                       SpareChannelGoesToNextRenderProcess) {
+  content::RunAllPendingInMessageLoop();
+  ASSERT_EQ(1u,
+            extension_service_->GetExtensionProcessHostsForTesting().size());
+
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  const SpareChannelStats before = WaitForSpareChannel();
+
+  // The render process of a new Runtime takes the spare channel, and its
+  // extensions work through it.
+  Runtime* new_runtime = Runtime::CreateWithDefaultWindow(
+      runtime()->runtime_context(), GURL());
+  content::TitleWatcher new_title_watcher(new_runtime->web_contents(),
+                                          kPassString);
+  new_title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(new_runtime, url);
+  EXPECT_EQ(kPassString, new_title_watcher.WaitAndGetTitle());
+  EXPECT_NE(runtime()->web_contents()->GetRenderProcessHost(),
+            new_runtime->web_contents()->GetRenderProcessHost());
+
+  // Another spare was requested to replace it.
+  const SpareChannelStats after = WaitForSpareChannel();
+  EXPECT_EQ(before.assigned + 1, after.assigned);
+  EXPECT_EQ(before.requested + 1, after.requested);
+}
@@ -10,6 +10,7 @@
 #include "content/public/test/test_utils.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 #include "xwalk/extensions/test/test.h"
+#include "xwalk/extensions/test/test_function_ids.h"
 #include "xwalk/extensions/test/xwalk_extensions_test_base.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/test/base/xwalk_test_utils.h"
@@ -21,10 +22,8 @@ using namespace xwalk::jsapi_test::test; // NOLINT
 
 TestExtension::TestExtension() {
   set_name("test");
-}
-
-const char* TestExtension::GetJavaScriptAPI() {
-  return kSource_internal_extension_browsertest_api;
+  SetJavaScriptAPI(kFunctionIdsJavaScript,
+                   kSource_internal_extension_browsertest_api);
 }
 
 XWalkExtensionInstance* TestExtension::CreateInstance() {
@@ -33,27 +32,29 @@ XWalkExtensionInstance* TestExtension::CreateInstance() {
 
 TestExtensionInstance::TestExtensionInstance()
     : XWalkInternalExtensionInstance() {
-  RegisterFunction("clearDatabase", &TestExtensionInstance::OnClearDatabase);
-  RegisterFunction("addPerson", &TestExtensionInstance::OnAddPerson);
-  RegisterFunction("addPersonObject",
+  RegisterFunction(kClearDatabase, &TestExtensionInstance::OnClearDatabase);
+  RegisterFunction(kAddPerson, &TestExtensionInstance::OnAddPerson);
+  RegisterFunction(kAddPersonObject,
       &TestExtensionInstance::OnAddPersonObject);
-  RegisterFunction("getAllPersons", &TestExtensionInstance::OnGetAllPersons);
-  RegisterFunction("getPersonAge", &TestExtensionInstance::OnGetPersonAge);
+  RegisterFunction(kGetAllPersons, &TestExtensionInstance::OnGetAllPersons);
+  RegisterFunction(kGetPersonAge, &TestExtensionInstance::OnGetPersonAge);
+  RegisterFunction(kFindPersonAge, &TestExtensionInstance::OnFindPersonAge);
+  RegisterFunction(kReplyTwice, &TestExtensionInstance::OnReplyTwice);
 }
 
-void TestExtensionInstance::OnClearDatabase(const std::string&,
-                                                          const std::string&,
-                                                          base::ListValue*) {
+void TestExtensionInstance::OnClearDatabase(int, int,
+                                            base::ListValue*) {
   database()->clear();
 }
 
 void TestExtensionInstance::OnAddPerson(
-    const std::string& function_name, const std::string&,
+    int function_id, int,
     base::ListValue* args) {
   scoped_ptr<AddPerson::Params> params(AddPerson::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -62,13 +63,14 @@ void TestExtensionInstance::OnAddPerson(
 }
 
 void TestExtensionInstance::OnAddPersonObject(
-    const std::string& function_name, const std::string&,
+    int function_id, int,
     base::ListValue* args) {
   scoped_ptr<AddPersonObject::Params>
       params(AddPersonObject::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -77,16 +79,17 @@ void TestExtensionInstance::OnAddPersonObject(
 }
 
 void TestExtensionInstance::OnGetAllPersons(
-    const std::string& function_name, const std::string& callback_id,
+    int function_id, int callback_id,
     base::ListValue* args) {
-  if (callback_id.empty())
+  if (callback_id == kNoCallback)
     return;
 
   scoped_ptr<GetAllPersons::Params>
       params(GetAllPersons::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -106,16 +109,17 @@ void TestExtensionInstance::OnGetAllPersons(
 }
 
 void TestExtensionInstance::OnGetPersonAge(
-    const std::string& function_name, const std::string& callback_id,
+    int function_id, int callback_id,
     base::ListValue* args) {
-  if (callback_id.empty())
+  if (callback_id == kNoCallback)
     return;
 
   scoped_ptr<GetPersonAge::Params>
       params(GetPersonAge::Params::Create(*args));
 
   if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
     return;
   }
 
@@ -129,6 +133,44 @@ void TestExtensionInstance::OnGetPersonAge(
   PostResult(callback_id, GetPersonAge::Results::Create(age));
 }
 
+void TestExtensionInstance::OnFindPersonAge(
+    int function_id, int callback_id,
+    base::ListValue* args) {
+  scoped_ptr<FindPersonAge::Params>
+      params(FindPersonAge::Params::Create(*args));
+
+  if (!params) {
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
+    return;
+  }
+
+  for (unsigned i = 0; i < database()->size(); ++i) {
+    if (database()->at(i).first == params->name) {
+      PostResult(callback_id,
+                 FindPersonAge::Results::Create(database()->at(i).second));
+      return;
+    }
+  }
+
+  PostError(callback_id, "No person called " + params->name);
+}
+
+void TestExtensionInstance::OnReplyTwice(
+    int function_id, int callback_id,
+    base::ListValue* args) {
+  scoped_ptr<ReplyTwice::Params> params(ReplyTwice::Params::Create(*args));
+
+  if (!params) {
+    LOG(WARNING) << "Malformed parameters passed to "
+                 << kFunctionNames[function_id];
+    return;
+  }
+
+  PostResult(callback_id, ReplyTwice::Results::Create(params->value));
+  PostResult(callback_id, ReplyTwice::Results::Create(params->value + 1));
+}
+
 class InternalExtensionTest : public XWalkExtensionsTestBase {
  public:
   void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
@@ -150,3 +192,16 @@ IN_PROC_BROWSER_TEST_F(InternalExtensionTest, InternalExtension) {
 
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+IN_PROC_BROWSER_TEST_F(InternalExtensionTest, PostMessageWithPromise) {
+  content::RunAllPendingInMessageLoop();
+
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+      base::FilePath().AppendASCII("test_internal_extension_promises.html"));
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
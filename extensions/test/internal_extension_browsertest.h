@@ -14,8 +14,6 @@ class TestExtension : public xwalk::extensions::XWalkInternalExtension {
  public:
   TestExtension();
 
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
-
   virtual xwalk::extensions::XWalkExtensionInstance* CreateInstance() OVERRIDE;
 };
 
@@ -29,17 +27,20 @@ class TestExtensionInstance
   Database* database() { return &database_; }
 
  private:
-  void OnClearDatabase(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
-  void OnAddPerson(const std::string& function_name,
-                   const std::string& callback_id, base::ListValue* args);
-  void OnAddPersonObject(const std::string& function_name,
-                         const std::string& callback_id,
-                         base::ListValue* args);
-  void OnGetAllPersons(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
-  void OnGetPersonAge(const std::string& function_name,
-                      const std::string& callback_id, base::ListValue* args);
+  void OnClearDatabase(int function_id,
+                       int callback_id, base::ListValue* args);
+  void OnAddPerson(int function_id,
+                   int callback_id, base::ListValue* args);
+  void OnAddPersonObject(int function_id,
+                         int callback_id, base::ListValue* args);
+  void OnGetAllPersons(int function_id,
+                       int callback_id, base::ListValue* args);
+  void OnGetPersonAge(int function_id,
+                      int callback_id, base::ListValue* args);
+  void OnFindPersonAge(int function_id,
+                       int callback_id, base::ListValue* args);
+  void OnReplyTwice(int function_id,
+                    int callback_id, base::ListValue* args);
 
   std::vector<std::pair<std::string, int> > database_;
 };
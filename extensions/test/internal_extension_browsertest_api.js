@@ -11,21 +11,33 @@ exports.Person = function(name, age) {
 };
 
 exports.clearDatabase = function() {
-  internal.postMessage('clearDatabase', []);
+  internal.postMessage(FunctionId.clearDatabase, []);
 };
 
 exports.addPerson = function(arg1, arg2) {
-  internal.postMessage('addPerson', [arg1, arg2]);
+  internal.postMessage(FunctionId.addPerson, [arg1, arg2]);
 };
 
 exports.addPersonObject = function(arg1) {
-  internal.postMessage('addPersonObject', [arg1]);
+  internal.postMessage(FunctionId.addPersonObject, [arg1]);
 };
 
 exports.getAllPersons = function(arg1, callback) {
-  internal.postMessage('getAllPersons', [arg1], callback);
+  internal.postMessage(FunctionId.getAllPersons, [arg1], callback);
 };
 
 exports.getPersonAge = function(arg1, callback) {
-  internal.postMessage('getPersonAge', [arg1], callback);
+  internal.postMessage(FunctionId.getPersonAge, [arg1], callback);
+};
+
+exports.getPersonAgeWithPromise = function(arg1) {
+  return internal.postMessageWithPromise(FunctionId.getPersonAge, [arg1]);
+};
+
+exports.findPersonAgeWithPromise = function(arg1) {
+  return internal.postMessageWithPromise(FunctionId.findPersonAge, [arg1]);
+};
+
+exports.replyTwice = function(arg1, callback) {
+  internal.postMessage(FunctionId.replyTwice, [arg1], callback);
 };
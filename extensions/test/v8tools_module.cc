@@ -39,6 +39,9 @@ class TestV8ToolsExtension : public XWalkExtension {
         "};"
         "exports.lifecycleTracker = function() {"
         "  return v8tools.lifecycleTracker();"
+        "};"
+        "exports.scriptCacheStats = function() {"
+        "  return v8tools.scriptCacheStats();"
         "};";
     return kAPI;
   }
@@ -69,3 +72,16 @@ IN_PROC_BROWSER_TEST_F(XWalkExtensionsV8ToolsTest,
 
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsV8ToolsTest,
+                       ScriptCacheIsSharedByFrames) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+      base::FilePath().AppendASCII("script_cache.html"));
+
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
@@ -4,6 +4,10 @@
 
 #include "xwalk/extensions/test/xwalk_extensions_test_base.h"
 
+#include <string.h>
+#include <deque>
+#include <map>
+#include <string>
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/runtime/browser/runtime.h"
@@ -11,9 +15,12 @@
 #include "xwalk/test/base/xwalk_test_utils.h"
 #include "content/public/test/browser_test_utils.h"
 #include "content/public/test/test_utils.h"
+#include "base/memory/shared_memory.h"
+#include "base/synchronization/lock.h"
 #include "base/task_runner.h"
 #include "base/time.h"
 
+using xwalk::Runtime;
 using xwalk::extensions::XWalkExtension;
 using xwalk::extensions::XWalkExtensionInstance;
 using xwalk::extensions::XWalkExtensionService;
@@ -81,6 +88,188 @@ class EchoExtension : public XWalkExtension {
   }
 };
 
+// Echoes messages to a listener set with a given delivery policy.
+const char* kDeliveryAPI =
+    "var listener = null;"
+    "exports.setPolicy = function(policy, callback) {"
+    "  listener = callback;"
+    "  return extension.setMessageListener(function(msg) {"
+    "    listener(msg);"
+    "  }, policy);"
+    "};"
+    "exports.post = function(msg) {"
+    "  extension.postMessage(msg);"
+    "};";
+
+class DeliveryExtension : public EchoExtension {
+ public:
+  DeliveryExtension() {
+    set_name("delivery");
+  }
+
+  virtual const char* GetJavaScriptAPI() {
+    return kDeliveryAPI;
+  }
+};
+
+// Echoes each stream opened by JavaScript back in a stream to JavaScript.
+// Both sides write more than a window of data, so they wait for their
+// stream to be writable again instead of dropping chunks.
+const char* kStreamEchoAPI =
+    "extension._setupExtensionStreams();"
+    "exports.echo = function(chunks, onEnd) {"
+    "  var received = [];"
+    "  var drained = false;"
+    "  extension.setStreamHandler(function(echo) {"
+    "    echo.on('data', function(chunk) { received.push(chunk); });"
+    "    echo.on('end', function() { onEnd(received, drained); });"
+    "  });"
+    "  var stream = extension.createStream();"
+    "  var next = 0;"
+    "  function writeChunks() {"
+    "    while (next < chunks.length) {"
+    "      if (!stream.write(chunks[next++]))"
+    "        return;"
+    "    }"
+    "    stream.end();"
+    "  }"
+    "  stream.on('drain', function() {"
+    "    drained = true;"
+    "    writeChunks();"
+    "  });"
+    "  writeChunks();"
+    "};";
+
+class StreamEchoContext : public XWalkExtensionInstance {
+ public:
+  StreamEchoContext() {
+  }
+  virtual void HandleStreamOpened(StreamId stream) OVERRIDE {
+    const StreamId echo_stream = OpenStreamToJS();
+    echo_streams_[stream] = echo_stream;
+    pending_[echo_stream].closed = false;
+  }
+  virtual void HandleStreamData(StreamId stream,
+                                const std::string& data) OVERRIDE {
+    const StreamId echo_stream = echo_streams_[stream];
+    pending_[echo_stream].chunks.push_back(data);
+    WritePendingChunks(echo_stream);
+  }
+  virtual void HandleStreamClosed(StreamId stream) OVERRIDE {
+    const StreamId echo_stream = echo_streams_[stream];
+    echo_streams_.erase(stream);
+    pending_[echo_stream].closed = true;
+    WritePendingChunks(echo_stream);
+  }
+  virtual void OnStreamWritableToJS(StreamId stream) OVERRIDE {
+    WritePendingChunks(stream);
+  }
+
+ private:
+  struct PendingEcho {
+    std::deque<std::string> chunks;
+    bool closed;
+  };
+
+  // Writes the chunks that fit in the window, the rest wait for
+  // OnStreamWritableToJS(). The stream is closed after its last chunk.
+  void WritePendingChunks(StreamId stream) {
+    std::map<StreamId, PendingEcho>::iterator it = pending_.find(stream);
+    if (it == pending_.end())
+      return;
+    PendingEcho& echo = it->second;
+    while (!echo.chunks.empty()) {
+      if (!WriteSerializedStreamToJS(stream, &echo.chunks.front()))
+        return;
+      echo.chunks.pop_front();
+    }
+    if (echo.closed) {
+      CloseStreamToJS(stream);
+      pending_.erase(it);
+    }
+  }
+
+  std::map<StreamId, StreamId> echo_streams_;
+  std::map<StreamId, PendingEcho> pending_;
+};
+
+class StreamEchoExtension : public XWalkExtension {
+ public:
+  StreamEchoExtension() : XWalkExtension() {
+    set_name("streamEcho");
+  }
+
+  virtual const char* GetJavaScriptAPI() {
+    return kStreamEchoAPI;
+  }
+
+  virtual XWalkExtensionInstance* CreateInstance() {
+    return new StreamEchoContext();
+  }
+};
+
+// Sends the number of frames asked by JavaScript, recycling a single shared
+// buffer filled with the number of the frame.
+const char* kFramesAPI =
+    "exports.start = function(count, onFrame) {"
+    "  extension.setSharedBufferListener(function(id, buffer) {"
+    "    onFrame(buffer);"
+    "    extension.releaseSharedBuffer(id);"
+    "  });"
+    "  extension.postMessage(count);"
+    "};";
+
+class FramesContext : public XWalkExtensionInstance {
+ public:
+  static const size_t kFrameSize = 64 * 1024;
+  static const BufferId kBuffer = 1;
+
+  FramesContext() : frames_left_(0) {
+    memory_.CreateAndMapAnonymous(kFrameSize);
+  }
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    if (msg->GetAsInteger(&frames_left_))
+      PostFrame();
+  }
+  virtual void OnSharedBufferReleased(BufferId buffer) OVERRIDE {
+    PostFrame();
+  }
+
+ private:
+  void PostFrame() {
+    if (frames_left_ <= 0)
+      return;
+    memset(memory_.memory(), --frames_left_, kFrameSize);
+    if (!PostSharedBufferToJS(kBuffer, &memory_, kFrameSize))
+      LOG(WARNING) << "Couldn't post frame.";
+  }
+
+  base::SharedMemory memory_;
+  int frames_left_;
+};
+
+class FramesExtension : public XWalkExtension {
+ public:
+  FramesExtension() : XWalkExtension() {
+    set_name("frames");
+  }
+
+  virtual const char* GetJavaScriptAPI() {
+    return kFramesAPI;
+  }
+
+  virtual XWalkExtensionInstance* CreateInstance() {
+    return new FramesContext();
+  }
+};
+
+class ThreadedEchoExtension : public EchoExtension {
+ public:
+  explicit ThreadedEchoExtension(ThreadingModel threading_model) {
+    set_threading_model(threading_model);
+  }
+};
+
 class DelayedEchoExtension : public XWalkExtension {
  public:
   DelayedEchoExtension() : XWalkExtension() {
@@ -96,6 +285,34 @@ class DelayedEchoExtension : public XWalkExtension {
   }
 };
 
+base::Lock g_lazy_instances_lock;
+int g_lazy_instances = 0;
+
+// Counts in the page how many times its API code was run. The code never
+// sends messages, so no instances should be created.
+class LazyExtension : public XWalkExtension {
+ public:
+  explicit LazyExtension(const std::string& name)
+      : XWalkExtension(),
+        api_("window.lazyLoads = (window.lazyLoads || 0) + 1;"
+             "exports.loaded = true;") {
+    set_name(name);
+  }
+
+  virtual const char* GetJavaScriptAPI() {
+    return api_.c_str();
+  }
+
+  virtual XWalkExtensionInstance* CreateInstance() {
+    base::AutoLock lock(g_lazy_instances_lock);
+    g_lazy_instances++;
+    return new EchoContext();
+  }
+
+ private:
+  std::string api_;
+};
+
 class ExtensionWithInvalidName : public XWalkExtension {
  public:
   ExtensionWithInvalidName() : XWalkExtension() {
@@ -129,6 +346,65 @@ class XWalkExtensionsDelayedTest : public XWalkExtensionsTestBase {
   }
 };
 
+class XWalkExtensionsDedicatedThreadTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(
+            new ThreadedEchoExtension(XWalkExtension::DEDICATED_THREAD)));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class XWalkExtensionsIOThreadTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(
+            new ThreadedEchoExtension(XWalkExtension::IO_THREAD)));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class XWalkExtensionsDeliveryTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new DeliveryExtension));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class XWalkExtensionsStreamTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new StreamEchoExtension));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class XWalkExtensionsSharedBufferTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    bool registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new FramesExtension));
+    ASSERT_TRUE(registered);
+  }
+};
+
+class XWalkExtensionsLazyTest : public XWalkExtensionsTestBase {
+ public:
+  void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    const char* kNames[] = { "lazy", "lazy.nested", "other.nested" };
+    for (size_t i = 0; i < arraysize(kNames); ++i) {
+      bool registered = extension_service->RegisterExtension(
+          scoped_ptr<XWalkExtension>(new LazyExtension(kNames[i])));
+      ASSERT_TRUE(registered);
+    }
+  }
+};
+
 IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtension) {
   content::RunAllPendingInMessageLoop();
   GURL url = GetExtensionsTestURL(base::FilePath(),
@@ -139,6 +415,28 @@ IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtension) {
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
 
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtensionInManyProcesses) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+      base::FilePath().AppendASCII("test_extension.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  // A new Runtime gets its own render process, which must have extensions
+  // too.
+  Runtime* new_runtime = Runtime::CreateWithDefaultWindow(
+      runtime()->runtime_context(), GURL());
+  content::TitleWatcher new_title_watcher(new_runtime->web_contents(),
+                                          kPassString);
+  new_title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(new_runtime, url);
+  EXPECT_EQ(kPassString, new_title_watcher.WaitAndGetTitle());
+  EXPECT_NE(runtime()->web_contents()->GetRenderProcessHost(),
+            new_runtime->web_contents()->GetRenderProcessHost());
+}
+
 IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtensionSync) {
   content::RunAllPendingInMessageLoop();
   GURL url = GetExtensionsTestURL(base::FilePath(),
@@ -160,3 +458,82 @@ IN_PROC_BROWSER_TEST_F(XWalkExtensionsDelayedTest, EchoExtensionSync) {
   xwalk_test_utils::NavigateToURL(runtime(), url);
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsDedicatedThreadTest, EchoExtension) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+      base::FilePath().AppendASCII("test_extension.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsDedicatedThreadTest, EchoExtensionSync) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "sync_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsIOThreadTest, EchoExtensionSync) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "sync_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsDeliveryTest, DeliveryPolicies) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "delivery_policies.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsStreamTest, StreamEcho) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "stream_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsSharedBufferTest, SharedBuffers) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "shared_buffers.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsLazyTest, LazyLoading) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "lazy_loading.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  base::AutoLock lock(g_lazy_instances_lock);
+  EXPECT_EQ(0, g_lazy_instances);
+}
@@ -0,0 +1,88 @@
+# Copyright (c) 2013 Intel Corporation. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+# Generates the integer IDs of the functions of an IDL described API, used
+# by internal extensions to dispatch calls without looking up names. The IDs
+# follow the order of the functions in the IDL.
+#
+# Usage: generate_function_ids.py <idl> <root namespace> <header path>
+#                                 <output>
+
+import re
+import sys
+
+TEMPLATE = """\
+// GENERATED FROM %(idl)s BY generate_function_ids.py, DO NOT EDIT.
+
+#ifndef %(guard)s
+#define %(guard)s
+
+%(open_namespaces)s
+
+enum FunctionId {
+%(enum)s
+};
+
+const int kFunctionCount = %(count)d;
+
+const char* const kFunctionNames[] = {
+%(names)s
+};
+
+// Defines the FunctionId object used by the JavaScript API to call the
+// functions, see XWalkInternalExtension::SetJavaScriptAPI().
+const char kFunctionIdsJavaScript[] =
+    "var FunctionId = { %(js)s };\\n";
+
+%(close_namespaces)s
+
+#endif  // %(guard)s
+"""
+
+def strip_comments(idl):
+  idl = re.sub(r'/\*.*?\*/', '', idl, flags=re.DOTALL)
+  return re.sub(r'//[^\n]*', '', idl)
+
+def parse_idl(idl):
+  idl = strip_comments(idl)
+  namespace = re.search(r'namespace\s+([\w.]+)\s*{', idl)
+  if not namespace:
+    raise Exception('No namespace found.')
+  functions = re.search(r'interface\s+Functions\s*{(.*?)}\s*;', idl,
+                        re.DOTALL)
+  if not functions:
+    return namespace.group(1), []
+  names = re.findall(r'static\s+[\w\[\]<>]+\s+(\w+)\s*\(',
+                     functions.group(1))
+  return namespace.group(1), names
+
+def enum_name(function_name):
+  return 'k' + function_name[0].upper() + function_name[1:]
+
+def main():
+  idl_path, root_namespace, header_path, output_path = sys.argv[1:5]
+  namespace, functions = parse_idl(file(idl_path).read())
+
+  namespaces = root_namespace.split('::') + namespace.split('.')
+  guard = re.sub(r'[^A-Z0-9]', '_', header_path.upper()) + '_'
+
+  values = {
+    'idl': idl_path.replace('\\', '/').split('/')[-1],
+    'guard': guard,
+    'open_namespaces': '\n'.join('namespace %s {' % n for n in namespaces),
+    'close_namespaces': '\n'.join('}  // namespace %s' % n
+                                  for n in reversed(namespaces)),
+    'enum': ',\n'.join('  %s = %d' % (enum_name(f), i)
+                       for i, f in enumerate(functions)),
+    'count': len(functions),
+    'names': '\n'.join('  "%s",' % f for f in functions),
+    'js': ', '.join('%s: %d' % (f, i) for i, f in enumerate(functions)),
+  }
+
+  output = open(output_path, 'w')
+  output.write(TEMPLATE % values)
+  output.close()
+
+if __name__ == '__main__':
+  sys.exit(main())
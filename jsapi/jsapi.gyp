@@ -17,5 +17,27 @@
         'cc_dir': 'xwalk/jsapi',
         'root_namespace': 'xwalk::jsapi',
       },
-   }],
+      'dependencies': [
+        'xwalk_jsapi_function_ids',
+      ],
+      'export_dependent_settings': [
+        'xwalk_jsapi_function_ids',
+      ],
+    },
+    {
+      'target_name': 'xwalk_jsapi_function_ids',
+      'type': 'none',
+      'sources': [
+        'dialog.idl',
+        'runtime.idl',
+      ],
+      'includes': [
+        '../extensions/xwalk_function_ids.gypi',
+      ],
+      'variables': {
+        'cc_dir': 'xwalk/jsapi',
+        'root_namespace': 'xwalk::jsapi',
+      },
+    },
+  ],
 }
@@ -6,5 +6,5 @@ extension._setupExtensionInternal();
 var internal = extension._internal;
 
 exports.getAPIVersion = function(callback) {
-  internal.postMessage('getAPIVersion', [], callback);
+  internal.postMessage(FunctionId.getAPIVersion, [], callback);
 }
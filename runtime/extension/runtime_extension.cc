@@ -6,6 +6,7 @@
 
 #include "base/bind.h"
 #include "xwalk/jsapi/runtime.h"
+#include "xwalk/jsapi/runtime_function_ids.h"
 
 extern const char kSource_runtime_api[];
 
@@ -13,10 +14,8 @@ namespace xwalk {
 
 RuntimeExtension::RuntimeExtension() {
   set_name("xwalk.runtime");
-}
-
-const char* RuntimeExtension::GetJavaScriptAPI() {
-  return kSource_runtime_api;
+  SetJavaScriptAPI(jsapi::runtime::kFunctionIdsJavaScript,
+                   kSource_runtime_api);
 }
 
 XWalkExtensionInstance* RuntimeExtension::CreateInstance() {
@@ -25,11 +24,12 @@ XWalkExtensionInstance* RuntimeExtension::CreateInstance() {
 
 RuntimeInstance::RuntimeInstance()
   : XWalkInternalExtensionInstance() {
-  RegisterFunction("getAPIVersion", &RuntimeInstance::OnGetAPIVersion);
+  RegisterFunction(jsapi::runtime::kGetAPIVersion,
+                   &RuntimeInstance::OnGetAPIVersion);
 }
 
 void RuntimeInstance::OnGetAPIVersion(
-    const std::string&, const std::string& callback_id,
+    int, int callback_id,
     base::ListValue* args) {
   PostResult(callback_id, jsapi::runtime::GetAPIVersion::Results::Create(1));
 };
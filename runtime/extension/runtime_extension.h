@@ -19,8 +19,6 @@ class RuntimeExtension : public XWalkInternalExtension {
  public:
   RuntimeExtension();
 
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
-
   virtual XWalkExtensionInstance* CreateInstance() OVERRIDE;
 };
 
@@ -29,8 +27,8 @@ class RuntimeInstance : public XWalkInternalExtensionInstance {
   explicit RuntimeInstance();
 
  private:
-  void OnGetAPIVersion(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
+  void OnGetAPIVersion(int function_id,
+                       int callback_id, base::ListValue* args);
 };
 
 }  // namespace xwalk
@@ -560,6 +560,7 @@
           'dependencies': [
             'xwalk',
             'xwalk_browsertest',
+            'xwalk_extensions_benchmark',
             'xwalk_unittest',
           ],
         },